@@ -28,10 +28,15 @@ int __stdcall wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCm
     VulkanAppBase theApp;
     theApp.initialize(window, AppTitle);
 
+    // 画面を塗りつぶすだけで変化しないので、ウィンドウの変化や入力があった時だけ描画する
+    theApp.getScheduler().setSchedule(FrameSchedule::OnDemand);
+
     while (glfwWindowShouldClose(window) == GLFW_FALSE)
     {
-        glfwPollEvents();
-        theApp.render();
+        if (theApp.getScheduler().waitForFrame())
+        {
+            theApp.frame();
+        }
     }
 
     // Vulkan 修了
@@ -1,12 +1,224 @@
 #include "TriangleApp.h"
+#include "../../common/spirvreflect.h"
 
 #include <fstream>
 #include <array>
+#include <algorithm>
+#include <cmath>
 
 using namespace glm;
 using namespace std;
 
+namespace
+{
+    // メッシュの読み込みに使うステージングバッファの大きさ
+    const VkDeviceSize StagingBufferSize = 64 * 1024 * 1024;
+
+    // ジオメトリプールの大きさ（メッシュがこれより大きければメッシュに合わせる）
+    const uint32_t GeometryPoolVertexCapacity = 1024 * 1024;
+    const uint32_t GeometryPoolIndexCapacity = 4 * 1024 * 1024;
+
+    // マテリアルごとの明るさ（フラグメントシェーダの特殊化定数 COLOR_INTENSITY）
+    const float MaterialIntensities[] = { 1.0f, 0.6f };
+
+    // 許容する LOD の誤差（ピクセル）
+    const float LodErrorThreshold = 1.0f;
+
+    // オブジェクトがこの数以上なら BVH で視錐台カリングする（少なければ SIMD で全部を判定する方が速い）
+    const uint32_t BvhCullingObjectCount = 16384;
+
+    // 記録したコマンドの数を出力する間隔（フレーム数）
+    const uint64_t CommandStatsInterval = 600;
+
+    // シェーダのキャッシュを置くディレクトリ（Release では SHADER_CACHE_SHIPPING で、ビルド後に作ったものだけを使う）
+    const char* ShaderCacheDir = "shadercache";
+
+    // メッシュファイルが書き換えられたか調べる間隔（フレーム数）
+    const uint32_t MeshReloadCheckInterval = 60;
+
+    /// <summary>
+    /// メッシュファイルと、隣のクック済みファイルの大きさと更新時刻（無いファイルは 0）
+    /// </summary>
+    array<uint64_t, 4> getMeshFileStamps(const string& fileName)
+    {
+        array<uint64_t, 4> stamps = {};
+        if (!getFileStamp(fileName.c_str(), stamps[0], stamps[1]))
+        {
+            stamps[0] = stamps[1] = 0;
+        }
+        if (!getFileStamp(getCookedMeshFileName(fileName).c_str(), stamps[2], stamps[3]))
+        {
+            stamps[2] = stamps[3] = 0;
+        }
+        return stamps;
+    }
+
+    /// <summary>
+    /// プリミティブと LOD の位置をずらす（ジオメトリプールの領域が動いた分。符号なしの桁あふれで負の移動も表す）
+    /// </summary>
+    void offsetPrimitives(vector<MeshPrimitive>& primitives, int32_t vertexDelta, uint32_t indexDelta)
+    {
+        for (auto& primitive : primitives)
+        {
+            primitive.firstIndex += indexDelta;
+            primitive.vertexOffset += vertexDelta;
+            for (uint32_t i = 0; i < primitive.lodCount; ++i)
+            {
+                primitive.lods[i].firstIndex += indexDelta;
+            }
+        }
+    }
+
+    /// <summary>
+    /// シーン全体を [-1, 1] に収めるための拡大率
+    /// </summary>
+    float getFitScale(const vec3& boundsMin, const vec3& boundsMax)
+    {
+        vec3 extent = (boundsMax - boundsMin) * 0.5f;
+        float radius = std::max(extent.x, std::max(extent.y, extent.z));
+        return radius > 0.0f ? 1.0f / radius : 1.0f;
+    }
+
+    /// <summary>
+    /// カメラが無いので、シーン全体が画面に収まるよう逆量子化の変換に平行移動と拡大縮小を畳み込む
+    /// x, y は [-1, 1]、z は Vulkan のクリップ空間に合わせて [0, 1] に収める
+    /// </summary>
+    PositionQuantization fitToView(const PositionQuantization& q, const vec3& boundsMin, const vec3& boundsMax)
+    {
+        vec3 center = (boundsMin + boundsMax) * 0.5f;
+        float s = getFitScale(boundsMin, boundsMax);
+
+        PositionQuantization result;
+        result.offset = vec4((vec3(q.offset) - center) * s, 0.0f);
+        result.scale = vec4(vec3(q.scale) * s, 1.0f);
+        result.offset.z = result.offset.z * 0.5f + 0.5f;
+        result.scale.z *= 0.5f;
+        return result;
+    }
+}
+
 void TriangleApp::prepare()
+{
+    m_uploader.initialize(m_device, m_physMemProps, m_deviceQueue, m_graphicsQueueIndex, StagingBufferSize);
+    m_fileReader.initialize();
+    m_uploader.attachFileReader(&m_fileReader);
+
+    if (m_vertexPulling && m_vkGetBufferDeviceAddress == nullptr)
+    {
+        OutputDebugStringA("Buffer device address is not supported on this device. Falling back to vertex input.\n");
+        m_vertexPulling = false;
+    }
+    if (!m_meshFile.empty())
+    {
+        m_meshFileStamps = getMeshFileStamps(m_meshFile);
+    }
+    if (m_meshFile.empty() || !loadMesh(m_meshFile.c_str()))
+    {
+        m_geometryPool.terminate();
+        createTriangle();
+    }
+    createScene();
+    updatePullConstants();
+    createInstanceBuffers();
+
+    // 状態が同じ描画が続けば 1 つのコマンドにまとめる（拡張が無ければ 1 つずつ記録する）
+    m_recorder.setMultiDraw(m_vkCmdDrawMultiIndexed, m_maxMultiDrawCount);
+
+    // シェーダの登録（バリアントはパイプライン生成時にキャッシュから取得される）
+#ifdef SHADER_CACHE_SHIPPING
+    m_shaderCache.initialize(ShaderCacheDir, ShaderPermutationCache::Mode::Shipping);
+#else
+    m_shaderCache.initialize(ShaderCacheDir, ShaderPermutationCache::Mode::Development);
+#endif
+    registerShaders();
+
+    // パイプラインレイアウト
+    // 位置の逆量子化の変換（バーテックスプリングでは頂点バッファのアドレスと読み方も）はプッシュ定数で頂点シェーダに渡す
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = m_vertexPulling ? sizeof(VertexPullConstants) : sizeof(PositionQuantization);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+    pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    vkCreatePipelineLayout(m_device, &pipelineLayoutCI, nullptr, &m_pipelineLayout);
+
+    // マテリアルごとのパイプラインの記述
+    // 特殊化定数はパイプライン生成時に定数として畳み込まれるため、シェーダ内の分岐やループが最適化される
+    // インスタンスごとの変換と色はバインディング 1 から VK_VERTEX_INPUT_RATE_INSTANCE で読む
+    // バーテックスプリングではメッシュの頂点は頂点入力に含めない（頂点のフォーマットが違うメッシュも同じパイプラインで描ける）
+    for (auto intensity : MaterialIntensities)
+    {
+        GraphicsPipelineDesc desc;
+
+        ShaderStageDesc vert{};
+        vert.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vert.shaderId = m_vertShader;
+        vert.defineMask = m_vertexPulling
+            ? m_shaderCache.getDefineMask(m_vertShader, { "USE_VERTEX_COLOR", "USE_INSTANCING", "USE_VERTEX_PULLING" })
+            : m_shaderCache.getDefineMask(m_vertShader, { "USE_VERTEX_COLOR", "USE_PACKED_POSITION", "USE_INSTANCING" });
+
+        ShaderStageDesc frag{};
+        frag.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        frag.shaderId = m_fragShader;
+        frag.defineMask = 0;
+        frag.constants.set(0, intensity); // COLOR_INTENSITY
+
+        desc.stages.push_back(vert);
+        desc.stages.push_back(frag);
+        if (!m_vertexPulling)
+        {
+            desc.addVertexBinding<MeshVertex>(0);
+        }
+        desc.addVertexBinding<InstanceData>(1);
+        m_materials.push_back(getPipeline(desc));
+    }
+
+    if (m_gpuDriven && !createGpuScene())
+    {
+        OutputDebugStringA("GPU-driven rendering is not supported on this device. Falling back to CPU instancing.\n");
+        m_gpuScene.terminate();
+        m_gpuDriven = false;
+    }
+
+    // 遮蔽カリングはデプスバッファの Hi-Z を使う（作れなければ視錐台カリングだけにする）
+    m_occlusionCulling = m_occlusionCulling && m_gpuDriven
+        && m_depthPyramid.initialize(m_device, m_physMemProps, m_shaderCache.getVariant(m_hizShader, 0u),
+            m_depthBufferView, m_swapchainExtent.width, m_swapchainExtent.height)
+        && m_gpuScene.setOcclusionCulling(m_shaderCache.getVariant(m_cullShader, { "USE_OCCLUSION" }), m_depthPyramid);
+}
+
+/// <summary>
+/// すべてのシェーダのすべてのバリアントを、Vulkan を初期化せずにキャッシュへ書き出す
+/// Release のビルド後の処理（main の precompile）から呼び、出荷用のキャッシュを作る
+/// </summary>
+bool TriangleApp::precompileShaders()
+{
+    m_shaderCache.initialize(ShaderCacheDir, ShaderPermutationCache::Mode::Development);
+    registerShaders();
+    const bool succeeded = m_shaderCache.precompileAll();
+    m_shaderCache.terminate();
+    return succeeded;
+}
+
+/// <summary>
+/// シェーダを登録する（バリアントはパイプライン生成時にキャッシュから取得される）
+/// </summary>
+void TriangleApp::registerShaders()
+{
+    m_vertShader = m_shaderCache.registerShader("shader.vert", VK_SHADER_STAGE_VERTEX_BIT, { "USE_VERTEX_COLOR", "USE_PACKED_POSITION", "USE_INSTANCING", "USE_VERTEX_PULLING" });
+    m_fragShader = m_shaderCache.registerShader("shader.frag", VK_SHADER_STAGE_FRAGMENT_BIT, {});
+    m_cullShader = m_shaderCache.registerShader("cull.comp", VK_SHADER_STAGE_COMPUTE_BIT, { "USE_OCCLUSION" });
+    m_clusterShader = m_shaderCache.registerShader("cluster.comp", VK_SHADER_STAGE_COMPUTE_BIT, { "USE_OCCLUSION" });
+    m_hizShader = m_shaderCache.registerShader("hiz.comp", VK_SHADER_STAGE_COMPUTE_BIT, {});
+}
+
+/// <summary>
+/// 三角形のデータを作ってジオメトリプールへ書き込む
+/// </summary>
+void TriangleApp::createTriangle()
 {
     const vec3 red(1.0f, 0.0f, 0.0f);
     const vec3 green(0.0f, 1.0f, 0.0f);
@@ -20,51 +232,725 @@ void TriangleApp::prepare()
 
     uint32_t indices[] = { 0, 1, 2, };
 
-    m_vertexBuffer = createBuffer(sizeof(vertices), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    m_indexBuffer = createBuffer(sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    // 頂点キャッシュ・オーバードロー・頂点フェッチの最適化（量子化前の float のデータに対して行う）
+    auto optimization = optimizeMesh(indices, _countof(indices), vertices, _countof(vertices), sizeof(Vertex), offsetof(Vertex, pos));
+    printMeshOptimizationReport("triangle", optimization);
+
+    MeshPrimitive primitive{};
+    primitive.indexCount = _countof(indices);
+    primitive.vertexCount = optimization.vertexCount;
+    primitive.quantization = computePositionQuantization(&vertices[0].pos.x, sizeof(Vertex), primitive.vertexCount);
+
+    // 頂点データは量子化しながら書き込み、インデックスは頂点数が収まれば 16bit に詰める
+    const float normal[] = { 0.0f, 0.0f, 1.0f };
+    const float texcoord[] = { 0.0f, 0.0f };
+    vector<MeshVertex> packedVertices(primitive.vertexCount);
+    auto dst = packedVertices.data();
+    encodePositionsSnorm16(&vertices[0].pos.x, sizeof(Vertex), primitive.vertexCount, primitive.quantization, &dst->pos, sizeof(MeshVertex));
+    encodeColorsUnorm8(&vertices[0].color.x, sizeof(Vertex), 3, primitive.vertexCount, &dst->color, sizeof(MeshVertex));
+    encodeNormalsOct16(normal, 0, primitive.vertexCount, &dst->normal, sizeof(MeshVertex));
+    encodeTexcoordsHalf(texcoord, 0, primitive.vertexCount, &dst->texcoord, sizeof(MeshVertex));
+
+    vector<uint8_t> packedIndices(getIndexSize(optimization.indexType) * primitive.indexCount);
+    writeIndices(packedIndices.data(), indices, primitive.indexCount, optimization.indexType);
+
+    // ジオメトリプールの領域へ転送する
+    m_geometryPool.initialize(m_device, m_physMemProps, sizeof(MeshVertex), optimization.indexType,
+        GeometryPoolVertexCapacity, GeometryPoolIndexCapacity, m_vertexPulling ? m_vkGetBufferDeviceAddress : nullptr);
+    m_meshGeometry = m_geometryPool.allocate(primitive.vertexCount, primitive.indexCount);
+    m_geometryPool.upload(m_uploader, m_meshGeometry, packedVertices.data(), packedIndices.data());
+    m_uploader.flush();
+
+    const auto& range = m_geometryPool.getRange(m_meshGeometry);
+    primitive.firstIndex = range.firstIndex;
+    primitive.vertexOffset = range.vertexOffset;
+    m_primitives.push_back(primitive);
+}
+
+/// <summary>
+/// メッシュファイルを読み込み、ジオメトリプールへ転送する
+/// </summary>
+bool TriangleApp::loadMesh(const char* fileName)
+{
+    // MeshCooker で変換済みのファイル（拡張子 .mesh）が隣にあればそちらを使う（解析と最適化を省ける）
+    // 元のファイルがクックした後に変わっていたり、古い形式でクックされていたりすれば元のファイルを読む
+    auto openFileName = getCookedMeshFileName(fileName);
+    if (!MappedFile().open(openFileName.c_str()))
+    {
+        openFileName = fileName;
+    }
+    else if (openFileName != fileName && !isMeshCacheUpToDate(openFileName.c_str(), fileName))
+    {
+        OutputDebugStringA((openFileName + " is out of date; loading the source mesh (re-run MeshCooker)\n").c_str());
+        openFileName = fileName;
+    }
+
+    MeshLoader loader;
+    if (!loader.open(openFileName.c_str()))
+    {
+        return false;
+    }
+    // クック済みでないファイルでもクラスタ単位でカリングできるよう、読み込み時にメッシュレットを作る
+    loader.setBuildMeshlets(m_gpuDriven && m_clusterCulling);
 
-    // 頂点データの書き込み
+    // 最初に読み込む時はメッシュが収まる大きさでジオメトリプールを作る
+    // 読み直す場合は同じプールを使うので、インデックスの型が同じでなければならない
+    if (m_geometryPool.getVertexBuffer() == VK_NULL_HANDLE)
     {
-        // void* 型の変数を宣言し、このポインタが指すメモリ位置を下の vkMapMemory 関数でマップする。
-        // マップする対象は m_vertexBuffer.memory。
-        // これによって、memcpy 関数を通して m_vertexBuffer.memory へデータが書き込まれるという流れだと思われる。
-        // そして最後に vkUnmapMemory でマップを解除する。
-        void* p;
-        vkMapMemory(m_device, m_vertexBuffer.memory, 0, VK_WHOLE_SIZE, 0, &p);
-        memcpy(p, vertices, sizeof(vertices));
-        vkUnmapMemory(m_device, m_vertexBuffer.memory);
+        m_geometryPool.initialize(m_device, m_physMemProps, sizeof(MeshVertex), loader.getIndexType(),
+            max(GeometryPoolVertexCapacity, loader.getVertexCount()), max(GeometryPoolIndexCapacity, loader.getIndexCount()),
+            m_vertexPulling ? m_vkGetBufferDeviceAddress : nullptr);
+    }
+    else if (m_geometryPool.getIndexType() != loader.getIndexType())
+    {
+        OutputDebugStringA("The mesh uses a different index type from the geometry pool. It is not loaded.\n");
+        return false;
     }
 
-    // インデックスデータの書き込み
+    // メッシュ全体で 1 つの領域を確保し、プリミティブの位置はその先頭からずらす
+    // 前のメッシュの領域は読み込めるまで残しておき、空きが断片化して確保できなければ詰めてからもう一度試す
+    auto geometry = m_geometryPool.allocate(loader.getVertexCount(), loader.getIndexCount());
+    if (geometry == InvalidGeometryId && m_geometryPool.fitsAfterCompaction(loader.getVertexCount(), loader.getIndexCount()))
+    {
+        const GeometryRange before = m_meshGeometry != InvalidGeometryId ? m_geometryPool.getRange(m_meshGeometry) : GeometryRange{};
+        if (m_geometryPool.compact(m_uploader))
+        {
+            if (m_meshGeometry != InvalidGeometryId)
+            {
+                const auto& after = m_geometryPool.getRange(m_meshGeometry);
+                offsetPrimitives(m_primitives, after.vertexOffset - before.vertexOffset, after.firstIndex - before.firstIndex);
+            }
+            geometry = m_geometryPool.allocate(loader.getVertexCount(), loader.getIndexCount());
+        }
+    }
+    if (geometry == InvalidGeometryId)
+    {
+        OutputDebugStringA("The geometry pool has no room for the mesh.\n");
+        return false;
+    }
+    if (!loader.load(m_uploader, m_geometryPool.getVertexBuffer(), m_geometryPool.getVertexByteOffset(geometry),
+        m_geometryPool.getIndexBuffer(), m_geometryPool.getIndexByteOffset(geometry)))
     {
-        void* p;
-        vkMapMemory(m_device, m_indexBuffer.memory, 0, VK_WHOLE_SIZE, 0, &p);
-        memcpy(p, indices, sizeof(indices));
-        vkUnmapMemory(m_device, m_indexBuffer.memory);
+        m_geometryPool.free(geometry);
+        return false;
     }
+    if (m_meshGeometry != InvalidGeometryId)
+    {
+        m_geometryPool.free(m_meshGeometry);
+    }
+    m_meshGeometry = geometry;
 
-    m_indexCount = _countof(indices);
+    const auto& range = m_geometryPool.getRange(m_meshGeometry);
+    m_primitives = loader.getPrimitives();
+    m_meshlets = loader.getMeshlets();
+    offsetPrimitives(m_primitives, range.vertexOffset, range.firstIndex);
+    const float fitScale = getFitScale(loader.getBoundsMin(), loader.getBoundsMax());
+    for (auto& primitive : m_primitives)
+    {
+        // LOD の誤差も画面に収めた後の空間の大きさにしておく
+        primitive.quantization = fitToView(primitive.quantization, loader.getBoundsMin(), loader.getBoundsMax());
+        for (auto& lod : primitive.lods)
+        {
+            lod.error *= fitScale;
+        }
+    }
+    return true;
+}
 
-    // 頂点の入力設定
-    VkVertexInputBindingDescription inputBinding
+/// <summary>
+/// 書き換えられたメッシュファイルを読み直し、ジオメトリプールの領域を入れ替える
+/// 描画スレッドと GPU が前のメッシュを使い終わるのを待ってから行う。読み込めなかった場合も前のメッシュを使い続けるが、
+/// プールを詰めると位置とバッファが変わるので、それらを使うもの（プッシュ定数・インスタンスのバッファ・GPU 上のシーン）はいつも作り直す
+/// </summary>
+void TriangleApp::reloadMesh()
+{
+    waitForRenderIdle();
+    if (!loadMesh(m_meshFile.c_str()))
     {
-        0,                          // binding
-        sizeof(Vertex),             // stride
-        VK_VERTEX_INPUT_RATE_VERTEX // inputRate
-    };
-    array<VkVertexInputAttributeDescription, 2> inputAttribs
+        OutputDebugStringA(("Failed to reload " + m_meshFile + ". Keeping the previous mesh.\n").c_str());
+    }
+
+    updatePullConstants();
+    createInstanceBuffers();
+    if (m_gpuDriven && !uploadGpuScene())
+    {
+        OutputDebugStringA("Failed to upload the reloaded mesh for GPU-driven rendering. Falling back to CPU instancing.\n");
+        m_gpuScene.terminate();
+        m_gpuDriven = false;
+        m_occlusionCulling = false;
+    }
+}
+
+/// <summary>
+/// 描画するオブジェクトを格子状に並べる
+/// </summary>
+void TriangleApp::createScene()
+{
+    m_objects.clear();
+    m_angles.clear();
+    m_previousAngles.clear();
+    m_animated = false;
+    m_objectBounds.clear();
+    m_objectBvh.clear();
+    m_sceneGraph.clear();
+    if (m_objectCount == 0)
+    {
+        SceneObject object{};
+        object.position = vec2(0.0f);
+        object.scale = 1.0f;
+        object.angularVelocity = 0.0f;
+        object.material = 0;
+        object.color = { { 255, 255, 255, 255 } };
+        addObject(object);
+        return;
+    }
+
+    // メッシュは [-1, 1] に収まるよう変換してあるので、升目に収まる大きさに縮める
+    // マテリアルは画面の上下で分ける（同じ組のオブジェクトは 1 回の描画にまとめられる）
+    const uint32_t columns = uint32_t(ceil(sqrt(double(m_objectCount))));
+    const uint32_t rows = (m_objectCount + columns - 1) / columns;
+    const float cellSize = 2.0f / float(columns);
+    m_objects.reserve(m_objectCount);
+    m_sceneGraph.reserve(m_objectCount);
+    for (uint32_t i = 0; i < m_objectCount; ++i)
+    {
+        const uint32_t x = i % columns;
+        const uint32_t y = i / columns;
+
+        SceneObject object;
+        object.position = vec2(-1.0f + cellSize * (float(x) + 0.5f), -1.0f + cellSize * (float(y) + 0.5f));
+        object.scale = cellSize * 0.45f;
+        object.angularVelocity = 0.5f + float(i % 7) * 0.25f;
+        object.material = y * uint32_t(_countof(MaterialIntensities)) / rows;
+        object.color = { { uint8_t(64 + x * 191 / columns), uint8_t(64 + y * 191 / rows), 255, 255 } };
+        addObject(object);
+    }
+
+    if (m_objectBvh.getProxyCount() > 0)
+    {
+        OutputDebugStringA(("Object BVH: " + to_string(m_objectBvh.getProxyCount()) + " objects, height " +
+            to_string(m_objectBvh.getHeight()) + ", area ratio " + to_string(m_objectBvh.getAreaRatio()) + "\n").c_str());
+    }
+}
+
+/// <summary>
+/// オブジェクトを登録し、シーングラフのノードとカリングに使う境界を作る
+/// z 軸まわりにしか回らないので、回転によらない大きさにしておけば境界は毎フレーム更新しなくてよい
+/// （メッシュは x, y が [-1, 1]、z が [0, 1] に収まっている）
+/// </summary>
+void TriangleApp::addObject(const SceneObject& object)
+{
+    m_objects.push_back(object);
+    m_animated = m_animated || object.angularVelocity != 0.0f;
+    m_angles.push_back(0.0f);
+    m_previousAngles.push_back(0.0f);
+    m_sceneGraph.addNode(InvalidSceneNode, vec3(object.position, 0.0f), quat(1.0f, 0.0f, 0.0f, 0.0f), vec3(object.scale, object.scale, 1.0f));
+
+    const vec3 extent(object.scale * sqrt(2.0f), object.scale * sqrt(2.0f), 0.5f);
+    const vec3 center(object.position, 0.5f);
+    const uint32_t index = m_objectBounds.add(center, length(extent), center - extent, center + extent);
+    if (m_objectCount >= BvhCullingObjectCount)
+    {
+        m_objectBvh.createProxy(center - extent, center + extent, index);
+    }
+}
+
+/// <summary>
+/// 時刻 time でのオブジェクトの変換（z 軸まわりに回転させる）
+/// </summary>
+InstanceData TriangleApp::makeInstance(const SceneObject& object, float time)
+{
+    const float angle = object.angularVelocity * time;
+    const float c = cos(angle) * object.scale;
+    const float s = sin(angle) * object.scale;
+
+    InstanceData instance;
+    instance.row0 = vec4(c, -s, 0.0f, object.position.x);
+    instance.row1 = vec4(s, c, 0.0f, object.position.y);
+    instance.row2 = vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    instance.color = object.color;
+    return instance;
+}
+
+/// <summary>
+/// オブジェクトを固定の刻み幅で回転させる
+/// 角度は 1 周したら 2π 戻すが、補間で逆回りにならないよう 1 つ前の角度も同じだけ戻す
+/// </summary>
+void TriangleApp::update(double step)
+{
+    const float twoPi = 6.28318531f;
+    for (size_t i = 0; i < m_objects.size(); ++i)
     {
+        float angle = m_angles[i];
+        float previous = angle;
+        angle += m_objects[i].angularVelocity * float(step);
+        if (angle >= twoPi)
         {
-            { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) },
-            { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color) },
+            angle -= twoPi;
+            previous -= twoPi;
         }
-    };
+        m_previousAngles[i] = previous;
+        m_angles[i] = angle;
+    }
+}
+
+/// <summary>
+/// オブジェクトの変換を更新して、視錐台に掛かるものを描画するインスタンスとして登録する
+/// 回転角は直前の 2 回の update の間を alpha で補間する
+/// </summary>
+void TriangleApp::updateInstances(float alpha, InstanceBatcher& batcher)
+{
+    batcher.clear();
+
+    // カメラが無いのでクリップ空間をそのまま視錐台にする
+    // BVH は木の順に返すので、cullFrustum と同じくオブジェクトの番号順に並べる（描画の順番を変えない）
+    const Frustum frustum = makeFrustum(mat4(1.0f));
+    if (m_objectBvh.getProxyCount() > 0)
+    {
+        m_visibleObjects.clear();
+        m_objectBvh.queryFrustum(frustum, m_visibleObjects);
+        sort(m_visibleObjects.begin(), m_visibleObjects.end());
+    }
+    else
+    {
+        cullFrustum(m_objectBounds, frustum, m_visibleObjects);
+    }
+
+    // 見えるオブジェクトだけ回転を反映してワールド行列を求める（見えないものは前の変換のまま）
+    for (uint32_t index : m_visibleObjects)
+    {
+        const float halfAngle = mix(m_previousAngles[index], m_angles[index], alpha) * 0.5f;
+        m_sceneGraph.setLocalRotation(index, quat(cos(halfAngle), 0.0f, 0.0f, sin(halfAngle)));
+    }
+    m_sceneGraph.update();
+
+    // プリミティブごとに見えるオブジェクトを LOD を選んで登録する（同じ組が続くので登録が速い）
+    // 正射影なので画面上の誤差は距離によらず、オブジェクトの大きさだけで決まる（makeCullingView と同じ換算）
+    const float pixelsPerUnit = float(m_swapchainExtent.height) * 0.5f;
+    const uint32_t primitiveCount = uint32_t(m_primitives.size());
+    for (uint32_t mesh = 0; mesh < primitiveCount; ++mesh)
+    {
+        const auto& primitive = m_primitives[mesh];
+        for (uint32_t index : m_visibleObjects)
+        {
+            const auto& object = m_objects[index];
+            auto& lod = m_objectLods[index * primitiveCount + mesh];
+            lod = selectMeshLod(primitive.lods, primitive.lodCount, object.scale * pixelsPerUnit, LodErrorThreshold, lod);
+
+            InstanceData instance;
+            m_sceneGraph.getWorldRows(index, instance.row0, instance.row1, instance.row2);
+            instance.color = object.color;
+            batcher.add(mesh * MaxMeshLods + lod, object.material, instance);
+        }
+    }
+}
+
+/// <summary>
+/// オブジェクトとプリミティブの組ごとのインスタンスのバッファと LOD の選択を、今の数に合わせて作る
+/// インスタンスのデータは毎フレーム書き換えるので、スワップチェインのイメージごとに区画を分ける
+/// </summary>
+void TriangleApp::createInstanceBuffers()
+{
+    const size_t instanceCount = m_objects.size() * m_primitives.size();
+    m_frameRing.terminate();
+    m_frameRing.initialize(m_device, m_physMemProps, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        uint32_t(m_swapchainImages.size()), VkDeviceSize(instanceCount) * sizeof(InstanceData));
+    for (auto& packet : m_framePackets)
+    {
+        packet.batcher.reserve(instanceCount);
+    }
+    m_objectLods.assign(instanceCount, 0);
+}
+
+/// <summary>
+/// プリミティブごとのプッシュ定数を作る（バーテックスプリングの場合のみ）
+/// ジオメトリプールを詰めるとバッファが作り直されてアドレスが変わるので、その後にも呼ぶ
+/// </summary>
+void TriangleApp::updatePullConstants()
+{
+    m_pullConstants.clear();
+    if (!m_vertexPulling)
+    {
+        return;
+    }
+    for (const auto& primitive : m_primitives)
+    {
+        m_pullConstants.push_back(makeVertexPullConstants(primitive.quantization, m_geometryPool.getVertexBufferAddress(),
+            m_geometryPool.getVertexStride(), VertexPullFormat::PackedMeshVertex));
+    }
+}
+
+/// <summary>
+/// GPU 駆動の描画の準備をしてシーンを転送する
+/// </summary>
+bool TriangleApp::createGpuScene()
+{
+    // 1 つのコマンドで 1 つのオブジェクトを描き、firstInstance でインスタンスのデータを選ぶ
+    if (!m_deviceFeatures.drawIndirectFirstInstance)
+    {
+        return false;
+    }
+    m_gpuScene.initialize(m_device, m_physMemProps, m_shaderCache.getVariant(m_cullShader, 0u),
+        m_vkCmdDrawIndexedIndirectCount, m_deviceFeatures.multiDrawIndirect == VK_TRUE);
+
+    if (m_clusterCulling && m_meshlets.empty())
+    {
+        OutputDebugStringA("The mesh has no meshlets. Cluster culling is disabled.\n");
+        m_clusterCulling = false;
+    }
+    if (m_clusterCulling)
+    {
+        // バリアントの参照は次の取得で無効になることがあるのでコピーしておく
+        const auto clusterShader = m_shaderCache.getVariant(m_clusterShader, 0u);
+        const auto occlusionClusterShader = m_shaderCache.getVariant(m_clusterShader, { "USE_OCCLUSION" });
+        // 法線の円錐による判定は使わない（パイプラインは裏面をカリングせず、ビューポートの上下反転で表裏の向きも逆になる）
+        m_clusterCulling = m_gpuScene.setClusterCulling(clusterShader, occlusionClusterShader, false);
+        if (!m_clusterCulling)
+        {
+            OutputDebugStringA("Cluster culling requires VK_KHR_draw_indirect_count. Culling per object.\n");
+        }
+    }
+
+    return uploadGpuScene();
+}
+
+/// <summary>
+/// GPU 駆動の描画のためにオブジェクトとメッシュの情報をデバイスローカルのバッファへ転送する
+/// オブジェクトはプリミティブごとに分け、逆量子化をインスタンスの変換に畳み込む（GPU 上では動かさない）
+/// メッシュを読み直した時は、GPU がバッファを使っていない状態で呼び直す
+/// </summary>
+bool TriangleApp::uploadGpuScene()
+{
+    vector<GpuMeshInfo> meshes;
+    vector<GpuMeshlet> meshlets;
+    for (const auto& primitive : m_primitives)
+    {
+        // 量子化された位置は [-1, 1] の立方体に収まるので、それを囲む球を境界球にする
+        GpuMeshInfo mesh{};
+        mesh.boundingSphere = vec4(0.0f, 0.0f, 0.0f, sqrt(3.0f));
+        mesh.vertexOffset = primitive.vertexOffset;
+        if (primitive.lodCount == 0)
+        {
+            mesh.lodCount = 1;
+            mesh.lods[0] = { primitive.firstIndex, primitive.indexCount, 0.0f, 0 };
+        }
+        else
+        {
+            mesh.lodCount = primitive.lodCount;
+            for (uint32_t i = 0; i < primitive.lodCount; ++i)
+            {
+                mesh.lods[i] = { primitive.lods[i].firstIndex, primitive.lods[i].indexCount, primitive.lods[i].error, 0 };
+            }
+        }
+
+        // メッシュレットの境界はメッシュと同じ量子化された位置の空間なので、そのまま使える
+        if (m_clusterCulling)
+        {
+            mesh.firstMeshlet = uint32_t(meshlets.size());
+            mesh.meshletCount = primitive.meshletCount;
+            for (uint32_t i = 0; i < primitive.meshletCount; ++i)
+            {
+                const auto& src = m_meshlets[primitive.firstMeshlet + i];
+                GpuMeshlet meshlet{};
+                meshlet.boundingSphere = vec4(src.center, src.radius);
+                meshlet.coneApex = vec4(src.coneApex, 0.0f);
+                meshlet.cone = vec4(src.coneAxis, src.coneCutoff);
+                meshlet.firstIndex = primitive.firstIndex + src.firstIndex;
+                meshlet.indexCount = src.triangleCount * 3;
+                meshlets.push_back(meshlet);
+            }
+        }
+        meshes.push_back(mesh);
+    }
+
+    vector<GpuSceneObject> objects;
+    objects.reserve(m_objects.size() * m_primitives.size());
+    for (const auto& object : m_objects)
+    {
+        auto instance = makeInstance(object, 0.0f);
+        for (uint32_t mesh = 0; mesh < uint32_t(m_primitives.size()); ++mesh)
+        {
+            objects.push_back({ mesh, object.material, object.scale, foldPositionQuantization(instance, m_primitives[mesh].quantization) });
+        }
+    }
+
+    bool succeeded = m_gpuScene.setScene(m_uploader, meshes, objects, meshlets);
+    succeeded &= m_uploader.flush();
+    return succeeded;
+}
+
+void TriangleApp::cleanup()
+{
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    for (auto& v : m_pipelines)
+    {
+        vkDestroyPipeline(m_device, v.second, nullptr);
+    }
+    m_pipelines.clear();
+    m_materials.clear();
+
+    m_geometryPool.terminate();
+    m_meshGeometry = InvalidGeometryId;
+    m_primitives.clear();
+    m_meshlets.clear();
+    m_pullConstants.clear();
+    m_objects.clear();
+    m_angles.clear();
+    m_previousAngles.clear();
+    m_sceneGraph.clear();
+    m_objectBounds.clear();
+    m_objectBvh.clear();
+    m_visibleObjects.clear();
+    m_objectLods.clear();
+
+    m_gpuScene.terminate();
+    m_depthPyramid.terminate();
+    m_frameRing.terminate();
+    m_uploader.terminate();
+    m_fileReader.terminate();
+    m_shaderCache.terminate();
+}
+
+void TriangleApp::makePreRenderPassCommand(VkCommandBuffer command)
+{
+    // このフレームのコマンドは m_recorder を通して記録する
+    m_recorder.begin(command);
+    if (!m_gpuDriven)
+    {
+        return;
+    }
+
+    // 遮蔽カリングでは前のフレームで見えていたものだけを先に描く
+    m_gpuScene.recordCulling(command, m_framePackets[m_framePacket].view, m_occlusionCulling ? GpuCullingPass::Early : GpuCullingPass::All);
+
+    // コンピュートのパイプラインとデスクリプタセットを直接バインドしている
+    m_recorder.invalidate();
+}
+
+/// <summary>
+/// 遮蔽カリングの後半
+/// 前半で描いたデプスから Hi-Z を作って残りのオブジェクトを判定し、新しく見えるようになったものを同じフレームバッファに続けて描く
+/// </summary>
+void TriangleApp::makePostRenderPassCommand(VkCommandBuffer command)
+{
+    if (!m_occlusionCulling)
+    {
+        return;
+    }
+
+    m_depthPyramid.record(command, m_depthBuffer);
+    m_gpuScene.recordCulling(command, m_framePackets[m_framePacket].view, GpuCullingPass::Late);
+    m_recorder.invalidate();
+
+    VkRenderPassBeginInfo renderPassBI{};
+    renderPassBI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBI.renderPass = m_renderPassLoad;
+    renderPassBI.framebuffer = m_framebuffers[m_imageIndex];
+    renderPassBI.renderArea.offset = VkOffset2D{ 0, 0 };
+    renderPassBI.renderArea.extent = m_swapchainExtent;
+    vkCmdBeginRenderPass(command, &renderPassBI, VK_SUBPASS_CONTENTS_INLINE);
+    recordGpuDrivenDraws();
+    vkCmdEndRenderPass(command);
+}
+
+/// <summary>
+/// カメラが無いのでクリップ空間をそのまま視錐台にし、LOD は正射影として選ぶ（画面の高さが 2 単位）
+/// </summary>
+GpuCullingView TriangleApp::makeCullingView() const
+{
+    GpuCullingView view{};
+    view.viewProjection = mat4(1.0f);
+    view.frustum = makeFrustum(view.viewProjection);
+    view.cameraPosition = vec3(0.0f);
+    view.viewDirection = vec3(0.0f, 0.0f, 1.0f);
+    view.perspective = false;
+    view.pixelsPerUnit = float(m_swapchainExtent.height) * 0.5f;
+    view.errorThreshold = LodErrorThreshold;
+    return view;
+}
+
+/// <summary>
+/// カメラとオブジェクトの更新（CPU でのインスタンシングでは見えるものの登録まで）をフレームパケットに書く
+/// 描画スレッドを使う場合は render と並行して呼ばれるので、render で使うものには触れない
+/// GPU 駆動の描画ではオブジェクトを動かさないので、回転するオブジェクトがあっても描画し直す必要は無い
+/// </summary>
+void TriangleApp::writeFramePacket(uint32_t packet)
+{
+    if (m_animated && !m_gpuDriven)
+    {
+        m_scheduler.requestFrame();
+    }
+
+    // メッシュファイルが書き換えられたら読み直す（MeshCooker でクックし直した場合も含む）
+    if (!m_meshFile.empty() && ++m_meshCheckCount % MeshReloadCheckInterval == 0)
+    {
+        const auto stamps = getMeshFileStamps(m_meshFile);
+        if (stamps != m_meshFileStamps)
+        {
+            m_meshFileStamps = stamps;
+            reloadMesh();
+        }
+    }
+
+    auto& framePacket = m_framePackets[packet];
+    framePacket.view = makeCullingView();
+    if (!m_gpuDriven)
+    {
+        updateInstances(m_timestep.getAlpha(), framePacket.batcher);
+    }
+}
+
+void TriangleApp::makeCommand(VkCommandBuffer command)
+{
+    if (m_gpuDriven)
+    {
+        recordGpuDrivenDraws();
+    }
+    else
+    {
+        recordInstancedDraws();
+    }
+
+    if (++m_frameCount % CommandStatsInterval == 0)
+    {
+        printCommandRecorderStats(m_gpuDriven ? "gpu-driven" : "instanced", m_recorder.getStats());
+    }
+}
+
+void TriangleApp::recordGpuDrivenDraws()
+{
+    // 記録するコマンドの数はマテリアルの数だけで、オブジェクトの数によらない
+    VkBuffer vertexBuffers[] = { m_geometryPool.getVertexBuffer(), m_gpuScene.getInstanceBuffer() };
+    VkDeviceSize offsets[] = { 0, 0 };
+    m_recorder.bindVertexBuffers(0, 2, vertexBuffers, offsets);
+    m_recorder.bindIndexBuffer(m_geometryPool.getIndexBuffer(), 0, m_geometryPool.getIndexType());
+
+    // 逆量子化はインスタンスの変換に畳み込んであるので、プッシュ定数は恒等変換にする
+    const PositionQuantization identity = { vec4(0.0f), vec4(1.0f) };
+    if (m_vertexPulling)
+    {
+        const auto constants = makeVertexPullConstants(identity, m_geometryPool.getVertexBufferAddress(),
+            m_geometryPool.getVertexStride(), VertexPullFormat::PackedMeshVertex);
+        m_recorder.pushConstants(m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VertexPullConstants), &constants);
+    }
+    else
+    {
+        m_recorder.pushConstants(m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PositionQuantization), &identity);
+    }
+    for (uint32_t material = 0; material < uint32_t(m_materials.size()); ++material)
+    {
+        // シェーダを取得できずにパイプラインが無いマテリアルは描かない
+        if (m_materials[material] == VK_NULL_HANDLE)
+        {
+            continue;
+        }
+        m_recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, m_materials[material]);
+        m_gpuScene.recordDraws(m_recorder.getCommandBuffer(), material);
+    }
+}
+
+void TriangleApp::recordInstancedDraws()
+{
+    // このイメージのフェンスは待ち終わっているので、前回このイメージで使った区画を書き換えてよい
+    m_frameRing.beginFrame(m_imageIndex);
+
+    auto& batcher = m_framePackets[m_framePacket].batcher;
+    FrameAllocation instances;
+    if (!batcher.build(m_frameRing, instances))
+    {
+        return;
+    }
+
+    // 各バッファオブジェクト（インスタンスのデータはバインディング 1）
+    m_drawGeometry = DrawGeometry{};
+    m_drawGeometry.vertexBufferCount = 2;
+    m_drawGeometry.vertexBuffers[0] = m_geometryPool.getVertexBuffer();
+    m_drawGeometry.vertexBuffers[1] = instances.buffer;
+    m_drawGeometry.vertexOffsets[0] = 0;
+    m_drawGeometry.vertexOffsets[1] = instances.offset;
+    m_drawGeometry.indexBuffer = m_geometryPool.getIndexBuffer();
+    m_drawGeometry.indexOffset = 0;
+    m_drawGeometry.indexType = m_geometryPool.getIndexType();
+
+    // メッシュ（LOD ごと）とマテリアルの組ごとに 1 回の描画でまとめて描く
+    // キーで並べ替えてから記録するので、パイプラインとプッシュ定数は変わった時だけセットされる
+    const auto& batches = batcher.getBatches();
+    m_drawPackets.resize(batches.size());
+    m_drawList.clear();
+    m_drawList.reserve(batches.size());
+    for (uint32_t i = 0; i < uint32_t(batches.size()); ++i)
+    {
+        const auto& batch = batches[i];
+        const uint32_t mesh = batch.mesh / MaxMeshLods;
+        const uint32_t lod = batch.mesh % MaxMeshLods;
+        const auto& primitive = m_primitives[mesh];
+
+        // シェーダを取得できずにパイプラインが無いマテリアルは描かない
+        if (m_materials[batch.material] == VK_NULL_HANDLE)
+        {
+            continue;
+        }
+
+        DrawPacket& packet = m_drawPackets[i];
+        packet.pipeline = m_materials[batch.material];
+        packet.layout = m_pipelineLayout;
+        packet.descriptorSet = VK_NULL_HANDLE;
+        packet.geometry = &m_drawGeometry;
+        if (m_vertexPulling)
+        {
+            packet.pushConstants = &m_pullConstants[mesh];
+            packet.pushConstantSize = sizeof(VertexPullConstants);
+        }
+        else
+        {
+            packet.pushConstants = &primitive.quantization;
+            packet.pushConstantSize = sizeof(PositionQuantization);
+        }
+        packet.pushConstantStages = VK_SHADER_STAGE_VERTEX_BIT;
+        packet.indexCount = lod > 0 ? primitive.lods[lod].indexCount : primitive.indexCount;
+        packet.instanceCount = batch.instanceCount;
+        packet.firstIndex = lod > 0 ? primitive.lods[lod].firstIndex : primitive.firstIndex;
+        packet.vertexOffset = primitive.vertexOffset;
+        packet.firstInstance = batch.firstInstance;
+
+        // マテリアルごとにパイプラインが 1 つなので、パイプラインの番号にはマテリアルの番号を使う
+        m_drawList.add(makeDrawKey(0, batch.material, 0, 0, batch.mesh), i);
+    }
+    m_drawList.sort();
+    m_drawList.record(m_recorder, m_drawPackets.data());
+}
+
+/// <summary>
+/// パイプライン記述に対応するパイプラインを取得する
+/// 同じハッシュのパイプラインが既にあれば、それを使い回す
+/// </summary>
+VkPipeline TriangleApp::getPipeline(GraphicsPipelineDesc& desc)
+{
+    auto hash = desc.hash();
+    auto it = m_pipelines.find(hash);
+    if (it != m_pipelines.end())
+    {
+        return it->second;
+    }
+
+    // 作れなかったもの（シェーダを取得できなかったもの）は覚えず、次の取得でもう一度作る
+    auto pipeline = createPipeline(desc);
+    if (pipeline != VK_NULL_HANDLE)
+    {
+        m_pipelines[hash] = pipeline;
+    }
+    return pipeline;
+}
+
+VkPipeline TriangleApp::createPipeline(GraphicsPipelineDesc& desc)
+{
+    // 頂点の入力設定
     VkPipelineVertexInputStateCreateInfo vertexInputCI{};
     vertexInputCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputCI.vertexBindingDescriptionCount = 1;
-    vertexInputCI.pVertexBindingDescriptions = &inputBinding;
-    vertexInputCI.vertexAttributeDescriptionCount = uint32_t(inputAttribs.size());
-    vertexInputCI.pVertexAttributeDescriptions = inputAttribs.data();
+    vertexInputCI.vertexBindingDescriptionCount = uint32_t(desc.vertexBindings.size());
+    vertexInputCI.pVertexBindingDescriptions = desc.vertexBindings.data();
+    vertexInputCI.vertexAttributeDescriptionCount = uint32_t(desc.vertexAttributes.size());
+    vertexInputCI.pVertexAttributeDescriptions = desc.vertexAttributes.data();
 
     // ブレンディングの設定
     const auto colorWriteAll = \
@@ -74,7 +960,7 @@ void TriangleApp::prepare()
         VK_COLOR_COMPONENT_A_BIT;
 
     VkPipelineColorBlendAttachmentState blendAttachment{};
-    blendAttachment.blendEnable = VK_TRUE;
+    blendAttachment.blendEnable = desc.blendEnable;
     blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
     blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
     blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
@@ -114,13 +1000,13 @@ void TriangleApp::prepare()
     // プリミティブトポロジー設定
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyCI{};
     inputAssemblyCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssemblyCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblyCI.topology = desc.topology;
 
     // ラスタライザステート設定
     VkPipelineRasterizationStateCreateInfo rasterizerCI{};
     rasterizerCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
     rasterizerCI.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizerCI.cullMode = VK_CULL_MODE_NONE;
+    rasterizerCI.cullMode = desc.cullMode;
     rasterizerCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
     rasterizerCI.lineWidth = 1.0f;
 
@@ -132,22 +1018,37 @@ void TriangleApp::prepare()
     // デプスステンシルステート設定
     VkPipelineDepthStencilStateCreateInfo depthStencilCI{};
     depthStencilCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencilCI.depthTestEnable = VK_TRUE;
+    depthStencilCI.depthTestEnable = desc.depthTestEnable;
     depthStencilCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-    depthStencilCI.depthWriteEnable = VK_TRUE;
+    depthStencilCI.depthWriteEnable = desc.depthWriteEnable;
     depthStencilCI.stencilTestEnable = VK_FALSE;
 
-    // シェーダバイナリの読み込み
-    vector<VkPipelineShaderStageCreateInfo> shaderStages
+    // シェーダバリアントの取得（キャッシュに無ければここでコンパイルされる）
+    vector<VkPipelineShaderStageCreateInfo> shaderStages;
+    for (auto& v : desc.stages)
     {
-        loadShaderModule("shader.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-        loadShaderModule("shader.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
-    };
-
-    // パイプラインレイアウト
-    VkPipelineLayoutCreateInfo pipelineLayoutCI{};
-    pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    vkCreatePipelineLayout(m_device, &pipelineLayoutCI, nullptr, &m_pipelineLayout);
+        const auto& spirv = m_shaderCache.getVariant(v.shaderId, v.defineMask);
+        if (spirv.empty())
+        {
+            // 取得に失敗したバリアントがあればパイプラインは作らない
+            for (const auto& stage : shaderStages)
+            {
+                vkDestroyShaderModule(m_device, stage.module, nullptr);
+            }
+            return VK_NULL_HANDLE;
+        }
+        // 頂点レイアウトと頂点シェーダの入力が食い違っていれば、壊れた描画をしないようにパイプラインを作らない
+        if (v.stage == VK_SHADER_STAGE_VERTEX_BIT && !validateVertexInputs(spirv, desc.vertexAttributes))
+        {
+            OutputDebugStringA("Vertex layout does not match the vertex shader inputs. The pipeline is not created.\n");
+            for (const auto& stage : shaderStages)
+            {
+                vkDestroyShaderModule(m_device, stage.module, nullptr);
+            }
+            return VK_NULL_HANDLE;
+        }
+        shaderStages.push_back(loadShaderModule(spirv, v.stage, v.constants.getInfo()));
+    }
 
     // パイプラインの構築
     VkGraphicsPipelineCreateInfo ci{};
@@ -162,89 +1063,25 @@ void TriangleApp::prepare()
     ci.pViewportState = &viewportCI;
     ci.renderPass = m_renderPass;
     ci.layout = m_pipelineLayout;
-    vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &ci, nullptr, &m_pipeline);
+    VkPipeline pipeline;
+    vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &ci, nullptr, &pipeline);
 
     // ShaderModule はもう不要のため破棄
     for (const auto& v : shaderStages)
     {
         vkDestroyShaderModule(m_device, v.module, nullptr);
     }
-}
-
-void TriangleApp::cleanup()
-{
-    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
-    vkDestroyPipeline(m_device, m_pipeline, nullptr);
 
-    vkFreeMemory(m_device, m_vertexBuffer.memory, nullptr);
-    vkFreeMemory(m_device, m_indexBuffer.memory, nullptr);
-    vkDestroyBuffer(m_device, m_vertexBuffer.buffer, nullptr);
-    vkDestroyBuffer(m_device, m_indexBuffer.buffer, nullptr);
+    return pipeline;
 }
 
-void TriangleApp::makeCommand(VkCommandBuffer command)
+VkPipelineShaderStageCreateInfo TriangleApp::loadShaderModule(const vector<uint32_t>& spirv, VkShaderStageFlagBits stage, const VkSpecializationInfo* specialization)
 {
-    // 作成したパイプラインをセット
-    vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
-
-    // 各バッファオブジェクトのセット
-    VkDeviceSize offset = 0;
-    vkCmdBindVertexBuffers(command, 0, 1, &m_vertexBuffer.buffer, &offset);
-    vkCmdBindIndexBuffer(command, m_indexBuffer.buffer, offset, VK_INDEX_TYPE_UINT32);
-
-    // 三角形描画
-    vkCmdDrawIndexed(command, m_indexCount, 1, 0, 0, 0);
-}
-
-TriangleApp::BufferObject TriangleApp::createBuffer(uint32_t size, VkBufferUsageFlags usage)
-{
-    BufferObject obj;
-    VkBufferCreateInfo ci{};
-    ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    ci.usage = usage;
-    ci.size = size;
-    auto result = vkCreateBuffer(m_device, &ci, nullptr, &obj.buffer);
-    checkResult(result);
-
-    // メモリ量の算出
-    VkMemoryRequirements reqs;
-    vkGetBufferMemoryRequirements(m_device, obj.buffer, &reqs);
-    VkMemoryAllocateInfo info{};
-    info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    info.allocationSize = reqs.size;
-
-    // メモリタイプの判定
-    auto flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
-    info.memoryTypeIndex = getMemoryTypeIndex(reqs.memoryTypeBits, flags);
-
-    // メモリの確保
-    vkAllocateMemory(m_device, &info, nullptr, &obj.memory);
-
-    // メモリのバインド
-    vkBindBufferMemory(m_device, obj.buffer, obj.memory, 0);
-
-    return obj;
-}
-
-VkPipelineShaderStageCreateInfo TriangleApp::loadShaderModule(const char* fileName, VkShaderStageFlagBits stage)
-{
-    ifstream infile(fileName, std::ios::binary);
-
-    if (!infile)
-    {
-        OutputDebugStringA("File not found.\n");
-        DebugBreak();
-    }
-
-    vector<char> filedata;
-    filedata.resize(uint32_t(infile.seekg(0, ifstream::end).tellg()));
-    infile.seekg(0, ifstream::beg).read(filedata.data(), filedata.size());
-
     VkShaderModule shaderModule;
     VkShaderModuleCreateInfo ci{};
     ci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    ci.pCode = reinterpret_cast<uint32_t*>(filedata.data());
-    ci.codeSize = filedata.size();
+    ci.pCode = spirv.data();
+    ci.codeSize = spirv.size() * sizeof(uint32_t);
     vkCreateShaderModule(m_device, &ci, nullptr, &shaderModule);
 
     VkPipelineShaderStageCreateInfo shaderStageCI{};
@@ -252,5 +1089,6 @@ VkPipelineShaderStageCreateInfo TriangleApp::loadShaderModule(const char* fileNa
     shaderStageCI.stage = stage;
     shaderStageCI.module = shaderModule;
     shaderStageCI.pName = "main";
+    shaderStageCI.pSpecializationInfo = specialization;
     return shaderStageCI;
 }
\ No newline at end of file
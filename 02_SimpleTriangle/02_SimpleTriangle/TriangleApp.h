@@ -1,17 +1,66 @@
 #pragma once
 
 #include "../../common/vkappbase.h"
+#include "../../common/shaderpermutation.h"
+#include "../../common/pipelinedesc.h"
+#include "../../common/vertexlayout.h"
+#include "../../common/vertexpacking.h"
+#include "../../common/meshoptimizer.h"
+#include "../../common/meshloader.h"
+#include "../../common/meshcache.h"
+#include "../../common/meshlod.h"
+#include "../../common/staging.h"
+#include "../../common/framering.h"
+#include "../../common/instancing.h"
+#include "../../common/gpudriven.h"
+#include "../../common/hizpyramid.h"
+#include "../../common/culling.h"
+#include "../../common/dynamicbvh.h"
+#include "../../common/drawlist.h"
+#include "../../common/commandrecorder.h"
+#include "../../common/geometrypool.h"
+#include "../../common/vertexpulling.h"
+#include "../../common/scenegraph.h"
 #include "glm/glm.hpp"
 
+#include <unordered_map>
+#include <string>
+#include <array>
+
 class TriangleApp : public VulkanAppBase
 {
 public:
-    TriangleApp() : VulkanAppBase() {}
+    TriangleApp() : VulkanAppBase(), m_meshCheckCount(0), m_meshGeometry(InvalidGeometryId), m_objectCount(0), m_objectBvh(0.0f, 0.0f), m_gpuDriven(false), m_vertexPulling(false), m_occlusionCulling(false), m_clusterCulling(false), m_animated(false), m_frameCount(0) {}
 
     virtual void prepare() override;
     virtual void cleanup() override;
 
     virtual void makeCommand(VkCommandBuffer command) override;
+    virtual void makePreRenderPassCommand(VkCommandBuffer command) override;
+    virtual void makePostRenderPassCommand(VkCommandBuffer command) override;
+    virtual void writeFramePacket(uint32_t packet) override;
+    virtual void update(double step) override;
+
+    // すべてのシェーダのバリアントをキャッシュへ書き出す（Vulkan は使わない。コンパイルできないものがあれば false）
+    bool precompileShaders();
+
+    // 読み込むメッシュファイル（glTF / OBJ）。指定しなければ三角形を描画する
+    void setMeshFile(const std::string& fileName) { m_meshFile = fileName; }
+
+    // 描画するメッシュの数（格子状に並べて回転させる）。0 なら画面全体に 1 つだけ描画する
+    void setObjectCount(uint32_t count) { m_objectCount = count; }
+
+    // GPU でカリングして間接描画する（デバイスが対応していなければ CPU でのインスタンシングになる）
+    void setGpuDriven(bool enable) { m_gpuDriven = enable; }
+
+    // 頂点シェーダが頂点バッファをデバイスアドレスで直接読む（デバイスが対応していなければ頂点入力を使う）
+    void setVertexPulling(bool enable) { m_vertexPulling = enable; }
+
+    // GPU 駆動の描画で、前のフレームに見えていたものを先に描いて作った Hi-Z で遮蔽カリングする
+    void setOcclusionCulling(bool enable) { m_occlusionCulling = enable; }
+
+    // GPU 駆動の描画で、メッシュレットを持つメッシュ（MeshCooker で変換した .mesh）をメッシュレット単位でカリングする
+    void setClusterCulling(bool enable) { m_clusterCulling = enable; }
 
     struct Vertex
     {
@@ -20,19 +69,112 @@ public:
     };
 
 private:
-    struct BufferObject
+    // シーン上の 1 つのオブジェクト（メッシュのすべてのプリミティブを描画する）
+    struct SceneObject
     {
-        VkBuffer buffer;
-        VkDeviceMemory memory;
+        glm::vec2 position;
+        float scale;
+        float angularVelocity;
+        uint32_t material;
+        Unorm8x4 color;
     };
 
-    BufferObject createBuffer(uint32_t size, VkBufferUsageFlags usage);
-    VkPipelineShaderStageCreateInfo loadShaderModule(const char* fileName, VkShaderStageFlagBits stage);
+    // メインスレッドで書いて render で読む、1 フレーム分の状態
+    struct FramePacket
+    {
+        GpuCullingView view;
+
+        // 見えるインスタンス（CPU でのインスタンシングの場合のみ）
+        InstanceBatcher batcher;
+    };
+
+    void registerShaders();
+    void createTriangle();
+    bool loadMesh(const char* fileName);
+    void reloadMesh();
+    void createScene();
+    void addObject(const SceneObject& object);
+    void updateInstances(float alpha, InstanceBatcher& batcher);
+    void createInstanceBuffers();
+    void updatePullConstants();
+    bool createGpuScene();
+    bool uploadGpuScene();
+    GpuCullingView makeCullingView() const;
+    void recordInstancedDraws();
+    void recordGpuDrivenDraws();
+    static InstanceData makeInstance(const SceneObject& object, float time);
+    VkPipelineShaderStageCreateInfo loadShaderModule(const std::vector<uint32_t>& spirv, VkShaderStageFlagBits stage, const VkSpecializationInfo* specialization);
+    VkPipeline getPipeline(GraphicsPipelineDesc& desc);
+    VkPipeline createPipeline(GraphicsPipelineDesc& desc);
+
+    ShaderPermutationCache m_shaderCache;
+    uint32_t m_vertShader;
+    uint32_t m_fragShader;
+    uint32_t m_cullShader;
+    uint32_t m_clusterShader;
+    uint32_t m_hizShader;
+
+    std::string m_meshFile;
 
-    BufferObject m_vertexBuffer;
-    BufferObject m_indexBuffer;
+    // メッシュファイルとクック済みファイルの大きさと更新時刻（変われば読み直す）
+    std::array<uint64_t, 4> m_meshFileStamps;
+    uint32_t m_meshCheckCount;
+    UploadScheduler m_uploader;
+    AsyncFileReader m_fileReader;
+
+    // シーンのすべてのメッシュの頂点とインデックス（バインドは 1 回で済む）
+    GeometryPool m_geometryPool;
+    GeometryId m_meshGeometry;
+
+    // プリミティブごとのプッシュ定数（バーテックスプリングの場合のみ）
+    std::vector<VertexPullConstants> m_pullConstants;
 
     VkPipelineLayout m_pipelineLayout;
-    VkPipeline m_pipeline;
-    uint32_t m_indexCount;
+
+    // マテリアルの番号 -> パイプライン
+    std::vector<VkPipeline> m_materials;
+
+    // パイプライン記述のハッシュ値 -> パイプライン
+    std::unordered_map<uint64_t, VkPipeline> m_pipelines;
+    std::vector<MeshPrimitive> m_primitives;
+
+    // プリミティブの firstMeshlet から meshletCount 個がそのメッシュレット（クック済みのファイルの場合のみ）
+    std::vector<Meshlet> m_meshlets;
+
+    uint32_t m_objectCount;
+    std::vector<SceneObject> m_objects;
+
+    // オブジェクトごとの最後の update と、その 1 つ前の回転角（描画ではこの間を補間する）
+    std::vector<float> m_angles;
+    std::vector<float> m_previousAngles;
+
+    // 回転するオブジェクトがある（OnDemand でも毎フレーム描画し直す）
+    bool m_animated;
+
+    // ここから m_objectLods まではメインスレッドの writeFramePacket だけが使う
+    // オブジェクトの変換（ノードの番号はオブジェクトの番号と同じ）
+    SceneGraph m_sceneGraph;
+    CullingBounds m_objectBounds;
+    std::vector<uint32_t> m_visibleObjects;
+
+    // オブジェクトが多い場合は BVH で視錐台カリングする（オブジェクトは移動しないので余白は付けない）
+    DynamicBvh m_objectBvh;
+
+    // オブジェクトとプリミティブの組（オブジェクト * プリミティブの数 + プリミティブ）ごとに前のフレームで選んだ LOD
+    std::vector<uint32_t> m_objectLods;
+    std::array<FramePacket, MaxFramePackets> m_framePackets;
+    FrameRingBuffer m_frameRing;
+    DrawGeometry m_drawGeometry;
+    std::vector<DrawPacket> m_drawPackets;
+    DrawList m_drawList;
+
+    bool m_gpuDriven;
+    bool m_vertexPulling;
+    bool m_occlusionCulling;
+    bool m_clusterCulling;
+    GpuDrivenScene m_gpuScene;
+    HiZPyramid m_depthPyramid;
+
+    CommandRecorder m_recorder;
+    uint64_t m_frameCount;
 };
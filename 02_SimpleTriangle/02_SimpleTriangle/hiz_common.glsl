@@ -0,0 +1,51 @@
+// cull.comp と cluster.comp の 2 段階の遮蔽カリングで共有する Hi-Z の判定（USE_OCCLUSION の場合のみインクルードする）
+
+// R: 最小、G: 最大の深度（0 段目の 1 テクセルが 2x2 ピクセル、hizpyramid.h）
+layout(binding = 6) uniform sampler2D depthPyramid;
+
+layout(std140, binding = 7) uniform OcclusionView
+{
+    mat4 viewProjection;
+    vec2 depthSize;         // デプスバッファの大きさ（ピクセル）
+    uint pyramidLevels;
+    uint reserved;
+} occlusion;
+
+// 境界球を囲む立方体の 8 頂点を投影し、画面上の矩形の最も手前の深度が Hi-Z の最も奥の深度より奥なら遮られている
+bool isOccluded(vec3 center, float radius)
+{
+    vec2 minNdc = vec2(1e30);
+    vec2 maxNdc = vec2(-1e30);
+    float nearestDepth = 1.0;
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = occlusion.viewProjection * vec4(corner, 1.0);
+
+        // 近平面を跨ぐものは判定しない
+        if (clip.w <= 1e-5 || clip.z <= 0.0)
+        {
+            return false;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        minNdc = min(minNdc, ndc.xy);
+        maxNdc = max(maxNdc, ndc.xy);
+        nearestDepth = min(nearestDepth, ndc.z);
+    }
+
+    // ピクセルの範囲（画面の外は切り詰める）
+    // ビューポートを上下反転して描いている（TriangleApp）ので、デプスの 0 行目が NDC の y = +1 になる
+    vec2 p0 = clamp(vec2(minNdc.x * 0.5 + 0.5, 0.5 - maxNdc.y * 0.5) * occlusion.depthSize, vec2(0.0), occlusion.depthSize - 1.0);
+    vec2 p1 = clamp(vec2(maxNdc.x * 0.5 + 0.5, 0.5 - minNdc.y * 0.5) * occlusion.depthSize, vec2(0.0), occlusion.depthSize - 1.0);
+
+    // 矩形が 2x2 テクセルに収まる段を選ぶ
+    float extent = max(p1.x - p0.x, p1.y - p0.y);
+    int level = clamp(int(ceil(log2(extent + 1.0))) - 1, 0, int(occlusion.pyramidLevels) - 1);
+    ivec2 t0 = ivec2(p0) >> (level + 1);
+    ivec2 t1 = ivec2(p1) >> (level + 1);
+
+    float farthest = max(
+        max(texelFetch(depthPyramid, t0, level).g, texelFetch(depthPyramid, ivec2(t1.x, t0.y), level).g),
+        max(texelFetch(depthPyramid, ivec2(t0.x, t1.y), level).g, texelFetch(depthPyramid, t1, level).g));
+    return nearestDepth > farthest;
+}
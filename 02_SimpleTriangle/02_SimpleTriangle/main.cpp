@@ -1,3 +1,4 @@
+#define NOMINMAX
 #include <windows.h>
 
 #include <vector>
@@ -5,8 +6,11 @@
 #include <cassert>
 #include <sstream>
 #include <numeric>
+#include <string>
+#include <cstdlib>
 
 #include "TriangleApp.h"
+#include "../../common/jobsystem.h"
 
 #pragma comment(lib, "vulkan-1.lib")
 
@@ -18,19 +22,89 @@ int __stdcall wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCm
     UNREFERENCED_PARAMETER(hPrevInstance);
     UNREFERENCED_PARAMETER(lpCmdLine);
 
+    // precompile だけを指定すると、ウィンドウも Vulkan も使わずにすべてのシェーダのバリアントを shadercache へ書き出して終わる
+    // （Release のビルド後の処理で出荷用のキャッシュを作る。コンパイルできないものがあれば 1 を返してビルドを失敗させる）
+    if (__argc == 2 && _wcsicmp(__wargv[1], L"precompile") == 0)
+    {
+        TriangleApp precompiler;
+        return precompiler.precompileShaders() ? 0 : 1;
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     glfwWindowHint(GLFW_RESIZABLE, 0);
     auto window = glfwCreateWindow(WindowWidth, WindowHeight, AppTitle, nullptr, nullptr);
 
     // Vulkan 初期化
+    // 引数にメッシュファイル（glTF / OBJ / MeshCooker で変換した .mesh）を指定するとそれを描画する
+    // 2 番目の引数で描画する数を指定すると、インスタンシングでまとめて描画する
+    // 3 番目以降の引数に gpu を指定すると、GPU でカリングして間接描画する
+    // pull を指定すると、頂点シェーダが頂点バッファを直接読む（バーテックスプリング）
+    // occlusion を gpu と一緒に指定すると、Hi-Z で遮られたものも描画しない
+    // clusters を gpu と一緒に指定すると、メッシュレットを持つ .mesh をメッシュレット単位でカリングする
+    // thread を指定すると、描画スレッドで描画する（フレームパケットはトリプルバッファ、thread2 ならダブルバッファ）
+    // ondemand を指定すると、変化がある時だけ描画する。fps=60 のように指定すると、フレームレートをそれ以下に抑える
+    // pin を指定すると、ジョブシステムのワーカースレッドをそれぞれ 1 つの論理コアに固定する
     TriangleApp theApp;
+    if (__argc > 1)
+    {
+        int length = WideCharToMultiByte(CP_UTF8, 0, __wargv[1], -1, nullptr, 0, nullptr, nullptr);
+        std::string fileName(size_t(length), '\0');
+        WideCharToMultiByte(CP_UTF8, 0, __wargv[1], -1, &fileName[0], length, nullptr, nullptr);
+        fileName.resize(size_t(length) - 1);
+        theApp.setMeshFile(fileName);
+    }
+    if (__argc > 2)
+    {
+        theApp.setObjectCount(uint32_t(_wtoi(__wargv[2])));
+    }
+    for (int i = 3; i < __argc; ++i)
+    {
+        if (_wcsicmp(__wargv[i], L"gpu") == 0)
+        {
+            theApp.setGpuDriven(true);
+        }
+        else if (_wcsicmp(__wargv[i], L"pull") == 0)
+        {
+            theApp.setVertexPulling(true);
+        }
+        else if (_wcsicmp(__wargv[i], L"occlusion") == 0)
+        {
+            theApp.setOcclusionCulling(true);
+        }
+        else if (_wcsicmp(__wargv[i], L"clusters") == 0)
+        {
+            theApp.setClusterCulling(true);
+        }
+        else if (_wcsicmp(__wargv[i], L"thread") == 0)
+        {
+            theApp.setRenderThread(3);
+        }
+        else if (_wcsicmp(__wargv[i], L"thread2") == 0)
+        {
+            theApp.setRenderThread(2);
+        }
+        else if (_wcsicmp(__wargv[i], L"ondemand") == 0)
+        {
+            theApp.getScheduler().setSchedule(FrameSchedule::OnDemand);
+        }
+        else if (_wcsnicmp(__wargv[i], L"fps=", 4) == 0)
+        {
+            theApp.getScheduler().setTargetFrameRate(_wtof(__wargv[i] + 4));
+        }
+        else if (_wcsicmp(__wargv[i], L"pin") == 0)
+        {
+            JobSystem::setDefaultPinning(true);
+        }
+    }
     theApp.initialize(window, AppTitle);
 
     while (glfwWindowShouldClose(window) == GLFW_FALSE)
     {
-        glfwPollEvents();
-        theApp.render();
+        if (theApp.getScheduler().waitForFrame())
+        {
+            theApp.frame();
+        }
     }
 
     // Vulkan 修了
@@ -1,9 +1,12 @@
 #version 450
 
+// パイプライン生成時に特殊化定数で上書きされる
+layout(constant_id=0) const float COLOR_INTENSITY = 1.0;
+
 layout(location=0) in vec4 inColor;
 layout(location=0) out vec4 outColor;
 
 void main()
 {
-    outColor = inColor;
+    outColor = vec4(inColor.rgb * COLOR_INTENSITY, inColor.a);
 }
\ No newline at end of file
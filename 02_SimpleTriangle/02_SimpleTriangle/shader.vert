@@ -1,7 +1,51 @@
 #version 450
 
+#ifdef USE_VERTEX_PULLING
+#extension GL_EXT_buffer_reference : require
+
+// 頂点バッファはデバイスアドレスで直接読み、フォーマットに応じてここで展開する（vertexpulling.h）
+// 頂点入力を使わないので、パイプラインはメッシュの頂点レイアウトによらない
+const uint VertexPullPackedMeshVertex = 0;
+const uint VertexPullFloatPositionColor = 1;
+
+layout(buffer_reference, std430, buffer_reference_align=4) readonly buffer VertexWords
+{
+    uint words[];
+};
+
+// 位置を元の座標に戻すための変換と、頂点バッファの読み方（メッシュごと）
+layout(push_constant) uniform VertexPull
+{
+    vec4 offset;
+    vec4 scale;
+    VertexWords vertices;
+    uint stride;
+    uint format;
+} pull;
+#else
+#ifdef USE_PACKED_POSITION
+// snorm16 / half に量子化された位置を元の座標に戻すための変換（メッシュごと）
+layout(push_constant) uniform PositionDequantize
+{
+    vec4 offset;
+    vec4 scale;
+} dequantize;
+
+layout(location=0) in vec4 inPos;
+#else
 layout(location=0) in vec3 inPos;
+#endif
+#ifdef USE_VERTEX_COLOR
 layout(location=1) in vec3 inColor;
+#endif
+#endif
+#ifdef USE_INSTANCING
+// インスタンスごとの変換（3x4 のアフィン行列の各行）と色
+layout(location=4) in vec4 inInstanceRow0;
+layout(location=5) in vec4 inInstanceRow1;
+layout(location=6) in vec4 inInstanceRow2;
+layout(location=7) in vec4 inInstanceColor;
+#endif
 
 layout(location=0) out vec4 outColor;
 
@@ -12,6 +56,43 @@ out gl_PerVertex
 
 void main()
 {
-    gl_Position = vec4(inPos, 1.0);
-    outColor = vec4(inColor, 1.0);
+#ifdef USE_VERTEX_PULLING
+    // gl_VertexIndex には vertexOffset が足されているので、バッファの先頭からの番号になる
+    const uint base = uint(gl_VertexIndex) * (pull.stride / 4);
+    vec3 pos;
+    vec3 color;
+    if (pull.format == VertexPullPackedMeshVertex)
+    {
+        pos = vec3(unpackSnorm2x16(pull.vertices.words[base]), unpackSnorm2x16(pull.vertices.words[base + 1]).x);
+        color = unpackUnorm4x8(pull.vertices.words[base + 2]).rgb;
+    }
+    else
+    {
+        pos = uintBitsToFloat(uvec3(pull.vertices.words[base], pull.vertices.words[base + 1], pull.vertices.words[base + 2]));
+        color = uintBitsToFloat(uvec3(pull.vertices.words[base + 3], pull.vertices.words[base + 4], pull.vertices.words[base + 5]));
+    }
+    pos = pull.offset.xyz + pos * pull.scale.xyz;
+#else
+#ifdef USE_PACKED_POSITION
+    vec3 pos = dequantize.offset.xyz + inPos.xyz * dequantize.scale.xyz;
+#else
+    vec3 pos = inPos;
+#endif
+#ifdef USE_VERTEX_COLOR
+    vec3 color = inColor;
+#endif
+#endif
+#ifdef USE_INSTANCING
+    vec4 p = vec4(pos, 1.0);
+    pos = vec3(dot(inInstanceRow0, p), dot(inInstanceRow1, p), dot(inInstanceRow2, p));
+#endif
+    gl_Position = vec4(pos, 1.0);
+#ifdef USE_VERTEX_COLOR
+    outColor = vec4(color, 1.0);
+#else
+    outColor = vec4(1.0);
+#endif
+#ifdef USE_INSTANCING
+    outColor *= inInstanceColor;
+#endif
 }
\ No newline at end of file
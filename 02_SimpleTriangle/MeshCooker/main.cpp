@@ -0,0 +1,262 @@
+#define NOMINMAX
+#include <windows.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+#include "../../common/meshloader.h"
+#include "../../common/meshoptimizer.h"
+#include "../../common/meshcache.h"
+#include "../../common/meshlet.h"
+#include "../../common/meshlod.h"
+
+#pragma comment(lib, "vulkan-1.lib")
+
+// MeshCooker: glTF / OBJ をクック済みの .mesh に変換するオフラインツール
+//
+//   MeshCooker [-c] [-l count] [-o output.mesh] input...
+//     -c  頂点とインデックスを圧縮する（ファイルは小さくなるが、読み込み時に復号が必要になる）
+//     -l  プリミティブごとの LOD の最大数（最も詳細なものを含む。1 なら簡略化しない。省略時は MaxMeshLods）
+//     -o  出力ファイル名（入力が 1 つの場合のみ。省略時は入力の拡張子を .mesh に置き換える）
+//
+// 頂点の統合・頂点キャッシュ / オーバードロー / 頂点フェッチの最適化・メッシュレットへの分割・LOD の生成をここで済ませておくことで、
+// 実行時の読み込みはファイルのコピーだけになる。
+
+using namespace std;
+
+namespace
+{
+    // 量子化済みの位置を float に戻す（オーバードロー最適化とメッシュレットの境界で使う）
+    vector<glm::vec3> dequantizePositions(const MeshVertex* vertices, size_t count, const PositionQuantization& quantization)
+    {
+        vector<glm::vec3> positions(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            glm::vec3 packed;
+            for (int c = 0; c < 3; ++c)
+            {
+                packed[c] = max(float(vertices[i].pos.v[c]) / 32767.0f, -1.0f);
+            }
+            positions[i] = glm::vec3(quantization.offset) + packed * glm::vec3(quantization.scale);
+        }
+        return positions;
+    }
+
+    // 簡略化で誤差に含める属性（法線 3 成分と UV 2 成分）と、その重み（位置はメッシュの大きさが 1 になるよう正規化して比べる）
+    const size_t LodAttributeCount = 5;
+    const float LodAttributeWeights[LodAttributeCount] = { 0.5f, 0.5f, 0.5f, 1.0f, 1.0f };
+
+    // 八面体に射影した法線と半精度の UV を float に戻す（LOD の簡略化で使う）
+    vector<float> decodeLodAttributes(const MeshVertex* vertices, size_t count)
+    {
+        vector<float> attributes(count * LodAttributeCount);
+        for (size_t i = 0; i < count; ++i)
+        {
+            float x = max(float(vertices[i].normal.v[0]) / 32767.0f, -1.0f);
+            float y = max(float(vertices[i].normal.v[1]) / 32767.0f, -1.0f);
+            const float z = 1.0f - fabs(x) - fabs(y);
+            if (z < 0.0f)
+            {
+                const float foldedX = (1.0f - fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+                const float foldedY = (1.0f - fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+                x = foldedX;
+                y = foldedY;
+            }
+            const glm::vec3 normal = glm::normalize(glm::vec3(x, y, z));
+
+            float* dst = &attributes[i * LodAttributeCount];
+            dst[0] = normal.x;
+            dst[1] = normal.y;
+            dst[2] = normal.z;
+            dst[3] = halfToFloat(vertices[i].texcoord.v[0]);
+            dst[4] = halfToFloat(vertices[i].texcoord.v[1]);
+        }
+        return attributes;
+    }
+
+    bool cookMesh(const string& input, const string& output, bool compress, uint32_t maxLodCount)
+    {
+        MeshLoader loader;
+        if (!loader.open(input.c_str()))
+        {
+            fprintf(stderr, "%s: cannot read the mesh\n", input.c_str());
+            return false;
+        }
+
+        vector<MeshVertex> vertices(loader.getVertexCount());
+        vector<uint8_t> indexData(size_t(loader.getIndexDataSize()));
+        if (!loader.loadToMemory(vertices.data(), indexData.data()))
+        {
+            fprintf(stderr, "%s: cannot decode the mesh\n", input.c_str());
+            return false;
+        }
+
+        vector<uint32_t> indices(loader.getIndexCount());
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            if (loader.getIndexType() == VK_INDEX_TYPE_UINT16)
+            {
+                indices[i] = reinterpret_cast<const uint16_t*>(indexData.data())[i];
+            }
+            else
+            {
+                indices[i] = reinterpret_cast<const uint32_t*>(indexData.data())[i];
+            }
+        }
+
+        vector<MeshVertex> cookedVertices;
+        vector<uint32_t> cookedIndices;
+        vector<MeshPrimitive> cookedPrimitives;
+        vector<Meshlet> cookedMeshlets;
+        uint32_t transformsBefore = 0, transformsAfter = 0, triangleCount = 0;
+        uint32_t lodCount = 0, lodTriangleCount = 0;
+
+        for (auto primitive : loader.getPrimitives())
+        {
+            vector<MeshVertex> v(vertices.begin() + primitive.vertexOffset, vertices.begin() + primitive.vertexOffset + primitive.vertexCount);
+            vector<uint32_t> idx(indices.begin() + primitive.firstIndex, indices.begin() + primitive.firstIndex + primitive.indexCount);
+
+            auto before = analyzeVertexCache(idx.data(), idx.size(), v.size());
+
+            // 量子化後に同じになった頂点（OBJ の角ごとの頂点など）をまとめてから最適化する
+            size_t vertexCount = weldVertices(idx.data(), idx.size(), v.data(), v.size(), sizeof(MeshVertex));
+            optimizeVertexCache(idx.data(), idx.data(), idx.size(), vertexCount);
+
+            auto positions = dequantizePositions(v.data(), vertexCount, primitive.quantization);
+            optimizeOverdraw(idx.data(), idx.data(), idx.size(), &positions[0].x, sizeof(glm::vec3), vertexCount, 1.05f);
+
+            // メッシュレットの境界は GPU 上のカリングと同じ量子化された位置の空間で求める
+            // 三角形の順番が変わるので、頂点フェッチの最適化（インデックスの順に頂点を並べ直す）より前に行う
+            const PositionQuantization packedSpace = { glm::vec4(0.0f), glm::vec4(1.0f) };
+            const auto packedPositions = dequantizePositions(v.data(), vertexCount, packedSpace);
+            primitive.firstMeshlet = uint32_t(cookedMeshlets.size());
+            primitive.meshletCount = uint32_t(buildMeshlets(idx.data(), idx.size(), &packedPositions[0].x, sizeof(glm::vec3), vertexCount, cookedMeshlets));
+
+            // 簡略化した LOD のインデックスを最も詳細な LOD の後ろに並べる（誤差はメッシュの空間の距離）
+            const auto attributes = decodeLodAttributes(v.data(), vertexCount);
+            MeshLod lods[MaxMeshLods];
+            primitive.lodCount = buildMeshLods(idx, &positions[0].x, sizeof(glm::vec3), vertexCount,
+                attributes.data(), sizeof(float) * LodAttributeCount, LodAttributeWeights, LodAttributeCount, lods, maxLodCount);
+
+            // 頂点はすべての LOD で共有するので、すべてのインデックスを合わせて並べ直す（最も詳細な LOD が先に参照する）
+            vertexCount = optimizeVertexFetch(v.data(), idx.data(), idx.size(), v.data(), vertexCount, sizeof(MeshVertex));
+            auto after = analyzeVertexCache(idx.data(), lods[0].indexCount, vertexCount);
+
+            transformsBefore += before.vertexTransforms;
+            transformsAfter += after.vertexTransforms;
+            triangleCount += after.triangleCount;
+
+            primitive.firstIndex = uint32_t(cookedIndices.size());
+            primitive.vertexOffset = int32_t(cookedVertices.size());
+            primitive.vertexCount = uint32_t(vertexCount);
+            for (uint32_t l = 0; l < primitive.lodCount; ++l)
+            {
+                primitive.lods[l] = { primitive.firstIndex + lods[l].firstIndex, lods[l].indexCount, lods[l].error };
+                lodTriangleCount += lods[l].indexCount / 3;
+            }
+            lodCount += primitive.lodCount;
+
+            cookedVertices.insert(cookedVertices.end(), v.begin(), v.begin() + vertexCount);
+            cookedIndices.insert(cookedIndices.end(), idx.begin(), idx.end());
+            cookedPrimitives.push_back(primitive);
+        }
+
+        MeshCacheSource source;
+        source.vertices = cookedVertices.data();
+        source.vertexCount = uint32_t(cookedVertices.size());
+        source.indices = cookedIndices.data();
+        source.indexCount = uint32_t(cookedIndices.size());
+        source.primitives = cookedPrimitives.data();
+        source.primitiveCount = uint32_t(cookedPrimitives.size());
+        source.meshlets = cookedMeshlets.data();
+        source.meshletCount = uint32_t(cookedMeshlets.size());
+        if (!getFileStamp(input.c_str(), source.sourceSize, source.sourceTime))
+        {
+            source.sourceSize = source.sourceTime = 0;
+        }
+        if (!writeMeshCache(output.c_str(), source, compress))
+        {
+            fprintf(stderr, "%s: cannot write the cooked mesh\n", output.c_str());
+            return false;
+        }
+
+        const double rawSize = double(cookedVertices.size() * sizeof(MeshVertex) + cookedIndices.size() * getIndexSize(selectIndexType(cookedVertices.size())));
+        MappedFile written;
+        written.open(output.c_str());
+        printf("%s -> %s\n", input.c_str(), output.c_str());
+        printf("  primitives %u, vertices %u -> %u, triangles %u\n",
+            uint32_t(cookedPrimitives.size()), loader.getVertexCount(), uint32_t(cookedVertices.size()), triangleCount);
+        printf("  ACMR %.3f -> %.3f\n",
+            triangleCount ? float(transformsBefore) / triangleCount : 0.0f, triangleCount ? float(transformsAfter) / triangleCount : 0.0f);
+        printf("  LODs %u, %.1f%% more triangles for all LODs\n",
+            lodCount, triangleCount ? 100.0f * float(lodTriangleCount - triangleCount) / float(triangleCount) : 0.0f);
+        const auto meshletStats = analyzeMeshlets(cookedMeshlets.data(), cookedMeshlets.size());
+        printf("  meshlets %u, %.1f vertices / %.1f triangles on average, %.0f%% with a normal cone\n",
+            meshletStats.meshletCount, meshletStats.averageVertices, meshletStats.averageTriangles, meshletStats.coneRatio * 100.0f);
+        printf("  %.2f MB (%.1f%% of raw streams)\n", written.size() / (1024.0 * 1024.0), rawSize > 0 ? 100.0 * written.size() / rawSize : 0.0);
+        return true;
+    }
+
+    int run(const vector<string>& args)
+    {
+        bool compress = false;
+        uint32_t maxLodCount = MaxMeshLods;
+        string output;
+        vector<string> inputs;
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            if (args[i] == "-c")
+            {
+                compress = true;
+            }
+            else if (args[i] == "-l" && i + 1 < args.size())
+            {
+                maxLodCount = uint32_t(min(max(atoi(args[++i].c_str()), 1), int(MaxMeshLods)));
+            }
+            else if (args[i] == "-o" && i + 1 < args.size())
+            {
+                output = args[++i];
+            }
+            else
+            {
+                inputs.push_back(args[i]);
+            }
+        }
+
+        if (inputs.empty() || (!output.empty() && inputs.size() != 1))
+        {
+            fprintf(stderr, "usage: MeshCooker [-c] [-l count] [-o output.mesh] input...\n");
+            return 1;
+        }
+
+        int result = 0;
+        for (const auto& input : inputs)
+        {
+            if (!cookMesh(input, output.empty() ? getCookedMeshFileName(input) : output, compress, maxLodCount))
+            {
+                result = 1;
+            }
+        }
+        return result;
+    }
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    // ファイル名は UTF-8 で扱う
+    vector<string> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        int length = WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, nullptr, 0, nullptr, nullptr);
+        string arg(size_t(length), '\0');
+        WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, &arg[0], length, nullptr, nullptr);
+        arg.resize(size_t(length) - 1);
+        args.push_back(arg);
+    }
+    return run(args);
+}
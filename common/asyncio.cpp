@@ -0,0 +1,828 @@
+#include "asyncio.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASYNCIO_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cerrno>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+#ifdef _WIN32
+    typedef void* NativeFile;
+#else
+    typedef int NativeFile;
+#endif
+
+    // 1 回のシステムコールで読む最大サイズ（ReadFile の DWORD と io_uring の len に収める）
+    const size_t MaxReadSize = size_t(1) << 30;
+
+    // io_uring_enter が EAGAIN / EBUSY を続けて返した場合に、やり直す最大の回数
+    const uint32_t MaxBusyRetries = 1000;
+
+    struct ReadRequest
+    {
+        NativeFile file;
+        uint64_t offset;
+        size_t size;
+        uint8_t* destination;
+        size_t done;
+        AsyncFileReader::Completion completion;
+    };
+
+    /// <summary>
+    /// ファイルの指定位置から読む（ワーカースレッド用の同期版）。読めたバイト数を返す
+    /// </summary>
+    size_t readAt(NativeFile file, uint64_t offset, uint8_t* destination, size_t size)
+    {
+#ifdef _WIN32
+        // 同期用のハンドルでは同じファイルへの読み込みが直列化されるので、FILE_FLAG_OVERLAPPED で開いて完了を待つ
+        HANDLE event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+#endif
+        size_t done = 0;
+        while (done < size)
+        {
+            const size_t length = min(size - done, MaxReadSize);
+#ifdef _WIN32
+            OVERLAPPED overlapped{};
+            overlapped.Offset = DWORD(offset + done);
+            overlapped.OffsetHigh = DWORD((offset + done) >> 32);
+            overlapped.hEvent = event;
+            DWORD bytesRead = 0;
+            if (!ReadFile(file, destination + done, DWORD(length), nullptr, &overlapped) && GetLastError() != ERROR_IO_PENDING)
+            {
+                break;
+            }
+            if (!GetOverlappedResult(file, &overlapped, &bytesRead, TRUE) || bytesRead == 0)
+            {
+                break;
+            }
+            done += bytesRead;
+#else
+            auto bytesRead = pread(file, destination + done, length, off_t(offset + done));
+            if (bytesRead < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytesRead <= 0)
+            {
+                break;
+            }
+            done += size_t(bytesRead);
+#endif
+        }
+#ifdef _WIN32
+        CloseHandle(event);
+#endif
+        return done;
+    }
+}
+
+/// <summary>
+/// 読み込みの実装の共通部分
+/// </summary>
+class AsyncFileReader::Backend
+{
+public:
+    virtual ~Backend() {}
+
+    virtual bool isIoUring() const = 0;
+    virtual bool registerBuffer(void*, size_t) { return false; }
+    virtual void unregisterBuffer() {}
+    virtual void read(NativeFile file, uint64_t offset, size_t size, void* destination, Completion completion) = 0;
+    virtual size_t poll() = 0;
+    virtual void wait() = 0;
+    virtual size_t getPendingCount() const = 0;
+
+    // 回復できないエラーで使えなくなった（AsyncFileReader が別の実装に切り替える）
+    virtual bool hasFailed() const { return false; }
+};
+
+#ifdef ASYNCIO_IO_URING
+/// <summary>
+/// io_uring による実装
+/// 要求は投入キュー（SQ）に書き込むだけで、poll / wait を呼ぶか一定数たまった時にまとめてカーネルへ送る
+/// 要求のスロットの数と SQ の大きさを同じにしているので、SQ が溢れることはない
+/// io_uring_enter が回復できないエラーを返した場合は、完了していない要求をすべて失敗として通知し、以後リングを使わない
+/// </summary>
+class AsyncFileReader::IoUringBackend : public AsyncFileReader::Backend
+{
+public:
+    IoUringBackend()
+        : m_ring(-1), m_sqRing(MAP_FAILED), m_cqRing(MAP_FAILED), m_sqes(nullptr), m_sqRingSize(0), m_cqRingSize(0), m_sqesSize(0)
+        , m_sqHead(nullptr), m_sqTail(nullptr), m_sqMask(nullptr), m_sqArray(nullptr)
+        , m_cqHead(nullptr), m_cqTail(nullptr), m_cqMask(nullptr), m_cqes(nullptr)
+        , m_unsubmitted(0), m_submitBatch(1), m_busyCount(0), m_failed(false), m_fixedBuffer(nullptr), m_fixedSize(0)
+    {
+    }
+
+    ~IoUringBackend()
+    {
+        if (m_ring >= 0)
+        {
+            wait();
+        }
+        if (m_sqes != nullptr)
+        {
+            munmap(m_sqes, m_sqesSize);
+        }
+        if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+        {
+            munmap(m_cqRing, m_cqRingSize);
+        }
+        if (m_sqRing != MAP_FAILED)
+        {
+            munmap(m_sqRing, m_sqRingSize);
+        }
+        if (m_ring >= 0)
+        {
+            close(m_ring);
+        }
+    }
+
+    bool create(uint32_t queueDepth)
+    {
+        io_uring_params params{};
+        m_ring = int(syscall(__NR_io_uring_setup, queueDepth, &params));
+        if (m_ring < 0)
+        {
+            // ENOSYS（カーネルが古い）や EPERM（seccomp などで禁止されている）の場合はスレッドでの読み込みに切り替える
+            return false;
+        }
+
+        // IORING_OP_READ は 5.6 から。同じ版で追加された機能の有無で判断する
+        if ((params.features & IORING_FEAT_RW_CUR_POS) == 0)
+        {
+            return false;
+        }
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap)
+        {
+            m_sqRingSize = m_cqRingSize = max(m_sqRingSize, m_cqRingSize);
+        }
+
+        m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED)
+        {
+            return false;
+        }
+        m_cqRing = singleMap ? m_sqRing : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED)
+        {
+            return false;
+        }
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+        {
+            return false;
+        }
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+        auto sq = static_cast<uint8_t*>(m_sqRing);
+        m_sqHead = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+        m_sqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        m_sqMask = reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+
+        auto cq = static_cast<uint8_t*>(m_cqRing);
+        m_cqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        m_cqMask = reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        m_requests.resize(params.sq_entries);
+        for (uint32_t i = params.sq_entries; i > 0; --i)
+        {
+            m_freeSlots.push_back(i - 1);
+        }
+
+        // システムコールの回数を減らすため、キューの 1/4 がたまるまでは送らない
+        m_submitBatch = max(1u, params.sq_entries / 4);
+        return true;
+    }
+
+    bool isIoUring() const override
+    {
+        return true;
+    }
+
+    bool registerBuffer(void* data, size_t size) override
+    {
+        unregisterBuffer();
+
+        iovec iov{ data, size };
+        if (syscall(__NR_io_uring_register, m_ring, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+        {
+            // RLIMIT_MEMLOCK が足りない場合など。固定バッファを使わない通常の読み込みになる
+            return false;
+        }
+        m_fixedBuffer = static_cast<uint8_t*>(data);
+        m_fixedSize = size;
+        return true;
+    }
+
+    void unregisterBuffer() override
+    {
+        if (m_fixedBuffer == nullptr)
+        {
+            return;
+        }
+        wait();
+        syscall(__NR_io_uring_register, m_ring, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+        m_fixedBuffer = nullptr;
+        m_fixedSize = 0;
+    }
+
+    void read(NativeFile file, uint64_t offset, size_t size, void* destination, Completion completion) override
+    {
+        while (m_freeSlots.empty())
+        {
+            reap(true);
+        }
+
+        if (m_failed)
+        {
+            if (completion)
+            {
+                completion(0, false);
+            }
+            return;
+        }
+
+        const uint32_t slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        m_requests[slot] = { file, offset, size, static_cast<uint8_t*>(destination), 0, move(completion) };
+        queue(slot);
+
+        if (m_unsubmitted >= m_submitBatch && !isRetryable(enter(0)))
+        {
+            failAll();
+        }
+    }
+
+    size_t poll() override
+    {
+        return reap(false);
+    }
+
+    void wait() override
+    {
+        while (getPendingCount() > 0)
+        {
+            reap(true);
+        }
+    }
+
+    size_t getPendingCount() const override
+    {
+        return m_requests.size() - m_freeSlots.size();
+    }
+
+    bool hasFailed() const override
+    {
+        return m_failed;
+    }
+
+private:
+    struct Finished
+    {
+        Completion completion;
+        size_t bytesRead;
+        bool succeeded;
+    };
+
+    // EAGAIN（カーネルの資源が一時的に足りない）と EBUSY（CQ が溢れている）は CQ を処理してからやり直せば送れる
+    static bool isRetryable(int error)
+    {
+        return error == 0 || error == EAGAIN || error == EBUSY;
+    }
+
+    /// <summary>
+    /// 要求の残りの部分を SQ に書き込む（まだカーネルには送らない）
+    /// </summary>
+    void queue(uint32_t slot)
+    {
+        const auto& request = m_requests[slot];
+        const uint32_t tail = *m_sqTail;
+        const uint32_t index = tail & *m_sqMask;
+
+        uint8_t* destination = request.destination + request.done;
+        const size_t length = min(request.size - request.done, MaxReadSize);
+        const bool fixed = m_fixedBuffer != nullptr && destination >= m_fixedBuffer && destination + length <= m_fixedBuffer + m_fixedSize;
+
+        auto& sqe = m_sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe.fd = request.file;
+        sqe.off = request.offset + request.done;
+        sqe.addr = uint64_t(reinterpret_cast<uintptr_t>(destination));
+        sqe.len = uint32_t(length);
+        sqe.buf_index = 0;
+        sqe.user_data = slot;
+        m_sqArray[index] = index;
+
+        // カーネルが SQE の内容を読むのは tail の更新を見た後
+        __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+        m_unsubmitted++;
+    }
+
+    /// <summary>
+    /// 積んだ要求をカーネルへ送り、minComplete 個の完了を待つ。失敗した場合は errno を返す（EINTR はやり直す）
+    /// </summary>
+    int enter(uint32_t minComplete)
+    {
+        for (;;)
+        {
+            const uint32_t flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+            auto result = syscall(__NR_io_uring_enter, m_ring, m_unsubmitted, minComplete, flags, nullptr, 0);
+            if (result >= 0)
+            {
+                m_unsubmitted -= min(m_unsubmitted, uint32_t(result));
+                return 0;
+            }
+            if (errno != EINTR)
+            {
+                return errno;
+            }
+        }
+    }
+
+    /// <summary>
+    /// 完了していない要求をすべて失敗として通知し、リングを使えなくする
+    /// SQ に残った要求を後でカーネルが処理してもスロットを再利用しないよう、以後 io_uring_enter は呼ばない
+    /// </summary>
+    size_t failAll()
+    {
+        m_failed = true;
+        m_unsubmitted = 0;
+
+        vector<bool> free(m_requests.size(), false);
+        for (auto slot : m_freeSlots)
+        {
+            free[slot] = true;
+        }
+
+        vector<Finished> finished;
+        m_freeSlots.clear();
+        for (uint32_t slot = uint32_t(m_requests.size()); slot > 0; --slot)
+        {
+            auto& request = m_requests[slot - 1];
+            if (!free[slot - 1])
+            {
+                finished.push_back({ move(request.completion), request.done, false });
+            }
+            m_freeSlots.push_back(slot - 1);
+        }
+
+        for (auto& f : finished)
+        {
+            if (f.completion)
+            {
+                f.completion(f.bytesRead, f.succeeded);
+            }
+        }
+        return finished.size();
+    }
+
+    /// <summary>
+    /// 完了キュー（CQ）を処理する。途中までしか読めなかった要求は残りを再び投入する
+    /// </summary>
+    size_t reap(bool waitForCompletion)
+    {
+        if (m_failed)
+        {
+            return 0;
+        }
+        if (m_unsubmitted > 0 || waitForCompletion)
+        {
+            const int error = enter(waitForCompletion ? 1 : 0);
+            if (!isRetryable(error))
+            {
+                return failAll();
+            }
+            if (error != 0)
+            {
+                // CQ を処理してから次の呼び出しでやり直す。何度やり直しても送れなければ諦める
+                if (++m_busyCount > MaxBusyRetries)
+                {
+                    return failAll();
+                }
+                this_thread::yield();
+            }
+            else
+            {
+                m_busyCount = 0;
+            }
+        }
+
+        vector<Finished> finished;
+
+        uint32_t head = *m_cqHead;
+        const uint32_t tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            const auto& cqe = m_cqes[head & *m_cqMask];
+            const auto slot = uint32_t(cqe.user_data);
+            auto& request = m_requests[slot];
+
+            if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+            {
+                queue(slot);
+                continue;
+            }
+            if (cqe.res > 0)
+            {
+                request.done += size_t(cqe.res);
+                if (request.done < request.size)
+                {
+                    queue(slot);
+                    continue;
+                }
+            }
+
+            // 完了（res が 0 ならファイルの終端、負ならエラー）
+            finished.push_back({ move(request.completion), request.done, request.done == request.size });
+            m_freeSlots.push_back(slot);
+        }
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+        // 通知の中から read を呼んでもよいよう、CQ を進めてから通知する
+        for (auto& f : finished)
+        {
+            if (f.completion)
+            {
+                f.completion(f.bytesRead, f.succeeded);
+            }
+        }
+        return finished.size();
+    }
+
+    int m_ring;
+    void* m_sqRing;
+    void* m_cqRing;
+    io_uring_sqe* m_sqes;
+    size_t m_sqRingSize;
+    size_t m_cqRingSize;
+    size_t m_sqesSize;
+
+    uint32_t* m_sqHead;
+    uint32_t* m_sqTail;
+    uint32_t* m_sqMask;
+    uint32_t* m_sqArray;
+    uint32_t* m_cqHead;
+    uint32_t* m_cqTail;
+    uint32_t* m_cqMask;
+    io_uring_cqe* m_cqes;
+
+    vector<ReadRequest> m_requests;
+    vector<uint32_t> m_freeSlots;
+    uint32_t m_unsubmitted;
+    uint32_t m_submitBatch;
+
+    // EAGAIN / EBUSY で続けてやり直した回数と、回復できないエラーでリングを使えなくなったか
+    uint32_t m_busyCount;
+    bool m_failed;
+
+    uint8_t* m_fixedBuffer;
+    size_t m_fixedSize;
+};
+#endif
+
+/// <summary>
+/// ワーカースレッドで同期的に読む実装（io_uring が使えない場合）
+/// </summary>
+class AsyncFileReader::ThreadPoolBackend : public AsyncFileReader::Backend
+{
+public:
+    ThreadPoolBackend(uint32_t queueDepth, uint32_t threadCount)
+        : m_queueDepth(max(queueDepth, 1u)), m_pending(0), m_quit(false)
+    {
+        for (uint32_t i = 0; i < max(threadCount, 1u); ++i)
+        {
+            m_threads.emplace_back([this]() { workerMain(); });
+        }
+    }
+
+    ~ThreadPoolBackend()
+    {
+        wait();
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_requestReady.notify_all();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    bool isIoUring() const override
+    {
+        return false;
+    }
+
+    void read(NativeFile file, uint64_t offset, size_t size, void* destination, Completion completion) override
+    {
+        // 要求が一杯なら、少なくとも 1 つ完了を通知してから積む
+        while (getPendingCount() >= m_queueDepth)
+        {
+            deliver(true);
+        }
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_requests.push_back({ file, offset, size, static_cast<uint8_t*>(destination), 0, move(completion) });
+            m_pending++;
+        }
+        m_requestReady.notify_one();
+    }
+
+    size_t poll() override
+    {
+        return deliver(false);
+    }
+
+    void wait() override
+    {
+        while (getPendingCount() > 0)
+        {
+            deliver(true);
+        }
+    }
+
+    size_t getPendingCount() const override
+    {
+        lock_guard<mutex> lock(m_mutex);
+        return m_pending;
+    }
+
+private:
+    void workerMain()
+    {
+        for (;;)
+        {
+            ReadRequest request;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_requestReady.wait(lock, [this]() { return m_quit || !m_requests.empty(); });
+                if (m_requests.empty())
+                {
+                    return;
+                }
+                request = move(m_requests.front());
+                m_requests.pop_front();
+            }
+
+            request.done = readAt(request.file, request.offset, request.destination, request.size);
+
+            {
+                lock_guard<mutex> lock(m_mutex);
+                m_finished.push_back(move(request));
+            }
+            m_completed.notify_all();
+        }
+    }
+
+    size_t deliver(bool waitForCompletion)
+    {
+        vector<ReadRequest> finished;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            if (waitForCompletion)
+            {
+                m_completed.wait(lock, [this]() { return !m_finished.empty() || m_pending == 0; });
+            }
+            finished.swap(m_finished);
+            m_pending -= finished.size();
+        }
+
+        for (auto& request : finished)
+        {
+            if (request.completion)
+            {
+                request.completion(request.done, request.done == request.size);
+            }
+        }
+        return finished.size();
+    }
+
+    const uint32_t m_queueDepth;
+    mutable mutex m_mutex;
+    condition_variable m_requestReady;
+    condition_variable m_completed;
+    deque<ReadRequest> m_requests;
+    vector<ReadRequest> m_finished;
+    size_t m_pending;
+    bool m_quit;
+    vector<thread> m_threads;
+};
+
+AsyncFileReader::AsyncFileReader()
+    : m_queueDepth(0), m_threadCount(0)
+{
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+    terminate();
+}
+
+bool AsyncFileReader::initialize(uint32_t queueDepth, uint32_t threadCount)
+{
+    terminate();
+    m_queueDepth = queueDepth;
+    m_threadCount = threadCount;
+
+#ifdef ASYNCIO_IO_URING
+    auto ring = unique_ptr<IoUringBackend>(new IoUringBackend());
+    if (ring->create(queueDepth))
+    {
+        m_backend = move(ring);
+        return true;
+    }
+#endif
+    m_backend.reset(new ThreadPoolBackend(queueDepth, threadCount));
+    return true;
+}
+
+void AsyncFileReader::terminate()
+{
+    if (m_backend)
+    {
+        m_backend->wait();
+        m_backend->unregisterBuffer();
+        m_backend.reset();
+    }
+    for (int i = 0; i < int(m_files.size()); ++i)
+    {
+        closeFile(i);
+    }
+    m_files.clear();
+}
+
+bool AsyncFileReader::isUsingIoUring() const
+{
+    return m_backend && m_backend->isIoUring();
+}
+
+bool AsyncFileReader::registerBuffer(void* data, size_t size)
+{
+    return m_backend && m_backend->registerBuffer(data, size);
+}
+
+void AsyncFileReader::unregisterBuffer()
+{
+    if (m_backend)
+    {
+        m_backend->unregisterBuffer();
+    }
+}
+
+int AsyncFileReader::openFile(const char* fileName)
+{
+    OpenFile file{};
+#ifdef _WIN32
+    // パスは UTF-8 で受け取り、ワイド文字版の API で開く
+    int length = MultiByteToWideChar(CP_UTF8, 0, fileName, -1, nullptr, 0);
+    wstring wideName(size_t(length), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, fileName, -1, &wideName[0], length);
+
+    file.handle = CreateFileW(wideName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_OVERLAPPED, nullptr);
+    if (file.handle == INVALID_HANDLE_VALUE)
+    {
+        return -1;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file.handle, &fileSize))
+    {
+        CloseHandle(file.handle);
+        return -1;
+    }
+    file.size = uint64_t(fileSize.QuadPart);
+#else
+    file.fd = ::open(fileName, O_RDONLY | O_CLOEXEC);
+    if (file.fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(file.fd, &st) != 0)
+    {
+        ::close(file.fd);
+        return -1;
+    }
+    file.size = uint64_t(st.st_size);
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(file.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+    file.used = true;
+
+    for (size_t i = 0; i < m_files.size(); ++i)
+    {
+        if (!m_files[i].used)
+        {
+            m_files[i] = file;
+            return int(i);
+        }
+    }
+    m_files.push_back(file);
+    return int(m_files.size() - 1);
+}
+
+/// <summary>
+/// ファイルを閉じる（そのファイルへの要求は先に完了させておくこと）
+/// </summary>
+void AsyncFileReader::closeFile(int file)
+{
+    if (file < 0 || file >= int(m_files.size()) || !m_files[file].used)
+    {
+        return;
+    }
+#ifdef _WIN32
+    CloseHandle(m_files[file].handle);
+#else
+    ::close(m_files[file].fd);
+#endif
+    m_files[file].used = false;
+}
+
+uint64_t AsyncFileReader::getFileSize(int file) const
+{
+    return (file >= 0 && file < int(m_files.size()) && m_files[file].used) ? m_files[file].size : 0;
+}
+
+void AsyncFileReader::read(int file, uint64_t offset, size_t size, void* destination, Completion completion)
+{
+    if (!m_backend || file < 0 || file >= int(m_files.size()) || !m_files[file].used)
+    {
+        if (completion)
+        {
+            completion(0, false);
+        }
+        return;
+    }
+
+    // io_uring が回復できないエラーで使えなくなったら、以後はスレッドで読む（失敗した要求は通知済み）
+    if (m_backend->hasFailed())
+    {
+        m_backend->wait();
+        m_backend.reset(new ThreadPoolBackend(m_queueDepth, m_threadCount));
+    }
+#ifdef _WIN32
+    m_backend->read(m_files[file].handle, offset, size, destination, move(completion));
+#else
+    m_backend->read(m_files[file].fd, offset, size, destination, move(completion));
+#endif
+}
+
+size_t AsyncFileReader::poll()
+{
+    return m_backend ? m_backend->poll() : 0;
+}
+
+void AsyncFileReader::wait()
+{
+    if (m_backend)
+    {
+        m_backend->wait();
+    }
+}
+
+size_t AsyncFileReader::getPendingCount() const
+{
+    return m_backend ? m_backend->getPendingCount() : 0;
+}
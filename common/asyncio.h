@@ -0,0 +1,82 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// ファイルの非同期読み込み
+/// </summary>
+/// <remarks>
+/// Linux では io_uring（liburing は使わずシステムコールを直接呼ぶ）で読み込み要求をまとめて送信する。
+/// registerBuffer で登録した領域（ステージングバッファ）への読み込みは固定バッファ（IORING_OP_READ_FIXED）として扱い、
+/// 要求ごとのページの固定を省く。
+/// io_uring が使えない環境（Windows、古いカーネル、コンテナで禁止されている場合など）では、
+/// 少数のワーカースレッドが pread / ReadFile で読み込む。
+/// io_uring が読み込み中に回復できないエラーを返した場合は、完了していない要求を失敗として通知し、以後はワーカースレッドで読む。
+///
+/// read で要求を積み、poll / wait を呼んだスレッドで完了の通知（completion）を受け取る。
+/// read / poll / wait は同じスレッドから呼ぶこと。
+/// </remarks>
+class AsyncFileReader
+{
+public:
+    // bytesRead は実際に読んだバイト数（失敗した場合や、ファイルの終端を越えた場合は succeeded が false）
+    typedef std::function<void(size_t bytesRead, bool succeeded)> Completion;
+
+    AsyncFileReader();
+    ~AsyncFileReader();
+
+    AsyncFileReader(const AsyncFileReader&) = delete;
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    // queueDepth は同時に発行する要求の最大数、threadCount は io_uring が使えない場合のワーカースレッド数
+    bool initialize(uint32_t queueDepth = 128, uint32_t threadCount = 4);
+    void terminate();
+
+    bool isUsingIoUring() const;
+
+    // 読み込み先として頻繁に使うメモリを登録する（1 つだけ。登録できなくても読み込みはできる）
+    bool registerBuffer(void* data, size_t size);
+    void unregisterBuffer();
+
+    // fileName は UTF-8。失敗した場合は -1
+    int openFile(const char* fileName);
+    void closeFile(int file);
+    uint64_t getFileSize(int file) const;
+
+    // 読み込みを要求する（要求が一杯の場合は空くまで完了を待つ）
+    void read(int file, uint64_t offset, size_t size, void* destination, Completion completion);
+
+    // 完了した要求の通知を行い、その数を返す（待たない）
+    size_t poll();
+
+    // すべての要求が完了するまで待つ
+    void wait();
+
+    size_t getPendingCount() const;
+
+private:
+    class Backend;
+    class IoUringBackend;
+    class ThreadPoolBackend;
+
+    struct OpenFile
+    {
+#ifdef _WIN32
+        void* handle;
+#else
+        int fd;
+#endif
+        uint64_t size;
+        bool used;
+    };
+
+    std::unique_ptr<Backend> m_backend;
+    std::vector<OpenFile> m_files;
+
+    // io_uring からワーカースレッドでの読み込みに切り替える時に使う
+    uint32_t m_queueDepth;
+    uint32_t m_threadCount;
+};
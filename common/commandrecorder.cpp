@@ -0,0 +1,375 @@
+#include "commandrecorder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+    void issue(CommandCount& count)
+    {
+        count.issued++;
+    }
+
+    void elide(CommandCount& count)
+    {
+        count.elided++;
+    }
+
+    void writeCount(stringstream& ss, const char* name, const CommandCount& count)
+    {
+        ss << name << " " << count.issued << "/" << (count.issued + count.elided) << ", ";
+    }
+
+    bool isSameViewport(const VkViewport& a, const VkViewport& b)
+    {
+        return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height
+            && a.minDepth == b.minDepth && a.maxDepth == b.maxDepth;
+    }
+
+    bool isSameRect(const VkRect2D& a, const VkRect2D& b)
+    {
+        return a.offset.x == b.offset.x && a.offset.y == b.offset.y
+            && a.extent.width == b.extent.width && a.extent.height == b.extent.height;
+    }
+}
+
+void printCommandRecorderStats(const char* name, const CommandRecorderStats& stats)
+{
+    // 種類ごとに 記録した数 / 呼び出した数
+    stringstream ss;
+    ss << "[CommandRecorder] " << name << ": ";
+    writeCount(ss, "pipeline", stats.pipelines);
+    writeCount(ss, "descriptor", stats.descriptorSets);
+    writeCount(ss, "vertex", stats.vertexBuffers);
+    writeCount(ss, "index", stats.indexBuffers);
+    writeCount(ss, "push", stats.pushConstants);
+    writeCount(ss, "dynamic", stats.dynamicStates);
+    ss << "draws " << stats.draws << " (multi-drawn " << stats.multiDrawn << ")" << endl;
+    OutputDebugStringA(ss.str().c_str());
+}
+
+CommandRecorder::CommandRecorder()
+    : m_command(VK_NULL_HANDLE), m_stats{}, m_drawMultiIndexed(nullptr), m_maxMultiDrawCount(0)
+{
+    invalidate();
+}
+
+void CommandRecorder::begin(VkCommandBuffer command)
+{
+    m_command = command;
+    m_stats = CommandRecorderStats{};
+    invalidate();
+}
+
+void CommandRecorder::invalidate()
+{
+    m_graphics = BindPointState{};
+    m_compute = BindPointState{};
+    memset(m_vertexBound, 0, sizeof(m_vertexBound));
+    m_indexBound = false;
+    m_pushLayout = VK_NULL_HANDLE;
+    m_pushStages = 0;
+    memset(m_pushValid, 0, sizeof(m_pushValid));
+    m_viewportValid = 0;
+    m_scissorValid = 0;
+}
+
+void CommandRecorder::setMultiDraw(PFN_vkCmdDrawMultiIndexedEXT drawMultiIndexed, uint32_t maxDrawCount)
+{
+    m_drawMultiIndexed = maxDrawCount > 0 ? drawMultiIndexed : nullptr;
+    m_maxMultiDrawCount = maxDrawCount;
+}
+
+CommandRecorder::BindPointState* CommandRecorder::getBindPointState(VkPipelineBindPoint bindPoint)
+{
+    switch (bindPoint)
+    {
+    case VK_PIPELINE_BIND_POINT_GRAPHICS:
+        return &m_graphics;
+    case VK_PIPELINE_BIND_POINT_COMPUTE:
+        return &m_compute;
+    default:
+        return nullptr;
+    }
+}
+
+void CommandRecorder::bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline)
+{
+    auto state = getBindPointState(bindPoint);
+    if (state != nullptr && state->pipeline == pipeline)
+    {
+        elide(m_stats.pipelines);
+        return;
+    }
+
+    vkCmdBindPipeline(m_command, bindPoint, pipeline);
+    issue(m_stats.pipelines);
+    if (state != nullptr)
+    {
+        state->pipeline = pipeline;
+    }
+
+    // ビューポートとシザーを動的ステートにしていないパイプラインはバインドで値を上書きするので、覚えている値は使えない
+    if (bindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS)
+    {
+        m_viewportValid = 0;
+        m_scissorValid = 0;
+    }
+}
+
+void CommandRecorder::bindDescriptorSets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet, uint32_t setCount,
+    const VkDescriptorSet* sets, uint32_t dynamicOffsetCount, const uint32_t* dynamicOffsets)
+{
+    auto state = getBindPointState(bindPoint);
+    const uint32_t endSet = firstSet + setCount;
+
+    // 動的オフセットは毎回変わるものとして扱う
+    if (state != nullptr && dynamicOffsetCount == 0 && endSet <= MaxRecorderDescriptorSets)
+    {
+        bool same = true;
+        for (uint32_t i = 0; i < setCount && same; ++i)
+        {
+            same = state->sets[firstSet + i] == sets[i] && state->setLayouts[firstSet + i] == layout;
+        }
+        if (same)
+        {
+            elide(m_stats.descriptorSets);
+            return;
+        }
+    }
+
+    vkCmdBindDescriptorSets(m_command, bindPoint, layout, firstSet, setCount, sets, dynamicOffsetCount, dynamicOffsets);
+    issue(m_stats.descriptorSets);
+    if (state == nullptr)
+    {
+        return;
+    }
+
+    // 互換性の無いレイアウトで他の番号にバインドされていたセットは無効になりうるので、レイアウトが違うものは忘れる
+    for (uint32_t i = 0; i < MaxRecorderDescriptorSets; ++i)
+    {
+        if (i >= firstSet && i < endSet)
+        {
+            const bool tracked = dynamicOffsetCount == 0;
+            state->sets[i] = tracked ? sets[i - firstSet] : VK_NULL_HANDLE;
+            state->setLayouts[i] = tracked ? layout : VK_NULL_HANDLE;
+        }
+        else if (state->setLayouts[i] != layout)
+        {
+            state->sets[i] = VK_NULL_HANDLE;
+            state->setLayouts[i] = VK_NULL_HANDLE;
+        }
+    }
+}
+
+/// <summary>
+/// 頂点バッファのバインド
+/// 変わったバインディングが連続する範囲ごとに記録する（変わっていないものは記録しない）
+/// </summary>
+void CommandRecorder::bindVertexBuffers(uint32_t firstBinding, uint32_t bindingCount, const VkBuffer* buffers, const VkDeviceSize* offsets)
+{
+    if (firstBinding + bindingCount > MaxRecorderVertexBindings)
+    {
+        vkCmdBindVertexBuffers(m_command, firstBinding, bindingCount, buffers, offsets);
+        issue(m_stats.vertexBuffers);
+        for (uint32_t i = firstBinding; i < MaxRecorderVertexBindings; ++i)
+        {
+            m_vertexBound[i] = false;
+        }
+        return;
+    }
+
+    bool issued = false;
+    uint32_t i = 0;
+    while (i < bindingCount)
+    {
+        const uint32_t binding = firstBinding + i;
+        if (m_vertexBound[binding] && m_vertexBuffers[binding] == buffers[i] && m_vertexOffsets[binding] == offsets[i])
+        {
+            ++i;
+            continue;
+        }
+
+        uint32_t end = i + 1;
+        while (end < bindingCount)
+        {
+            const uint32_t b = firstBinding + end;
+            if (m_vertexBound[b] && m_vertexBuffers[b] == buffers[end] && m_vertexOffsets[b] == offsets[end])
+            {
+                break;
+            }
+            ++end;
+        }
+
+        vkCmdBindVertexBuffers(m_command, binding, end - i, buffers + i, offsets + i);
+        for (uint32_t k = i; k < end; ++k)
+        {
+            m_vertexBound[firstBinding + k] = true;
+            m_vertexBuffers[firstBinding + k] = buffers[k];
+            m_vertexOffsets[firstBinding + k] = offsets[k];
+        }
+        issued = true;
+        i = end;
+    }
+
+    // 数は呼び出し単位（範囲が分かれても 1 回と数える）
+    if (issued)
+    {
+        issue(m_stats.vertexBuffers);
+    }
+    else
+    {
+        elide(m_stats.vertexBuffers);
+    }
+}
+
+void CommandRecorder::bindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType)
+{
+    if (m_indexBound && m_indexBuffer == buffer && m_indexOffset == offset && m_indexType == indexType)
+    {
+        elide(m_stats.indexBuffers);
+        return;
+    }
+
+    vkCmdBindIndexBuffer(m_command, buffer, offset, indexType);
+    issue(m_stats.indexBuffers);
+    m_indexBound = true;
+    m_indexBuffer = buffer;
+    m_indexOffset = offset;
+    m_indexType = indexType;
+}
+
+void CommandRecorder::pushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* values)
+{
+    if (offset + size > MaxRecorderPushConstantSize)
+    {
+        vkCmdPushConstants(m_command, layout, stages, offset, size, values);
+        issue(m_stats.pushConstants);
+        memset(m_pushValid, 0, sizeof(m_pushValid));
+        return;
+    }
+
+    if (layout != m_pushLayout || stages != m_pushStages)
+    {
+        m_pushLayout = layout;
+        m_pushStages = stages;
+        memset(m_pushValid, 0, sizeof(m_pushValid));
+    }
+
+    bool valid = true;
+    for (uint32_t i = offset; i < offset + size && valid; ++i)
+    {
+        valid = (m_pushValid[i / 64] >> (i % 64)) & 1;
+    }
+    if (valid && memcmp(m_pushData + offset, values, size) == 0)
+    {
+        elide(m_stats.pushConstants);
+        return;
+    }
+
+    vkCmdPushConstants(m_command, layout, stages, offset, size, values);
+    issue(m_stats.pushConstants);
+    memcpy(m_pushData + offset, values, size);
+    for (uint32_t i = offset; i < offset + size; ++i)
+    {
+        m_pushValid[i / 64] |= 1ull << (i % 64);
+    }
+}
+
+void CommandRecorder::setViewport(uint32_t firstViewport, uint32_t viewportCount, const VkViewport* viewports)
+{
+    if (firstViewport + viewportCount <= MaxRecorderViewports)
+    {
+        bool same = true;
+        for (uint32_t i = 0; i < viewportCount && same; ++i)
+        {
+            const uint32_t index = firstViewport + i;
+            same = ((m_viewportValid >> index) & 1) && isSameViewport(m_viewports[index], viewports[i]);
+        }
+        if (same)
+        {
+            elide(m_stats.dynamicStates);
+            return;
+        }
+        for (uint32_t i = 0; i < viewportCount; ++i)
+        {
+            m_viewports[firstViewport + i] = viewports[i];
+            m_viewportValid |= 1u << (firstViewport + i);
+        }
+    }
+
+    vkCmdSetViewport(m_command, firstViewport, viewportCount, viewports);
+    issue(m_stats.dynamicStates);
+}
+
+void CommandRecorder::setScissor(uint32_t firstScissor, uint32_t scissorCount, const VkRect2D* scissors)
+{
+    if (firstScissor + scissorCount <= MaxRecorderViewports)
+    {
+        bool same = true;
+        for (uint32_t i = 0; i < scissorCount && same; ++i)
+        {
+            const uint32_t index = firstScissor + i;
+            same = ((m_scissorValid >> index) & 1) && isSameRect(m_scissors[index], scissors[i]);
+        }
+        if (same)
+        {
+            elide(m_stats.dynamicStates);
+            return;
+        }
+        for (uint32_t i = 0; i < scissorCount; ++i)
+        {
+            m_scissors[firstScissor + i] = scissors[i];
+            m_scissorValid |= 1u << (firstScissor + i);
+        }
+    }
+
+    vkCmdSetScissor(m_command, firstScissor, scissorCount, scissors);
+    issue(m_stats.dynamicStates);
+}
+
+void CommandRecorder::draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance)
+{
+    vkCmdDraw(m_command, vertexCount, instanceCount, firstVertex, firstInstance);
+    m_stats.draws++;
+}
+
+void CommandRecorder::drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance)
+{
+    vkCmdDrawIndexed(m_command, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+    m_stats.draws++;
+}
+
+void CommandRecorder::drawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride)
+{
+    vkCmdDrawIndexedIndirect(m_command, buffer, offset, drawCount, stride);
+    m_stats.draws++;
+}
+
+/// <summary>
+/// マルチドロー
+/// 拡張が使えれば maxMultiDrawCount ずつに分けて vkCmdDrawMultiIndexedEXT で記録し、使えなければ 1 つずつ vkCmdDrawIndexed で記録する
+/// </summary>
+void CommandRecorder::drawMultiIndexed(uint32_t drawCount, const VkMultiDrawIndexedInfoEXT* draws, uint32_t instanceCount, uint32_t firstInstance)
+{
+    if (m_drawMultiIndexed == nullptr || drawCount == 1)
+    {
+        for (uint32_t i = 0; i < drawCount; ++i)
+        {
+            vkCmdDrawIndexed(m_command, draws[i].indexCount, instanceCount, draws[i].firstIndex, draws[i].vertexOffset, firstInstance);
+        }
+        m_stats.draws += drawCount;
+        return;
+    }
+
+    for (uint32_t first = 0; first < drawCount; first += m_maxMultiDrawCount)
+    {
+        const uint32_t count = min(drawCount - first, m_maxMultiDrawCount);
+        m_drawMultiIndexed(m_command, count, draws + first, instanceCount, firstInstance, sizeof(VkMultiDrawIndexedInfoEXT), nullptr);
+        m_stats.draws++;
+        m_stats.multiDrawn += count;
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "vkappbase.h"
+
+#include <cstdint>
+
+/// <summary>
+/// 状態を変えないコマンドを省くコマンドバッファの薄いラッパー
+/// </summary>
+/// <remarks>
+/// バインドしたパイプライン・デスクリプタセット・頂点 / インデックスバッファ・プッシュ定数・動的ステート（ビューポートとシザー）を
+/// CPU 側に覚えておき、同じ値をもう一度セットする呼び出しはコマンドバッファに記録しない。
+/// begin でコマンドバッファを受け取った時点では何もセットされていないとみなす（コマンドバッファの開始時の状態と同じ）。
+/// ラッパーを通さずに状態を変えるコマンドを記録した場合は invalidate を呼ぶこと。
+/// setMultiDraw で VK_EXT_multi_draw の関数を渡すと、drawMultiIndexed は複数の描画を 1 つのコマンドで記録する
+/// （渡さなければ vkCmdDrawIndexed を並べる）。
+/// 記録した数と省いた数を種類ごとに数えるので、フレームの統計に使える（begin で 0 に戻る）。
+/// </remarks>
+
+// 覚えておく数の上限（超える分は常に記録する）
+const uint32_t MaxRecorderDescriptorSets = 4;
+const uint32_t MaxRecorderVertexBindings = 8;
+const uint32_t MaxRecorderViewports = 4;
+const uint32_t MaxRecorderPushConstantSize = 128;
+
+struct CommandCount
+{
+    uint32_t issued;
+    uint32_t elided;
+};
+
+struct CommandRecorderStats
+{
+    CommandCount pipelines;
+    CommandCount descriptorSets;
+    CommandCount vertexBuffers;
+    CommandCount indexBuffers;
+    CommandCount pushConstants;
+    CommandCount dynamicStates;
+
+    // 記録した描画コマンドの数と、そのうちマルチドローにまとめた描画の数
+    uint32_t draws;
+    uint32_t multiDrawn;
+};
+
+// 統計をデバッグ出力に書く
+void printCommandRecorderStats(const char* name, const CommandRecorderStats& stats);
+
+class CommandRecorder
+{
+public:
+    CommandRecorder();
+
+    // 記録を始めるコマンドバッファ（覚えている状態と統計を消す）
+    void begin(VkCommandBuffer command);
+
+    // ラッパーを通さずに状態を変えた場合に呼ぶ（以降の呼び出しは必ず記録される）
+    void invalidate();
+
+    // VK_EXT_multi_draw が使えない場合は nullptr を渡す（maxDrawCount は maxMultiDrawCount）
+    void setMultiDraw(PFN_vkCmdDrawMultiIndexedEXT drawMultiIndexed, uint32_t maxDrawCount);
+    bool hasMultiDraw() const { return m_drawMultiIndexed != nullptr; }
+
+    void bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline);
+    void bindDescriptorSets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet, uint32_t setCount,
+        const VkDescriptorSet* sets, uint32_t dynamicOffsetCount = 0, const uint32_t* dynamicOffsets = nullptr);
+    void bindVertexBuffers(uint32_t firstBinding, uint32_t bindingCount, const VkBuffer* buffers, const VkDeviceSize* offsets);
+    void bindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType);
+    void pushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* values);
+    void setViewport(uint32_t firstViewport, uint32_t viewportCount, const VkViewport* viewports);
+    void setScissor(uint32_t firstScissor, uint32_t scissorCount, const VkRect2D* scissors);
+
+    void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance);
+    void drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
+    void drawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride);
+
+    // インスタンスの範囲が同じ描画をまとめて記録する（draws の vertexOffset は描画ごとに使う）
+    void drawMultiIndexed(uint32_t drawCount, const VkMultiDrawIndexedInfoEXT* draws, uint32_t instanceCount, uint32_t firstInstance);
+
+    VkCommandBuffer getCommandBuffer() const { return m_command; }
+    const CommandRecorderStats& getStats() const { return m_stats; }
+
+private:
+    // グラフィックスとコンピュートのバインドポイントごとの状態
+    struct BindPointState
+    {
+        VkPipeline pipeline;
+        VkPipelineLayout setLayouts[MaxRecorderDescriptorSets];
+        VkDescriptorSet sets[MaxRecorderDescriptorSets];
+    };
+
+    BindPointState* getBindPointState(VkPipelineBindPoint bindPoint);
+
+    VkCommandBuffer m_command;
+    CommandRecorderStats m_stats;
+
+    PFN_vkCmdDrawMultiIndexedEXT m_drawMultiIndexed;
+    uint32_t m_maxMultiDrawCount;
+
+    BindPointState m_graphics;
+    BindPointState m_compute;
+
+    bool m_vertexBound[MaxRecorderVertexBindings];
+    VkBuffer m_vertexBuffers[MaxRecorderVertexBindings];
+    VkDeviceSize m_vertexOffsets[MaxRecorderVertexBindings];
+
+    bool m_indexBound;
+    VkBuffer m_indexBuffer;
+    VkDeviceSize m_indexOffset;
+    VkIndexType m_indexType;
+
+    // プッシュ定数はバイトごとに、同じレイアウトとステージでセット済みかを覚える
+    VkPipelineLayout m_pushLayout;
+    VkShaderStageFlags m_pushStages;
+    uint64_t m_pushValid[MaxRecorderPushConstantSize / 64];
+    uint8_t m_pushData[MaxRecorderPushConstantSize];
+
+    uint32_t m_viewportValid;
+    VkViewport m_viewports[MaxRecorderViewports];
+    uint32_t m_scissorValid;
+    VkRect2D m_scissors[MaxRecorderViewports];
+};
@@ -0,0 +1,47 @@
+#include "cpufeatures.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPUFEATURES_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace
+{
+    CpuFeatures detectCpuFeatures()
+    {
+        CpuFeatures features{};
+#if defined(CPUFEATURES_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return features;
+        }
+
+        // OS が YMM レジスタを保存するか（OSXSAVE と XCR0）
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6)
+        {
+            return features;
+        }
+        features.fma = (info[2] & (1 << 12)) != 0;
+        features.f16c = (info[2] & (1 << 29)) != 0;
+
+        __cpuidex(info, 7, 0);
+        features.avx2 = (info[1] & (1 << 5)) != 0;
+#elif defined(CPUFEATURES_X86)
+        features.avx2 = __builtin_cpu_supports("avx2");
+        features.fma = __builtin_cpu_supports("fma");
+        features.f16c = __builtin_cpu_supports("f16c");
+#endif
+        return features;
+    }
+}
+
+const CpuFeatures& getCpuFeatures()
+{
+    static const CpuFeatures features = detectCpuFeatures();
+    return features;
+}
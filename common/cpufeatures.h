@@ -0,0 +1,15 @@
+#pragma once
+
+/// <summary>
+/// 実行中の CPU が対応している命令セット（SIMD カーネルの選択に使う）
+/// OS が YMM レジスタを保存しない場合は、AVX 系の命令はすべて false になる
+/// </summary>
+struct CpuFeatures
+{
+    bool avx2;
+    bool fma;
+    bool f16c;
+};
+
+// 初回の呼び出しで判定し、以降は同じ結果を返す
+const CpuFeatures& getCpuFeatures();
@@ -0,0 +1,157 @@
+#include "culling_impl.h"
+#include "cpufeatures.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace culling;
+
+namespace
+{
+    // 1 つのワーカーが一度に判定するオブジェクトの数（少なすぎるとスレッドの受け渡しの方が重くなる）
+    const size_t CullChunkSize = 16384;
+
+    bool useAvx2()
+    {
+        const auto& features = getCpuFeatures();
+        return features.avx2 && features.fma;
+    }
+
+    size_t cullChunk(const BoundsView& bounds, const PlaneSet& planes, size_t first, size_t count, uint32_t* visible)
+    {
+#if defined(CULLING_X86)
+        return useAvx2()
+            ? cullRangeAvx2(bounds, planes, first, count, visible)
+            : cullRange<PairOps<Sse2Ops>>(bounds, planes, first, count, visible);
+#elif defined(CULLING_NEON)
+        return cullRange<PairOps<NeonOps>>(bounds, planes, first, count, visible);
+#else
+        return cullRange<ScalarOps>(bounds, planes, first, count, visible);
+#endif
+    }
+}
+
+void CullingBounds::clear()
+{
+    m_sphereX.clear();
+    m_sphereY.clear();
+    m_sphereZ.clear();
+    m_radius.clear();
+    m_boxCenterX.clear();
+    m_boxCenterY.clear();
+    m_boxCenterZ.clear();
+    m_boxExtentX.clear();
+    m_boxExtentY.clear();
+    m_boxExtentZ.clear();
+}
+
+void CullingBounds::reserve(size_t count)
+{
+    m_sphereX.reserve(count);
+    m_sphereY.reserve(count);
+    m_sphereZ.reserve(count);
+    m_radius.reserve(count);
+    m_boxCenterX.reserve(count);
+    m_boxCenterY.reserve(count);
+    m_boxCenterZ.reserve(count);
+    m_boxExtentX.reserve(count);
+    m_boxExtentY.reserve(count);
+    m_boxExtentZ.reserve(count);
+}
+
+uint32_t CullingBounds::add(const glm::vec3& sphereCenter, float sphereRadius, const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    const size_t index = size();
+    m_sphereX.resize(index + 1);
+    m_sphereY.resize(index + 1);
+    m_sphereZ.resize(index + 1);
+    m_radius.resize(index + 1);
+    m_boxCenterX.resize(index + 1);
+    m_boxCenterY.resize(index + 1);
+    m_boxCenterZ.resize(index + 1);
+    m_boxExtentX.resize(index + 1);
+    m_boxExtentY.resize(index + 1);
+    m_boxExtentZ.resize(index + 1);
+    set(uint32_t(index), sphereCenter, sphereRadius, boxMin, boxMax);
+    return uint32_t(index);
+}
+
+uint32_t CullingBounds::add(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    return add((boxMin + boxMax) * 0.5f, glm::length(boxMax - boxMin) * 0.5f, boxMin, boxMax);
+}
+
+void CullingBounds::set(uint32_t index, const glm::vec3& sphereCenter, float sphereRadius, const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    const glm::vec3 center = (boxMin + boxMax) * 0.5f;
+    const glm::vec3 extent = (boxMax - boxMin) * 0.5f;
+    m_sphereX[index] = sphereCenter.x;
+    m_sphereY[index] = sphereCenter.y;
+    m_sphereZ[index] = sphereCenter.z;
+    m_radius[index] = sphereRadius;
+    m_boxCenterX[index] = center.x;
+    m_boxCenterY[index] = center.y;
+    m_boxCenterZ[index] = center.z;
+    m_boxExtentX[index] = extent.x;
+    m_boxExtentY[index] = extent.y;
+    m_boxExtentZ[index] = extent.z;
+}
+
+/// <summary>
+/// 視錐台カリング
+/// 塊ごとに visible の塊の先頭から書いておき、最後に前へ詰める（塊の順に詰めるので番号は昇順のまま）
+/// </summary>
+size_t cullFrustum(const CullingBounds& bounds, const Frustum& frustum, vector<uint32_t>& visible)
+{
+    const size_t count = bounds.size();
+    visible.resize(count);
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    const BoundsView view = {
+        bounds.getSphereX(), bounds.getSphereY(), bounds.getSphereZ(), bounds.getRadius(),
+        bounds.getBoxCenterX(), bounds.getBoxCenterY(), bounds.getBoxCenterZ(),
+        bounds.getBoxExtentX(), bounds.getBoxExtentY(), bounds.getBoxExtentZ(),
+    };
+
+    PlaneSet planes;
+    for (int i = 0; i < 6; ++i)
+    {
+        const glm::vec4& plane = frustum.planes[i];
+        planes.x[i] = plane.x;
+        planes.y[i] = plane.y;
+        planes.z[i] = plane.z;
+        planes.d[i] = plane.w;
+        planes.absX[i] = fabsf(plane.x);
+        planes.absY[i] = fabsf(plane.y);
+        planes.absZ[i] = fabsf(plane.z);
+    }
+
+    const size_t chunkCount = (count + CullChunkSize - 1) / CullChunkSize;
+    uint32_t* out = visible.data();
+    if (chunkCount == 1)
+    {
+        const size_t written = cullChunk(view, planes, 0, count, out);
+        visible.resize(written);
+        return written;
+    }
+
+    vector<size_t> written(chunkCount);
+    parallelFor(chunkCount, [&](size_t chunk) {
+        const size_t first = chunk * CullChunkSize;
+        written[chunk] = cullChunk(view, planes, first, min(CullChunkSize, count - first), out + first);
+    });
+
+    size_t total = written[0];
+    for (size_t chunk = 1; chunk < chunkCount; ++chunk)
+    {
+        memmove(out + total, out + chunk * CullChunkSize, written[chunk] * sizeof(uint32_t));
+        total += written[chunk];
+    }
+    visible.resize(total);
+    return total;
+}
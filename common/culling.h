@@ -0,0 +1,64 @@
+#pragma once
+#include "frustum.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// CPU での視錐台カリング
+/// </summary>
+/// <remarks>
+/// オブジェクトの境界（球と AABB）を要素ごとの配列（SoA）で持ち、AVX2 / SSE2 / NEON のカーネルで
+/// 1 回のループにつき 8 個以上のオブジェクトを 6 枚の平面と判定する。
+/// 球と AABB の両方が平面の内側に掛かっているものを見えるとする（球で大まかに、AABB で細長い物体を絞る）。
+/// 全体は一定数ごとの塊に分けてワーカースレッドで処理し、見えるオブジェクトの番号を昇順に詰めて返す。
+/// </remarks>
+
+/// <summary>
+/// カリングに使うオブジェクトの境界（AABB は中心と半分の大きさで持つ）
+/// </summary>
+class CullingBounds
+{
+public:
+    void clear();
+    void reserve(size_t count);
+
+    // 番号（登録順）を返す
+    uint32_t add(const glm::vec3& sphereCenter, float sphereRadius, const glm::vec3& boxMin, const glm::vec3& boxMax);
+
+    // AABB とそれを囲む球を登録する
+    uint32_t add(const glm::vec3& boxMin, const glm::vec3& boxMax);
+
+    void set(uint32_t index, const glm::vec3& sphereCenter, float sphereRadius, const glm::vec3& boxMin, const glm::vec3& boxMax);
+
+    size_t size() const { return m_radius.size(); }
+
+    // 要素ごとの配列（SIMD のカーネルが読む）
+    const float* getSphereX() const { return m_sphereX.data(); }
+    const float* getSphereY() const { return m_sphereY.data(); }
+    const float* getSphereZ() const { return m_sphereZ.data(); }
+    const float* getRadius() const { return m_radius.data(); }
+    const float* getBoxCenterX() const { return m_boxCenterX.data(); }
+    const float* getBoxCenterY() const { return m_boxCenterY.data(); }
+    const float* getBoxCenterZ() const { return m_boxCenterZ.data(); }
+    const float* getBoxExtentX() const { return m_boxExtentX.data(); }
+    const float* getBoxExtentY() const { return m_boxExtentY.data(); }
+    const float* getBoxExtentZ() const { return m_boxExtentZ.data(); }
+
+private:
+    std::vector<float> m_sphereX;
+    std::vector<float> m_sphereY;
+    std::vector<float> m_sphereZ;
+    std::vector<float> m_radius;
+    std::vector<float> m_boxCenterX;
+    std::vector<float> m_boxCenterY;
+    std::vector<float> m_boxCenterZ;
+    std::vector<float> m_boxExtentX;
+    std::vector<float> m_boxExtentY;
+    std::vector<float> m_boxExtentZ;
+};
+
+// 視錐台に掛かるオブジェクトの番号を昇順に visible へ書き（大きさも合わせる）、その数を返す
+size_t cullFrustum(const CullingBounds& bounds, const Frustum& frustum, std::vector<uint32_t>& visible);
@@ -0,0 +1,20 @@
+// AVX2 / FMA を使う視錐台カリングのカーネル
+// このファイルだけ AVX2 を有効にしてコンパイルする（vcxproj のファイル単位の設定）。
+// 呼び出しは culling.cpp で CPU の対応を確認してから行われる。
+#if !defined(_MSC_VER) && (defined(__x86_64__) || defined(__i386__))
+#pragma GCC target("avx2,fma")
+#endif
+#define CULLING_AVX2
+#include "culling_impl.h"
+
+#ifdef CULLING_X86
+
+namespace culling
+{
+    size_t cullRangeAvx2(const BoundsView& bounds, const PlaneSet& planes, size_t first, size_t count, uint32_t* visible)
+    {
+        return cullRange<Avx2Ops>(bounds, planes, first, count, visible);
+    }
+}
+
+#endif
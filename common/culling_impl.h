@@ -0,0 +1,256 @@
+#pragma once
+// culling.cpp / culling_avx2.cpp の内部実装（他から include しないこと）
+//
+// カーネルは SIMD 命令セットごとの Ops 構造体をテンプレート引数に取り、1 回のループで Ops::Width 個のオブジェクトを判定する。
+// SSE2 / NEON は 4 レーンなので、PairOps で 2 本ずつまとめて 8 個にする（依存の無い命令が並ぶのでパイプラインも埋まりやすい）。
+
+#include "culling.h"
+
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CULLING_X86
+#include <immintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define CULLING_NEON
+#include <arm_neon.h>
+#endif
+
+namespace culling
+{
+    // 境界の配列
+    struct BoundsView
+    {
+        const float* sphereX;
+        const float* sphereY;
+        const float* sphereZ;
+        const float* radius;
+        const float* boxCenterX;
+        const float* boxCenterY;
+        const float* boxCenterZ;
+        const float* boxExtentX;
+        const float* boxExtentY;
+        const float* boxExtentZ;
+    };
+
+    // 平面の成分ごとの値（absX などは AABB の判定に使う法線の絶対値）
+    struct PlaneSet
+    {
+        float x[6];
+        float y[6];
+        float z[6];
+        float d[6];
+        float absX[6];
+        float absY[6];
+        float absZ[6];
+    };
+
+    size_t cullRangeAvx2(const BoundsView& bounds, const PlaneSet& planes, size_t first, size_t count, uint32_t* visible);
+
+// Ops とカーネルはコンパイルオプションの違う 2 つの翻訳単位から使われるので、内部リンケージにしておく
+namespace
+{
+    // ---- スカラー（端数の処理と、SIMD が使えない環境用） ----
+    struct ScalarOps
+    {
+        typedef float F;
+        typedef bool Mask;
+        static const size_t Width = 1;
+
+        static F load(const float* p) { return *p; }
+        static F set1(float v) { return v; }
+        static F add(F a, F b) { return a + b; }
+        static F mul(F a, F b) { return a * b; }
+        static F madd(F a, F b, F c) { return a * b + c; }
+        static Mask allTrue() { return true; }
+        static Mask greaterEqual(F a, F b) { return a >= b; }
+        static Mask maskAnd(Mask a, Mask b) { return a && b; }
+        static uint32_t moveMask(Mask m) { return m ? 1u : 0u; }
+    };
+
+    // ---- 4 レーンの命令を 2 本ずつ使って 8 個にする ----
+    template<class O>
+    struct PairOps
+    {
+        struct F
+        {
+            typename O::F lo;
+            typename O::F hi;
+        };
+        struct Mask
+        {
+            typename O::Mask lo;
+            typename O::Mask hi;
+        };
+        static const size_t Width = O::Width * 2;
+
+        static F load(const float* p) { return { O::load(p), O::load(p + O::Width) }; }
+        static F set1(float v) { return { O::set1(v), O::set1(v) }; }
+        static F add(F a, F b) { return { O::add(a.lo, b.lo), O::add(a.hi, b.hi) }; }
+        static F mul(F a, F b) { return { O::mul(a.lo, b.lo), O::mul(a.hi, b.hi) }; }
+        static F madd(F a, F b, F c) { return { O::madd(a.lo, b.lo, c.lo), O::madd(a.hi, b.hi, c.hi) }; }
+        static Mask allTrue() { return { O::allTrue(), O::allTrue() }; }
+        static Mask greaterEqual(F a, F b) { return { O::greaterEqual(a.lo, b.lo), O::greaterEqual(a.hi, b.hi) }; }
+        static Mask maskAnd(Mask a, Mask b) { return { O::maskAnd(a.lo, b.lo), O::maskAnd(a.hi, b.hi) }; }
+        static uint32_t moveMask(Mask m) { return O::moveMask(m.lo) | (O::moveMask(m.hi) << O::Width); }
+    };
+
+#if defined(CULLING_X86)
+    // ---- SSE2（x64 では常に使える） ----
+    struct Sse2Ops
+    {
+        typedef __m128 F;
+        typedef __m128 Mask;
+        static const size_t Width = 4;
+
+        static F load(const float* p) { return _mm_loadu_ps(p); }
+        static F set1(float v) { return _mm_set1_ps(v); }
+        static F add(F a, F b) { return _mm_add_ps(a, b); }
+        static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+        static F madd(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+        static Mask allTrue() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+        static Mask greaterEqual(F a, F b) { return _mm_cmpge_ps(a, b); }
+        static Mask maskAnd(Mask a, Mask b) { return _mm_and_ps(a, b); }
+        static uint32_t moveMask(Mask m) { return uint32_t(_mm_movemask_ps(m)); }
+    };
+
+#if defined(CULLING_AVX2)
+    // ---- AVX2 / FMA（culling_avx2.cpp でのみ使う） ----
+    struct Avx2Ops
+    {
+        typedef __m256 F;
+        typedef __m256 Mask;
+        static const size_t Width = 8;
+
+        static F load(const float* p) { return _mm256_loadu_ps(p); }
+        static F set1(float v) { return _mm256_set1_ps(v); }
+        static F add(F a, F b) { return _mm256_add_ps(a, b); }
+        static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+        static F madd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+        static Mask allTrue() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+        static Mask greaterEqual(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+        static Mask maskAnd(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+        static uint32_t moveMask(Mask m) { return uint32_t(_mm256_movemask_ps(m)); }
+    };
+#endif
+#elif defined(CULLING_NEON)
+    // ---- NEON ----
+    struct NeonOps
+    {
+        typedef float32x4_t F;
+        typedef uint32x4_t Mask;
+        static const size_t Width = 4;
+
+        static F load(const float* p) { return vld1q_f32(p); }
+        static F set1(float v) { return vdupq_n_f32(v); }
+        static F add(F a, F b) { return vaddq_f32(a, b); }
+        static F mul(F a, F b) { return vmulq_f32(a, b); }
+        static F madd(F a, F b, F c) { return vfmaq_f32(c, a, b); }
+        static Mask allTrue() { return vdupq_n_u32(0xffffffffu); }
+        static Mask greaterEqual(F a, F b) { return vcgeq_f32(a, b); }
+        static Mask maskAnd(Mask a, Mask b) { return vandq_u32(a, b); }
+        static uint32_t moveMask(Mask m)
+        {
+            const uint32_t bits[4] = { 1, 2, 4, 8 };
+            return vaddvq_u32(vandq_u32(m, vld1q_u32(bits)));
+        }
+    };
+#endif
+
+    // 0 でない値の最下位の 1 のビットの位置
+    inline uint32_t countTrailingZeros(uint32_t value)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return uint32_t(index);
+#else
+        return uint32_t(__builtin_ctz(value));
+#endif
+    }
+
+    /// <summary>
+    /// 1 枚の平面の内側に、球と AABB の両方が掛かっているか
+    /// 球：dot(n, center) + d >= -radius
+    /// AABB：dot(n, center) + d + dot(|n|, extent) >= 0（法線の向きに最も遠い頂点が内側にあるか）
+    /// </summary>
+    template<class Ops>
+    inline typename Ops::Mask testPlane(const PlaneSet& planes, int p,
+        typename Ops::F sx, typename Ops::F sy, typename Ops::F sz, typename Ops::F r,
+        typename Ops::F cx, typename Ops::F cy, typename Ops::F cz,
+        typename Ops::F ex, typename Ops::F ey, typename Ops::F ez)
+    {
+        typedef typename Ops::F F;
+        const F nx = Ops::set1(planes.x[p]);
+        const F ny = Ops::set1(planes.y[p]);
+        const F nz = Ops::set1(planes.z[p]);
+        const F d = Ops::set1(planes.d[p]);
+        const F zero = Ops::set1(0.0f);
+
+        const F sphereDistance = Ops::madd(nx, sx, Ops::madd(ny, sy, Ops::madd(nz, sz, Ops::add(d, r))));
+        const F boxDistance = Ops::madd(nx, cx, Ops::madd(ny, cy, Ops::madd(nz, cz, d)));
+        const F boxReach = Ops::madd(Ops::set1(planes.absX[p]), ex,
+            Ops::madd(Ops::set1(planes.absY[p]), ey, Ops::mul(Ops::set1(planes.absZ[p]), ez)));
+        return Ops::maskAnd(Ops::greaterEqual(sphereDistance, zero), Ops::greaterEqual(Ops::add(boxDistance, boxReach), zero));
+    }
+
+    /// <summary>
+    /// [first, first + count) のオブジェクトを判定し、見えるものの番号を visible に詰めて書いてその数を返す
+    /// visible には count 個分の領域が必要
+    /// </summary>
+    template<class Ops>
+    size_t cullRange(const BoundsView& b, const PlaneSet& planes, size_t first, size_t count, uint32_t* visible)
+    {
+        typedef typename Ops::F F;
+        typedef typename Ops::Mask Mask;
+
+        const size_t end = first + count;
+        size_t written = 0;
+        size_t i = first;
+        for (; i + Ops::Width <= end; i += Ops::Width)
+        {
+            const F sx = Ops::load(b.sphereX + i);
+            const F sy = Ops::load(b.sphereY + i);
+            const F sz = Ops::load(b.sphereZ + i);
+            const F r = Ops::load(b.radius + i);
+            const F cx = Ops::load(b.boxCenterX + i);
+            const F cy = Ops::load(b.boxCenterY + i);
+            const F cz = Ops::load(b.boxCenterZ + i);
+            const F ex = Ops::load(b.boxExtentX + i);
+            const F ey = Ops::load(b.boxExtentY + i);
+            const F ez = Ops::load(b.boxExtentZ + i);
+
+            // 平面のループは展開しておく（/O2 では展開されないことがあり、その差が大きい）
+            Mask inside = testPlane<Ops>(planes, 0, sx, sy, sz, r, cx, cy, cz, ex, ey, ez);
+            inside = Ops::maskAnd(inside, testPlane<Ops>(planes, 1, sx, sy, sz, r, cx, cy, cz, ex, ey, ez));
+            inside = Ops::maskAnd(inside, testPlane<Ops>(planes, 2, sx, sy, sz, r, cx, cy, cz, ex, ey, ez));
+            inside = Ops::maskAnd(inside, testPlane<Ops>(planes, 3, sx, sy, sz, r, cx, cy, cz, ex, ey, ez));
+            inside = Ops::maskAnd(inside, testPlane<Ops>(planes, 4, sx, sy, sz, r, cx, cy, cz, ex, ey, ez));
+            inside = Ops::maskAnd(inside, testPlane<Ops>(planes, 5, sx, sy, sz, r, cx, cy, cz, ex, ey, ez));
+
+            // 大半が見えない場面が多いので、全部見えない塊は書き込みを省く
+            const uint32_t mask = Ops::moveMask(inside);
+            if (mask == 0)
+            {
+                continue;
+            }
+            uint32_t remaining = mask;
+            while (remaining != 0)
+            {
+                visible[written++] = uint32_t(i) + countTrailingZeros(remaining);
+                remaining &= remaining - 1;
+            }
+        }
+
+        if (Ops::Width > 1 && i < end)
+        {
+            written += cullRange<ScalarOps>(b, planes, i, end - i, visible + written);
+        }
+        return written;
+    }
+}
+}
@@ -0,0 +1,187 @@
+#include "drawlist.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    // この数以下なら基数ソートのヒストグラムの準備の方が重いので挿入ソートにする
+    const size_t SmallSortCount = 64;
+
+    const int RadixBits = 8;
+    const int RadixBuckets = 1 << RadixBits;
+    const int RadixPasses = 64 / RadixBits;
+
+    bool isSameGeometry(const DrawGeometry& a, const DrawGeometry& b)
+    {
+        if (a.vertexBufferCount != b.vertexBufferCount || a.indexBuffer != b.indexBuffer
+            || a.indexOffset != b.indexOffset || a.indexType != b.indexType)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < a.vertexBufferCount; ++i)
+        {
+            if (a.vertexBuffers[i] != b.vertexBuffers[i] || a.vertexOffsets[i] != b.vertexOffsets[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 描画の範囲（firstIndex, indexCount, vertexOffset）以外が同じなら 1 回のマルチドローにまとめられる
+    bool canMultiDraw(const DrawPacket& a, const DrawPacket& b)
+    {
+        if (a.pipeline != b.pipeline || a.layout != b.layout || a.descriptorSet != b.descriptorSet
+            || a.instanceCount != b.instanceCount || a.firstInstance != b.firstInstance
+            || a.pushConstantSize != b.pushConstantSize || a.pushConstantStages != b.pushConstantStages)
+        {
+            return false;
+        }
+        if (a.geometry != b.geometry && !isSameGeometry(*a.geometry, *b.geometry))
+        {
+            return false;
+        }
+        return a.pushConstants == b.pushConstants || memcmp(a.pushConstants, b.pushConstants, a.pushConstantSize) == 0;
+    }
+}
+
+uint64_t makeDrawKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t depth, uint32_t geometry)
+{
+    return (uint64_t(pass & 0xf) << 60)
+        | (uint64_t(pipeline & 0xfff) << 48)
+        | (uint64_t(material & 0xffff) << 32)
+        | (uint64_t(depth & 0xffff) << 16)
+        | uint64_t(geometry & 0xffff);
+}
+
+uint32_t makeDepthBucket(float depth, float nearZ, float farZ, bool backToFront)
+{
+    float t = (farZ > nearZ) ? (depth - nearZ) / (farZ - nearZ) : 0.0f;
+    t = min(max(t, 0.0f), 1.0f);
+    const uint32_t bucket = uint32_t(t * 65535.0f + 0.5f);
+    return backToFront ? 0xffff - bucket : bucket;
+}
+
+void DrawList::clear()
+{
+    m_items.clear();
+}
+
+void DrawList::reserve(size_t count)
+{
+    m_items.reserve(count);
+    m_scratch.reserve(count);
+}
+
+void DrawList::add(uint64_t key, uint32_t packet)
+{
+    m_items.push_back({ key, packet });
+}
+
+/// <summary>
+/// LSD 基数ソート
+/// 全ての桁のヒストグラムを 1 回の走査で数え、1 つのバケットに全要素が入る桁（パスだけ違うなど）は並べ替えを省く
+/// </summary>
+void DrawList::sort()
+{
+    const size_t count = m_items.size();
+    if (count <= SmallSortCount)
+    {
+        for (size_t i = 1; i < count; ++i)
+        {
+            const Item item = m_items[i];
+            size_t j = i;
+            for (; j > 0 && m_items[j - 1].key > item.key; --j)
+            {
+                m_items[j] = m_items[j - 1];
+            }
+            m_items[j] = item;
+        }
+        return;
+    }
+
+    uint32_t histograms[RadixPasses][RadixBuckets];
+    memset(histograms, 0, sizeof(histograms));
+    for (const auto& item : m_items)
+    {
+        for (int pass = 0; pass < RadixPasses; ++pass)
+        {
+            histograms[pass][(item.key >> (pass * RadixBits)) & (RadixBuckets - 1)]++;
+        }
+    }
+
+    m_scratch.resize(count);
+    Item* src = m_items.data();
+    Item* dst = m_scratch.data();
+    for (int pass = 0; pass < RadixPasses; ++pass)
+    {
+        uint32_t* histogram = histograms[pass];
+        const int shift = pass * RadixBits;
+        if (histogram[(src[0].key >> shift) & (RadixBuckets - 1)] == count)
+        {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (int bucket = 0; bucket < RadixBuckets; ++bucket)
+        {
+            const uint32_t n = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            dst[histogram[(src[i].key >> shift) & (RadixBuckets - 1)]++] = src[i];
+        }
+        swap(src, dst);
+    }
+
+    // 奇数回並べ替えた場合は結果が m_scratch 側にある
+    if (src != m_items.data())
+    {
+        m_items.swap(m_scratch);
+    }
+}
+
+void DrawList::record(CommandRecorder& recorder, const DrawPacket* packets)
+{
+    size_t i = 0;
+    while (i < m_items.size())
+    {
+        const DrawPacket& packet = packets[m_items[i].packet];
+        recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipeline);
+        if (packet.descriptorSet != VK_NULL_HANDLE)
+        {
+            recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, packet.layout, 0, 1, &packet.descriptorSet);
+        }
+
+        const DrawGeometry& geometry = *packet.geometry;
+        recorder.bindVertexBuffers(0, geometry.vertexBufferCount, geometry.vertexBuffers, geometry.vertexOffsets);
+        recorder.bindIndexBuffer(geometry.indexBuffer, geometry.indexOffset, geometry.indexType);
+
+        if (packet.pushConstantSize > 0)
+        {
+            recorder.pushConstants(packet.layout, packet.pushConstantStages, 0, packet.pushConstantSize, packet.pushConstants);
+        }
+
+        // 続く描画のうち状態が同じものを集める
+        m_multiDraws.clear();
+        m_multiDraws.push_back({ packet.firstIndex, packet.indexCount, packet.vertexOffset });
+        size_t end = i + 1;
+        for (; end < m_items.size(); ++end)
+        {
+            const DrawPacket& next = packets[m_items[end].packet];
+            if (!canMultiDraw(packet, next))
+            {
+                break;
+            }
+            m_multiDraws.push_back({ next.firstIndex, next.indexCount, next.vertexOffset });
+        }
+
+        recorder.drawMultiIndexed(uint32_t(m_multiDraws.size()), m_multiDraws.data(), packet.instanceCount, packet.firstInstance);
+        i = end;
+    }
+}
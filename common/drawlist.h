@@ -0,0 +1,91 @@
+#pragma once
+#include "vkappbase.h"
+#include "commandrecorder.h"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// ソートキーで並べ替えてから記録する描画のリスト
+/// </summary>
+/// <remarks>
+/// 描画は 64 ビットのソートキーと、呼び出し側の描画パケット（DrawPacket）の番号の組で登録する。
+/// キーは上位から パス（4）| パイプライン（12）| マテリアル（16）| 深度（16）| ジオメトリ（16）ビットで、
+/// 昇順に並べるとパスごとにパイプラインの切り替えが最も少なくなり、次にデスクリプタ、頂点バッファの順で切り替えが減る。
+/// 並べ替えは 8 ビットずつの LSD 基数ソート（安定）で、全要素で同じ桁の回は省く。
+/// record は CommandRecorder を通して記録するので、直前と同じパイプライン・デスクリプタセット・頂点 / インデックスバッファ・プッシュ定数はセットされない。
+/// 並べた結果、状態（上の全てとインスタンスの範囲）が同じ描画が続けば 1 回の drawMultiIndexed にまとめる。
+/// </remarks>
+
+// 1 つの描画で使う頂点バッファのバインディングの最大数
+const uint32_t MaxDrawVertexBuffers = 4;
+
+/// <summary>
+/// 描画に使う頂点バッファとインデックスバッファの組
+/// </summary>
+struct DrawGeometry
+{
+    uint32_t vertexBufferCount;
+    VkBuffer vertexBuffers[MaxDrawVertexBuffers];
+    VkDeviceSize vertexOffsets[MaxDrawVertexBuffers];
+    VkBuffer indexBuffer;
+    VkDeviceSize indexOffset;
+    VkIndexType indexType;
+};
+
+/// <summary>
+/// 1 回の vkCmdDrawIndexed に必要な状態
+/// geometry と pushConstants は record が終わるまで有効なものを指すこと
+/// descriptorSet が VK_NULL_HANDLE の場合はセット 0 をバインドしない
+/// </summary>
+struct DrawPacket
+{
+    VkPipeline pipeline;
+    VkPipelineLayout layout;
+    VkDescriptorSet descriptorSet;
+    const DrawGeometry* geometry;
+
+    const void* pushConstants;
+    uint32_t pushConstantSize;
+    VkShaderStageFlags pushConstantStages;
+
+    uint32_t indexCount;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t firstInstance;
+};
+
+// 各フィールドは幅を超えた分を切り捨てる
+uint64_t makeDrawKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t depth, uint32_t geometry);
+
+// ビュー空間の深度を [nearZ, farZ] で 16 ビットに量子化する（backToFront なら奥から手前の順に並ぶよう反転する）
+uint32_t makeDepthBucket(float depth, float nearZ, float farZ, bool backToFront);
+
+class DrawList
+{
+public:
+    struct Item
+    {
+        uint64_t key;
+        uint32_t packet;
+    };
+
+    void clear();
+    void reserve(size_t count);
+    void add(uint64_t key, uint32_t packet);
+
+    // キーの昇順に並べ替える（同じキーは登録順）
+    void sort();
+
+    // packets[item.packet] を順に記録する
+    void record(CommandRecorder& recorder, const DrawPacket* packets);
+
+    const std::vector<Item>& getItems() const { return m_items; }
+    size_t size() const { return m_items.size(); }
+
+private:
+    std::vector<Item> m_items;
+    std::vector<Item> m_scratch;
+    std::vector<VkMultiDrawIndexedInfoEXT> m_multiDraws;
+};
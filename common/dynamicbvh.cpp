@@ -0,0 +1,617 @@
+#include "dynamicbvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+    // 探索のスタックの初期の大きさ（回転で高さは概ね log2(葉の数) の 2 倍に収まる）
+    const size_t QueryStackReserve = 64;
+
+    // fat AABB が新しい AABB よりこの倍率の余白以上に大きくなったら、入れ直して縮める
+    const float FatShrinkFactor = 4.0f;
+
+    float surfaceArea(const vec3& boundsMin, const vec3& boundsMax)
+    {
+        const vec3 d = boundsMax - boundsMin;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    float unionArea(const vec3& aMin, const vec3& aMax, const vec3& bMin, const vec3& bMax)
+    {
+        return surfaceArea(min(aMin, bMin), max(aMax, bMax));
+    }
+
+    bool contains(const vec3& outerMin, const vec3& outerMax, const vec3& innerMin, const vec3& innerMax)
+    {
+        return outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z
+            && innerMax.x <= outerMax.x && innerMax.y <= outerMax.y && innerMax.z <= outerMax.z;
+    }
+
+    bool overlaps(const vec3& aMin, const vec3& aMax, const vec3& bMin, const vec3& bMax)
+    {
+        return aMin.x <= bMax.x && bMin.x <= aMax.x
+            && aMin.y <= bMax.y && bMin.y <= aMax.y
+            && aMin.z <= bMax.z && bMin.z <= aMax.z;
+    }
+
+    /// <summary>
+    /// レイと AABB のスラブ法による判定。当たれば入る距離（始点が中にあれば 0）を返す
+    /// </summary>
+    bool intersectRay(const vec3& origin, const vec3& inverseDirection, float maxDistance,
+        const vec3& boundsMin, const vec3& boundsMax, float& distance)
+    {
+        float tMin = 0.0f;
+        float tMax = maxDistance;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float t0 = (boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+            float t1 = (boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+            if (t0 > t1)
+            {
+                swap(t0, t1);
+            }
+            tMin = std::max(tMin, t0);
+            tMax = std::min(tMax, t1);
+            if (tMin > tMax)
+            {
+                return false;
+            }
+        }
+        distance = tMin;
+        return true;
+    }
+}
+
+DynamicBvh::DynamicBvh(float margin, float displacementScale)
+    : m_root(InvalidNode), m_freeList(InvalidNode), m_proxyCount(0), m_margin(margin), m_displacementScale(displacementScale)
+{
+}
+
+void DynamicBvh::clear()
+{
+    m_nodes.clear();
+    m_links.clear();
+    m_root = InvalidNode;
+    m_freeList = InvalidNode;
+    m_proxyCount = 0;
+}
+
+uint32_t DynamicBvh::allocateNode()
+{
+    if (m_freeList == InvalidNode)
+    {
+        m_nodes.push_back(Node{});
+        m_links.push_back({ InvalidNode, -1 });
+        m_freeList = uint32_t(m_nodes.size()) - 1;
+    }
+
+    const uint32_t node = m_freeList;
+    m_freeList = m_links[node].parent;
+    m_nodes[node] = Node{};
+    m_nodes[node].child1 = InvalidNode;
+    m_nodes[node].child2 = InvalidNode;
+    m_links[node] = { InvalidNode, 0 };
+    return node;
+}
+
+void DynamicBvh::freeNode(uint32_t node)
+{
+    m_links[node] = { m_freeList, -1 };
+    m_freeList = node;
+}
+
+BvhProxyId DynamicBvh::createProxy(const vec3& boundsMin, const vec3& boundsMax, uint32_t userData)
+{
+    const uint32_t leaf = allocateNode();
+    m_nodes[leaf].boundsMin = boundsMin - vec3(m_margin);
+    m_nodes[leaf].boundsMax = boundsMax + vec3(m_margin);
+    m_nodes[leaf].child2 = userData;
+    insertLeaf(leaf);
+    m_proxyCount++;
+    return leaf;
+}
+
+void DynamicBvh::destroyProxy(BvhProxyId proxy)
+{
+    removeLeaf(proxy);
+    freeNode(proxy);
+    m_proxyCount--;
+}
+
+bool DynamicBvh::moveProxy(BvhProxyId proxy, const vec3& boundsMin, const vec3& boundsMax, const vec3& displacement)
+{
+    Node& leaf = m_nodes[proxy];
+    if (contains(leaf.boundsMin, leaf.boundsMax, boundsMin, boundsMax))
+    {
+        // 速く動いた後で止まったオブジェクトの fat AABB が大きいままにならないようにする
+        const vec3 hugeMargin(m_margin * FatShrinkFactor + length(displacement) * m_displacementScale);
+        if (contains(boundsMin - hugeMargin, boundsMax + hugeMargin, leaf.boundsMin, leaf.boundsMax))
+        {
+            return false;
+        }
+    }
+
+    removeLeaf(proxy);
+
+    // 移動している方向へ余分に広げておく
+    const vec3 predicted = displacement * m_displacementScale;
+    leaf.boundsMin = boundsMin - vec3(m_margin) + min(predicted, vec3(0.0f));
+    leaf.boundsMax = boundsMax + vec3(m_margin) + max(predicted, vec3(0.0f));
+    insertLeaf(proxy);
+    return true;
+}
+
+void DynamicBvh::getFatBounds(BvhProxyId proxy, vec3& boundsMin, vec3& boundsMax) const
+{
+    boundsMin = m_nodes[proxy].boundsMin;
+    boundsMax = m_nodes[proxy].boundsMax;
+}
+
+/// <summary>
+/// 新しい葉と組にする兄弟を選ぶ
+/// 根から、ここで組にした場合のコストと、子に降りた場合のコストの下限を比べながら降りる
+/// （降りる場合も、このノードの AABB が広がる分は祖先のコストとして必ず掛かる）
+/// </summary>
+uint32_t DynamicBvh::findBestSibling(const vec3& boundsMin, const vec3& boundsMax) const
+{
+    uint32_t index = m_root;
+    while (!isLeaf(index))
+    {
+        const Node& node = m_nodes[index];
+        const float area = surfaceArea(node.boundsMin, node.boundsMax);
+        const float combinedArea = unionArea(node.boundsMin, node.boundsMax, boundsMin, boundsMax);
+
+        // ここで新しい親を作る場合
+        const float cost = 2.0f * combinedArea;
+        const float inheritanceCost = 2.0f * (combinedArea - area);
+
+        float childCosts[2];
+        const uint32_t children[2] = { node.child1, node.child2 };
+        for (int i = 0; i < 2; ++i)
+        {
+            const Node& child = m_nodes[children[i]];
+            const float childArea = unionArea(child.boundsMin, child.boundsMax, boundsMin, boundsMax);
+            childCosts[i] = isLeaf(children[i])
+                ? childArea + inheritanceCost
+                : childArea - surfaceArea(child.boundsMin, child.boundsMax) + inheritanceCost;
+        }
+
+        if (cost < childCosts[0] && cost < childCosts[1])
+        {
+            break;
+        }
+        index = childCosts[0] < childCosts[1] ? children[0] : children[1];
+    }
+    return index;
+}
+
+void DynamicBvh::insertLeaf(uint32_t leaf)
+{
+    if (m_root == InvalidNode)
+    {
+        m_root = leaf;
+        m_links[leaf].parent = InvalidNode;
+        return;
+    }
+
+    const vec3 leafMin = m_nodes[leaf].boundsMin;
+    const vec3 leafMax = m_nodes[leaf].boundsMax;
+    const uint32_t sibling = findBestSibling(leafMin, leafMax);
+
+    // 兄弟の位置に新しい親を作り、兄弟と葉をその子にする
+    const uint32_t oldParent = m_links[sibling].parent;
+    const uint32_t newParent = allocateNode();
+    m_nodes[newParent].boundsMin = min(leafMin, m_nodes[sibling].boundsMin);
+    m_nodes[newParent].boundsMax = max(leafMax, m_nodes[sibling].boundsMax);
+    m_nodes[newParent].child1 = sibling;
+    m_nodes[newParent].child2 = leaf;
+    m_links[newParent] = { oldParent, m_links[sibling].height + 1 };
+    m_links[sibling].parent = newParent;
+    m_links[leaf].parent = newParent;
+
+    if (oldParent == InvalidNode)
+    {
+        m_root = newParent;
+    }
+    else if (m_nodes[oldParent].child1 == sibling)
+    {
+        m_nodes[oldParent].child1 = newParent;
+    }
+    else
+    {
+        m_nodes[oldParent].child2 = newParent;
+    }
+
+    refitAncestors(oldParent);
+}
+
+void DynamicBvh::removeLeaf(uint32_t leaf)
+{
+    if (leaf == m_root)
+    {
+        m_root = InvalidNode;
+        return;
+    }
+
+    // 親を取り除き、兄弟を親の位置に上げる
+    const uint32_t parent = m_links[leaf].parent;
+    const uint32_t grandParent = m_links[parent].parent;
+    const uint32_t sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+    freeNode(parent);
+    m_links[sibling].parent = grandParent;
+
+    if (grandParent == InvalidNode)
+    {
+        m_root = sibling;
+        return;
+    }
+
+    if (m_nodes[grandParent].child1 == parent)
+    {
+        m_nodes[grandParent].child1 = sibling;
+    }
+    else
+    {
+        m_nodes[grandParent].child2 = sibling;
+    }
+    refitAncestors(grandParent);
+}
+
+/// <summary>
+/// node から根まで、回転を試してから AABB と高さを子から求め直す
+/// </summary>
+void DynamicBvh::refitAncestors(uint32_t node)
+{
+    while (node != InvalidNode)
+    {
+        rotate(node);
+
+        Node& n = m_nodes[node];
+        n.boundsMin = min(m_nodes[n.child1].boundsMin, m_nodes[n.child2].boundsMin);
+        n.boundsMax = max(m_nodes[n.child1].boundsMax, m_nodes[n.child2].boundsMax);
+        m_links[node].height = 1 + std::max(m_links[n.child1].height, m_links[n.child2].height);
+        node = m_links[node].parent;
+    }
+}
+
+/// <summary>
+/// 木の回転
+/// node の子 B, C について、B を C の子と、または C を B の子と入れ替えた場合に、
+/// 入れ替え先の子の表面積が最も減るものを行う（node 自身の AABB は変わらない）
+/// </summary>
+void DynamicBvh::rotate(uint32_t node)
+{
+    const uint32_t b = m_nodes[node].child1;
+    const uint32_t c = m_nodes[node].child2;
+    if (m_links[node].height < 2)
+    {
+        return;
+    }
+
+    enum class Rotation
+    {
+        None,
+        BF, // B と C の child1（F）を入れ替える
+        BG, // B と C の child2（G）を入れ替える
+        CD, // C と B の child1（D）を入れ替える
+        CE, // C と B の child2（E）を入れ替える
+    };
+    Rotation best = Rotation::None;
+    float bestCost = 0.0f;
+
+    const Node& nb = m_nodes[b];
+    const Node& nc = m_nodes[c];
+    if (!isLeaf(c))
+    {
+        const float areaC = surfaceArea(nc.boundsMin, nc.boundsMax);
+        const Node& f = m_nodes[nc.child1];
+        const Node& g = m_nodes[nc.child2];
+        const float costBF = unionArea(nb.boundsMin, nb.boundsMax, g.boundsMin, g.boundsMax) - areaC;
+        const float costBG = unionArea(nb.boundsMin, nb.boundsMax, f.boundsMin, f.boundsMax) - areaC;
+        if (costBF < bestCost)
+        {
+            best = Rotation::BF;
+            bestCost = costBF;
+        }
+        if (costBG < bestCost)
+        {
+            best = Rotation::BG;
+            bestCost = costBG;
+        }
+    }
+    if (!isLeaf(b))
+    {
+        const float areaB = surfaceArea(nb.boundsMin, nb.boundsMax);
+        const Node& d = m_nodes[nb.child1];
+        const Node& e = m_nodes[nb.child2];
+        const float costCD = unionArea(nc.boundsMin, nc.boundsMax, e.boundsMin, e.boundsMax) - areaB;
+        const float costCE = unionArea(nc.boundsMin, nc.boundsMax, d.boundsMin, d.boundsMax) - areaB;
+        if (costCD < bestCost)
+        {
+            best = Rotation::CD;
+            bestCost = costCD;
+        }
+        if (costCE < bestCost)
+        {
+            best = Rotation::CE;
+            bestCost = costCE;
+        }
+    }
+    if (best == Rotation::None)
+    {
+        return;
+    }
+
+    // child を parent の子の grandChild と入れ替え、parent の AABB と高さを直す
+    auto swapWithGrandChild = [&](uint32_t child, uint32_t parent, bool first) {
+        Node& p = m_nodes[parent];
+        uint32_t& slot = first ? p.child1 : p.child2;
+        const uint32_t grandChild = slot;
+        slot = child;
+        m_links[child].parent = parent;
+
+        Node& n = m_nodes[node];
+        if (n.child1 == child)
+        {
+            n.child1 = grandChild;
+        }
+        else
+        {
+            n.child2 = grandChild;
+        }
+        m_links[grandChild].parent = node;
+
+        p.boundsMin = min(m_nodes[p.child1].boundsMin, m_nodes[p.child2].boundsMin);
+        p.boundsMax = max(m_nodes[p.child1].boundsMax, m_nodes[p.child2].boundsMax);
+        m_links[parent].height = 1 + std::max(m_links[p.child1].height, m_links[p.child2].height);
+    };
+
+    switch (best)
+    {
+    case Rotation::BF:
+        swapWithGrandChild(b, c, true);
+        break;
+    case Rotation::BG:
+        swapWithGrandChild(b, c, false);
+        break;
+    case Rotation::CD:
+        swapWithGrandChild(c, b, true);
+        break;
+    case Rotation::CE:
+        swapWithGrandChild(c, b, false);
+        break;
+    default:
+        break;
+    }
+}
+
+void DynamicBvh::collectLeaves(uint32_t node, vector<uint32_t>& stack, vector<uint32_t>& userData) const
+{
+    const size_t base = stack.size();
+    stack.push_back(node);
+    while (stack.size() > base)
+    {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+        const Node& n = m_nodes[index];
+        if (n.child1 == InvalidNode)
+        {
+            userData.push_back(n.child2);
+            continue;
+        }
+        stack.push_back(n.child2);
+        stack.push_back(n.child1);
+    }
+}
+
+/// <summary>
+/// 視錐台の判定
+/// ノードごとに、まだ完全に内側と分かっていない平面のビットを持って降りる
+/// </summary>
+void DynamicBvh::queryFrustum(const Frustum& frustum, vector<uint32_t>& userData) const
+{
+    if (m_root == InvalidNode)
+    {
+        return;
+    }
+
+    vec3 absNormals[6];
+    for (int i = 0; i < 6; ++i)
+    {
+        absNormals[i] = abs(vec3(frustum.planes[i]));
+    }
+
+    // (ノード, 調べる平面のビット)
+    vector<uint32_t> stack;
+    vector<uint32_t> leafStack;
+    stack.reserve(QueryStackReserve * 2);
+    stack.push_back(m_root);
+    stack.push_back(0x3f);
+    while (!stack.empty())
+    {
+        uint32_t mask = stack.back();
+        stack.pop_back();
+        const uint32_t index = stack.back();
+        stack.pop_back();
+
+        const Node& n = m_nodes[index];
+        const vec3 center = (n.boundsMin + n.boundsMax) * 0.5f;
+        const vec3 extent = (n.boundsMax - n.boundsMin) * 0.5f;
+        bool outside = false;
+        for (int i = 0; i < 6 && !outside; ++i)
+        {
+            if ((mask & (1u << i)) == 0)
+            {
+                continue;
+            }
+            const vec4& plane = frustum.planes[i];
+            const float d = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            const float r = dot(absNormals[i], extent);
+            if (d + r < 0.0f)
+            {
+                outside = true;
+            }
+            else if (d - r >= 0.0f)
+            {
+                mask &= ~(1u << i);
+            }
+        }
+        if (outside)
+        {
+            continue;
+        }
+
+        if (n.child1 == InvalidNode)
+        {
+            userData.push_back(n.child2);
+        }
+        else if (mask == 0)
+        {
+            collectLeaves(index, leafStack, userData);
+        }
+        else
+        {
+            stack.push_back(n.child2);
+            stack.push_back(mask);
+            stack.push_back(n.child1);
+            stack.push_back(mask);
+        }
+    }
+}
+
+void DynamicBvh::queryOverlap(const vec3& boundsMin, const vec3& boundsMax, vector<uint32_t>& userData) const
+{
+    if (m_root == InvalidNode)
+    {
+        return;
+    }
+
+    vector<uint32_t> stack;
+    stack.reserve(QueryStackReserve);
+    stack.push_back(m_root);
+    while (!stack.empty())
+    {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+
+        const Node& n = m_nodes[index];
+        if (!overlaps(n.boundsMin, n.boundsMax, boundsMin, boundsMax))
+        {
+            continue;
+        }
+        if (n.child1 == InvalidNode)
+        {
+            userData.push_back(n.child2);
+            continue;
+        }
+        stack.push_back(n.child2);
+        stack.push_back(n.child1);
+    }
+}
+
+/// <summary>
+/// レイの判定
+/// 子は両方とも判定し、近い方を後に積んで先に調べる。callback が距離を縮めたら、それより遠いノードは積んであっても飛ばす
+/// </summary>
+void DynamicBvh::raycast(const vec3& origin, const vec3& direction, float maxDistance,
+    const function<float(uint32_t userData, float distance)>& callback) const
+{
+    if (m_root == InvalidNode)
+    {
+        return;
+    }
+
+    // 0 の成分は十分大きな値にして、その軸のスラブを常に満たすか外れるかにする
+    vec3 inverseDirection;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        inverseDirection[axis] = direction[axis] != 0.0f ? 1.0f / direction[axis] : copysign(1e30f, direction[axis]);
+    }
+
+    float distance;
+    if (!intersectRay(origin, inverseDirection, maxDistance, m_nodes[m_root].boundsMin, m_nodes[m_root].boundsMax, distance))
+    {
+        return;
+    }
+
+    // (ノード, 入る距離)
+    vector<pair<uint32_t, float>> stack;
+    stack.reserve(QueryStackReserve);
+    stack.push_back({ m_root, distance });
+    while (!stack.empty())
+    {
+        const auto entry = stack.back();
+        stack.pop_back();
+        if (entry.second > maxDistance)
+        {
+            continue;
+        }
+
+        const Node& n = m_nodes[entry.first];
+        if (n.child1 == InvalidNode)
+        {
+            const float result = callback(n.child2, entry.second);
+            if (result <= 0.0f)
+            {
+                return;
+            }
+            maxDistance = std::min(maxDistance, result);
+            continue;
+        }
+
+        float distance1, distance2;
+        const Node& child1 = m_nodes[n.child1];
+        const Node& child2 = m_nodes[n.child2];
+        const bool hit1 = intersectRay(origin, inverseDirection, maxDistance, child1.boundsMin, child1.boundsMax, distance1);
+        const bool hit2 = intersectRay(origin, inverseDirection, maxDistance, child2.boundsMin, child2.boundsMax, distance2);
+        if (hit1 && hit2)
+        {
+            if (distance1 <= distance2)
+            {
+                stack.push_back({ n.child2, distance2 });
+                stack.push_back({ n.child1, distance1 });
+            }
+            else
+            {
+                stack.push_back({ n.child1, distance1 });
+                stack.push_back({ n.child2, distance2 });
+            }
+        }
+        else if (hit1)
+        {
+            stack.push_back({ n.child1, distance1 });
+        }
+        else if (hit2)
+        {
+            stack.push_back({ n.child2, distance2 });
+        }
+    }
+}
+
+uint32_t DynamicBvh::getHeight() const
+{
+    return m_root != InvalidNode ? uint32_t(m_links[m_root].height) + 1 : 0;
+}
+
+float DynamicBvh::getAreaRatio() const
+{
+    if (m_root == InvalidNode)
+    {
+        return 0.0f;
+    }
+
+    float total = 0.0f;
+    for (uint32_t i = 0; i < uint32_t(m_nodes.size()); ++i)
+    {
+        if (m_links[i].height > 0)
+        {
+            total += surfaceArea(m_nodes[i].boundsMin, m_nodes[i].boundsMax);
+        }
+    }
+    const float rootArea = surfaceArea(m_nodes[m_root].boundsMin, m_nodes[m_root].boundsMax);
+    return rootArea > 0.0f ? total / rootArea : 0.0f;
+}
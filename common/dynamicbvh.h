@@ -0,0 +1,100 @@
+#pragma once
+#include "frustum.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+/// <summary>
+/// 動くオブジェクトの AABB を入れておく動的な BVH（二分木）
+/// </summary>
+/// <remarks>
+/// 葉にはオブジェクトの AABB を余白（margin）で広げた fat AABB を入れる。
+/// 移動しても fat AABB に収まっている間は木を変えず、はみ出した時だけ取り除いて入れ直す。
+/// その時は移動量の分だけ進む方向へ広げておくので、同じ向きに動き続けるオブジェクトも入れ直しが少なくて済む。
+/// 挿入先は表面積のコスト（SAH）で選び、挿入・削除の後は祖先の AABB を直しながら、
+/// 子と孫を入れ替えて表面積が減る場合は入れ替える（木の回転）。
+/// ノードは番号で指す配列に置き、探索で読む AABB と子の番号（32 バイト）と、それ以外（親・高さ）を別の配列に分けている。
+/// 視錐台の判定は、ある平面の完全に内側にあるノードの子ではその平面を調べず、全ての平面の内側なら子孫の葉をそのまま返す。
+/// プロキシの番号は葉のノードの番号で、破棄するまで変わらない。
+/// </remarks>
+
+typedef uint32_t BvhProxyId;
+const BvhProxyId InvalidBvhProxy = ~0u;
+
+class DynamicBvh
+{
+public:
+    // margin: fat AABB の余白、displacementScale: 移動量の何倍を移動方向へ広げておくか
+    DynamicBvh(float margin = 0.1f, float displacementScale = 2.0f);
+
+    void clear();
+
+    BvhProxyId createProxy(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t userData);
+    void destroyProxy(BvhProxyId proxy);
+
+    // 新しい AABB と前回からの移動量。木を作り直した（fat AABB からはみ出した）場合は true
+    bool moveProxy(BvhProxyId proxy, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& displacement);
+
+    uint32_t getUserData(BvhProxyId proxy) const { return m_nodes[proxy].child2; }
+    void getFatBounds(BvhProxyId proxy, glm::vec3& boundsMin, glm::vec3& boundsMax) const;
+
+    // fat AABB が視錐台に掛かるプロキシの userData を追加する
+    void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& userData) const;
+
+    // fat AABB が AABB と重なるプロキシの userData を追加する
+    void queryOverlap(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<uint32_t>& userData) const;
+
+    // origin から direction（正規化しなくてよい。距離は direction の長さを単位とする）に伸ばしたレイが fat AABB に当たったプロキシごとに
+    // callback(userData, 入る距離) を近いノードから順に呼ぶ。callback はオブジェクト自体との判定をして次を返す:
+    //   0: 打ち切る、距離: それより遠いものは調べない（当たった距離を返せば最も近いものが残る）、maxDistance 以上: そのまま続ける
+    void raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+        const std::function<float(uint32_t userData, float distance)>& callback) const;
+
+    size_t getProxyCount() const { return m_proxyCount; }
+
+    // 木の高さ（空なら 0）
+    uint32_t getHeight() const;
+
+    // 内部ノードの表面積の合計と根の表面積の比（SAH の質の目安、小さいほどよい）
+    float getAreaRatio() const;
+
+private:
+    static const uint32_t InvalidNode = ~0u;
+
+    // 探索で読むデータ（32 バイト）
+    struct Node
+    {
+        glm::vec3 boundsMin;
+        uint32_t child1;    // 葉なら InvalidNode
+        glm::vec3 boundsMax;
+        uint32_t child2;    // 葉なら userData
+    };
+
+    // 木を変える時だけ使うデータ
+    struct NodeLink
+    {
+        uint32_t parent;    // 空きのノードでは次の空きのノード
+        int32_t height;     // 葉は 0、空きのノードは -1
+    };
+
+    bool isLeaf(uint32_t node) const { return m_nodes[node].child1 == InvalidNode; }
+    uint32_t allocateNode();
+    void freeNode(uint32_t node);
+    uint32_t findBestSibling(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+    void insertLeaf(uint32_t leaf);
+    void removeLeaf(uint32_t leaf);
+    void refitAncestors(uint32_t node);
+    void rotate(uint32_t node);
+    void collectLeaves(uint32_t node, std::vector<uint32_t>& stack, std::vector<uint32_t>& userData) const;
+
+    std::vector<Node> m_nodes;
+    std::vector<NodeLink> m_links;
+    uint32_t m_root;
+    uint32_t m_freeList;
+    size_t m_proxyCount;
+
+    float m_margin;
+    float m_displacementScale;
+};
@@ -0,0 +1,51 @@
+#include "fixedtimestep.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+FixedTimestep::FixedTimestep()
+    : m_step(1.0 / 60.0)
+    , m_maxSteps(5)
+    , m_accumulator(0.0)
+    , m_stepCount(0)
+    , m_droppedTime(0.0)
+{
+}
+
+void FixedTimestep::initialize(double step, uint32_t maxSteps)
+{
+    m_step = step > 0.0 ? step : 1.0 / 60.0;
+    m_maxSteps = max(maxSteps, 1u);
+    reset();
+}
+
+void FixedTimestep::reset()
+{
+    m_accumulator = 0.0;
+    m_stepCount = 0;
+    m_droppedTime = 0.0;
+}
+
+uint32_t FixedTimestep::advance(double elapsed)
+{
+    m_accumulator += max(elapsed, 0.0);
+
+    uint32_t steps = 0;
+    while (m_accumulator >= m_step && steps < m_maxSteps)
+    {
+        m_accumulator -= m_step;
+        steps++;
+    }
+
+    // 追い付けなかった分は 1 ステップ未満だけ残して捨てる（補間の比が 1 を超えないように）
+    if (m_accumulator >= m_step)
+    {
+        const double kept = fmod(m_accumulator, m_step);
+        m_droppedTime += m_accumulator - kept;
+        m_accumulator = kept;
+    }
+    m_stepCount += steps;
+    return steps;
+}
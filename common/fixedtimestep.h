@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+/// <summary>
+/// 固定の時間刻みでシミュレーションを進めるための時間の積算
+/// </summary>
+/// <remarks>
+/// 毎フレーム実際に経過した時間を advance で積算し、溜まった分だけ刻み幅 step のステップを進める（返した数だけ update を呼ぶ）。
+/// 表示のフレームレートが変わってもシミュレーションの 1 秒あたりのステップ数は変わらないので、
+/// 例えば 144 Hz で描画しても 60 Hz のシミュレーションなら 1 フレームあたり 0 か 1 ステップで済む。
+/// 処理が追い付かず 1 フレームで maxSteps より多く進める必要がある場合は、残りの時間を捨てる
+/// （進めるほど次のフレームが遅れて、さらにステップが増え続けるのを防ぐ。シミュレーションはその分だけゆっくりになる）。
+/// 描画する状態は直前の 2 ステップの状態を getAlpha で補間する（0 なら 1 つ前、1 なら最後のステップの状態）。
+/// 補間するので、描画は最後のステップより最大で 1 ステップ分だけ遅れる。
+/// </remarks>
+class FixedTimestep
+{
+public:
+    FixedTimestep();
+
+    // step は 1 ステップの秒数、maxSteps は 1 回の advance で進める最大のステップ数
+    void initialize(double step, uint32_t maxSteps);
+    void reset();
+
+    // 経過した秒数を積算し、進めるステップの数を返す
+    uint32_t advance(double elapsed);
+
+    float getAlpha() const { return float(m_accumulator / m_step); }
+    double getStep() const { return m_step; }
+
+    // 進めたステップの数の合計と、追い付けずに捨てた時間（秒）
+    uint64_t getStepCount() const { return m_stepCount; }
+    double getDroppedTime() const { return m_droppedTime; }
+
+private:
+    double m_step;
+    uint32_t m_maxSteps;
+    double m_accumulator;
+    uint64_t m_stepCount;
+    double m_droppedTime;
+};
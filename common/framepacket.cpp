@@ -0,0 +1,121 @@
+#include "framepacket.h"
+
+#include <algorithm>
+
+using namespace std;
+
+FramePacketQueue::FramePacketQueue()
+    : m_ready(InvalidFramePacket)
+    , m_droppedCount(0)
+    , m_closed(false)
+{
+}
+
+void FramePacketQueue::initialize(uint32_t packetCount)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_states.assign(min(max(packetCount, 2u), MaxFramePackets), State::Free);
+    m_ready = InvalidFramePacket;
+    m_droppedCount = 0;
+    m_closed = false;
+}
+
+void FramePacketQueue::close()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_closed = true;
+    }
+    m_writable.notify_all();
+    m_readable.notify_all();
+}
+
+uint32_t FramePacketQueue::beginWrite()
+{
+    unique_lock<mutex> lock(m_mutex);
+    uint32_t packet = InvalidFramePacket;
+    m_writable.wait(lock, [&]()
+    {
+        auto it = find(m_states.begin(), m_states.end(), State::Free);
+        packet = it != m_states.end() ? uint32_t(it - m_states.begin()) : InvalidFramePacket;
+        return m_closed || packet != InvalidFramePacket;
+    });
+    if (m_closed)
+    {
+        return InvalidFramePacket;
+    }
+    m_states[packet] = State::Writing;
+    return packet;
+}
+
+void FramePacketQueue::endWrite(uint32_t packet)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_ready != InvalidFramePacket)
+        {
+            m_states[m_ready] = State::Free;
+            m_droppedCount++;
+        }
+        m_states[packet] = State::Ready;
+        m_ready = packet;
+    }
+    m_readable.notify_one();
+}
+
+bool FramePacketQueue::waitForWritable(chrono::milliseconds timeout)
+{
+    unique_lock<mutex> lock(m_mutex);
+    return m_writable.wait_for(lock, timeout, [&]()
+    {
+        return m_closed || find(m_states.begin(), m_states.end(), State::Free) != m_states.end();
+    });
+}
+
+bool FramePacketQueue::waitForConsumed(chrono::milliseconds timeout)
+{
+    unique_lock<mutex> lock(m_mutex);
+    return m_writable.wait_for(lock, timeout, [&]() { return m_closed || m_ready == InvalidFramePacket; });
+}
+
+void FramePacketQueue::waitForIdle()
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_writable.wait(lock, [&]()
+    {
+        return m_closed || (m_ready == InvalidFramePacket && find(m_states.begin(), m_states.end(), State::Reading) == m_states.end());
+    });
+}
+
+uint32_t FramePacketQueue::beginRead()
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_readable.wait(lock, [&]() { return m_closed || m_ready != InvalidFramePacket; });
+    if (m_closed)
+    {
+        return InvalidFramePacket;
+    }
+    const uint32_t packet = m_ready;
+    m_states[packet] = State::Reading;
+    m_ready = InvalidFramePacket;
+    lock.unlock();
+
+    // waitForConsumed で待っている書く側を起こす
+    m_writable.notify_all();
+    return packet;
+}
+
+void FramePacketQueue::endRead(uint32_t packet)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_states[packet] = State::Free;
+    }
+    m_writable.notify_all();
+}
+
+uint64_t FramePacketQueue::getDroppedCount() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_droppedCount;
+}
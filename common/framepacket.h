@@ -0,0 +1,76 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstdint>
+#include <chrono>
+
+// フレームパケットの最大数（トリプルバッファ）
+const uint32_t MaxFramePackets = 3;
+
+/// <summary>
+/// メインスレッドが書いたフレームパケットを描画スレッドへ渡すための、パケットの番号の受け渡し
+/// </summary>
+/// <remarks>
+/// パケットの中身は呼び出し側が番号ごとに持ち、ここでは各番号の状態（空き・書き込み中・書き終わり・読み込み中）だけを管理する。
+/// メインスレッドは beginWrite で空いた番号を受け取って書き、endWrite で渡す。
+/// 描画スレッドは beginRead で最も新しく書き終わった番号を受け取って描き、endRead で返す。
+/// まだ読まれていないパケットがあるうちに次のパケットが書き終わると、古い方は読まずに捨てる（遅れて古い状態を描かない）。
+/// パケットが 3 つなら、読み込み中と書き終わりの他に必ず 1 つ空いているので、beginWrite は待たない（トリプルバッファ）。
+/// 2 つなら、描画スレッドが読み込み中に書き終わったパケットがあると、次の beginWrite はどちらかが空くまで待つ（ダブルバッファ）。
+/// 書く側が描画より速いとパケットを捨て続けて CPU を無駄に使うので、VulkanAppBase::frame は
+/// waitForWritable で空きを、endWrite の前に waitForConsumed で前のパケットが読まれたことを待ち、読まれていないパケットを 1 つまでにする。
+/// どちらも時間を区切って待つので、呼び出し側は待つ間にウィンドウのイベントを処理できる。
+/// close の後は、どちらの begin も待っている場合を含めて InvalidFramePacket を返し、どちらの wait も true を返す。
+/// </remarks>
+class FramePacketQueue
+{
+public:
+    static const uint32_t InvalidFramePacket = ~0u;
+
+    FramePacketQueue();
+
+    // packetCount は 2 か 3
+    void initialize(uint32_t packetCount);
+    void close();
+
+    uint32_t beginWrite();
+    void endWrite(uint32_t packet);
+
+    // 空いたパケットがあるか、close されるまで最大 timeout 待つ（待ち終わらなければ false）
+    bool waitForWritable(std::chrono::milliseconds timeout);
+
+    // 書き終わったパケットが描画スレッドに読まれるか、close されるまで最大 timeout 待つ（待ち終わらなければ false）
+    bool waitForConsumed(std::chrono::milliseconds timeout);
+
+    // 書き終わったパケットがすべて読まれて描き終わるか、close されるまで待つ
+    void waitForIdle();
+
+    uint32_t beginRead();
+    void endRead(uint32_t packet);
+
+    uint32_t getPacketCount() const { return uint32_t(m_states.size()); }
+
+    // 読まれずに捨てたパケットの数
+    uint64_t getDroppedCount() const;
+
+private:
+    enum class State : uint8_t
+    {
+        Free,
+        Writing,
+        Ready,
+        Reading,
+    };
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_writable;
+    std::condition_variable m_readable;
+    std::vector<State> m_states;
+
+    // 書き終わって読まれていないパケット（無ければ InvalidFramePacket）
+    uint32_t m_ready;
+    uint64_t m_droppedCount;
+    bool m_closed;
+};
@@ -0,0 +1,118 @@
+#include "framering.h"
+
+using namespace std;
+
+namespace
+{
+    // 区画の先頭の境界（どの用途のオフセットの制約も満たすよう大きめにする）
+    const VkDeviceSize FrameAlignment = 256;
+
+}
+
+FrameRingBuffer::FrameRingBuffer()
+    : m_device(VK_NULL_HANDLE), m_buffer(VK_NULL_HANDLE), m_memory(VK_NULL_HANDLE), m_mapped(nullptr)
+    , m_frameCount(0), m_frameCapacity(0), m_frameBase(0), m_head(0)
+{
+}
+
+void FrameRingBuffer::initialize(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProps,
+    VkBufferUsageFlags usage, uint32_t frameCount, VkDeviceSize frameCapacity)
+{
+    m_device = device;
+    m_frameCount = frameCount;
+    m_frameCapacity = (frameCapacity + FrameAlignment - 1) / FrameAlignment * FrameAlignment;
+    m_frameBase = 0;
+    m_head = 0;
+
+    VkBufferCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    ci.size = m_frameCapacity * frameCount;
+    ci.usage = usage;
+    ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    vkCreateBuffer(m_device, &ci, nullptr, &m_buffer);
+
+    VkMemoryRequirements reqs;
+    vkGetBufferMemoryRequirements(m_device, m_buffer, &reqs);
+    VkMemoryAllocateInfo ai{};
+    ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    ai.allocationSize = reqs.size;
+
+    // GPU から直接読めるメモリにホストから書ければ、転送を挟まずに済む
+    const VkMemoryPropertyFlags hostProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    // そのヒープが小さくて確保できなければ、そのメモリタイプを除いて探し直す
+    uint32_t memoryTypeBits = reqs.memoryTypeBits;
+    ai.memoryTypeIndex = findMemoryType(memProps, memoryTypeBits, hostProps | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (ai.memoryTypeIndex == ~0u || vkAllocateMemory(m_device, &ai, nullptr, &m_memory) != VK_SUCCESS)
+    {
+        if (ai.memoryTypeIndex != ~0u)
+        {
+            memoryTypeBits &= ~(1u << ai.memoryTypeIndex);
+        }
+        ai.memoryTypeIndex = findMemoryType(memProps, memoryTypeBits, hostProps);
+        if (ai.memoryTypeIndex == ~0u)
+        {
+            // 容量を 0 にしておき、allocate が常に失敗するようにする
+            OutputDebugStringA("FrameRingBuffer: no host-visible memory type.\n");
+            vkDestroyBuffer(m_device, m_buffer, nullptr);
+            m_buffer = VK_NULL_HANDLE;
+            m_device = VK_NULL_HANDLE;
+            m_frameCapacity = 0;
+            return;
+        }
+        vkAllocateMemory(m_device, &ai, nullptr, &m_memory);
+    }
+    vkBindBufferMemory(m_device, m_buffer, m_memory, 0);
+
+    void* p;
+    vkMapMemory(m_device, m_memory, 0, VK_WHOLE_SIZE, 0, &p);
+    m_mapped = static_cast<uint8_t*>(p);
+}
+
+void FrameRingBuffer::terminate()
+{
+    if (m_device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    vkUnmapMemory(m_device, m_memory);
+    vkFreeMemory(m_device, m_memory, nullptr);
+    vkDestroyBuffer(m_device, m_buffer, nullptr);
+
+    m_device = VK_NULL_HANDLE;
+    m_buffer = VK_NULL_HANDLE;
+    m_memory = VK_NULL_HANDLE;
+    m_mapped = nullptr;
+}
+
+/// <summary>
+/// フレームの区画を切り替えて空にする
+/// </summary>
+void FrameRingBuffer::beginFrame(uint32_t frameIndex)
+{
+    m_frameBase = m_frameCapacity * (frameIndex % m_frameCount);
+    m_head.store(0, memory_order_relaxed);
+}
+
+/// <summary>
+/// 現在のフレームの区画から領域を切り出す（ロックを取らずに先頭位置を進めるだけ）
+/// </summary>
+bool FrameRingBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment, FrameAllocation& allocation)
+{
+    auto head = m_head.load(memory_order_relaxed);
+    VkDeviceSize offset;
+    do
+    {
+        offset = (head + alignment - 1) / alignment * alignment;
+        if (offset + size > m_frameCapacity)
+        {
+            return false;
+        }
+    } while (!m_head.compare_exchange_weak(head, offset + size, memory_order_relaxed));
+
+    allocation.data = m_mapped + m_frameBase + offset;
+    allocation.buffer = m_buffer;
+    allocation.offset = m_frameBase + offset;
+    allocation.size = size;
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "vkappbase.h"
+
+#include <atomic>
+#include <cstdint>
+
+/// <summary>
+/// フレームごとのバッファ上に確保した領域
+/// data は永続的にマップされたメモリを指すので、そのまま書き込んでよい
+/// </summary>
+struct FrameAllocation
+{
+    void* data;
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+/// <summary>
+/// 毎フレーム CPU から書き換えるデータ（インスタンスの変換など）のためのリングバッファ
+/// </summary>
+/// <remarks>
+/// 1 つのバッファをフレーム数（スワップチェインのイメージ数）の区画に分け、
+/// beginFrame で指定したフレームの区画を先頭から線形に確保する。
+/// その区画を前回使ったコマンドバッファのフェンスを待ってから beginFrame を呼ぶこと
+/// （VulkanAppBase::render は makeCommand の前にフェンスを待つので、makeCommand の中で m_imageIndex を渡せばよい）。
+/// メモリはホストから見えてコヒーレントなもので、デバイスローカルなもの（Resizable BAR など）があればそちらを使う。
+/// allocate は複数のスレッドから同時に呼んでよい。
+/// </remarks>
+class FrameRingBuffer
+{
+public:
+    FrameRingBuffer();
+
+    void initialize(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProps,
+        VkBufferUsageFlags usage, uint32_t frameCount, VkDeviceSize frameCapacity);
+    void terminate();
+
+    void beginFrame(uint32_t frameIndex);
+
+    // 現在のフレームの区画に空きがなければ false を返す
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, FrameAllocation& allocation);
+
+    VkBuffer getBuffer() const { return m_buffer; }
+    VkDeviceSize getFrameCapacity() const { return m_frameCapacity; }
+    uint32_t getFrameCount() const { return m_frameCount; }
+
+private:
+    VkDevice m_device;
+    VkBuffer m_buffer;
+    VkDeviceMemory m_memory;
+    uint8_t* m_mapped;
+
+    uint32_t m_frameCount;
+    VkDeviceSize m_frameCapacity;
+    VkDeviceSize m_frameBase;
+    std::atomic<VkDeviceSize> m_head;
+};
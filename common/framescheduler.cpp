@@ -0,0 +1,148 @@
+#include "framescheduler.h"
+#include "vkappbase.h"
+
+#include <mmsystem.h>
+#include <thread>
+#include <cmath>
+
+#pragma comment(lib, "winmm.lib")
+
+using namespace std;
+
+namespace
+{
+    // スリープにかかった時間の平均と分散を更新する重み（最近の値ほど重くする）
+    const double SleepEstimateWeight = 0.05;
+
+    // OnDemand で要求が無くても起きる既定の間隔（秒）
+    const double DefaultMaxIdleTime = 1.0;
+
+    FrameScheduler* getScheduler(GLFWwindow* window)
+    {
+        return static_cast<FrameScheduler*>(glfwGetWindowUserPointer(window));
+    }
+}
+
+FrameScheduler::FrameScheduler()
+    : m_schedule(FrameSchedule::Continuous)
+    , m_maxIdleTime(DefaultMaxIdleTime)
+    , m_requested(true)
+    , m_frameInterval(Clock::duration::zero())
+    , m_timerPeriodSet(false)
+    , m_sleepMean(0.002)
+    , m_sleepVariance(0.0)
+{
+}
+
+void FrameScheduler::initialize(GLFWwindow* window)
+{
+    glfwSetWindowUserPointer(window, this);
+    glfwSetWindowRefreshCallback(window, [](GLFWwindow* w) { getScheduler(w)->requestFrame(); });
+    glfwSetFramebufferSizeCallback(window, [](GLFWwindow* w, int, int) { getScheduler(w)->requestFrame(); });
+    glfwSetWindowFocusCallback(window, [](GLFWwindow* w, int) { getScheduler(w)->requestFrame(); });
+    glfwSetKeyCallback(window, [](GLFWwindow* w, int, int, int, int) { getScheduler(w)->requestFrame(); });
+    glfwSetCharCallback(window, [](GLFWwindow* w, unsigned int) { getScheduler(w)->requestFrame(); });
+    glfwSetMouseButtonCallback(window, [](GLFWwindow* w, int, int, int) { getScheduler(w)->requestFrame(); });
+    glfwSetCursorPosCallback(window, [](GLFWwindow* w, double, double) { getScheduler(w)->requestFrame(); });
+    glfwSetScrollCallback(window, [](GLFWwindow* w, double, double) { getScheduler(w)->requestFrame(); });
+    m_requested = true;
+    m_nextFrame = Clock::now();
+}
+
+void FrameScheduler::terminate()
+{
+    if (m_timerPeriodSet)
+    {
+        timeEndPeriod(1);
+        m_timerPeriodSet = false;
+    }
+}
+
+void FrameScheduler::setTargetFrameRate(double frameRate)
+{
+    m_frameInterval = frameRate > 0.0
+        ? chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / frameRate))
+        : Clock::duration::zero();
+    m_nextFrame = Clock::now();
+
+    // スリープの分解能を 1 ms にする（既定は 15.6 ms 程度で、見込む誤差が大きくなり回って待つ時間が増える）
+    if (frameRate > 0.0 && !m_timerPeriodSet)
+    {
+        m_timerPeriodSet = timeBeginPeriod(1) == TIMERR_NOERROR;
+    }
+}
+
+void FrameScheduler::requestFrame()
+{
+    // 既に要求されていれば、眠っているメインループはもう起こしてある
+    if (!m_requested.exchange(true))
+    {
+        glfwPostEmptyEvent();
+    }
+}
+
+/// <summary>
+/// イベントを処理し、次のフレームを処理する時刻まで待つ
+/// OnDemand で要求が無いまま m_maxIdleTime が過ぎた場合は false を返す
+/// </summary>
+bool FrameScheduler::waitForFrame()
+{
+    glfwPollEvents();
+    if (m_schedule == FrameSchedule::OnDemand)
+    {
+        if (!m_requested)
+        {
+            glfwWaitEventsTimeout(m_maxIdleTime);
+        }
+        if (!m_requested.exchange(false))
+        {
+            return false;
+        }
+    }
+    pace();
+    return true;
+}
+
+void FrameScheduler::pace()
+{
+    if (m_frameInterval == Clock::duration::zero())
+    {
+        return;
+    }
+
+    const auto now = Clock::now();
+    if (now >= m_nextFrame)
+    {
+        // 1 フレーム以上遅れていれば、まとめて取り戻さずに今から数え直す
+        m_nextFrame = now - m_nextFrame > m_frameInterval ? now + m_frameInterval : m_nextFrame + m_frameInterval;
+        return;
+    }
+    sleepUntil(m_nextFrame);
+    m_nextFrame += m_frameInterval;
+}
+
+void FrameScheduler::sleepUntil(Clock::time_point target)
+{
+    for (;;)
+    {
+        const auto start = Clock::now();
+        const double remaining = chrono::duration<double>(target - start).count();
+        if (remaining <= m_sleepMean + sqrt(m_sleepVariance))
+        {
+            break;
+        }
+
+        this_thread::sleep_for(chrono::milliseconds(1));
+
+        const double observed = chrono::duration<double>(Clock::now() - start).count();
+        const double delta = observed - m_sleepMean;
+        m_sleepMean += SleepEstimateWeight * delta;
+        m_sleepVariance = (1.0 - SleepEstimateWeight) * (m_sleepVariance + SleepEstimateWeight * delta * delta);
+    }
+
+    // 残りは回って待つ
+    while (Clock::now() < target)
+    {
+        YieldProcessor();
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+struct GLFWwindow;
+
+enum class FrameSchedule
+{
+    // 毎フレーム描画する
+    Continuous,
+
+    // requestFrame か入力・ウィンドウの変化があった時だけ描画する
+    OnDemand,
+};
+
+/// <summary>
+/// メインループで次のフレームをいつ処理するかを決める
+/// </summary>
+/// <remarks>
+/// waitForFrame でウィンドウのイベントを処理し、次のフレームを処理すべきなら true を返す。
+/// OnDemand では要求が無ければ glfwWaitEventsTimeout で眠るので、変化の無い間は CPU も GPU もほとんど使わない。
+/// 入力（キー・マウス・スクロール）とウィンドウの変化（再描画・大きさ・フォーカス）は、initialize で設定するコールバックが要求にする
+/// （ウィンドウのユーザーポインタとこれらのコールバックを使うので、アプリケーションは別に設定しないこと）。
+/// 目標のフレームレートを設定すると、どちらのモードでもフレームの間隔をそれに合わせる。
+/// 待ち方は、OS のスリープの誤差を見込んで間に合う所まで 1 ms ずつ眠り、残りは回って待つ。
+/// スリープにかかった時間の平均と標準偏差を覚えておき、残りがその和より短くなったら眠らない（1 ms 未満の精度になる）。
+/// 処理が目標の間隔より 1 フレーム以上遅れた場合は、取り戻そうとせずそこから数え直す。
+/// </remarks>
+class FrameScheduler
+{
+public:
+    FrameScheduler();
+
+    void initialize(GLFWwindow* window);
+    void terminate();
+
+    void setSchedule(FrameSchedule schedule) { m_schedule = schedule; }
+
+    // 1 秒あたりのフレーム数の上限（0 なら上限なし。FIFO の present なら表示に合わせて待つ）
+    void setTargetFrameRate(double frameRate);
+
+    // OnDemand で要求が無くても起きる間隔（秒）
+    void setMaxIdleTime(double seconds) { m_maxIdleTime = seconds; }
+
+    // 次のフレームを処理するよう要求する（どのスレッドから呼んでもよい）
+    void requestFrame();
+
+    bool waitForFrame();
+
+    FrameSchedule getSchedule() const { return m_schedule; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    void pace();
+    void sleepUntil(Clock::time_point target);
+
+    FrameSchedule m_schedule;
+    double m_maxIdleTime;
+    std::atomic<bool> m_requested;
+
+    Clock::duration m_frameInterval;
+    Clock::time_point m_nextFrame;
+    bool m_timerPeriodSet;
+
+    // 1 ms のスリープに実際にかかった時間（秒）の平均と分散
+    double m_sleepMean;
+    double m_sleepVariance;
+};
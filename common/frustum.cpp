@@ -0,0 +1,48 @@
+#include "frustum.h"
+
+#include <cmath>
+
+using namespace glm;
+
+/// <summary>
+/// クリップ空間の条件 -w <= x <= w, -w <= y <= w, 0 <= z <= w を行列の行で表す（Gribb / Hartmann の方法）
+/// </summary>
+Frustum makeFrustum(const mat4& viewProjection)
+{
+    // glm の行列は列優先なので、行 i は (m[0][i], m[1][i], m[2][i], m[3][i])
+    vec4 rows[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        rows[i] = vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    }
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];
+    frustum.planes[1] = rows[3] - rows[0];
+    frustum.planes[2] = rows[3] + rows[1];
+    frustum.planes[3] = rows[3] - rows[1];
+    frustum.planes[4] = rows[2];
+    frustum.planes[5] = rows[3] - rows[2];
+
+    for (auto& plane : frustum.planes)
+    {
+        float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+        if (length > 0.0f)
+        {
+            plane = plane * (1.0f / length);
+        }
+    }
+    return frustum;
+}
+
+bool isSphereVisible(const Frustum& frustum, const vec3& center, float radius)
+{
+    for (const auto& plane : frustum.planes)
+    {
+        if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "glm/glm.hpp"
+
+/// <summary>
+/// 視錐台を 6 枚の平面で表したもの
+/// 平面は (法線, d) で、dot(normal, p) + d >= 0 の側が内側。法線は正規化してある
+/// 並びは左・右・下・上・近・遠
+/// </summary>
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+// ビュー射影行列から視錐台の平面を取り出す（Vulkan のクリップ空間、z は [0, w]）
+Frustum makeFrustum(const glm::mat4& viewProjection);
+
+// 球が視錐台と交わる（または内側にある）か。平面ごとの判定なので、角の近くでは外側でも true になることがある
+bool isSphereVisible(const Frustum& frustum, const glm::vec3& center, float radius);
@@ -0,0 +1,342 @@
+#include "geometrypool.h"
+#include "meshoptimizer.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    // 頂点入力・インデックスとしての使用に加えて、転送とコンピュートシェーダからの読み込み（カリングなど）に使う
+    const VkBufferUsageFlags PoolBufferUsage =
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+}
+
+void GeometryPool::RangeAllocator::reset(uint32_t capacity)
+{
+    m_free.clear();
+    if (capacity > 0)
+    {
+        m_free.push_back({ 0, capacity });
+    }
+    m_freeCount = capacity;
+}
+
+bool GeometryPool::RangeAllocator::allocate(uint32_t count, uint32_t& offset)
+{
+    if (count == 0)
+    {
+        offset = 0;
+        return true;
+    }
+
+    for (size_t i = 0; i < m_free.size(); ++i)
+    {
+        auto& span = m_free[i];
+        if (span.count < count)
+        {
+            continue;
+        }
+
+        offset = span.offset;
+        span.offset += count;
+        span.count -= count;
+        if (span.count == 0)
+        {
+            m_free.erase(m_free.begin() + i);
+        }
+        m_freeCount -= count;
+        return true;
+    }
+    return false;
+}
+
+void GeometryPool::RangeAllocator::free(uint32_t offset, uint32_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    // 前後の空きと隣り合っていれば結合する
+    auto next = lower_bound(m_free.begin(), m_free.end(), offset, [](const Span& span, uint32_t value) { return span.offset < value; });
+    const bool mergePrev = next != m_free.begin() && prev(next)->offset + prev(next)->count == offset;
+    const bool mergeNext = next != m_free.end() && offset + count == next->offset;
+    if (mergePrev && mergeNext)
+    {
+        prev(next)->count += count + next->count;
+        m_free.erase(next);
+    }
+    else if (mergePrev)
+    {
+        prev(next)->count += count;
+    }
+    else if (mergeNext)
+    {
+        next->offset = offset;
+        next->count += count;
+    }
+    else
+    {
+        m_free.insert(next, { offset, count });
+    }
+    m_freeCount += count;
+}
+
+void GeometryPool::RangeAllocator::resetPacked(uint32_t capacity, uint32_t used)
+{
+    m_free.clear();
+    if (used < capacity)
+    {
+        m_free.push_back({ used, capacity - used });
+    }
+    m_freeCount = capacity - used;
+}
+
+GeometryPool::GeometryPool()
+    : m_device(VK_NULL_HANDLE), m_memProps{}, m_getDeviceAddress(nullptr), m_vertexStride(0), m_indexType(VK_INDEX_TYPE_UINT32), m_indexSize(4)
+    , m_vertexCapacity(0), m_indexCapacity(0), m_vertexBuffer{}, m_indexBuffer{}
+{
+    m_vertexSpace.reset(0);
+    m_indexSpace.reset(0);
+}
+
+void GeometryPool::initialize(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProps,
+    uint32_t vertexStride, VkIndexType indexType, uint32_t vertexCapacity, uint32_t indexCapacity,
+    PFN_vkGetBufferDeviceAddressKHR getDeviceAddress)
+{
+    m_device = device;
+    m_memProps = memProps;
+    m_getDeviceAddress = getDeviceAddress;
+    m_vertexStride = vertexStride;
+    m_indexType = indexType;
+    m_indexSize = uint32_t(getIndexSize(indexType));
+    m_vertexCapacity = vertexCapacity;
+    m_indexCapacity = indexCapacity;
+
+    m_vertexBuffer = createBuffer(VkDeviceSize(vertexCapacity) * vertexStride, PoolBufferUsage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    m_indexBuffer = createBuffer(VkDeviceSize(indexCapacity) * m_indexSize, PoolBufferUsage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    if (m_vertexBuffer.buffer == VK_NULL_HANDLE || m_indexBuffer.buffer == VK_NULL_HANDLE)
+    {
+        // 確保できなければ空のプールにして、allocate が常に失敗するようにする
+        destroyBuffer(m_vertexBuffer);
+        destroyBuffer(m_indexBuffer);
+        m_vertexCapacity = m_indexCapacity = 0;
+        vertexCapacity = indexCapacity = 0;
+    }
+    m_vertexSpace.reset(vertexCapacity);
+    m_indexSpace.reset(indexCapacity);
+    m_ranges.clear();
+    m_live.clear();
+    m_freeIds.clear();
+}
+
+void GeometryPool::terminate()
+{
+    if (m_device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    destroyBuffer(m_vertexBuffer);
+    destroyBuffer(m_indexBuffer);
+    m_vertexSpace.reset(0);
+    m_indexSpace.reset(0);
+    m_ranges.clear();
+    m_live.clear();
+    m_freeIds.clear();
+    m_device = VK_NULL_HANDLE;
+}
+
+GeometryId GeometryPool::allocate(uint32_t vertexCount, uint32_t indexCount)
+{
+    uint32_t vertexOffset, firstIndex;
+    if (!m_vertexSpace.allocate(vertexCount, vertexOffset))
+    {
+        return InvalidGeometryId;
+    }
+    if (!m_indexSpace.allocate(indexCount, firstIndex))
+    {
+        m_vertexSpace.free(vertexOffset, vertexCount);
+        return InvalidGeometryId;
+    }
+
+    GeometryId id;
+    if (!m_freeIds.empty())
+    {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+    }
+    else
+    {
+        id = GeometryId(m_ranges.size());
+        m_ranges.emplace_back();
+        m_live.push_back(false);
+    }
+    m_ranges[id] = { int32_t(vertexOffset), vertexCount, firstIndex, indexCount };
+    m_live[id] = true;
+    return id;
+}
+
+void GeometryPool::free(GeometryId id)
+{
+    if (id >= m_ranges.size() || !m_live[id])
+    {
+        return;
+    }
+
+    const auto& range = m_ranges[id];
+    m_vertexSpace.free(uint32_t(range.vertexOffset), range.vertexCount);
+    m_indexSpace.free(range.firstIndex, range.indexCount);
+    m_ranges[id] = GeometryRange{};
+    m_live[id] = false;
+    m_freeIds.push_back(id);
+}
+
+bool GeometryPool::upload(UploadScheduler& uploader, GeometryId id, const void* vertices, const void* indices)
+{
+    const auto& range = m_ranges[id];
+    bool succeeded = true;
+    if (range.vertexCount > 0)
+    {
+        succeeded &= uploader.upload(vertices, VkDeviceSize(range.vertexCount) * m_vertexStride, m_vertexBuffer.buffer, getVertexByteOffset(id));
+    }
+    if (range.indexCount > 0)
+    {
+        succeeded &= uploader.upload(indices, VkDeviceSize(range.indexCount) * m_indexSize, m_indexBuffer.buffer, getIndexByteOffset(id));
+    }
+    return succeeded;
+}
+
+bool GeometryPool::fitsAfterCompaction(uint32_t vertexCount, uint32_t indexCount) const
+{
+    return vertexCount <= m_vertexSpace.getFreeCount() && indexCount <= m_indexSpace.getFreeCount();
+}
+
+/// <summary>
+/// 使用中の領域を今の位置の順のまま先頭から詰め直す
+/// 同じバッファの中で重なる範囲はコピーできないので、新しいバッファを作ってそちらへ詰めてから古いものを捨てる
+/// </summary>
+bool GeometryPool::compact(UploadScheduler& uploader)
+{
+    // 先に登録されている転送を古いバッファへ反映させておく
+    bool succeeded = uploader.flush();
+
+    vector<GeometryId> live;
+    for (GeometryId id = 0; id < GeometryId(m_ranges.size()); ++id)
+    {
+        if (m_live[id])
+        {
+            live.push_back(id);
+        }
+    }
+
+    Buffer vertexBuffer = createBuffer(VkDeviceSize(m_vertexCapacity) * m_vertexStride, PoolBufferUsage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    Buffer indexBuffer = createBuffer(VkDeviceSize(m_indexCapacity) * m_indexSize, PoolBufferUsage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    if (vertexBuffer.buffer == VK_NULL_HANDLE || indexBuffer.buffer == VK_NULL_HANDLE)
+    {
+        // 今のバッファと配置はそのまま使い続ける
+        destroyBuffer(vertexBuffer);
+        destroyBuffer(indexBuffer);
+        return false;
+    }
+
+    // 頂点とインデックスはそれぞれ元の位置の順に詰める
+    sort(live.begin(), live.end(), [&](GeometryId a, GeometryId b) { return m_ranges[a].vertexOffset < m_ranges[b].vertexOffset; });
+    uint32_t vertexHead = 0;
+    for (auto id : live)
+    {
+        auto& range = m_ranges[id];
+        if (range.vertexCount > 0)
+        {
+            const VkBufferCopy region = {
+                VkDeviceSize(range.vertexOffset) * m_vertexStride, VkDeviceSize(vertexHead) * m_vertexStride, VkDeviceSize(range.vertexCount) * m_vertexStride };
+            uploader.copyBuffer(m_vertexBuffer.buffer, vertexBuffer.buffer, region);
+        }
+        range.vertexOffset = int32_t(vertexHead);
+        vertexHead += range.vertexCount;
+    }
+
+    sort(live.begin(), live.end(), [&](GeometryId a, GeometryId b) { return m_ranges[a].firstIndex < m_ranges[b].firstIndex; });
+    uint32_t indexHead = 0;
+    for (auto id : live)
+    {
+        auto& range = m_ranges[id];
+        if (range.indexCount > 0)
+        {
+            const VkBufferCopy region = {
+                VkDeviceSize(range.firstIndex) * m_indexSize, VkDeviceSize(indexHead) * m_indexSize, VkDeviceSize(range.indexCount) * m_indexSize };
+            uploader.copyBuffer(m_indexBuffer.buffer, indexBuffer.buffer, region);
+        }
+        range.firstIndex = indexHead;
+        indexHead += range.indexCount;
+    }
+
+    succeeded &= uploader.flush();
+
+    destroyBuffer(m_vertexBuffer);
+    destroyBuffer(m_indexBuffer);
+    m_vertexBuffer = vertexBuffer;
+    m_indexBuffer = indexBuffer;
+    m_vertexSpace.resetPacked(m_vertexCapacity, vertexHead);
+    m_indexSpace.resetPacked(m_indexCapacity, indexHead);
+    return succeeded;
+}
+
+GeometryPool::Buffer GeometryPool::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage)
+{
+    Buffer obj{};
+    VkBufferCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    ci.size = max<VkDeviceSize>(size, 16);
+    ci.usage = usage;
+    if (m_getDeviceAddress != nullptr)
+    {
+        ci.usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR;
+    }
+    ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    vkCreateBuffer(m_device, &ci, nullptr, &obj.buffer);
+
+    VkMemoryRequirements reqs;
+    vkGetBufferMemoryRequirements(m_device, obj.buffer, &reqs);
+    VkMemoryAllocateInfo ai{};
+    ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    ai.allocationSize = reqs.size;
+    ai.memoryTypeIndex = findMemoryType(m_memProps, reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (ai.memoryTypeIndex == ~0u)
+    {
+        OutputDebugStringA("GeometryPool: no device-local memory type for the pool buffers.\n");
+        vkDestroyBuffer(m_device, obj.buffer, nullptr);
+        return Buffer{};
+    }
+
+    // デバイスアドレスを取るバッファのメモリは、そのためのフラグを付けて確保する
+    VkMemoryAllocateFlagsInfo flagsInfo{};
+    flagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+    flagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+    if (m_getDeviceAddress != nullptr)
+    {
+        ai.pNext = &flagsInfo;
+    }
+    vkAllocateMemory(m_device, &ai, nullptr, &obj.memory);
+    vkBindBufferMemory(m_device, obj.buffer, obj.memory, 0);
+
+    if (m_getDeviceAddress != nullptr)
+    {
+        VkBufferDeviceAddressInfoKHR addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR;
+        addressInfo.buffer = obj.buffer;
+        obj.address = m_getDeviceAddress(m_device, &addressInfo);
+    }
+    return obj;
+}
+
+void GeometryPool::destroyBuffer(Buffer& buffer)
+{
+    if (buffer.buffer != VK_NULL_HANDLE)
+    {
+        vkDestroyBuffer(m_device, buffer.buffer, nullptr);
+        vkFreeMemory(m_device, buffer.memory, nullptr);
+    }
+    buffer = Buffer{};
+}
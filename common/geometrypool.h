@@ -0,0 +1,133 @@
+#pragma once
+#include "vkappbase.h"
+#include "staging.h"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// シーン全体のメッシュを 1 組の頂点バッファとインデックスバッファにまとめて置くプール
+/// </summary>
+/// <remarks>
+/// デバイスローカルの大きな頂点バッファとインデックスバッファを 1 つずつ作り、メッシュごとに領域を切り出す。
+/// メッシュは (firstIndex, vertexOffset, indexCount) で指すので、バッファのバインドは 1 回で済み、
+/// マルチドローや間接描画でも同じバッファのまま描画できる。
+/// 解放した領域は空きリストに戻して再利用する（隣り合う空きは結合する）。
+/// 空きが断片化して確保できなくなったら compact で使用中の領域を先頭から詰める。
+/// 詰めると領域の位置が変わるので、GeometryId から getRange で取り直すこと。
+/// initialize に vkGetBufferDeviceAddressKHR を渡すと、バッファをデバイスアドレスで読めるように作る（バーテックスプリング用）。
+/// 頂点の大きさとインデックスの型はプール全体で 1 つ。16 ビットのインデックスでも、
+/// 各メッシュの頂点数が 65535 以下なら vertexOffset で全体のどこにでも置ける。
+/// </remarks>
+
+typedef uint32_t GeometryId;
+const GeometryId InvalidGeometryId = ~0u;
+
+/// <summary>
+/// メッシュに割り当てた領域（頂点とインデックスの単位）
+/// </summary>
+struct GeometryRange
+{
+    int32_t vertexOffset;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+class GeometryPool
+{
+public:
+    GeometryPool();
+
+    // getDeviceAddress が nullptr でなければ、バッファのデバイスアドレスを取得できるようにする
+    void initialize(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProps,
+        uint32_t vertexStride, VkIndexType indexType, uint32_t vertexCapacity, uint32_t indexCapacity,
+        PFN_vkGetBufferDeviceAddressKHR getDeviceAddress = nullptr);
+    void terminate();
+
+    // 空きが無ければ InvalidGeometryId を返す
+    GeometryId allocate(uint32_t vertexCount, uint32_t indexCount);
+    void free(GeometryId id);
+
+    // 確保した領域へデータを転送する（vertices は vertexCount 個、indices は indexCount 個。完了させるには uploader の flush を呼ぶ）
+    bool upload(UploadScheduler& uploader, GeometryId id, const void* vertices, const void* indices);
+
+    // 使用中の領域を先頭へ詰める（GPU がバッファを使っていない時に呼ぶ。uploader の flush で完了するまで待つ）
+    // 登録済みの転送も一緒に完了させる。バッファが作り直されるので、getVertexBuffer / getIndexBuffer も取り直すこと
+    bool compact(UploadScheduler& uploader);
+
+    // 断片化していなければ確保できるか（allocate に失敗した後、compact する価値があるかの判定に使う）
+    bool fitsAfterCompaction(uint32_t vertexCount, uint32_t indexCount) const;
+
+    const GeometryRange& getRange(GeometryId id) const { return m_ranges[id]; }
+    VkDeviceSize getVertexByteOffset(GeometryId id) const { return VkDeviceSize(m_ranges[id].vertexOffset) * m_vertexStride; }
+    VkDeviceSize getIndexByteOffset(GeometryId id) const { return VkDeviceSize(m_ranges[id].firstIndex) * m_indexSize; }
+
+    VkBuffer getVertexBuffer() const { return m_vertexBuffer.buffer; }
+    VkBuffer getIndexBuffer() const { return m_indexBuffer.buffer; }
+    // 初期化時に getDeviceAddress を渡さなかった場合は 0（compact で変わる）
+    VkDeviceAddress getVertexBufferAddress() const { return m_vertexBuffer.address; }
+    VkDeviceAddress getIndexBufferAddress() const { return m_indexBuffer.address; }
+    VkIndexType getIndexType() const { return m_indexType; }
+    uint32_t getVertexStride() const { return m_vertexStride; }
+    uint32_t getUsedVertexCount() const { return m_vertexCapacity - m_vertexSpace.getFreeCount(); }
+    uint32_t getUsedIndexCount() const { return m_indexCapacity - m_indexSpace.getFreeCount(); }
+
+private:
+    struct Buffer
+    {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        VkDeviceAddress address;
+    };
+
+    /// <summary>
+    /// 一次元の領域の空きリスト（先頭から最初に収まる空きを使う）
+    /// </summary>
+    class RangeAllocator
+    {
+    public:
+        void reset(uint32_t capacity);
+        bool allocate(uint32_t count, uint32_t& offset);
+        void free(uint32_t offset, uint32_t count);
+
+        // 先頭の used 個を使用中にし、残りを 1 つの空きにする（compact 用）
+        void resetPacked(uint32_t capacity, uint32_t used);
+
+        uint32_t getFreeCount() const { return m_freeCount; }
+
+    private:
+        struct Span
+        {
+            uint32_t offset;
+            uint32_t count;
+        };
+
+        // offset の昇順
+        std::vector<Span> m_free;
+        uint32_t m_freeCount;
+    };
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
+    void destroyBuffer(Buffer& buffer);
+
+    VkDevice m_device;
+    VkPhysicalDeviceMemoryProperties m_memProps;
+    PFN_vkGetBufferDeviceAddressKHR m_getDeviceAddress;
+
+    uint32_t m_vertexStride;
+    VkIndexType m_indexType;
+    uint32_t m_indexSize;
+    uint32_t m_vertexCapacity;
+    uint32_t m_indexCapacity;
+
+    Buffer m_vertexBuffer;
+    Buffer m_indexBuffer;
+    RangeAllocator m_vertexSpace;
+    RangeAllocator m_indexSpace;
+
+    // GeometryId -> 領域（解放した番号は m_freeIds から再利用する）
+    std::vector<GeometryRange> m_ranges;
+    std::vector<bool> m_live;
+    std::vector<GeometryId> m_freeIds;
+};
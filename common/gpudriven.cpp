@@ -0,0 +1,644 @@
+#include "gpudriven.h"
+#include "pipelinedesc.h"
+#include "meshlod.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    // cull.comp のワークグループの大きさ（local_size_x）
+    const uint32_t CullGroupSize = 64;
+
+    // cluster.comp のワークグループの大きさ（1 つのクラスタの作業で判定するメッシュレットの最大数）
+    const uint32_t ClusterGroupSize = 64;
+
+    // cull.comp の ObjectInfo
+    // clusterBase は Visibility のうち、このオブジェクトのメッシュレットごとの見えたかどうかの先頭
+    // lod は前のフレームで選んだ LOD（cull.comp が書き換える）
+    struct GpuObjectInfo
+    {
+        uint32_t mesh;
+        uint32_t group;
+        uint32_t commandSlot;
+        float lodErrorScale;
+        uint32_t clusterBase;
+        uint32_t lod;
+        uint32_t reserved[2];
+    };
+
+    // cull.comp の DrawGroups（先頭の drawCounts と clusterDrawCounts だけを毎フレーム 0 にする）
+    struct GpuDrawGroups
+    {
+        uint32_t drawCounts[MaxGpuDrawGroups];
+        uint32_t clusterDrawCounts[MaxGpuDrawGroups];
+        uint32_t commandBases[MaxGpuDrawGroups];
+        uint32_t clusterCommandBases[MaxGpuDrawGroups];
+    };
+
+    // cull.comp / cluster.comp の ClusterWork の先頭（vkCmdDispatchIndirect の引数）と、それに続く作業
+    struct GpuClusterDispatch
+    {
+        uint32_t groupCount[3];
+        uint32_t reserved;
+    };
+
+    struct GpuClusterWorkItem
+    {
+        uint32_t object;
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+        uint32_t flags;
+    };
+
+    // cull.comp のプッシュ定数
+    struct CullParams
+    {
+        glm::vec4 planes[6];
+        glm::vec4 camera;
+        uint32_t objectCount;
+        float pixelsPerUnit;
+        float errorThreshold;
+        uint32_t pass;
+    };
+
+    static_assert(sizeof(CullParams) <= 128, "push constants must fit in the guaranteed 128 bytes");
+
+    // cull.comp の OcclusionView（std140）
+    struct OcclusionViewData
+    {
+        glm::mat4 viewProjection;
+        glm::vec2 depthSize;
+        uint32_t pyramidLevels;
+        uint32_t reserved;
+    };
+
+    // cull.comp のバインディング番号
+    enum CullBinding : uint32_t
+    {
+        BindingInstances,
+        BindingObjects,
+        BindingMeshes,
+        BindingDraws,
+        BindingGroups,
+        BindingVisibility,
+        BindingDepthPyramid,
+        BindingOcclusionView,
+        BindingMeshlets,
+        BindingClusterWork,
+        BindingCount,
+    };
+
+    // BindingVisibility から BindingOcclusionView までは USE_OCCLUSION のバリアントだけが、
+    // BindingMeshlets 以降はクラスタ単位のカリングだけが使う
+    VkDescriptorType getDescriptorType(uint32_t binding)
+    {
+        switch (binding)
+        {
+        case BindingDepthPyramid:
+            return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        case BindingOcclusionView:
+            return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        default:
+            return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        }
+    }
+
+}
+
+GpuDrivenScene::GpuDrivenScene()
+    : m_device(VK_NULL_HANDLE), m_memProps{}, m_drawIndexedIndirectCount(nullptr), m_multiDrawIndirect(false)
+    , m_setLayout(VK_NULL_HANDLE), m_descriptorPool(VK_NULL_HANDLE), m_descriptorSet(VK_NULL_HANDLE)
+    , m_pipelineLayout(VK_NULL_HANDLE), m_pipeline(VK_NULL_HANDLE), m_occlusionPipeline(VK_NULL_HANDLE)
+    , m_clusterPipeline(VK_NULL_HANDLE), m_occlusionClusterPipeline(VK_NULL_HANDLE)
+    , m_pyramidLevels(0), m_depthSize(0.0f), m_visibilityRecorded(false)
+    , m_instances{}, m_objects{}, m_meshes{}, m_draws{}, m_groups{}, m_visibility{}, m_occlusionView{}, m_meshlets{}, m_clusterWork{}
+    , m_objectCount(0), m_groupCount(0), m_groupBases{}, m_groupSizes{}
+    , m_clusterCount(0), m_clusterGroupBases{}, m_clusterGroupSizes{}
+{
+}
+
+void GpuDrivenScene::initialize(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProps, const vector<uint32_t>& cullShader,
+    PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount, bool multiDrawIndirect)
+{
+    m_device = device;
+    m_memProps = memProps;
+    m_drawIndexedIndirectCount = drawIndexedIndirectCount;
+    m_multiDrawIndirect = multiDrawIndirect;
+
+    // デスクリプタセット（遮蔽カリングの Hi-Z と視点以外は SSBO）
+    VkDescriptorSetLayoutBinding bindings[BindingCount];
+    for (uint32_t i = 0; i < BindingCount; ++i)
+    {
+        bindings[i] = VkDescriptorSetLayoutBinding{};
+        bindings[i].binding = i;
+        bindings[i].descriptorType = getDescriptorType(i);
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo setLayoutCI{};
+    setLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutCI.bindingCount = BindingCount;
+    setLayoutCI.pBindings = bindings;
+    vkCreateDescriptorSetLayout(m_device, &setLayoutCI, nullptr, &m_setLayout);
+
+    VkDescriptorPoolSize poolSizes[3] = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = BindingCount - 2;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = 1;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[2].descriptorCount = 1;
+    VkDescriptorPoolCreateInfo poolCI{};
+    poolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCI.maxSets = 1;
+    poolCI.poolSizeCount = 3;
+    poolCI.pPoolSizes = poolSizes;
+    vkCreateDescriptorPool(m_device, &poolCI, nullptr, &m_descriptorPool);
+
+    VkDescriptorSetAllocateInfo setAI{};
+    setAI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setAI.descriptorPool = m_descriptorPool;
+    setAI.descriptorSetCount = 1;
+    setAI.pSetLayouts = &m_setLayout;
+    vkAllocateDescriptorSets(m_device, &setAI, &m_descriptorSet);
+
+    // パイプライン（視点の情報はプッシュ定数で渡す）
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullParams);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+    pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCI.setLayoutCount = 1;
+    pipelineLayoutCI.pSetLayouts = &m_setLayout;
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    vkCreatePipelineLayout(m_device, &pipelineLayoutCI, nullptr, &m_pipelineLayout);
+
+    m_pipeline = createCullPipeline(cullShader);
+}
+
+/// <summary>
+/// cull.comp / cluster.comp のバリアントからパイプラインを作る（デスクリプタセットとプッシュ定数はどれも同じ）
+/// </summary>
+VkPipeline GpuDrivenScene::createCullPipeline(const vector<uint32_t>& shader, bool coneCulling)
+{
+    VkShaderModuleCreateInfo moduleCI{};
+    moduleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleCI.pCode = shader.data();
+    moduleCI.codeSize = shader.size() * sizeof(uint32_t);
+    VkShaderModule shaderModule;
+    vkCreateShaderModule(m_device, &moduleCI, nullptr, &shaderModule);
+
+    // USE_DRAW_COUNT：見えるものだけを詰めて書くか、オブジェクトごとの位置に書くか
+    SpecializationConstants constants;
+    constants.set(0, m_drawIndexedIndirectCount != nullptr);
+    // CONE_CULLING：法線の円錐で裏を向いたクラスタを除くか（cluster.comp のみが使う）
+    constants.set(1, coneCulling);
+    // LOD_HYSTERESIS：今より粗い LOD へ切り替える誤差の余裕（CPU の selectMeshLod と同じ値）
+    constants.set(2, LodHysteresis);
+
+    VkComputePipelineCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    ci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    ci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    ci.stage.module = shaderModule;
+    ci.stage.pName = "main";
+    ci.stage.pSpecializationInfo = constants.getInfo();
+    ci.layout = m_pipelineLayout;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &ci, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        OutputDebugStringA("GpuDrivenScene: failed to create the culling pipeline.\n");
+        pipeline = VK_NULL_HANDLE;
+    }
+
+    vkDestroyShaderModule(m_device, shaderModule, nullptr);
+    return pipeline;
+}
+
+bool GpuDrivenScene::setOcclusionCulling(const vector<uint32_t>& occlusionCullShader, const HiZPyramid& pyramid)
+{
+    if (occlusionCullShader.empty() || pyramid.getView() == VK_NULL_HANDLE)
+    {
+        return false;
+    }
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.sampler = pyramid.getSampler();
+    imageInfo.imageView = pyramid.getView();
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = m_descriptorSet;
+    write.dstBinding = BindingDepthPyramid;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+    m_pyramidLevels = pyramid.getLevelCount();
+    m_depthSize = glm::vec2(float(pyramid.getDepthWidth()), float(pyramid.getDepthHeight()));
+    if (m_occlusionPipeline == VK_NULL_HANDLE)
+    {
+        m_occlusionPipeline = createCullPipeline(occlusionCullShader);
+    }
+    return m_occlusionPipeline != VK_NULL_HANDLE;
+}
+
+bool GpuDrivenScene::setClusterCulling(const vector<uint32_t>& clusterShader, const vector<uint32_t>& occlusionClusterShader, bool coneCulling)
+{
+    // 見えるクラスタの数は GPU 上でしか分からない
+    if (m_drawIndexedIndirectCount == nullptr || clusterShader.empty() || occlusionClusterShader.empty())
+    {
+        return false;
+    }
+
+    if (m_clusterPipeline == VK_NULL_HANDLE)
+    {
+        m_clusterPipeline = createCullPipeline(clusterShader, coneCulling);
+        m_occlusionClusterPipeline = createCullPipeline(occlusionClusterShader, coneCulling);
+    }
+    if (m_occlusionClusterPipeline == VK_NULL_HANDLE)
+    {
+        vkDestroyPipeline(m_device, m_clusterPipeline, nullptr);
+        m_clusterPipeline = VK_NULL_HANDLE;
+    }
+    return m_clusterPipeline != VK_NULL_HANDLE;
+}
+
+void GpuDrivenScene::terminate()
+{
+    if (m_device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    destroySceneBuffers();
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipeline(m_device, m_occlusionPipeline, nullptr);
+    vkDestroyPipeline(m_device, m_clusterPipeline, nullptr);
+    vkDestroyPipeline(m_device, m_occlusionClusterPipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+
+    m_pipeline = VK_NULL_HANDLE;
+    m_occlusionPipeline = VK_NULL_HANDLE;
+    m_clusterPipeline = VK_NULL_HANDLE;
+    m_occlusionClusterPipeline = VK_NULL_HANDLE;
+    m_pipelineLayout = VK_NULL_HANDLE;
+    m_descriptorPool = VK_NULL_HANDLE;
+    m_descriptorSet = VK_NULL_HANDLE;
+    m_setLayout = VK_NULL_HANDLE;
+    m_device = VK_NULL_HANDLE;
+}
+
+bool GpuDrivenScene::setScene(UploadScheduler& uploader, const vector<GpuMeshInfo>& meshes, const vector<GpuSceneObject>& objects,
+    const vector<GpuMeshlet>& meshlets)
+{
+    destroySceneBuffers();
+
+    // クラスタ単位のカリングが無効ならメッシュレットは無いものとして扱う（cull.comp は meshletCount で判断する）
+    vector<GpuMeshInfo> meshInfos(meshes);
+    const bool useClusters = isClusterCullingEnabled() && !meshlets.empty();
+    for (auto& mesh : meshInfos)
+    {
+        if (!useClusters)
+        {
+            mesh.firstMeshlet = 0;
+            mesh.meshletCount = 0;
+        }
+        else if (uint64_t(mesh.firstMeshlet) + mesh.meshletCount > meshlets.size())
+        {
+            OutputDebugStringA("GpuDrivenScene: invalid meshlet range.\n");
+            return false;
+        }
+    }
+
+    // 描画グループごとの数を数えて、コマンドの領域の先頭を決める
+    // クラスタのコマンドはグループのオブジェクトのメッシュレットがすべて見える場合の数だけ確保する
+    uint32_t groupSizes[MaxGpuDrawGroups] = {};
+    uint32_t clusterGroupSizes[MaxGpuDrawGroups] = {};
+    uint32_t groupCount = 0;
+    uint32_t clusterWorkCapacity = 0;
+    for (const auto& object : objects)
+    {
+        if (object.group >= MaxGpuDrawGroups || object.mesh >= meshInfos.size())
+        {
+            OutputDebugStringA("GpuDrivenScene: invalid draw group or mesh index.\n");
+            return false;
+        }
+        const uint32_t meshletCount = meshInfos[object.mesh].meshletCount;
+        groupSizes[object.group]++;
+        clusterGroupSizes[object.group] += meshletCount;
+        clusterWorkCapacity += (meshletCount + ClusterGroupSize - 1) / ClusterGroupSize;
+        groupCount = max(groupCount, object.group + 1);
+    }
+    if (objects.empty())
+    {
+        return true;
+    }
+
+    GpuDrawGroups groups{};
+    uint32_t base = 0;
+    for (uint32_t i = 0; i < MaxGpuDrawGroups; ++i)
+    {
+        groups.commandBases[i] = base;
+        m_groupBases[i] = base;
+        m_groupSizes[i] = groupSizes[i];
+        base += groupSizes[i];
+    }
+    for (uint32_t i = 0; i < MaxGpuDrawGroups; ++i)
+    {
+        groups.clusterCommandBases[i] = base;
+        m_clusterGroupBases[i] = base;
+        m_clusterGroupSizes[i] = clusterGroupSizes[i];
+        base += clusterGroupSizes[i];
+    }
+    const uint32_t commandCount = base;
+    m_clusterCount = commandCount - uint32_t(objects.size());
+
+    // コマンドの位置はグループ内での登録順（drawIndexedIndirectCount が使えない場合に使う）
+    // メッシュレットごとの見えたかどうかはオブジェクトの分の後ろに並べる
+    vector<InstanceData> instances(objects.size());
+    vector<GpuObjectInfo> objectInfos(objects.size());
+    uint32_t cursors[MaxGpuDrawGroups];
+    copy(begin(m_groupBases), end(m_groupBases), cursors);
+    uint32_t clusterBase = uint32_t(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+        const auto& object = objects[i];
+        instances[i] = object.instance;
+        objectInfos[i] = { object.mesh, object.group, cursors[object.group]++, object.lodErrorScale, clusterBase, 0, {} };
+        clusterBase += meshInfos[object.mesh].meshletCount;
+    }
+
+    const VkBufferUsageFlags storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    const VkDeviceSize instanceSize = sizeof(InstanceData) * instances.size();
+    const VkDeviceSize objectSize = sizeof(GpuObjectInfo) * objectInfos.size();
+    const VkDeviceSize meshSize = sizeof(GpuMeshInfo) * meshInfos.size();
+    const VkDeviceSize meshletSize = useClusters ? sizeof(GpuMeshlet) * meshlets.size() : 0;
+    m_instances = createBuffer(instanceSize, storage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    m_objects = createBuffer(objectSize, storage);
+    m_meshes = createBuffer(meshSize, storage);
+    m_draws = createBuffer(sizeof(VkDrawIndexedIndirectCommand) * commandCount, storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    m_groups = createBuffer(sizeof(GpuDrawGroups), storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    m_visibility = createBuffer(sizeof(uint32_t) * clusterBase, storage);
+    m_occlusionView = createBuffer(sizeof(OcclusionViewData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_meshlets = createBuffer(meshletSize, storage);
+    m_clusterWork = createBuffer(sizeof(GpuClusterDispatch) + sizeof(GpuClusterWorkItem) * clusterWorkCapacity,
+        storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    for (auto buffer : { &m_instances, &m_objects, &m_meshes, &m_draws, &m_groups, &m_visibility, &m_occlusionView, &m_meshlets, &m_clusterWork })
+    {
+        if (buffer->buffer == VK_NULL_HANDLE)
+        {
+            destroySceneBuffers();
+            return false;
+        }
+    }
+    m_objectCount = uint32_t(objects.size());
+    m_groupCount = groupCount;
+
+    bool succeeded = uploader.upload(instances.data(), instanceSize, m_instances.buffer, 0);
+    succeeded &= uploader.upload(objectInfos.data(), objectSize, m_objects.buffer, 0);
+    succeeded &= uploader.upload(meshInfos.data(), meshSize, m_meshes.buffer, 0);
+    succeeded &= uploader.upload(&groups, sizeof(groups), m_groups.buffer, 0);
+    if (meshletSize > 0)
+    {
+        succeeded &= uploader.upload(meshlets.data(), meshletSize, m_meshlets.buffer, 0);
+    }
+
+    // 最初のフレームは前のフレームで見えていたものが無いので、すべて後半のパスで判定する
+    const vector<uint32_t> visibility(clusterBase, 0);
+    succeeded &= uploader.upload(visibility.data(), sizeof(uint32_t) * visibility.size(), m_visibility.buffer, 0);
+
+    // デスクリプタセットを新しいバッファに向ける（Hi-Z は setOcclusionCulling で設定する）
+    const uint32_t bindings[] = { BindingInstances, BindingObjects, BindingMeshes, BindingDraws, BindingGroups, BindingVisibility, BindingOcclusionView,
+        BindingMeshlets, BindingClusterWork };
+    const Buffer* buffers[] = { &m_instances, &m_objects, &m_meshes, &m_draws, &m_groups, &m_visibility, &m_occlusionView,
+        &m_meshlets, &m_clusterWork };
+    const uint32_t writeCount = uint32_t(_countof(bindings));
+    VkDescriptorBufferInfo bufferInfos[_countof(bindings)];
+    VkWriteDescriptorSet writes[_countof(bindings)];
+    for (uint32_t i = 0; i < writeCount; ++i)
+    {
+        bufferInfos[i] = { buffers[i]->buffer, 0, VK_WHOLE_SIZE };
+        writes[i] = VkWriteDescriptorSet{};
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = m_descriptorSet;
+        writes[i].dstBinding = bindings[i];
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = getDescriptorType(bindings[i]);
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(m_device, writeCount, writes, 0, nullptr);
+    return succeeded;
+}
+
+void GpuDrivenScene::recordCulling(VkCommandBuffer command, const GpuCullingView& view, GpuCullingPass pass)
+{
+    if (m_objectCount == 0)
+    {
+        return;
+    }
+
+    const bool occlusion = pass != GpuCullingPass::All && isOcclusionCullingEnabled();
+    if (pass == GpuCullingPass::Late && !occlusion)
+    {
+        return;
+    }
+
+    // 前のパスの間接描画がコマンドと数を読み終え、前のパスのコンピュートシェーダが見えたかどうかと視点を読み書きし終えてから書き換える
+    // 間接描画の読み込みの後の書き込み（WAR）は実行の依存だけで足りるので、srcAccessMask には書き込みだけを指定する
+    // 続く vkCmdFillBuffer / vkCmdUpdateBuffer はシェーダが書いたものを上書きするので、転送の書き込みにも見えるようにする（WAW）
+    VkMemoryBarrier previousBarrier{};
+    previousBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    previousBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    previousBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(command, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &previousBarrier, 0, nullptr, 0, nullptr);
+
+    // 最初のフレームは前のフレームで見えていたものが無い（Hi-Z もまだ作っていない）ので、何も描かないコマンドで埋めるだけにする
+    const bool skipDispatch = pass == GpuCullingPass::Early && occlusion && !m_visibilityRecorded;
+    bool transferred = false;
+    if (skipDispatch)
+    {
+        vkCmdFillBuffer(command, m_draws.buffer, 0, VK_WHOLE_SIZE, 0);
+        transferred = true;
+    }
+    if (m_drawIndexedIndirectCount != nullptr)
+    {
+        vkCmdFillBuffer(command, m_groups.buffer, 0, sizeof(uint32_t) * MaxGpuDrawGroups * 2, 0);
+        transferred = true;
+    }
+    if (m_clusterCount > 0 && !skipDispatch)
+    {
+        // オブジェクトのパスが作業を追加するたびにワークグループの数を増やす
+        const GpuClusterDispatch dispatch = { { 0, 1, 1 }, 0 };
+        vkCmdUpdateBuffer(command, m_clusterWork.buffer, 0, sizeof(dispatch), &dispatch);
+        transferred = true;
+    }
+    if (pass == GpuCullingPass::Late)
+    {
+        OcclusionViewData occlusionView{};
+        occlusionView.viewProjection = view.viewProjection;
+        occlusionView.depthSize = m_depthSize;
+        occlusionView.pyramidLevels = m_pyramidLevels;
+        vkCmdUpdateBuffer(command, m_occlusionView.buffer, 0, sizeof(occlusionView), &occlusionView);
+        transferred = true;
+        m_visibilityRecorded = true;
+    }
+    if (transferred)
+    {
+        VkMemoryBarrier clearBarrier{};
+        clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_UNIFORM_READ_BIT
+            | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(command, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+    }
+    if (skipDispatch)
+    {
+        return;
+    }
+
+    CullParams params{};
+    copy(begin(view.frustum.planes), end(view.frustum.planes), params.planes);
+    params.camera = view.perspective ? glm::vec4(view.cameraPosition, 1.0f) : glm::vec4(view.viewDirection, 0.0f);
+    params.objectCount = m_objectCount;
+    params.pixelsPerUnit = view.pixelsPerUnit;
+    params.errorThreshold = view.errorThreshold;
+    params.pass = occlusion ? uint32_t(pass) : uint32_t(GpuCullingPass::All);
+
+    vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, occlusion ? m_occlusionPipeline : m_pipeline);
+    vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+    vkCmdPushConstants(command, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(command, (m_objectCount + CullGroupSize - 1) / CullGroupSize, 1, 1);
+
+    // オブジェクトのパスが書き出した作業をクラスタのパスで判定する（デスクリプタセットとプッシュ定数はそのまま使える）
+    if (m_clusterCount > 0)
+    {
+        VkMemoryBarrier workBarrier{};
+        workBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        workBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        workBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(command, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &workBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, occlusion ? m_occlusionClusterPipeline : m_clusterPipeline);
+        vkCmdDispatchIndirect(command, m_clusterWork.buffer, 0);
+    }
+
+    // 書き出したコマンドと数を間接描画で読む
+    VkBufferMemoryBarrier barriers[2] = {};
+    const VkBuffer written[2] = { m_draws.buffer, m_groups.buffer };
+    for (int i = 0; i < 2; ++i)
+    {
+        barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barriers[i].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barriers[i].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].buffer = written[i];
+        barriers[i].offset = 0;
+        barriers[i].size = VK_WHOLE_SIZE;
+    }
+    vkCmdPipelineBarrier(command, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        0, 0, nullptr, 2, barriers, 0, nullptr);
+}
+
+void GpuDrivenScene::recordDraws(VkCommandBuffer command, uint32_t group)
+{
+    if (group >= m_groupCount || m_groupSizes[group] == 0)
+    {
+        return;
+    }
+
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    const VkDeviceSize offset = VkDeviceSize(m_groupBases[group]) * stride;
+    const uint32_t maxDrawCount = m_groupSizes[group];
+
+    if (m_drawIndexedIndirectCount != nullptr)
+    {
+        m_drawIndexedIndirectCount(command, m_draws.buffer, offset, m_groups.buffer, sizeof(uint32_t) * group, maxDrawCount, stride);
+
+        // クラスタのパスが書き出したメッシュレットごとのコマンド
+        if (m_clusterGroupSizes[group] > 0)
+        {
+            const VkDeviceSize clusterOffset = VkDeviceSize(m_clusterGroupBases[group]) * stride;
+            m_drawIndexedIndirectCount(command, m_draws.buffer, clusterOffset, m_groups.buffer,
+                sizeof(uint32_t) * (MaxGpuDrawGroups + group), m_clusterGroupSizes[group], stride);
+        }
+    }
+    else if (m_multiDrawIndirect)
+    {
+        vkCmdDrawIndexedIndirect(command, m_draws.buffer, offset, maxDrawCount, stride);
+    }
+    else
+    {
+        // multiDrawIndirect が無いデバイスでは 1 つずつ発行するしかない
+        for (uint32_t i = 0; i < maxDrawCount; ++i)
+        {
+            vkCmdDrawIndexedIndirect(command, m_draws.buffer, offset + VkDeviceSize(i) * stride, 1, stride);
+        }
+    }
+}
+
+GpuDrivenScene::Buffer GpuDrivenScene::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage)
+{
+    Buffer obj{};
+    VkBufferCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    ci.size = max<VkDeviceSize>(size, 16);
+    ci.usage = usage;
+    ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    vkCreateBuffer(m_device, &ci, nullptr, &obj.buffer);
+
+    VkMemoryRequirements reqs;
+    vkGetBufferMemoryRequirements(m_device, obj.buffer, &reqs);
+    VkMemoryAllocateInfo ai{};
+    ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    ai.allocationSize = reqs.size;
+    ai.memoryTypeIndex = findMemoryType(m_memProps, reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (ai.memoryTypeIndex == ~0u)
+    {
+        OutputDebugStringA("GpuDrivenScene: no device-local memory type for a scene buffer.\n");
+        vkDestroyBuffer(m_device, obj.buffer, nullptr);
+        return Buffer{};
+    }
+    vkAllocateMemory(m_device, &ai, nullptr, &obj.memory);
+    vkBindBufferMemory(m_device, obj.buffer, obj.memory, 0);
+    return obj;
+}
+
+void GpuDrivenScene::destroyBuffer(Buffer& buffer)
+{
+    if (buffer.buffer != VK_NULL_HANDLE)
+    {
+        vkDestroyBuffer(m_device, buffer.buffer, nullptr);
+        vkFreeMemory(m_device, buffer.memory, nullptr);
+    }
+    buffer = Buffer{};
+}
+
+void GpuDrivenScene::destroySceneBuffers()
+{
+    destroyBuffer(m_instances);
+    destroyBuffer(m_objects);
+    destroyBuffer(m_meshes);
+    destroyBuffer(m_draws);
+    destroyBuffer(m_groups);
+    destroyBuffer(m_visibility);
+    destroyBuffer(m_occlusionView);
+    destroyBuffer(m_meshlets);
+    destroyBuffer(m_clusterWork);
+    m_objectCount = 0;
+    m_groupCount = 0;
+    m_clusterCount = 0;
+    m_visibilityRecorded = false;
+}
@@ -0,0 +1,216 @@
+#pragma once
+#include "vkappbase.h"
+#include "instancing.h"
+#include "frustum.h"
+#include "staging.h"
+#include "meshloader.h"
+#include "hizpyramid.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// GPU 駆動の描画（コンピュートシェーダでカリングと LOD の選択を行い、間接描画する）
+/// </summary>
+/// <remarks>
+/// オブジェクトとメッシュの情報はデバイスローカルの SSBO に置く。
+/// recordCulling で記録するコンピュートシェーダ（cull.comp）がオブジェクトごとに視錐台との判定と LOD の選択を行い、
+/// 見えるものだけ VkDrawIndexedIndirectCommand を書き出して描画グループごとの数を数える。
+/// LOD はオブジェクトごとに前のフレームで選んだものを覚えておき、CPU の selectMeshLod（meshlod.h）と同じ規則で
+/// 粗い LOD へは余裕を持って切り替える（境目の距離で LOD が行き来しない）。
+/// 描画は vkCmdDrawIndexedIndirectCount（VK_KHR_draw_indirect_count）で行うので、
+/// CPU が記録するコマンドの数はシーンの大きさによらず描画グループの数だけになる。
+/// 拡張が使えない場合はオブジェクトごとの位置にコマンドを書き（カリングされたものは instanceCount = 0）、
+/// グループの全オブジェクト分を vkCmdDrawIndexedIndirect で発行する。
+/// 1 つのコマンドが 1 つのオブジェクトを描画し、firstInstance でインスタンスのデータ（InstanceData）を選ぶので、
+/// デバイスの drawIndirectFirstInstance が必要。
+/// setOcclusionCulling で Hi-Z（HiZPyramid）による 2 段階の遮蔽カリングを有効にできる。
+/// 前半のパス（Early）で前のフレームに見えていたものを描き、そのデプスから Hi-Z を作ってから、
+/// 後半のパス（Late）で遮られていないものを記録し直して、前半で描かなかったものを描く。
+/// 前のフレームで隠れていたものが見えるようになっても、後半で描かれるので 1 フレームも欠けない。
+/// setClusterCulling を有効にすると、メッシュレット（meshlet.h）を持つメッシュを最も詳細な LOD で描く場合は
+/// オブジェクトのパスがクラスタの作業（最大 64 メッシュレットずつ）を書き出し、続けて vkCmdDispatchIndirect で
+/// クラスタのパス（cluster.comp）がメッシュレットごとに視錐台・法線の円錐・Hi-Z で判定して、見えるものだけの間接描画コマンドを書き出す。
+/// 遮蔽カリングの見えたかどうかもクラスタごとに記録するので、大きな 1 つのメッシュでも見えている部分だけが描かれる。
+/// クラスタのコマンドは見えるものだけを詰めて書くので、VK_KHR_draw_indirect_count が必要。
+/// </remarks>
+
+// 描画グループ（1 つのパイプラインで描画するオブジェクトの集まり）の最大数
+const uint32_t MaxGpuDrawGroups = 16;
+
+struct GpuMeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+    uint32_t reserved;
+};
+
+/// <summary>
+/// メッシュ（プリミティブ）の情報（cull.comp の MeshInfo と同じ std430 のレイアウト）
+/// boundingSphere は量子化された位置の空間での中心と半径、LOD の error はメッシュの空間での誤差
+/// メッシュレットは setScene に渡す配列の firstMeshlet から meshletCount 個（最も詳細な LOD を分割したもの）
+/// </summary>
+struct GpuMeshInfo
+{
+    glm::vec4 boundingSphere;
+    int32_t vertexOffset;
+    uint32_t lodCount;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    GpuMeshLod lods[MaxMeshLods];
+};
+
+static_assert(sizeof(GpuMeshInfo) == 32 + 16 * MaxMeshLods, "GpuMeshInfo must match the std430 layout of cull.comp");
+
+/// <summary>
+/// メッシュレットの情報（cluster.comp の Meshlet と同じ std430 のレイアウト）
+/// 境界はメッシュと同じ量子化された位置の空間、cone は xyz が軸で w が coneCutoff（meshlet.h）
+/// firstIndex はインデックスバッファ上の位置
+/// </summary>
+struct GpuMeshlet
+{
+    glm::vec4 boundingSphere;
+    glm::vec4 coneApex;
+    glm::vec4 cone;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t reserved[2];
+};
+
+static_assert(sizeof(GpuMeshlet) == 64, "GpuMeshlet must match the std430 layout of cluster.comp");
+
+/// <summary>
+/// GPU で描画するオブジェクト
+/// instance は量子化を畳み込んだ変換（foldPositionQuantization）、lodErrorScale はメッシュの空間からワールドへの大きさ
+/// </summary>
+struct GpuSceneObject
+{
+    uint32_t mesh;
+    uint32_t group;
+    float lodErrorScale;
+    InstanceData instance;
+};
+
+/// <summary>
+/// カリングと LOD の選択に使う視点の情報
+/// viewProjection は frustum を取り出したのと同じ行列
+/// viewDirection は正射影の場合のカメラの向き（法線の円錐によるクラスタのカリングで使う）
+/// pixelsPerUnit は距離 1 の位置で 1 単位が画面上で何ピクセルになるか（正射影の場合は距離によらない）
+/// errorThreshold は許容する LOD の誤差（ピクセル）
+/// </summary>
+struct GpuCullingView
+{
+    Frustum frustum;
+    glm::mat4 viewProjection;   // 遮蔽カリングで境界を画面に投影する（Late のパスのみ）
+    glm::vec3 cameraPosition;
+    glm::vec3 viewDirection;
+    bool perspective;
+    float pixelsPerUnit;
+    float errorThreshold;
+};
+
+/// <summary>
+/// recordCulling で記録するパス
+/// </summary>
+enum class GpuCullingPass
+{
+    // 視錐台カリングだけを行い、見えるものをすべて描く
+    All,
+    // 前のフレームで見えていたもののうち、視錐台に掛かるものを描く
+    Early,
+    // Hi-Z で遮られていないものを見えるものとして記録し、Early で描かなかったものを描く
+    Late,
+};
+
+class GpuDrivenScene
+{
+public:
+    GpuDrivenScene();
+
+    // cullShader は cull.comp の SPIR-V
+    // drawIndexedIndirectCount が nullptr の場合は vkCmdDrawIndexedIndirect で描画する
+    void initialize(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProps, const std::vector<uint32_t>& cullShader,
+        PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount, bool multiDrawIndirect);
+    void terminate();
+
+    // GPU 上のバッファを作り直して転送を登録する（GPU がバッファを使っていない時に呼び、最後に uploader の flush で完了させる）
+    // meshlets はクラスタ単位のカリングが有効な場合のみ使う
+    bool setScene(UploadScheduler& uploader, const std::vector<GpuMeshInfo>& meshes, const std::vector<GpuSceneObject>& objects,
+        const std::vector<GpuMeshlet>& meshlets = {});
+
+    // クラスタ単位のカリングを有効にする（setScene より前に呼ぶ）。clusterShader は cluster.comp、
+    // occlusionClusterShader は USE_OCCLUSION を定義した cluster.comp の SPIR-V
+    // coneCulling は描画するパイプラインが裏面をカリングする場合のみ true にする（法線の円錐で裏を向いたクラスタを除く）
+    bool setClusterCulling(const std::vector<uint32_t>& clusterShader, const std::vector<uint32_t>& occlusionClusterShader, bool coneCulling);
+    bool isClusterCullingEnabled() const { return m_clusterPipeline != VK_NULL_HANDLE; }
+
+    // 遮蔽カリングを有効にする。occlusionCullShader は USE_OCCLUSION を定義した cull.comp の SPIR-V
+    // pyramid は GpuDrivenScene より後まで残し、Late のパスの前に record しておくこと
+    bool setOcclusionCulling(const std::vector<uint32_t>& occlusionCullShader, const HiZPyramid& pyramid);
+    bool isOcclusionCullingEnabled() const { return m_occlusionPipeline != VK_NULL_HANDLE; }
+
+    // レンダーパスの外で記録する
+    // 遮蔽カリングが無効なら Early は All と同じで、Late は何も記録しない
+    void recordCulling(VkCommandBuffer command, const GpuCullingView& view, GpuCullingPass pass = GpuCullingPass::All);
+
+    // レンダーパスの中で記録する。パイプラインと頂点・インデックスバッファ（バインディング 1 は getInstanceBuffer）はセット済みであること
+    void recordDraws(VkCommandBuffer command, uint32_t group);
+
+    VkBuffer getInstanceBuffer() const { return m_instances.buffer; }
+    uint32_t getObjectCount() const { return m_objectCount; }
+    uint32_t getGroupCount() const { return m_groupCount; }
+    bool isUsingDrawCount() const { return m_drawIndexedIndirectCount != nullptr; }
+
+private:
+    struct Buffer
+    {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+    };
+
+    VkPipeline createCullPipeline(const std::vector<uint32_t>& shader, bool coneCulling = false);
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
+    void destroyBuffer(Buffer& buffer);
+    void destroySceneBuffers();
+
+    VkDevice m_device;
+    VkPhysicalDeviceMemoryProperties m_memProps;
+    PFN_vkCmdDrawIndexedIndirectCountKHR m_drawIndexedIndirectCount;
+    bool m_multiDrawIndirect;
+
+    VkDescriptorSetLayout m_setLayout;
+    VkDescriptorPool m_descriptorPool;
+    VkDescriptorSet m_descriptorSet;
+    VkPipelineLayout m_pipelineLayout;
+    VkPipeline m_pipeline;
+    VkPipeline m_occlusionPipeline;
+    VkPipeline m_clusterPipeline;
+    VkPipeline m_occlusionClusterPipeline;
+    uint32_t m_pyramidLevels;
+    glm::vec2 m_depthSize;
+
+    // Late のパスで見えたかどうかを一度でも記録したか（それまでは Hi-Z も無い）
+    bool m_visibilityRecorded;
+
+    Buffer m_instances;
+    Buffer m_objects;
+    Buffer m_meshes;
+    Buffer m_draws;
+    Buffer m_groups;
+    Buffer m_visibility;
+    Buffer m_occlusionView;
+    Buffer m_meshlets;
+    Buffer m_clusterWork;
+
+    uint32_t m_objectCount;
+    uint32_t m_groupCount;
+    uint32_t m_groupBases[MaxGpuDrawGroups];
+    uint32_t m_groupSizes[MaxGpuDrawGroups];
+
+    // クラスタのコマンドの領域（m_draws のオブジェクトの分の後ろ）。0 ならこのシーンではクラスタを使わない
+    uint32_t m_clusterCount;
+    uint32_t m_clusterGroupBases[MaxGpuDrawGroups];
+    uint32_t m_clusterGroupSizes[MaxGpuDrawGroups];
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// FNV-1a (64bit) の初期値
+const uint64_t HashSeed = 14695981039346656037ull;
+
+/// <summary>
+/// FNV-1a (64bit) でバイト列をハッシュ値に畳み込む
+/// キャッシュキーの計算用で、暗号学的な強度は無い
+/// </summary>
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = HashSeed)
+{
+    auto p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template<class T>
+inline uint64_t hashValue(const T& value, uint64_t hash = HashSeed)
+{
+    return hashBytes(&value, sizeof(T), hash);
+}
@@ -0,0 +1,309 @@
+#include "hizpyramid.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    // hiz.comp のワークグループの大きさ（local_size_x, local_size_y）
+    const uint32_t HiZGroupSize = 8;
+
+    const VkFormat PyramidFormat = VK_FORMAT_R32G32_SFLOAT;
+
+    // hiz.comp のプッシュ定数
+    struct HiZParams
+    {
+        uint32_t fromDepth;
+    };
+
+    VkImageMemoryBarrier makeImageBarrier(VkImage image, VkImageAspectFlags aspect, uint32_t baseLevel, uint32_t levelCount,
+        VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+    {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = { aspect, baseLevel, levelCount, 0, 1 };
+        return barrier;
+    }
+}
+
+HiZPyramid::HiZPyramid()
+    : m_device(VK_NULL_HANDLE), m_image(VK_NULL_HANDLE), m_memory(VK_NULL_HANDLE), m_view(VK_NULL_HANDLE), m_sampler(VK_NULL_HANDLE)
+    , m_setLayout(VK_NULL_HANDLE), m_descriptorPool(VK_NULL_HANDLE), m_pipelineLayout(VK_NULL_HANDLE), m_pipeline(VK_NULL_HANDLE)
+    , m_depthWidth(0), m_depthHeight(0)
+{
+}
+
+bool HiZPyramid::initialize(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProps, const vector<uint32_t>& shader,
+    VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight)
+{
+    if (shader.empty() || depthWidth == 0 || depthHeight == 0)
+    {
+        OutputDebugStringA("HiZPyramid: no shader or empty depth buffer.\n");
+        return false;
+    }
+
+    m_device = device;
+    m_depthWidth = depthWidth;
+    m_depthHeight = depthHeight;
+
+    // 段ごとの大きさ（半分に切り上げながら 1x1 まで）
+    VkExtent2D size = { (depthWidth + 1) / 2, (depthHeight + 1) / 2 };
+    m_levelSizes.clear();
+    for (;;)
+    {
+        m_levelSizes.push_back(size);
+        if (size.width == 1 && size.height == 1)
+        {
+            break;
+        }
+        size = { (size.width + 1) / 2, (size.height + 1) / 2 };
+    }
+    const uint32_t levelCount = uint32_t(m_levelSizes.size());
+
+    // ピラミッドのイメージ（段ごとに書き込み、カリングからはサンプリングする）
+    VkImageCreateInfo imageCI{};
+    imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCI.imageType = VK_IMAGE_TYPE_2D;
+    imageCI.format = PyramidFormat;
+    imageCI.extent = { m_levelSizes[0].width, m_levelSizes[0].height, 1 };
+    imageCI.mipLevels = levelCount;
+    imageCI.arrayLayers = 1;
+    imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    vkCreateImage(m_device, &imageCI, nullptr, &m_image);
+
+    VkMemoryRequirements reqs;
+    vkGetImageMemoryRequirements(m_device, m_image, &reqs);
+    VkMemoryAllocateInfo ai{};
+    ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    ai.allocationSize = reqs.size;
+    ai.memoryTypeIndex = findMemoryType(memProps, reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (ai.memoryTypeIndex == ~0u)
+    {
+        OutputDebugStringA("HiZPyramid: no device-local memory type for the pyramid image.\n");
+        terminate();
+        return false;
+    }
+    vkAllocateMemory(m_device, &ai, nullptr, &m_memory);
+    vkBindImageMemory(m_device, m_image, m_memory, 0);
+
+    VkImageViewCreateInfo viewCI{};
+    viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewCI.image = m_image;
+    viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewCI.format = PyramidFormat;
+    viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+    vkCreateImageView(m_device, &viewCI, nullptr, &m_view);
+
+    m_levelViews.resize(levelCount);
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+        vkCreateImageView(m_device, &viewCI, nullptr, &m_levelViews[level]);
+    }
+
+    // texelFetch でしか読まないので、フィルタはかけない
+    VkSamplerCreateInfo samplerCI{};
+    samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCI.magFilter = VK_FILTER_NEAREST;
+    samplerCI.minFilter = VK_FILTER_NEAREST;
+    samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCI.maxLod = VK_LOD_CLAMP_NONE;
+    vkCreateSampler(m_device, &samplerCI, nullptr, &m_sampler);
+
+    // デスクリプタセット（読み込み元と書き込み先の段）を段の数だけ作る
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutCreateInfo setLayoutCI{};
+    setLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutCI.bindingCount = 2;
+    setLayoutCI.pBindings = bindings;
+    vkCreateDescriptorSetLayout(m_device, &setLayoutCI, nullptr, &m_setLayout);
+
+    VkDescriptorPoolSize poolSizes[2] = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = levelCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = levelCount;
+    VkDescriptorPoolCreateInfo poolCI{};
+    poolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCI.maxSets = levelCount;
+    poolCI.poolSizeCount = 2;
+    poolCI.pPoolSizes = poolSizes;
+    vkCreateDescriptorPool(m_device, &poolCI, nullptr, &m_descriptorPool);
+
+    vector<VkDescriptorSetLayout> setLayouts(levelCount, m_setLayout);
+    VkDescriptorSetAllocateInfo setAI{};
+    setAI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setAI.descriptorPool = m_descriptorPool;
+    setAI.descriptorSetCount = levelCount;
+    setAI.pSetLayouts = setLayouts.data();
+    m_levelSets.resize(levelCount);
+    vkAllocateDescriptorSets(m_device, &setAI, m_levelSets.data());
+
+    // 0 段目はデプスバッファから、それ以降は 1 つ前の段から読む
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        VkDescriptorImageInfo source{};
+        source.sampler = m_sampler;
+        source.imageView = level == 0 ? depthView : m_levelViews[level - 1];
+        source.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+        VkDescriptorImageInfo destination{};
+        destination.imageView = m_levelViews[level];
+        destination.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet writes[2] = {};
+        for (int i = 0; i < 2; ++i)
+        {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = m_levelSets[level];
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = bindings[i].descriptorType;
+        }
+        writes[0].pImageInfo = &source;
+        writes[1].pImageInfo = &destination;
+        vkUpdateDescriptorSets(m_device, 2, writes, 0, nullptr);
+    }
+
+    // パイプライン（読み込み元がデプスバッファかどうかはプッシュ定数で渡す）
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(HiZParams);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+    pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCI.setLayoutCount = 1;
+    pipelineLayoutCI.pSetLayouts = &m_setLayout;
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    vkCreatePipelineLayout(m_device, &pipelineLayoutCI, nullptr, &m_pipelineLayout);
+
+    VkShaderModuleCreateInfo moduleCI{};
+    moduleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleCI.pCode = shader.data();
+    moduleCI.codeSize = shader.size() * sizeof(uint32_t);
+    VkShaderModule shaderModule;
+    vkCreateShaderModule(m_device, &moduleCI, nullptr, &shaderModule);
+
+    VkComputePipelineCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    ci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    ci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    ci.stage.module = shaderModule;
+    ci.stage.pName = "main";
+    ci.layout = m_pipelineLayout;
+    const VkResult result = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &ci, nullptr, &m_pipeline);
+    vkDestroyShaderModule(m_device, shaderModule, nullptr);
+    if (result != VK_SUCCESS)
+    {
+        OutputDebugStringA("HiZPyramid: failed to create the compute pipeline.\n");
+        terminate();
+        return false;
+    }
+    return true;
+}
+
+void HiZPyramid::terminate()
+{
+    if (m_device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+    vkDestroySampler(m_device, m_sampler, nullptr);
+    for (auto view : m_levelViews)
+    {
+        vkDestroyImageView(m_device, view, nullptr);
+    }
+    vkDestroyImageView(m_device, m_view, nullptr);
+    vkDestroyImage(m_device, m_image, nullptr);
+    vkFreeMemory(m_device, m_memory, nullptr);
+
+    m_levelViews.clear();
+    m_levelSets.clear();
+    m_levelSizes.clear();
+    m_pipeline = VK_NULL_HANDLE;
+    m_pipelineLayout = VK_NULL_HANDLE;
+    m_descriptorPool = VK_NULL_HANDLE;
+    m_setLayout = VK_NULL_HANDLE;
+    m_sampler = VK_NULL_HANDLE;
+    m_view = VK_NULL_HANDLE;
+    m_image = VK_NULL_HANDLE;
+    m_memory = VK_NULL_HANDLE;
+    m_device = VK_NULL_HANDLE;
+}
+
+/// <summary>
+/// ピラミッドを作り直すコマンドを記録する
+/// 段ごとに、前の段の書き込みが終わってから次の段を読む
+/// </summary>
+void HiZPyramid::record(VkCommandBuffer command, VkImage depthImage)
+{
+    if (m_pipeline == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    // デプスの書き込みが終わってから読み、ピラミッドは前の内容を捨てて書き込む（前のフレームのカリングが読み終わってから）
+    const uint32_t levelCount = getLevelCount();
+    VkImageMemoryBarrier begin[2] = {
+        makeImageBarrier(depthImage, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
+        makeImageBarrier(m_image, VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT),
+    };
+    vkCmdPipelineBarrier(command, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, begin);
+
+    vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        const HiZParams params = { level == 0 ? 1u : 0u };
+        vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_levelSets[level], 0, nullptr);
+        vkCmdPushConstants(command, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+        vkCmdDispatch(command,
+            (m_levelSizes[level].width + HiZGroupSize - 1) / HiZGroupSize,
+            (m_levelSizes[level].height + HiZGroupSize - 1) / HiZGroupSize, 1);
+
+        // 書いた段を次の段（最後の段ならカリング）で読む
+        VkImageMemoryBarrier written = makeImageBarrier(m_image, VK_IMAGE_ASPECT_COLOR_BIT, level, 1,
+            VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        vkCmdPipelineBarrier(command, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &written);
+    }
+
+    // デプスバッファをアタッチメントに戻す（読み終わってから書き込む）
+    VkImageMemoryBarrier end = makeImageBarrier(depthImage, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        0, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+    vkCmdPipelineBarrier(command, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, &end);
+}
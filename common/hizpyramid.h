@@ -0,0 +1,56 @@
+#pragma once
+#include "vkappbase.h"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// デプスバッファから作る深度のミップピラミッド（Hi-Z）
+/// </summary>
+/// <remarks>
+/// 各テクセルは下の段の 2x2 テクセルの深度の最小値（R）と最大値（G）を持つ（R32G32_SFLOAT）。
+/// 0 段目はデプスバッファの半分の解像度（端数は切り上げ）で、n 段目の 1 テクセルは 2^(n+1) x 2^(n+1) ピクセルを覆う。
+/// 最後の段は 1x1 になる。
+/// record はコンピュートシェーダ（hiz.comp）を段ごとに 1 回ディスパッチする。
+/// デプスバッファを一時的にサンプリング用のレイアウトに移し、終わったらアタッチメントのレイアウトに戻す。
+/// ピラミッドは常に VK_IMAGE_LAYOUT_GENERAL で、record の後のコンピュートシェーダから getView と getSampler で texelFetch できる。
+/// </remarks>
+class HiZPyramid
+{
+public:
+    HiZPyramid();
+
+    // depthView はサンプリングできる（VK_IMAGE_USAGE_SAMPLED_BIT 付きの）デプスバッファのビュー、shader は hiz.comp の SPIR-V
+    bool initialize(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProps, const std::vector<uint32_t>& shader,
+        VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight);
+    void terminate();
+
+    // レンダーパスの外で記録する。depthImage は VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL であること
+    void record(VkCommandBuffer command, VkImage depthImage);
+
+    VkImageView getView() const { return m_view; }
+    VkSampler getSampler() const { return m_sampler; }
+    uint32_t getDepthWidth() const { return m_depthWidth; }
+    uint32_t getDepthHeight() const { return m_depthHeight; }
+    uint32_t getLevelCount() const { return uint32_t(m_levelViews.size()); }
+
+private:
+    VkDevice m_device;
+    VkImage m_image;
+    VkDeviceMemory m_memory;
+    VkImageView m_view;
+    VkSampler m_sampler;
+
+    // 段ごとのビュー（書き込み先と、次の段の読み込み元）とデスクリプタセット
+    std::vector<VkImageView> m_levelViews;
+    std::vector<VkDescriptorSet> m_levelSets;
+    std::vector<VkExtent2D> m_levelSizes;
+
+    VkDescriptorSetLayout m_setLayout;
+    VkDescriptorPool m_descriptorPool;
+    VkPipelineLayout m_pipelineLayout;
+    VkPipeline m_pipeline;
+
+    uint32_t m_depthWidth;
+    uint32_t m_depthHeight;
+};
@@ -0,0 +1,111 @@
+#include "instancing.h"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+InstanceData foldPositionQuantization(const InstanceData& instance, const PositionQuantization& quantization)
+{
+    // row . (offset + packed * scale, 1) = (row.xyz * scale) . packed + (row.xyz . offset + row.w)
+    auto fold = [&](const glm::vec4& row)
+    {
+        return glm::vec4(row.x * quantization.scale.x, row.y * quantization.scale.y, row.z * quantization.scale.z,
+            row.x * quantization.offset.x + row.y * quantization.offset.y + row.z * quantization.offset.z + row.w);
+    };
+
+    InstanceData result;
+    result.row0 = fold(instance.row0);
+    result.row1 = fold(instance.row1);
+    result.row2 = fold(instance.row2);
+    result.color = instance.color;
+    return result;
+}
+
+InstanceBatcher::InstanceBatcher()
+    : m_lastKey(~0ull), m_lastBatch(0)
+{
+}
+
+void InstanceBatcher::clear()
+{
+    m_instances.clear();
+    m_instanceBatches.clear();
+    m_batches.clear();
+    m_batchIndices.clear();
+    m_lastKey = ~0ull;
+    m_lastBatch = 0;
+}
+
+void InstanceBatcher::reserve(size_t instanceCount)
+{
+    m_instances.reserve(instanceCount);
+    m_instanceBatches.reserve(instanceCount);
+}
+
+void InstanceBatcher::add(uint32_t mesh, uint32_t material, const InstanceData& instance)
+{
+    // 同じ組が続けて登録されることが多いので、直前の組なら表を引かない
+    const uint64_t key = makeKey(mesh, material);
+    if (key != m_lastKey)
+    {
+        auto it = m_batchIndices.find(key);
+        if (it == m_batchIndices.end())
+        {
+            it = m_batchIndices.emplace(key, uint32_t(m_batches.size())).first;
+            m_batches.push_back({ mesh, material, 0, 0 });
+        }
+        m_lastKey = key;
+        m_lastBatch = it->second;
+    }
+
+    m_batches[m_lastBatch].instanceCount++;
+    m_instances.push_back(instance);
+    m_instanceBatches.push_back(m_lastBatch);
+}
+
+bool InstanceBatcher::build(FrameRingBuffer& ring, FrameAllocation& allocation)
+{
+    if (m_instances.empty())
+    {
+        return false;
+    }
+
+    // 組の並び順を決めて、それぞれの先頭位置を求める
+    vector<uint32_t> order(m_batches.size());
+    iota(order.begin(), order.end(), 0u);
+    sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+    {
+        return makeKey(m_batches[a].mesh, m_batches[a].material) < makeKey(m_batches[b].mesh, m_batches[b].material);
+    });
+
+    const VkDeviceSize size = VkDeviceSize(m_instances.size()) * sizeof(InstanceData);
+    if (!ring.allocate(size, 16, allocation))
+    {
+        return false;
+    }
+
+    vector<uint32_t> cursors(m_batches.size());
+    uint32_t first = 0;
+    for (auto i : order)
+    {
+        m_batches[i].firstInstance = first;
+        cursors[i] = first;
+        first += m_batches[i].instanceCount;
+    }
+
+    // 書き込み先は書き込み結合のメモリのことがあるので、読み戻さずに 1 回だけ書く
+    auto dst = static_cast<InstanceData*>(allocation.data);
+    for (size_t i = 0; i < m_instances.size(); ++i)
+    {
+        dst[cursors[m_instanceBatches[i]]++] = m_instances[i];
+    }
+
+    vector<InstanceBatch> sorted(m_batches.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        sorted[i] = m_batches[order[i]];
+    }
+    m_batches.swap(sorted);
+    return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "vertexlayout.h"
+#include "vertexpacking.h"
+#include "framering.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+/// <summary>
+/// インスタンシングで描画する 1 つ分のデータ（52 バイト）
+/// 変換は 3x4 のアフィン行列を行ごとに持つ（position' = (dot(row0, p), dot(row1, p), dot(row2, p))、p = (position, 1)）
+/// 頂点バッファのバインディングに VK_VERTEX_INPUT_RATE_INSTANCE で渡す。メッシュの頂点のロケーション（0 - 3）と重ならないよう 4 から使う
+/// </summary>
+struct InstanceData
+{
+    glm::vec4 row0;
+    glm::vec4 row1;
+    glm::vec4 row2;
+    Unorm8x4 color;
+};
+
+DECLARE_VERTEX_LAYOUT(InstanceData, VK_VERTEX_INPUT_RATE_INSTANCE,
+    VERTEX_ATTRIBUTE(InstanceData, row0, 4),
+    VERTEX_ATTRIBUTE(InstanceData, row1, 5),
+    VERTEX_ATTRIBUTE(InstanceData, row2, 6),
+    VERTEX_ATTRIBUTE(InstanceData, color, 7));
+
+// インスタンスの変換に位置の逆量子化（offset + packed * scale）を畳み込む
+// 量子化されたままの位置に直接掛けられるので、メッシュごとのプッシュ定数なしで描画できる
+InstanceData foldPositionQuantization(const InstanceData& instance, const PositionQuantization& quantization);
+
+/// <summary>
+/// 同じメッシュとマテリアルのインスタンスの並び（1 回の vkCmdDrawIndexed で描画する）
+/// firstInstance は build で確保した領域の先頭からの番号（その位置をバインドして vkCmdDrawIndexed に渡す）
+/// </summary>
+struct InstanceBatch
+{
+    uint32_t mesh;
+    uint32_t material;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+/// <summary>
+/// 描画するオブジェクトをメッシュとマテリアルの組ごとにまとめ、インスタンスのデータをフレームごとのバッファへ書き込む
+/// </summary>
+/// <remarks>
+/// 毎フレーム clear してから add でオブジェクトを登録し、build で書き込む（build の後は clear するまで add しないこと）。
+/// まとめ方は組ごとの個数を数えて先頭位置を決め、各インスタンスをその位置へ直接書き込む（インスタンス自体の比較ソートはしない）。
+/// 組はマテリアル、メッシュの順に並べるので、パイプラインの切り替えはマテリアルの数だけで済む。
+/// mesh / material の番号の意味は呼び出し側が決める。
+/// </remarks>
+class InstanceBatcher
+{
+public:
+    InstanceBatcher();
+
+    void clear();
+    void reserve(size_t instanceCount);
+
+    void add(uint32_t mesh, uint32_t material, const InstanceData& instance);
+
+    // ring から領域を確保してインスタンスを書き込む。allocation にはバインドするバッファと位置が入る
+    // 登録されたインスタンスが無い場合と、空きが足りない場合は false を返す
+    bool build(FrameRingBuffer& ring, FrameAllocation& allocation);
+
+    const std::vector<InstanceBatch>& getBatches() const { return m_batches; }
+    size_t getInstanceCount() const { return m_instances.size(); }
+
+private:
+    static uint64_t makeKey(uint32_t mesh, uint32_t material)
+    {
+        return (uint64_t(material) << 32) | mesh;
+    }
+
+    std::vector<InstanceData> m_instances;
+    std::vector<uint32_t> m_instanceBatches;
+    std::vector<InstanceBatch> m_batches;
+
+    // (マテリアル, メッシュ) -> m_batches の番号
+    std::unordered_map<uint64_t, uint32_t> m_batchIndices;
+    uint64_t m_lastKey;
+    uint32_t m_lastBatch;
+};
@@ -0,0 +1,494 @@
+#include "jobsystem.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <thread>
+#include <algorithm>
+
+using namespace std;
+
+struct JobCounter::Job
+{
+    function<void()> func;
+    JobCounter* counter;
+};
+
+namespace
+{
+    // ワーカーごとのキューに入るジョブの数（一杯なら投入したスレッドでそのまま実行する）
+    const int64_t WorkerQueueCapacity = 4096;
+
+    // ジョブが見つからない場合に、眠る前に探し直す回数
+    const int IdleSpinCount = 64;
+
+    const uint32_t NotWorker = ~0u;
+
+    // このスレッドがワーカーならその番号（ワーカーを持つジョブシステムも覚えておく）
+    thread_local const JobSystem* t_jobSystem = nullptr;
+    thread_local uint32_t t_workerIndex = NotWorker;
+
+    // 共有のジョブシステムを初期化する時にワーカーをコアに固定するか（JobSystem::setDefaultPinning）
+    atomic<bool> g_defaultPinning(false);
+
+    void pinThread(thread& t, unsigned core)
+    {
+#ifdef _WIN32
+        if (core < sizeof(DWORD_PTR) * 8)
+        {
+            SetThreadAffinityMask(t.native_handle(), DWORD_PTR(1) << core);
+        }
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#else
+        (void)t;
+        (void)core;
+#endif
+    }
+}
+
+/// <summary>
+/// Chase-Lev の両端キュー（Lê ほか「Correct and Efficient Work-Stealing for Weak Memory Models」のメモリ順序による）
+/// push / pop は持ち主のワーカーだけが末尾で行い、steal は他のスレッドが先頭から行う。
+/// 取り合いになるのは最後の 1 つだけで、その場合だけ top の CAS で決着をつける
+/// </summary>
+class JobSystem::Worker
+{
+public:
+    Worker() : m_top(0), m_bottom(0), m_jobs(size_t(WorkerQueueCapacity)), m_random(0) {}
+
+    bool push(Job* job)
+    {
+        const int64_t b = m_bottom.load(memory_order_relaxed);
+        const int64_t t = m_top.load(memory_order_acquire);
+        if (b - t >= WorkerQueueCapacity)
+        {
+            return false;
+        }
+        m_jobs[size_t(b & (WorkerQueueCapacity - 1))].store(job, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        m_bottom.store(b + 1, memory_order_relaxed);
+        return true;
+    }
+
+    Job* pop()
+    {
+        const int64_t b = m_bottom.load(memory_order_relaxed) - 1;
+        m_bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = m_top.load(memory_order_relaxed);
+        if (t > b)
+        {
+            m_bottom.store(b + 1, memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job* job = m_jobs[size_t(b & (WorkerQueueCapacity - 1))].load(memory_order_relaxed);
+        if (t == b)
+        {
+            // 最後の 1 つは steal と取り合う
+            if (!m_top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+            {
+                job = nullptr;
+            }
+            m_bottom.store(b + 1, memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* steal()
+    {
+        int64_t t = m_top.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        const int64_t b = m_bottom.load(memory_order_acquire);
+        if (t >= b)
+        {
+            return nullptr;
+        }
+        Job* job = m_jobs[size_t(t & (WorkerQueueCapacity - 1))].load(memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return job;
+    }
+
+    bool isEmpty() const
+    {
+        return m_bottom.load(memory_order_relaxed) <= m_top.load(memory_order_relaxed);
+    }
+
+    // 盗む相手を選ぶ乱数（xorshift）
+    uint32_t nextRandom()
+    {
+        m_random ^= m_random << 13;
+        m_random ^= m_random >> 17;
+        m_random ^= m_random << 5;
+        return m_random;
+    }
+
+    void seedRandom(uint32_t seed) { m_random = seed != 0 ? seed : 1; }
+
+    thread m_thread;
+
+private:
+    // top と bottom は別のスレッドが書くので、別のキャッシュラインに置く
+    atomic<int64_t> m_top;
+    char m_padding[64];
+    atomic<int64_t> m_bottom;
+    vector<atomic<Job*>> m_jobs;
+    uint32_t m_random;
+};
+
+JobSystem::JobSystem()
+    : m_sharedCount(0)
+    , m_queuedCount(0)
+    , m_sleepingCount(0)
+    , m_stopping(false)
+{
+}
+
+JobSystem::~JobSystem()
+{
+    terminate();
+}
+
+JobSystem& JobSystem::getDefault()
+{
+    static JobSystem instance;
+    static once_flag initialized;
+    call_once(initialized, []() {
+        if (instance.m_workers.empty())
+        {
+            instance.initialize(0, g_defaultPinning);
+        }
+    });
+    return instance;
+}
+
+void JobSystem::setDefaultPinning(bool pinThreads)
+{
+    g_defaultPinning = pinThreads;
+}
+
+void JobSystem::initialize(uint32_t workerCount, bool pinThreads)
+{
+    terminate();
+
+    const unsigned coreCount = max(1u, thread::hardware_concurrency());
+    if (workerCount == 0)
+    {
+        workerCount = coreCount - 1;
+    }
+
+    m_stopping = false;
+    m_workers.resize(workerCount);
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        m_workers[i].reset(new Worker());
+        m_workers[i]->seedRandom(0x9e3779b9u * (i + 1));
+    }
+
+    // すべてのワーカーを作ってから起動する（起動したワーカーは他のワーカーから盗む）
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        m_workers[i]->m_thread = thread(&JobSystem::workerMain, this, i);
+        if (pinThreads)
+        {
+            pinThread(m_workers[i]->m_thread, (i + 1) % coreCount);
+        }
+    }
+}
+
+void JobSystem::terminate()
+{
+    if (m_workers.empty())
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker->m_thread.join();
+    }
+
+    // 実行されずに残ったジョブは、呼び出したスレッドで片付ける
+    for (auto& worker : m_workers)
+    {
+        while (auto job = worker->pop())
+        {
+            m_queuedCount--;
+            execute(job);
+        }
+    }
+    for (;;)
+    {
+        Job* job = nullptr;
+        {
+            lock_guard<mutex> lock(m_sharedMutex);
+            if (m_sharedJobs.empty())
+            {
+                break;
+            }
+            job = m_sharedJobs.front();
+            m_sharedJobs.pop_front();
+            m_sharedCount--;
+        }
+        m_queuedCount--;
+        execute(job);
+    }
+    m_workers.clear();
+}
+
+void JobSystem::run(function<void()> func, JobCounter* counter)
+{
+    if (counter != nullptr)
+    {
+        counter->m_count.fetch_add(1, memory_order_relaxed);
+    }
+    push(new Job{ move(func), counter });
+}
+
+/// <summary>
+/// 継続の登録と dependency が 0 になる処理（finish）が競合しないよう、0 になった後の継続の取り出しと
+/// 登録はどちらも dependency のロックの中で行う
+/// </summary>
+void JobSystem::runAfter(JobCounter& dependency, function<void()> func, JobCounter* counter)
+{
+    if (counter != nullptr)
+    {
+        counter->m_count.fetch_add(1, memory_order_relaxed);
+    }
+    Job* job = new Job{ move(func), counter };
+    {
+        lock_guard<mutex> lock(dependency.m_mutex);
+        if (dependency.m_count.load() != 0)
+        {
+            dependency.m_continuations.push_back(job);
+            return;
+        }
+    }
+    push(job);
+}
+
+void JobSystem::wait(const JobCounter& counter)
+{
+    const uint32_t workerIndex = t_jobSystem == this ? t_workerIndex : NotWorker;
+    while (!counter.isDone())
+    {
+        if (Job* job = take(workerIndex))
+        {
+            execute(job);
+        }
+        else
+        {
+            this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t grainSize, const function<void(size_t, size_t)>& func)
+{
+    grainSize = max<size_t>(grainSize, 1);
+    if (count <= grainSize || m_workers.empty())
+    {
+        if (count > 0)
+        {
+            func(0, count);
+        }
+        return;
+    }
+
+    JobCounter counter;
+    processRange(0, count, grainSize, func, counter);
+    wait(counter);
+}
+
+/// <summary>
+/// [begin, end) を grainSize ずつ処理する。他のスレッドが取れる仕事が無くなっていれば、残りの後ろ半分をジョブにして渡す
+/// </summary>
+void JobSystem::processRange(size_t begin, size_t end, size_t grainSize, const function<void(size_t, size_t)>& func, JobCounter& counter)
+{
+    while (begin < end)
+    {
+        if (end - begin > grainSize && !hasQueuedWork())
+        {
+            const size_t middle = begin + (end - begin + 1) / 2;
+            run([this, middle, end, grainSize, &func, &counter]() { processRange(middle, end, grainSize, func, counter); }, &counter);
+            end = middle;
+            continue;
+        }
+        const size_t chunkEnd = min(begin + grainSize, end);
+        func(begin, chunkEnd);
+        begin = chunkEnd;
+    }
+}
+
+/// <summary>
+/// ワーカーなら自分のキューに、それ以外なら共有のキューに入れ、眠っているワーカーがいれば起こす
+/// 眠る側は眠っている数を増やしてからキューの中身の数を見るので、どちらかが必ず相手の変更に気付く
+/// </summary>
+void JobSystem::push(Job* job)
+{
+    if (m_workers.empty())
+    {
+        execute(job);
+        return;
+    }
+
+    m_queuedCount.fetch_add(1);
+    if (t_jobSystem == this && t_workerIndex != NotWorker)
+    {
+        if (!m_workers[t_workerIndex]->push(job))
+        {
+            m_queuedCount--;
+            execute(job);
+            return;
+        }
+    }
+    else
+    {
+        lock_guard<mutex> lock(m_sharedMutex);
+        m_sharedJobs.push_back(job);
+        m_sharedCount++;
+    }
+
+    if (m_sleepingCount.load() > 0)
+    {
+        lock_guard<mutex> lock(m_sleepMutex);
+        m_wakeup.notify_one();
+    }
+}
+
+/// <summary>
+/// 自分のキューの末尾、共有のキュー、他のワーカーのキューの先頭（乱数で選んだワーカーから順に）の順に探す
+/// </summary>
+JobSystem::Job* JobSystem::take(uint32_t workerIndex)
+{
+    Job* job = nullptr;
+    if (workerIndex != NotWorker)
+    {
+        job = m_workers[workerIndex]->pop();
+    }
+    if (job == nullptr && m_sharedCount.load(memory_order_relaxed) > 0)
+    {
+        lock_guard<mutex> lock(m_sharedMutex);
+        if (!m_sharedJobs.empty())
+        {
+            job = m_sharedJobs.front();
+            m_sharedJobs.pop_front();
+            m_sharedCount--;
+        }
+    }
+    if (job == nullptr)
+    {
+        const uint32_t workerCount = uint32_t(m_workers.size());
+        const uint32_t start = workerIndex != NotWorker
+            ? m_workers[workerIndex]->nextRandom() % workerCount
+            : uint32_t(hash<thread::id>()(this_thread::get_id()) % workerCount);
+        for (uint32_t i = 0; i < workerCount && job == nullptr; ++i)
+        {
+            const uint32_t victim = (start + i) % workerCount;
+            if (victim != workerIndex)
+            {
+                job = m_workers[victim]->steal();
+            }
+        }
+    }
+    if (job != nullptr)
+    {
+        m_queuedCount--;
+    }
+    return job;
+}
+
+void JobSystem::execute(Job* job)
+{
+    job->func();
+    JobCounter* counter = job->counter;
+    delete job;
+    finish(counter);
+}
+
+/// <summary>
+/// 数を減らす間は m_finishing を増やしておき、待っているスレッドが継続の投入の途中でカウンタを破棄しないようにする
+/// （最後に m_finishing を減らした後はカウンタに触れない）
+/// </summary>
+void JobSystem::finish(JobCounter* counter)
+{
+    if (counter == nullptr)
+    {
+        return;
+    }
+
+    counter->m_finishing.fetch_add(1);
+    if (counter->m_count.fetch_sub(1) == 1)
+    {
+        vector<Job*> continuations;
+        {
+            lock_guard<mutex> lock(counter->m_mutex);
+            continuations.swap(counter->m_continuations);
+        }
+        for (auto job : continuations)
+        {
+            push(job);
+        }
+    }
+    counter->m_finishing.fetch_sub(1);
+}
+
+bool JobSystem::hasQueuedWork() const
+{
+    if (t_jobSystem == this && t_workerIndex != NotWorker)
+    {
+        return !m_workers[t_workerIndex]->isEmpty();
+    }
+    return m_sharedCount.load(memory_order_relaxed) > 0;
+}
+
+void JobSystem::workerMain(uint32_t workerIndex)
+{
+    t_jobSystem = this;
+    t_workerIndex = workerIndex;
+
+    int idleCount = 0;
+    while (!m_stopping.load(memory_order_relaxed))
+    {
+        if (Job* job = take(workerIndex))
+        {
+            execute(job);
+            idleCount = 0;
+            continue;
+        }
+        if (++idleCount < IdleSpinCount)
+        {
+            this_thread::yield();
+            continue;
+        }
+
+        unique_lock<mutex> lock(m_sleepMutex);
+        m_sleepingCount.fetch_add(1);
+        m_wakeup.wait(lock, [this]() { return m_queuedCount.load() > 0 || m_stopping.load(); });
+        m_sleepingCount.fetch_sub(1);
+        idleCount = 0;
+    }
+
+    t_jobSystem = nullptr;
+    t_workerIndex = NotWorker;
+}
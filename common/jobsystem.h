@@ -0,0 +1,117 @@
+#pragma once
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+
+class JobSystem;
+
+/// <summary>
+/// ジョブの完了を数えるカウンタ
+/// run で渡すと投入時に 1 増え、ジョブが終わると 1 減る。0 になったら runAfter で登録したジョブ（継続）を投入する
+/// isDone が true になれば、ジョブシステムはもうカウンタに触れないので破棄してよい
+/// </summary>
+class JobCounter
+{
+public:
+    JobCounter() : m_count(0), m_finishing(0) {}
+
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool isDone() const { return m_count.load() == 0 && m_finishing.load() == 0; }
+
+private:
+    friend class JobSystem;
+    struct Job;
+
+    std::atomic<uint32_t> m_count;
+
+    // ジョブの終わりの処理（数を減らして継続を投入する）の途中のスレッドの数
+    std::atomic<uint32_t> m_finishing;
+    std::mutex m_mutex;
+    std::vector<Job*> m_continuations;
+};
+
+/// <summary>
+/// 決まった数のワーカースレッドでジョブを実行する
+/// </summary>
+/// <remarks>
+/// ワーカーはそれぞれ Chase-Lev の両端キューを持ち、自分で投入したジョブは末尾から取り出し（後に積んだものほどキャッシュに残っている）、
+/// 自分のキューが空になったら他のワーカーのキューの先頭から盗む。ワーカー同士の受け渡しでロックを取るのは、眠る・起こす場合だけになる。
+/// ワーカー以外のスレッド（メインスレッドや描画スレッド）が投入したジョブは共有のキューに入れ、ワーカーはそこからも取り出す。
+/// wait はカウンタが 0 になるまでの間、呼んだスレッドでも他のジョブを実行する（ジョブの中で wait してもワーカーが塞がらない）。
+///
+/// parallelFor は範囲を最初から細かく分けず、実行しながら分ける（lazy binary splitting）。
+/// 範囲を grainSize ずつ処理し、その間に自分のキューが空になっていれば（他のスレッドが取れる仕事が無ければ）残りの後ろ半分をジョブにする。
+/// 他のスレッドが空いていればすぐに半分が盗まれてさらに分かれ、皆が忙しければ分けずに続けて処理するので、
+/// 要素ごとの処理時間が偏っていても、要素が軽くて多くても、分ける単位を調整しなくてよい。
+///
+/// ワーカーの数を指定しなければ、コア数 - 1（呼び出したスレッドの分を空ける）にする。
+/// pinThreads を指定すると、ワーカー i を論理コア i + 1 に固定する（コア 0 はメインスレッドのために空ける）。
+/// </remarks>
+class JobSystem
+{
+public:
+    JobSystem();
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // parallelFor（parallel.h）などが使う共有のジョブシステム（初めて使う時にワーカーの数を指定せずに初期化する）
+    static JobSystem& getDefault();
+
+    // 共有のジョブシステムのワーカーをコアに固定するか（getDefault を初めて呼ぶ前に設定する。ワーカーを作り直さずに済む）
+    static void setDefaultPinning(bool pinThreads);
+
+    // 既に初期化されていれば作り直す（他のスレッドがジョブを投入していない時に呼ぶこと）
+    void initialize(uint32_t workerCount = 0, bool pinThreads = false);
+    void terminate();
+
+    // func を実行するジョブを投入する
+    void run(std::function<void()> func, JobCounter* counter = nullptr);
+
+    // dependency が 0 になってから func を実行する（既に 0 なら、すぐに投入する）
+    void runAfter(JobCounter& dependency, std::function<void()> func, JobCounter* counter = nullptr);
+
+    // counter が 0 になるまで、他のジョブを実行しながら待つ
+    void wait(const JobCounter& counter);
+
+    // [0, count) を分けて func(begin, end) を並列に呼ぶ。grainSize より細かくは分けない。全て終わるまで戻らない
+    void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& func);
+
+    // ジョブを実行するスレッドの数（ワーカーと、wait する呼び出し元のスレッド）
+    unsigned getThreadCount() const { return unsigned(m_workers.size()) + 1; }
+
+private:
+    typedef JobCounter::Job Job;
+    class Worker;
+
+    void push(Job* job);
+    Job* take(uint32_t workerIndex);
+    void execute(Job* job);
+    void finish(JobCounter* counter);
+    bool hasQueuedWork() const;
+    void workerMain(uint32_t workerIndex);
+    void processRange(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& func, JobCounter& counter);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    // ワーカー以外のスレッドが投入したジョブ
+    mutable std::mutex m_sharedMutex;
+    std::deque<Job*> m_sharedJobs;
+    std::atomic<size_t> m_sharedCount;
+
+    // キューに入っていてまだ取り出されていないジョブの数と、眠っているワーカーの数
+    std::atomic<size_t> m_queuedCount;
+    std::atomic<uint32_t> m_sleepingCount;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeup;
+    std::atomic<bool> m_stopping;
+};
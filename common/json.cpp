@@ -0,0 +1,378 @@
+#include "json.h"
+
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    const JsonValue NullValue;
+
+    // 深すぎる入れ子でスタックを使い切らないための制限
+    const int MaxDepth = 256;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+    if (m_type != Type::Array || index >= m_elements.size())
+    {
+        return NullValue;
+    }
+    return m_elements[index];
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const
+{
+    for (const auto& m : m_members)
+    {
+        if (m.first == key)
+        {
+            return m.second;
+        }
+    }
+    return NullValue;
+}
+
+bool JsonValue::has(const char* key) const
+{
+    for (const auto& m : m_members)
+    {
+        if (m.first == key)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// <summary>
+/// 再帰下降の JSON パーサ
+/// </summary>
+class JsonParser
+{
+public:
+    JsonParser(const char* text, size_t length)
+        : m_cur(text), m_begin(text), m_end(text + length)
+    {
+    }
+
+    bool parse(JsonValue& result, string& error)
+    {
+        skipWhitespace();
+        if (!parseValue(result, 0))
+        {
+            error = m_error;
+            return false;
+        }
+        skipWhitespace();
+        if (m_cur != m_end)
+        {
+            fail("unexpected trailing characters");
+            error = m_error;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool fail(const char* message)
+    {
+        stringstream ss;
+        ss << "offset " << (m_cur - m_begin) << ": " << message;
+        m_error = ss.str();
+        return false;
+    }
+
+    void skipWhitespace()
+    {
+        while (m_cur < m_end && (*m_cur == ' ' || *m_cur == '\t' || *m_cur == '\n' || *m_cur == '\r'))
+        {
+            ++m_cur;
+        }
+    }
+
+    bool consumeLiteral(const char* literal)
+    {
+        size_t length = strlen(literal);
+        if (size_t(m_end - m_cur) < length || memcmp(m_cur, literal, length) != 0)
+        {
+            return fail("invalid literal");
+        }
+        m_cur += length;
+        return true;
+    }
+
+    bool parseValue(JsonValue& value, int depth)
+    {
+        if (depth > MaxDepth)
+        {
+            return fail("nesting too deep");
+        }
+        if (m_cur == m_end)
+        {
+            return fail("unexpected end of input");
+        }
+
+        switch (*m_cur)
+        {
+        case '{':
+            return parseObject(value, depth);
+        case '[':
+            return parseArray(value, depth);
+        case '"':
+            value.m_type = JsonValue::Type::String;
+            return parseString(value.m_string);
+        case 't':
+            value.m_type = JsonValue::Type::Bool;
+            value.m_bool = true;
+            return consumeLiteral("true");
+        case 'f':
+            value.m_type = JsonValue::Type::Bool;
+            value.m_bool = false;
+            return consumeLiteral("false");
+        case 'n':
+            value.m_type = JsonValue::Type::Null;
+            return consumeLiteral("null");
+        default:
+            return parseNumber(value);
+        }
+    }
+
+    bool parseObject(JsonValue& value, int depth)
+    {
+        value.m_type = JsonValue::Type::Object;
+        ++m_cur;
+        skipWhitespace();
+        if (m_cur < m_end && *m_cur == '}')
+        {
+            ++m_cur;
+            return true;
+        }
+
+        for (;;)
+        {
+            skipWhitespace();
+            if (m_cur == m_end || *m_cur != '"')
+            {
+                return fail("expected object key");
+            }
+
+            value.m_members.emplace_back();
+            auto& member = value.m_members.back();
+            if (!parseString(member.first))
+            {
+                return false;
+            }
+
+            skipWhitespace();
+            if (m_cur == m_end || *m_cur != ':')
+            {
+                return fail("expected ':'");
+            }
+            ++m_cur;
+            skipWhitespace();
+            if (!parseValue(member.second, depth + 1))
+            {
+                return false;
+            }
+
+            skipWhitespace();
+            if (m_cur < m_end && *m_cur == ',')
+            {
+                ++m_cur;
+                continue;
+            }
+            if (m_cur < m_end && *m_cur == '}')
+            {
+                ++m_cur;
+                return true;
+            }
+            return fail("expected ',' or '}'");
+        }
+    }
+
+    bool parseArray(JsonValue& value, int depth)
+    {
+        value.m_type = JsonValue::Type::Array;
+        ++m_cur;
+        skipWhitespace();
+        if (m_cur < m_end && *m_cur == ']')
+        {
+            ++m_cur;
+            return true;
+        }
+
+        for (;;)
+        {
+            skipWhitespace();
+            value.m_elements.emplace_back();
+            if (!parseValue(value.m_elements.back(), depth + 1))
+            {
+                return false;
+            }
+
+            skipWhitespace();
+            if (m_cur < m_end && *m_cur == ',')
+            {
+                ++m_cur;
+                continue;
+            }
+            if (m_cur < m_end && *m_cur == ']')
+            {
+                ++m_cur;
+                return true;
+            }
+            return fail("expected ',' or ']'");
+        }
+    }
+
+    bool parseHex4(uint32_t& code)
+    {
+        if (m_end - m_cur < 4)
+        {
+            return fail("invalid unicode escape");
+        }
+        code = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            char c = *m_cur++;
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= uint32_t(c - '0');
+            else if (c >= 'a' && c <= 'f') code |= uint32_t(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') code |= uint32_t(c - 'A' + 10);
+            else return fail("invalid unicode escape");
+        }
+        return true;
+    }
+
+    static void appendUtf8(string& s, uint32_t code)
+    {
+        if (code < 0x80)
+        {
+            s += char(code);
+        }
+        else if (code < 0x800)
+        {
+            s += char(0xc0 | (code >> 6));
+            s += char(0x80 | (code & 0x3f));
+        }
+        else if (code < 0x10000)
+        {
+            s += char(0xe0 | (code >> 12));
+            s += char(0x80 | ((code >> 6) & 0x3f));
+            s += char(0x80 | (code & 0x3f));
+        }
+        else
+        {
+            s += char(0xf0 | (code >> 18));
+            s += char(0x80 | ((code >> 12) & 0x3f));
+            s += char(0x80 | ((code >> 6) & 0x3f));
+            s += char(0x80 | (code & 0x3f));
+        }
+    }
+
+    bool parseString(string& s)
+    {
+        ++m_cur;
+        for (;;)
+        {
+            // エスケープのない部分はまとめてコピーする
+            auto start = m_cur;
+            while (m_cur < m_end && *m_cur != '"' && *m_cur != '\\')
+            {
+                ++m_cur;
+            }
+            s.append(start, m_cur);
+
+            if (m_cur == m_end)
+            {
+                return fail("unterminated string");
+            }
+            if (*m_cur == '"')
+            {
+                ++m_cur;
+                return true;
+            }
+
+            ++m_cur;
+            if (m_cur == m_end)
+            {
+                return fail("unterminated string");
+            }
+            char c = *m_cur++;
+            switch (c)
+            {
+            case '"': s += '"'; break;
+            case '\\': s += '\\'; break;
+            case '/': s += '/'; break;
+            case 'b': s += '\b'; break;
+            case 'f': s += '\f'; break;
+            case 'n': s += '\n'; break;
+            case 'r': s += '\r'; break;
+            case 't': s += '\t'; break;
+            case 'u':
+            {
+                uint32_t code = 0;
+                if (!parseHex4(code))
+                {
+                    return false;
+                }
+                // サロゲートペア
+                if (code >= 0xd800 && code < 0xdc00 && m_end - m_cur >= 6 && m_cur[0] == '\\' && m_cur[1] == 'u')
+                {
+                    m_cur += 2;
+                    uint32_t low = 0;
+                    if (!parseHex4(low))
+                    {
+                        return false;
+                    }
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                }
+                appendUtf8(s, code);
+                break;
+            }
+            default:
+                return fail("invalid escape sequence");
+            }
+        }
+    }
+
+    bool parseNumber(JsonValue& value)
+    {
+        // strtod はロケールの影響を受けるが、glTF で小数点以外の区切りが使われることはない
+        auto start = m_cur;
+        while (m_cur < m_end && *m_cur != '\0' && strchr("+-0123456789.eE", *m_cur) != nullptr)
+        {
+            ++m_cur;
+        }
+        if (start == m_cur)
+        {
+            return fail("unexpected character");
+        }
+
+        string text(start, m_cur);
+        char* end = nullptr;
+        value.m_type = JsonValue::Type::Number;
+        value.m_number = strtod(text.c_str(), &end);
+        if (end != text.c_str() + text.size())
+        {
+            m_cur = start;
+            return fail("invalid number");
+        }
+        return true;
+    }
+
+    const char* m_cur;
+    const char* m_begin;
+    const char* m_end;
+    string m_error;
+};
+
+bool parseJson(const char* text, size_t length, JsonValue& result, string& error)
+{
+    result = JsonValue();
+    JsonParser parser(text, length);
+    return parser.parse(result, error);
+}
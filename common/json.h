@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// JSON の値（glTF などのメタデータを読むための最小限の DOM）
+/// </summary>
+/// <remarks>
+/// 存在しないキーや範囲外の要素を参照すると null の値が返るので、
+/// gltf["meshes"][0]["primitives"] のように続けて辿ってから型を確認すればよい。
+/// </remarks>
+class JsonValue
+{
+public:
+    enum class Type
+    {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object,
+    };
+
+    JsonValue() : m_type(Type::Null), m_number(0.0), m_bool(false) {}
+
+    Type getType() const { return m_type; }
+    bool isNull() const { return m_type == Type::Null; }
+    bool isNumber() const { return m_type == Type::Number; }
+    bool isString() const { return m_type == Type::String; }
+    bool isArray() const { return m_type == Type::Array; }
+    bool isObject() const { return m_type == Type::Object; }
+
+    double asNumber(double defaultValue = 0.0) const { return m_type == Type::Number ? m_number : defaultValue; }
+    uint32_t asUint(uint32_t defaultValue = 0) const { return m_type == Type::Number ? uint32_t(m_number) : defaultValue; }
+    bool asBool(bool defaultValue = false) const { return m_type == Type::Bool ? m_bool : defaultValue; }
+    const std::string& asString() const { return m_string; }
+
+    // 配列の要素数、またはオブジェクトのメンバ数
+    size_t size() const { return m_type == Type::Array ? m_elements.size() : m_members.size(); }
+
+    const JsonValue& operator[](size_t index) const;
+    const JsonValue& operator[](const char* key) const;
+    bool has(const char* key) const;
+
+    const std::vector<std::pair<std::string, JsonValue>>& getMembers() const { return m_members; }
+
+private:
+    friend class JsonParser;
+
+    Type m_type;
+    double m_number;
+    bool m_bool;
+    std::string m_string;
+    std::vector<JsonValue> m_elements;
+    std::vector<std::pair<std::string, JsonValue>> m_members;
+};
+
+// 失敗した場合は error に位置と理由が入る
+bool parseJson(const char* text, size_t length, JsonValue& result, std::string& error);
@@ -0,0 +1,145 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <string>
+
+using namespace std;
+
+MappedFile::MappedFile()
+    : m_data(nullptr), m_size(0), m_opened(false)
+#ifdef _WIN32
+    , m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#else
+    , m_file(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char* fileName)
+{
+    close();
+
+#ifdef _WIN32
+    // パスは UTF-8 で受け取り、ワイド文字版の API で開く
+    int length = MultiByteToWideChar(CP_UTF8, 0, fileName, -1, nullptr, 0);
+    wstring wideName(size_t(length), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, fileName, -1, &wideName[0], length);
+
+    // 先読みのヒントとして FILE_FLAG_SEQUENTIAL_SCAN を付ける
+    m_file = CreateFileW(wideName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_file, &fileSize))
+    {
+        close();
+        return false;
+    }
+    m_size = size_t(fileSize.QuadPart);
+    m_opened = true;
+
+    // 空のファイルはマップできない
+    if (m_size == 0)
+    {
+        return true;
+    }
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr)
+    {
+        close();
+        return false;
+    }
+#else
+    m_file = ::open(fileName, O_RDONLY);
+    if (m_file < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_file, &st) != 0)
+    {
+        close();
+        return false;
+    }
+    m_size = size_t(st.st_size);
+    m_opened = true;
+
+    if (m_size == 0)
+    {
+        return true;
+    }
+
+    void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+    if (p == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    madvise(p, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const uint8_t*>(p);
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (m_data != nullptr)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != nullptr)
+    {
+        CloseHandle(m_mapping);
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+    }
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    if (m_data != nullptr)
+    {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+    if (m_file >= 0)
+    {
+        ::close(m_file);
+    }
+    m_file = -1;
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_opened = false;
+}
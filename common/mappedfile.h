@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// 読み取り専用でメモリマップしたファイル
+/// </summary>
+/// <remarks>
+/// ファイルの内容はページ単位で必要になった時に読み込まれるので、
+/// 複数のスレッドから別々の範囲を読んでも I/O はそれぞれ並行して行われる。
+/// </remarks>
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // fileName は UTF-8
+    bool open(const char* fileName);
+    void close();
+
+    bool isOpen() const { return m_opened; }
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    bool m_opened;
+
+#ifdef _WIN32
+    void* m_file;
+    void* m_mapping;
+#else
+    int m_file;
+#endif
+};
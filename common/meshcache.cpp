@@ -0,0 +1,422 @@
+#include "meshcache.h"
+#include "meshcodec.h"
+#include "meshoptimizer.h"
+#include "parallel.h"
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    // ブロックの大きさ（実行時の 1 作業分。ステージングバッファはこれより大きい必要がある）
+    const uint32_t VerticesPerBlock = 16384;
+    const uint32_t IndicesPerBlock = 65535;    // 三角形の途中で区切らないよう 3 の倍数にする
+
+    uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + MeshCacheAlignment - 1) & ~uint64_t(MeshCacheAlignment - 1);
+    }
+
+    bool isRangeValid(uint64_t offset, uint64_t size, uint64_t fileSize)
+    {
+        return offset <= fileSize && size <= fileSize - offset;
+    }
+}
+
+/// <summary>
+/// クック済みのメッシュを書き出す（MeshCooker から使う）
+/// ブロックごとの圧縮は並列に行い、圧縮しても小さくならないブロックはそのまま保存する
+/// </summary>
+bool writeMeshCache(const char* fileName, const MeshCacheSource& source, bool compress)
+{
+    uint32_t maxVertexCount = 0;
+    for (uint32_t i = 0; i < source.primitiveCount; ++i)
+    {
+        maxVertexCount = max(maxVertexCount, source.primitives[i].vertexCount);
+    }
+    const auto indexType = selectIndexType(maxVertexCount);
+    const auto indexSize = getIndexSize(indexType);
+
+    MeshCacheHeader header{};
+    header.magic = MeshCacheMagic;
+    header.version = MeshCacheVersion;
+    header.vertexStride = sizeof(MeshVertex);
+
+    constexpr auto attributes = VertexLayout<MeshVertex>::attributes();
+    static_assert(attributes.size() <= MeshCacheMaxAttributes, "too many vertex attributes for the mesh cache");
+    header.attributeCount = uint32_t(attributes.size());
+    for (size_t i = 0; i < attributes.size(); ++i)
+    {
+        header.attributes[i] = { attributes[i].location, uint32_t(attributes[i].format), attributes[i].offset, attributes[i].size };
+    }
+
+    header.indexType = uint32_t(indexType);
+    header.vertexCount = source.vertexCount;
+    header.indexCount = source.indexCount;
+    header.primitiveCount = source.primitiveCount;
+    header.sourceSize = source.sourceSize;
+    header.sourceTime = source.sourceTime;
+
+    // プリミティブと LOD とメッシュレットのテーブル
+    vector<MeshCachePrimitive> primitives(source.primitiveCount);
+    vector<MeshCacheLod> lods;
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (uint32_t i = 0; i < source.primitiveCount; ++i)
+    {
+        const auto& src = source.primitives[i];
+        auto& dst = primitives[i];
+        dst.vertexOffset = uint32_t(src.vertexOffset);
+        dst.vertexCount = src.vertexCount;
+        dst.firstLod = uint32_t(lods.size());
+        dst.lodCount = src.lodCount;
+        dst.firstMeshlet = src.firstMeshlet;
+        dst.meshletCount = src.meshletCount;
+        memcpy(dst.quantizationOffset, &src.quantization.offset, sizeof(dst.quantizationOffset));
+        memcpy(dst.quantizationScale, &src.quantization.scale, sizeof(dst.quantizationScale));
+        memcpy(dst.boundsMin, &src.boundsMin, sizeof(dst.boundsMin));
+        memcpy(dst.boundsMax, &src.boundsMax, sizeof(dst.boundsMax));
+        boundsMin = glm::min(boundsMin, src.boundsMin);
+        boundsMax = glm::max(boundsMax, src.boundsMax);
+
+        for (uint32_t l = 0; l < src.lodCount; ++l)
+        {
+            lods.push_back({ src.lods[l].firstIndex, src.lods[l].indexCount, src.lods[l].error, 0 });
+        }
+    }
+    header.lodCount = uint32_t(lods.size());
+
+    vector<MeshCacheMeshlet> meshlets(source.meshletCount);
+    for (uint32_t i = 0; i < source.meshletCount; ++i)
+    {
+        const auto& src = source.meshlets[i];
+        auto& dst = meshlets[i];
+        dst.firstIndex = src.firstIndex;
+        dst.triangleCount = src.triangleCount;
+        dst.vertexCount = src.vertexCount;
+        dst.coneCutoff = src.coneCutoff;
+        memcpy(dst.center, &src.center, sizeof(dst.center));
+        dst.radius = src.radius;
+        memcpy(dst.coneApex, &src.coneApex, sizeof(dst.coneApex));
+        memcpy(dst.coneAxis, &src.coneAxis, sizeof(dst.coneAxis));
+    }
+    header.meshletCount = source.meshletCount;
+    memcpy(header.boundsMin, &boundsMin, sizeof(header.boundsMin));
+    memcpy(header.boundsMax, &boundsMax, sizeof(header.boundsMax));
+
+    // ブロックに区切って符号化する
+    vector<MeshCacheBlock> blocks;
+    for (uint32_t first = 0; first < source.vertexCount; first += VerticesPerBlock)
+    {
+        blocks.push_back({ MeshCacheVertexStream, MeshCacheRaw, first, min(VerticesPerBlock, source.vertexCount - first), 0, 0 });
+    }
+    for (uint32_t first = 0; first < source.indexCount; first += IndicesPerBlock)
+    {
+        blocks.push_back({ MeshCacheIndexStream, MeshCacheRaw, first, min(IndicesPerBlock, source.indexCount - first), 0, 0 });
+    }
+
+    vector<vector<uint8_t>> blockData(blocks.size());
+    parallelFor(blocks.size(), [&](size_t i)
+    {
+        auto& block = blocks[i];
+        auto& data = blockData[i];
+        if (block.stream == MeshCacheVertexStream)
+        {
+            auto src = reinterpret_cast<const uint8_t*>(source.vertices + block.first);
+            const size_t rawSize = size_t(block.count) * sizeof(MeshVertex);
+            if (compress)
+            {
+                encodeVertexBlock(src, block.count, sizeof(MeshVertex), data);
+            }
+            if (!compress || data.size() >= rawSize)
+            {
+                data.assign(src, src + rawSize);
+            }
+            else
+            {
+                block.encoding = MeshCacheCompressed;
+            }
+        }
+        else
+        {
+            const size_t rawSize = size_t(block.count) * indexSize;
+            if (compress)
+            {
+                encodeIndexBlock(source.indices + block.first, block.count, data);
+            }
+            if (!compress || data.size() >= rawSize)
+            {
+                data.resize(rawSize);
+                writeIndices(data.data(), source.indices + block.first, block.count, indexType);
+            }
+            else
+            {
+                block.encoding = MeshCacheCompressed;
+            }
+        }
+        block.dataSize = data.size();
+    });
+    header.blockCount = uint32_t(blocks.size());
+
+    // ファイル上の配置
+    uint64_t offset = alignOffset(sizeof(MeshCacheHeader));
+    header.primitiveTableOffset = offset;
+    offset = alignOffset(offset + sizeof(MeshCachePrimitive) * primitives.size());
+    header.lodTableOffset = offset;
+    offset = alignOffset(offset + sizeof(MeshCacheLod) * lods.size());
+    header.meshletTableOffset = offset;
+    offset = alignOffset(offset + sizeof(MeshCacheMeshlet) * meshlets.size());
+    header.blockTableOffset = offset;
+    offset = alignOffset(offset + sizeof(MeshCacheBlock) * blocks.size());
+    for (auto& block : blocks)
+    {
+        block.dataOffset = offset;
+        offset = alignOffset(offset + block.dataSize);
+    }
+    header.fileSize = offset;
+
+#ifdef _WIN32
+    int length = MultiByteToWideChar(CP_UTF8, 0, fileName, -1, nullptr, 0);
+    wstring wideName(size_t(length), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, fileName, -1, &wideName[0], length);
+    ofstream outfile(wideName.c_str(), ios::binary | ios::trunc);
+#else
+    ofstream outfile(fileName, ios::binary | ios::trunc);
+#endif
+    if (!outfile)
+    {
+        return false;
+    }
+
+    const char padding[MeshCacheAlignment] = {};
+    auto write = [&](const void* data, size_t size)
+    {
+        outfile.write(static_cast<const char*>(data), streamsize(size));
+    };
+    auto pad = [&](uint64_t target)
+    {
+        auto current = uint64_t(outfile.tellp());
+        write(padding, size_t(target - current));
+    };
+
+    write(&header, sizeof(header));
+    pad(header.primitiveTableOffset);
+    write(primitives.data(), sizeof(MeshCachePrimitive) * primitives.size());
+    pad(header.lodTableOffset);
+    write(lods.data(), sizeof(MeshCacheLod) * lods.size());
+    pad(header.meshletTableOffset);
+    write(meshlets.data(), sizeof(MeshCacheMeshlet) * meshlets.size());
+    pad(header.blockTableOffset);
+    write(blocks.data(), sizeof(MeshCacheBlock) * blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        pad(blocks[i].dataOffset);
+        write(blockData[i].data(), blockData[i].size());
+    }
+    pad(header.fileSize);
+    return bool(outfile);
+}
+
+/// <summary>
+/// 読み込む前にファイルの内容を検証する
+/// 頂点の形式が現在の MeshVertex と異なる場合（構造体を変更した後など）は再クックが必要
+/// </summary>
+bool validateMeshCache(const uint8_t* data, size_t size, string& error)
+{
+    MeshCacheHeader header;
+    if (size < sizeof(header))
+    {
+        error = "truncated header";
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != MeshCacheMagic)
+    {
+        error = "not a cooked mesh file";
+        return false;
+    }
+    if (header.version != MeshCacheVersion)
+    {
+        error = "version " + to_string(header.version) + " is not supported; re-cook the mesh";
+        return false;
+    }
+    if (header.fileSize != size)
+    {
+        error = "file size does not match the header";
+        return false;
+    }
+
+    constexpr auto attributes = VertexLayout<MeshVertex>::attributes();
+    bool layoutMatches = header.vertexStride == sizeof(MeshVertex) && header.attributeCount == attributes.size();
+    for (size_t i = 0; layoutMatches && i < attributes.size(); ++i)
+    {
+        const auto& a = header.attributes[i];
+        layoutMatches = a.location == attributes[i].location && a.format == uint32_t(attributes[i].format) &&
+            a.offset == attributes[i].offset && a.size == attributes[i].size;
+    }
+    if (!layoutMatches)
+    {
+        error = "vertex layout differs from MeshVertex; re-cook the mesh";
+        return false;
+    }
+    if (header.indexType != VK_INDEX_TYPE_UINT16 && header.indexType != VK_INDEX_TYPE_UINT32)
+    {
+        error = "invalid index type";
+        return false;
+    }
+
+    if (!isRangeValid(header.primitiveTableOffset, uint64_t(header.primitiveCount) * sizeof(MeshCachePrimitive), size) ||
+        !isRangeValid(header.lodTableOffset, uint64_t(header.lodCount) * sizeof(MeshCacheLod), size) ||
+        !isRangeValid(header.meshletTableOffset, uint64_t(header.meshletCount) * sizeof(MeshCacheMeshlet), size) ||
+        !isRangeValid(header.blockTableOffset, uint64_t(header.blockCount) * sizeof(MeshCacheBlock), size) ||
+        header.primitiveTableOffset % alignof(MeshCachePrimitive) != 0 ||
+        header.lodTableOffset % alignof(MeshCacheLod) != 0 ||
+        header.meshletTableOffset % alignof(MeshCacheMeshlet) != 0 ||
+        header.blockTableOffset % alignof(MeshCacheBlock) != 0)
+    {
+        error = "table exceeds the file";
+        return false;
+    }
+
+    auto primitives = reinterpret_cast<const MeshCachePrimitive*>(data + header.primitiveTableOffset);
+    auto lods = reinterpret_cast<const MeshCacheLod*>(data + header.lodTableOffset);
+    auto meshlets = reinterpret_cast<const MeshCacheMeshlet*>(data + header.meshletTableOffset);
+    auto blocks = reinterpret_cast<const MeshCacheBlock*>(data + header.blockTableOffset);
+    for (uint32_t i = 0; i < header.primitiveCount; ++i)
+    {
+        const auto& primitive = primitives[i];
+        if (uint64_t(primitive.vertexOffset) + primitive.vertexCount > header.vertexCount ||
+            primitive.lodCount == 0 || primitive.lodCount > MaxMeshLods ||
+            uint64_t(primitive.firstLod) + primitive.lodCount > header.lodCount)
+        {
+            error = "invalid primitive";
+            return false;
+        }
+        for (uint32_t l = 0; l < primitive.lodCount; ++l)
+        {
+            const auto& lod = lods[primitive.firstLod + l];
+            if (uint64_t(lod.firstIndex) + lod.indexCount > header.indexCount)
+            {
+                error = "invalid LOD";
+                return false;
+            }
+        }
+
+        // メッシュレットは最も詳細な LOD の範囲に収まっていること
+        if (uint64_t(primitive.firstMeshlet) + primitive.meshletCount > header.meshletCount)
+        {
+            error = "invalid meshlet range";
+            return false;
+        }
+        const auto& lod = lods[primitive.firstLod];
+        for (uint32_t m = 0; m < primitive.meshletCount; ++m)
+        {
+            const auto& meshlet = meshlets[primitive.firstMeshlet + m];
+            if (meshlet.triangleCount > MaxMeshletTriangles || meshlet.vertexCount > MaxMeshletVertices ||
+                uint64_t(meshlet.firstIndex) + uint64_t(meshlet.triangleCount) * 3 > lod.indexCount)
+            {
+                error = "invalid meshlet";
+                return false;
+            }
+        }
+    }
+
+    const auto indexSize = getIndexSize(VkIndexType(header.indexType));
+    for (uint32_t i = 0; i < header.blockCount; ++i)
+    {
+        const auto& block = blocks[i];
+        const uint32_t total = block.stream == MeshCacheVertexStream ? header.vertexCount : header.indexCount;
+        const uint64_t rawSize = uint64_t(block.count) * (block.stream == MeshCacheVertexStream ? sizeof(MeshVertex) : indexSize);
+        if (block.stream > MeshCacheIndexStream || block.encoding > MeshCacheCompressed ||
+            uint64_t(block.first) + block.count > total ||
+            (block.encoding == MeshCacheRaw && block.dataSize != rawSize) ||
+            !isRangeValid(block.dataOffset, block.dataSize, size))
+        {
+            error = "invalid data block";
+            return false;
+        }
+    }
+    return true;
+}
+
+string getCookedMeshFileName(const string& sourceFileName)
+{
+    auto slash = sourceFileName.find_last_of("/\\");
+    auto dot = sourceFileName.find_last_of('.');
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+    {
+        return sourceFileName + ".mesh";
+    }
+    return sourceFileName.substr(0, dot) + ".mesh";
+}
+
+bool getFileStamp(const char* fileName, uint64_t& size, uint64_t& modifiedTime)
+{
+#ifdef _WIN32
+    int length = MultiByteToWideChar(CP_UTF8, 0, fileName, -1, nullptr, 0);
+    wstring wideName(size_t(length), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, fileName, -1, &wideName[0], length);
+
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(wideName.c_str(), GetFileExInfoStandard, &data))
+    {
+        return false;
+    }
+    size = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+
+    // FILETIME は 1601 年からの 100 ナノ秒単位なので、どちらの環境でクックしても比べられるよう 1970 年からのナノ秒に揃える
+    const uint64_t ticks = (uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+    const uint64_t UnixEpochTicks = 116444736000000000ull;
+    modifiedTime = ticks >= UnixEpochTicks ? (ticks - UnixEpochTicks) * 100 : 0;
+#else
+    struct stat st;
+    if (stat(fileName, &st) != 0)
+    {
+        return false;
+    }
+    size = uint64_t(st.st_size);
+#ifdef __APPLE__
+    modifiedTime = uint64_t(st.st_mtimespec.tv_sec) * 1000000000ull + uint64_t(st.st_mtimespec.tv_nsec);
+#else
+    modifiedTime = uint64_t(st.st_mtim.tv_sec) * 1000000000ull + uint64_t(st.st_mtim.tv_nsec);
+#endif
+#endif
+    return true;
+}
+
+bool isMeshCacheUpToDate(const char* cookedFileName, const char* sourceFileName)
+{
+    MappedFile cooked;
+    MeshCacheHeader header;
+    if (!cooked.open(cookedFileName) || cooked.size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, cooked.data(), sizeof(header));
+    if (header.magic != MeshCacheMagic || header.version != MeshCacheVersion)
+    {
+        return false;
+    }
+
+    uint64_t sourceSize, sourceTime;
+    if (!getFileStamp(sourceFileName, sourceSize, sourceTime))
+    {
+        return true;
+    }
+    return sourceSize == header.sourceSize && sourceTime == header.sourceTime;
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include "meshloader.h"
+
+#include <string>
+#include <cstdint>
+
+/// <summary>
+/// オフラインで変換（クック）済みのメッシュファイル（.mesh）の形式
+/// </summary>
+/// <remarks>
+/// MeshCooker が glTF / OBJ を読み込み、頂点の統合・キャッシュ / オーバードロー / フェッチの最適化・量子化、
+/// メッシュレットへの分割（meshlet.h）と LOD の生成（meshlod.h）を済ませて書き出す。
+/// 実行時は MeshLoader がメモリマップし、ブロックごとにステージングバッファへコピー（圧縮されていれば復号）するだけなので、
+/// テキストの解析や最適化の計算は一切行わない。
+///
+/// ファイルの構成（すべてリトルエンディアン、各テーブルとブロックは MeshCacheAlignment に揃える）
+///   MeshCacheHeader
+///   MeshCachePrimitive[primitiveCount]
+///   MeshCacheLod[lodCount]          プリミティブごとに firstLod から lodCount 個
+///   MeshCacheMeshlet[meshletCount]  プリミティブごとに firstMeshlet から meshletCount 個（最も詳細な LOD を分割したもの）
+///   MeshCacheBlock[blockCount]      頂点・インデックスのストリームを一定数ごとに区切ったもの
+///   ブロックのデータ
+/// 頂点のストリームは GPU 上の頂点バッファ、インデックスのストリームはインデックスバッファの内容そのもの。
+/// 圧縮されたブロックはそれぞれ独立に復号できる（meshcodec.h）。
+/// 頂点の形式はヘッダに属性の記述として保存し、読み込み時に MeshVertex の VertexLayout と一致するか確認する。
+/// 変換元のファイルの大きさと更新時刻もヘッダに保存し、元のファイルが変わっていれば古いとみなす（isMeshCacheUpToDate）。
+/// glTF が参照する外部のバッファ（.bin）や画像の変更は検出しないので、それらを変えた場合はクックし直す。
+/// </remarks>
+
+const uint32_t MeshCacheMagic = 0x4853454D;     // "MESH"
+const uint32_t MeshCacheVersion = 3;
+const uint32_t MeshCacheMaxAttributes = 8;
+const uint32_t MeshCacheAlignment = 16;
+
+enum MeshCacheStream : uint32_t
+{
+    MeshCacheVertexStream = 0,
+    MeshCacheIndexStream = 1,
+};
+
+enum MeshCacheEncoding : uint32_t
+{
+    MeshCacheRaw = 0,
+    MeshCacheCompressed = 1,
+};
+
+struct MeshCacheAttribute
+{
+    uint32_t location;
+    uint32_t format;    // VkFormat
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t fileSize;
+
+    uint32_t vertexStride;
+    uint32_t attributeCount;
+    MeshCacheAttribute attributes[MeshCacheMaxAttributes];
+
+    uint32_t indexType; // VkIndexType
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t primitiveCount;
+    uint32_t lodCount;
+    uint32_t blockCount;
+    float boundsMin[3];
+    float boundsMax[3];
+
+    uint64_t primitiveTableOffset;
+    uint64_t lodTableOffset;
+    uint64_t blockTableOffset;
+
+    uint64_t meshletTableOffset;
+    uint32_t meshletCount;
+    uint32_t reserved;
+
+    uint64_t sourceSize;    // 変換元のファイルの大きさ（バイト）
+    uint64_t sourceTime;    // 変換元のファイルの更新時刻（1970 年からのナノ秒）
+};
+
+struct MeshCachePrimitive
+{
+    uint32_t vertexOffset;
+    uint32_t vertexCount;
+    uint32_t firstLod;
+    uint32_t lodCount;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    float quantizationOffset[4];
+    float quantizationScale[4];
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+struct MeshCacheLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+    uint32_t reserved;
+};
+
+// Meshlet と同じ内容（firstIndex はプリミティブの最も詳細な LOD の先頭から、境界は量子化された位置の空間）
+struct MeshCacheMeshlet
+{
+    uint32_t firstIndex;
+    uint32_t triangleCount;
+    uint32_t vertexCount;
+    float coneCutoff;
+    float center[3];
+    float radius;
+    float coneApex[3];
+    float coneAxis[3];
+};
+
+struct MeshCacheBlock
+{
+    uint32_t stream;    // MeshCacheStream
+    uint32_t encoding;  // MeshCacheEncoding
+    uint32_t first;     // ストリーム内の最初の要素（頂点またはインデックス）
+    uint32_t count;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 256, "MeshCacheHeader layout changed; bump MeshCacheVersion");
+static_assert(sizeof(MeshCachePrimitive) == 80, "MeshCachePrimitive layout changed; bump MeshCacheVersion");
+static_assert(sizeof(MeshCacheLod) == 16, "MeshCacheLod layout changed; bump MeshCacheVersion");
+static_assert(sizeof(MeshCacheMeshlet) == 56, "MeshCacheMeshlet layout changed; bump MeshCacheVersion");
+static_assert(sizeof(MeshCacheBlock) == 32, "MeshCacheBlock layout changed; bump MeshCacheVersion");
+
+/// <summary>
+/// 書き出す内容（MeshPrimitive の firstIndex / vertexOffset / lods / firstMeshlet はこの配列内の位置）
+/// </summary>
+struct MeshCacheSource
+{
+    const MeshVertex* vertices;
+    uint32_t vertexCount;
+    const uint32_t* indices;
+    uint32_t indexCount;
+    const MeshPrimitive* primitives;
+    uint32_t primitiveCount;
+    const Meshlet* meshlets;
+    uint32_t meshletCount;
+    uint64_t sourceSize;    // getFileStamp で取得した変換元のファイルの情報
+    uint64_t sourceTime;
+};
+
+bool writeMeshCache(const char* fileName, const MeshCacheSource& source, bool compress);
+
+// ヘッダとテーブルの範囲、頂点の形式を検証する（失敗した場合は error に理由を入れる）
+bool validateMeshCache(const uint8_t* data, size_t size, std::string& error);
+
+// ファイルの大きさと更新時刻（1970 年からのナノ秒）を取得する（fileName は UTF-8）
+bool getFileStamp(const char* fileName, uint64_t& size, uint64_t& modifiedTime);
+
+// クック済みファイルが現在の形式で、変換元のファイルから作られた後に元のファイルが変わっていないか
+// （変換元のファイルが無い場合はクック済みファイルだけを配布したものとみなして true）
+bool isMeshCacheUpToDate(const char* cookedFileName, const char* sourceFileName);
+
+// 元のメッシュファイル名に対応するクック済みファイル名（拡張子を .mesh に置き換える）
+std::string getCookedMeshFileName(const std::string& sourceFileName);
@@ -0,0 +1,193 @@
+#include "meshcodec.h"
+
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    // 1 グループの値の数（ヘッダの 2bit で幅を選ぶ単位）
+    const size_t GroupSize = 16;
+
+    // ヘッダの値 -> 1 値あたりのビット数
+    const uint32_t GroupBits[4] = { 0, 2, 4, 8 };
+
+    uint8_t zigzag8(uint8_t delta)
+    {
+        auto d = int8_t(delta);
+        return uint8_t((d << 1) ^ (d >> 7));
+    }
+
+    uint8_t unzigzag8(uint8_t value)
+    {
+        return uint8_t((value >> 1) ^ uint8_t(-int(value & 1)));
+    }
+
+    uint32_t selectGroupHeader(const uint8_t* values)
+    {
+        uint8_t maxValue = 0;
+        for (size_t i = 0; i < GroupSize; ++i)
+        {
+            maxValue = max(maxValue, values[i]);
+        }
+        return maxValue == 0 ? 0 : maxValue < 4 ? 1 : maxValue < 16 ? 2 : 3;
+    }
+}
+
+/// <summary>
+/// 頂点のブロックを圧縮して out の末尾に追加する
+/// </summary>
+void encodeVertexBlock(const uint8_t* vertices, size_t count, size_t stride, vector<uint8_t>& out)
+{
+    const size_t groupCount = (count + GroupSize - 1) / GroupSize;
+    vector<uint8_t> deltas(groupCount * GroupSize, 0);
+
+    for (size_t k = 0; k < stride; ++k)
+    {
+        uint8_t previous = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint8_t value = vertices[i * stride + k];
+            deltas[i] = zigzag8(uint8_t(value - previous));
+            previous = value;
+        }
+
+        // ヘッダ（1 バイトに 4 グループ分）
+        const size_t headerStart = out.size();
+        out.resize(out.size() + (groupCount + 3) / 4, 0);
+        for (size_t g = 0; g < groupCount; ++g)
+        {
+            const uint8_t* values = &deltas[g * GroupSize];
+            uint32_t header = selectGroupHeader(values);
+            out[headerStart + g / 4] |= uint8_t(header << ((g % 4) * 2));
+
+            const uint32_t bits = GroupBits[header];
+            if (bits == 0)
+            {
+                continue;
+            }
+
+            const uint32_t perByte = 8 / bits;
+            for (size_t i = 0; i < GroupSize; i += perByte)
+            {
+                uint8_t byte = 0;
+                for (uint32_t j = 0; j < perByte; ++j)
+                {
+                    byte |= uint8_t(values[i + j] << (j * bits));
+                }
+                out.push_back(byte);
+            }
+        }
+    }
+}
+
+bool decodeVertexBlock(const uint8_t* data, size_t size, size_t count, size_t stride, uint8_t* vertices)
+{
+    const size_t groupCount = (count + GroupSize - 1) / GroupSize;
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+
+    for (size_t k = 0; k < stride; ++k)
+    {
+        const uint8_t* headers = p;
+        p += (groupCount + 3) / 4;
+        if (p > end)
+        {
+            return false;
+        }
+
+        uint8_t previous = 0;
+        for (size_t g = 0; g < groupCount; ++g)
+        {
+            const uint32_t header = (headers[g / 4] >> ((g % 4) * 2)) & 3;
+            const uint32_t bits = GroupBits[header];
+
+            uint8_t values[GroupSize] = {};
+            if (bits != 0)
+            {
+                const uint32_t perByte = 8 / bits;
+                const uint8_t mask = uint8_t((1u << bits) - 1);
+                if (p + GroupSize / perByte > end)
+                {
+                    return false;
+                }
+                for (size_t i = 0; i < GroupSize; i += perByte)
+                {
+                    uint8_t byte = *p++;
+                    for (uint32_t j = 0; j < perByte; ++j)
+                    {
+                        values[i + j] = uint8_t((byte >> (j * bits)) & mask);
+                    }
+                }
+            }
+
+            const size_t first = g * GroupSize;
+            const size_t n = min(GroupSize, count - first);
+            for (size_t i = 0; i < n; ++i)
+            {
+                previous = uint8_t(previous + unzigzag8(values[i]));
+                vertices[(first + i) * stride + k] = previous;
+            }
+        }
+    }
+    return p == end;
+}
+
+/// <summary>
+/// インデックスのブロックを圧縮して out の末尾に追加する
+/// </summary>
+void encodeIndexBlock(const uint32_t* indices, size_t count, vector<uint8_t>& out)
+{
+    uint32_t previous = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        int64_t delta = int64_t(indices[i]) - int64_t(previous);
+        uint64_t value = uint64_t((delta << 1) ^ (delta >> 63));
+        previous = indices[i];
+
+        do
+        {
+            uint8_t byte = uint8_t(value & 0x7f);
+            value >>= 7;
+            out.push_back(value != 0 ? uint8_t(byte | 0x80) : byte);
+        } while (value != 0);
+    }
+}
+
+bool decodeIndexBlock(const uint8_t* data, size_t size, size_t count, VkIndexType indexType, void* indices)
+{
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+
+    int64_t previous = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t value = 0;
+        for (uint32_t shift = 0;; shift += 7)
+        {
+            if (p == end || shift > 35)
+            {
+                return false;
+            }
+            uint8_t byte = *p++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                break;
+            }
+        }
+
+        int64_t delta = int64_t(value >> 1) ^ -int64_t(value & 1);
+        previous += delta;
+
+        if (indexType == VK_INDEX_TYPE_UINT16)
+        {
+            static_cast<uint16_t*>(indices)[i] = uint16_t(previous);
+        }
+        else
+        {
+            static_cast<uint32_t*>(indices)[i] = uint32_t(previous);
+        }
+    }
+    return p == end;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "vkappbase.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// 頂点・インデックスの可逆圧縮（meshoptimizer の頂点コーデックと同じ考え方の簡易版）
+/// </summary>
+/// <remarks>
+/// 頂点は構造体のバイト位置ごとに直前の頂点との差分を取り、16 個ずつ 0 / 2 / 4 / 8 bit に詰める。
+/// 頂点フェッチ最適化済みの並びでは隣の頂点が近い値になるため、差分の上位ビットがほとんど 0 になる。
+/// インデックスは直前のインデックスとの差分を zigzag 符号化した可変長整数で保存する。
+/// どちらもブロック単位で独立に復号できるので、復号は複数スレッドで並列に行える。
+/// </remarks>
+
+void encodeVertexBlock(const uint8_t* vertices, size_t count, size_t stride, std::vector<uint8_t>& out);
+bool decodeVertexBlock(const uint8_t* data, size_t size, size_t count, size_t stride, uint8_t* vertices);
+
+void encodeIndexBlock(const uint32_t* indices, size_t count, std::vector<uint8_t>& out);
+bool decodeIndexBlock(const uint8_t* data, size_t size, size_t count, VkIndexType indexType, void* indices);
@@ -0,0 +1,342 @@
+#include "meshlet.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+    // 候補の三角形を比べる際に、法線の向きの違い（1 - cos）を距離に換算する重み（想定する半径に対する比）
+    const float ConeWeight = 0.5f;
+
+    // 法線の広がりがこれより大きい（軸との cos の最小値がこれ以下の）メッシュレットは円錐で判定しない
+    const float MinConeDot = 0.1f;
+
+    const uint32_t InvalidIndex = ~0u;
+
+    vec3 loadPosition(const float* positions, size_t stride, uint32_t index)
+    {
+        auto p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + size_t(index) * stride);
+        return vec3(p[0], p[1], p[2]);
+    }
+
+    /// <summary>
+    /// 位置が同じ頂点に同じ番号を振る
+    /// UV や法線の継ぎ目で分かれた頂点（統合していない OBJ では全ての角）も、隣接の判定では同じ頂点として扱うため
+    /// </summary>
+    vector<uint32_t> remapPositions(const float* positions, size_t stride, size_t vertexCount)
+    {
+        size_t tableSize = 1;
+        while (tableSize < vertexCount * 2)
+        {
+            tableSize *= 2;
+        }
+        vector<uint32_t> table(tableSize, InvalidIndex);
+        vector<uint32_t> remap(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            const vec3 p = loadPosition(positions, stride, uint32_t(v));
+            size_t slot = size_t(hashValue(p)) & (tableSize - 1);
+            for (;;)
+            {
+                auto& entry = table[slot];
+                if (entry == InvalidIndex)
+                {
+                    entry = uint32_t(v);
+                    remap[v] = uint32_t(v);
+                    break;
+                }
+                if (loadPosition(positions, stride, entry) == p)
+                {
+                    remap[v] = entry;
+                    break;
+                }
+                slot = (slot + 1) & (tableSize - 1);
+            }
+        }
+        return remap;
+    }
+}
+
+/// <summary>
+/// 三角形を貪欲法でメッシュレットにまとめ、インデックスをメッシュレットの順に並べ替える
+/// 作り途中のメッシュレットと位置を共有する三角形の中から、追加する頂点が少なく、
+/// 中心に近く法線の向きが揃っているものを選んで加えていく。
+/// 隣接する三角形が無くなったら（上限に達しておらず、入る場合は）入力の順で次の三角形を加える。
+/// 入力は頂点キャッシュ最適化済みの順を想定しており、空間的に近い三角形が続くので、離れた部品が 1 つにまとめられることは少ない。
+/// メッシュレットを meshlets の末尾に追加し、その数を返す
+/// </summary>
+size_t buildMeshlets(uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount,
+    vector<Meshlet>& meshlets)
+{
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+    {
+        return 0;
+    }
+
+    // 位置を共有する三角形の一覧（CSR 形式）
+    const auto remap = remapPositions(positions, positionStride, vertexCount);
+    vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        adjacencyOffsets[remap[indices[i]] + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+    vector<uint32_t> adjacency(triangleCount * 3);
+    {
+        vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; ++i)
+        {
+            adjacency[cursors[remap[indices[i]]]++] = uint32_t(i / 3);
+        }
+    }
+
+    // 三角形の重心と単位法線（面積が 0 の三角形の法線は 0）
+    vector<vec3> centroids(triangleCount);
+    vector<vec3> normals(triangleCount);
+    float totalArea = 0.0f;
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        const vec3 a = loadPosition(positions, positionStride, indices[t * 3 + 0]);
+        const vec3 b = loadPosition(positions, positionStride, indices[t * 3 + 1]);
+        const vec3 c = loadPosition(positions, positionStride, indices[t * 3 + 2]);
+        const vec3 n = cross(b - a, c - a);
+        const float area = length(n);
+        centroids[t] = (a + b + c) / 3.0f;
+        normals[t] = area > 0.0f ? n / area : vec3(0.0f);
+        totalArea += area * 0.5f;
+    }
+
+    // 三角形が上限まで入った場合のメッシュレットの半径の目安（法線の重みを距離に換算する）
+    const float expectedRadius = sqrt(totalArea / float(triangleCount) * float(MaxMeshletTriangles) / 3.14159265f);
+    const float coneWeight = ConeWeight * expectedRadius;
+
+    vector<uint8_t> emitted(triangleCount, 0);
+    vector<uint32_t> vertexOwners(vertexCount, InvalidIndex);
+    vector<uint32_t> candidateOwners(triangleCount, InvalidIndex);
+    vector<uint32_t> candidates;
+    vector<uint32_t> reordered;
+    reordered.reserve(triangleCount * 3);
+
+    const size_t firstMeshlet = meshlets.size();
+    size_t cursor = 0;
+    while (reordered.size() < triangleCount * 3)
+    {
+        const uint32_t owner = uint32_t(meshlets.size());
+        const uint32_t firstIndex = uint32_t(reordered.size());
+        uint32_t meshletVertices = 0;
+        uint32_t meshletTriangles = 0;
+        vec3 centroidSum(0.0f);
+        vec3 normalSum(0.0f);
+        candidates.clear();
+
+        auto countExtraVertices = [&](uint32_t triangle) {
+            uint32_t extra = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t v = indices[triangle * 3 + k];
+                // 同じ頂点を 2 回使う縮退した三角形でも数えすぎないよう、前の角と同じなら数えない
+                const bool repeated = (k > 0 && v == indices[triangle * 3]) || (k > 1 && v == indices[triangle * 3 + 1]);
+                extra += vertexOwners[v] != owner && !repeated ? 1 : 0;
+            }
+            return extra;
+        };
+
+        while (meshletTriangles < MaxMeshletTriangles)
+        {
+            const vec3 center = meshletTriangles > 0 ? centroidSum / float(meshletTriangles) : vec3(0.0f);
+            const float axisLength = length(normalSum);
+            const vec3 axis = axisLength > 0.0f ? normalSum / axisLength : vec3(0.0f);
+
+            // 隣接する三角形から選ぶ（加え終わったものは一覧から取り除く）
+            uint32_t best = InvalidIndex;
+            uint32_t bestExtra = 4;
+            float bestScore = 0.0f;
+            size_t kept = 0;
+            for (size_t i = 0; i < candidates.size(); ++i)
+            {
+                const uint32_t triangle = candidates[i];
+                if (emitted[triangle])
+                {
+                    continue;
+                }
+                candidates[kept++] = triangle;
+
+                const uint32_t extra = countExtraVertices(triangle);
+                if (meshletVertices + extra > MaxMeshletVertices || extra > bestExtra)
+                {
+                    continue;
+                }
+                const float score = distance(centroids[triangle], center) + coneWeight * (1.0f - dot(normals[triangle], axis));
+                if (extra < bestExtra || score < bestScore)
+                {
+                    best = triangle;
+                    bestExtra = extra;
+                    bestScore = score;
+                }
+            }
+            candidates.resize(kept);
+
+            if (best == InvalidIndex)
+            {
+                while (cursor < triangleCount && emitted[cursor])
+                {
+                    cursor++;
+                }
+                if (cursor == triangleCount || meshletVertices + countExtraVertices(uint32_t(cursor)) > MaxMeshletVertices)
+                {
+                    break;
+                }
+                best = uint32_t(cursor);
+            }
+
+            // 三角形を加え、その頂点と位置を共有する三角形を候補にする
+            emitted[best] = 1;
+            meshletVertices += countExtraVertices(best);
+            meshletTriangles++;
+            centroidSum += centroids[best];
+            normalSum += normals[best];
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t v = indices[best * 3 + k];
+                reordered.push_back(v);
+                vertexOwners[v] = owner;
+
+                const uint32_t shared = remap[v];
+                for (uint32_t a = adjacencyOffsets[shared]; a < adjacencyOffsets[shared + 1]; ++a)
+                {
+                    const uint32_t triangle = adjacency[a];
+                    if (!emitted[triangle] && candidateOwners[triangle] != owner)
+                    {
+                        candidateOwners[triangle] = owner;
+                        candidates.push_back(triangle);
+                    }
+                }
+            }
+        }
+
+        Meshlet meshlet = computeMeshletBounds(reordered.data() + firstIndex, meshletTriangles, positions, positionStride);
+        meshlet.firstIndex = firstIndex;
+        meshlets.push_back(meshlet);
+    }
+
+    memcpy(indices, reordered.data(), reordered.size() * sizeof(uint32_t));
+    return meshlets.size() - firstMeshlet;
+}
+
+/// <summary>
+/// メッシュレットの境界球と法線の円錐を求める（firstIndex は 0 のまま返す）
+/// 円錐の頂点は、すべての三角形の平面の裏側（または平面上）になるよう軸に沿って後ろへずらす
+/// これより軸に近い向きから見れば、どの三角形もカメラに裏を向けている
+/// </summary>
+Meshlet computeMeshletBounds(const uint32_t* indices, size_t triangleCount, const float* positions, size_t positionStride)
+{
+    Meshlet meshlet{};
+    meshlet.triangleCount = uint32_t(triangleCount);
+    meshlet.coneCutoff = 1.0f;
+    if (triangleCount == 0)
+    {
+        return meshlet;
+    }
+
+    vector<uint32_t> vertices(indices, indices + triangleCount * 3);
+    sort(vertices.begin(), vertices.end());
+    vertices.erase(unique(vertices.begin(), vertices.end()), vertices.end());
+    meshlet.vertexCount = uint32_t(vertices.size());
+
+    // 境界球（AABB の中心から最も遠い頂点まで）
+    vec3 boundsMin(loadPosition(positions, positionStride, vertices[0]));
+    vec3 boundsMax(boundsMin);
+    for (uint32_t v : vertices)
+    {
+        const vec3 p = loadPosition(positions, positionStride, v);
+        boundsMin = min(boundsMin, p);
+        boundsMax = max(boundsMax, p);
+    }
+    meshlet.center = (boundsMin + boundsMax) * 0.5f;
+    for (uint32_t v : vertices)
+    {
+        meshlet.radius = std::max(meshlet.radius, distance(meshlet.center, loadPosition(positions, positionStride, v)));
+    }
+    meshlet.coneApex = meshlet.center;
+
+    // 法線の円錐（面積が 0 の三角形は向きが無いので除く）
+    vector<vec3> normals;
+    normals.reserve(triangleCount);
+    vec3 normalSum(0.0f);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        const vec3 a = loadPosition(positions, positionStride, indices[t * 3 + 0]);
+        const vec3 b = loadPosition(positions, positionStride, indices[t * 3 + 1]);
+        const vec3 c = loadPosition(positions, positionStride, indices[t * 3 + 2]);
+        const vec3 n = cross(b - a, c - a);
+        const float area = length(n);
+        normals.push_back(area > 0.0f ? n / area : vec3(0.0f));
+        normalSum += normals.back();
+    }
+    const float axisLength = length(normalSum);
+    if (axisLength <= 0.0f)
+    {
+        return meshlet;
+    }
+    const vec3 axis = normalSum / axisLength;
+
+    float minDot = 1.0f;
+    for (const auto& n : normals)
+    {
+        if (n != vec3(0.0f))
+        {
+            minDot = std::min(minDot, dot(n, axis));
+        }
+    }
+    if (minDot <= MinConeDot)
+    {
+        return meshlet;
+    }
+
+    float maxT = 0.0f;
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        const vec3& n = normals[t];
+        if (n == vec3(0.0f))
+        {
+            continue;
+        }
+        const vec3 a = loadPosition(positions, positionStride, indices[t * 3]);
+        maxT = std::max(maxT, dot(meshlet.center - a, n) / dot(axis, n));
+    }
+    meshlet.coneApex = meshlet.center - axis * maxT;
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = sqrt(1.0f - minDot * minDot);
+    return meshlet;
+}
+
+MeshletStatistics analyzeMeshlets(const Meshlet* meshlets, size_t meshletCount)
+{
+    MeshletStatistics stats{};
+    stats.meshletCount = uint32_t(meshletCount);
+    if (meshletCount == 0)
+    {
+        return stats;
+    }
+
+    size_t vertices = 0, triangles = 0, cones = 0;
+    for (size_t i = 0; i < meshletCount; ++i)
+    {
+        vertices += meshlets[i].vertexCount;
+        triangles += meshlets[i].triangleCount;
+        cones += meshlets[i].coneCutoff < 1.0f ? 1 : 0;
+    }
+    stats.averageVertices = float(vertices) / float(meshletCount);
+    stats.averageTriangles = float(triangles) / float(meshletCount);
+    stats.coneRatio = float(cones) / float(meshletCount);
+    return stats;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "glm/glm.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// メッシュレット（小さな三角形のクラスタ）への分割
+/// </summary>
+/// <remarks>
+/// 大きな 1 つのメッシュ（建物や地形のタイルなど）はオブジェクト単位ではほとんどカリングできないので、
+/// 三角形を最大 MaxMeshletVertices 頂点・MaxMeshletTriangles 三角形のクラスタに分け、クラスタ単位でカリングする。
+/// buildMeshlets はインデックスをメッシュレットごとに連続するよう並べ替えるので、
+/// メッシュレットは元のインデックスバッファの範囲（firstIndex から triangleCount * 3 個）として描画できる。
+/// 頂点は並べ替えない（頂点フェッチの最適化は分割の後で行ってよい）。
+/// 分割はオフラインでは MeshCooker が、glTF / OBJ の読み込み時には MeshLoader（setBuildMeshlets）が行う。
+/// 境界はそれぞれ次のカリングに使う（gpudriven.h の cluster.comp）。
+///   境界球: 視錐台カリングと Hi-Z による遮蔽カリング
+///   法線の円錐: すべての三角形が裏を向いている場合の背面カリング
+///     dot(normalize(coneApex - カメラの位置), coneAxis) >= coneCutoff なら裏を向いている
+///     （正射影ではカメラの向き d について dot(d, coneAxis) >= coneCutoff）
+///   三角形の表は cross(b - a, c - a) の向き。法線が広がりすぎて判定できない場合は coneAxis = 0、coneCutoff = 1 にする
+/// 頂点の上限 64 と三角形の上限 124 は、メッシュシェーダで 1 ワークグループが出力しやすい大きさに合わせている。
+/// </remarks>
+
+const uint32_t MaxMeshletVertices = 64;
+const uint32_t MaxMeshletTriangles = 124;
+
+/// <summary>
+/// 1 つのメッシュレット
+/// firstIndex は buildMeshlets に渡したインデックスの先頭からの位置、境界は渡した位置の空間
+/// </summary>
+struct Meshlet
+{
+    uint32_t firstIndex;
+    uint32_t triangleCount;
+    uint32_t vertexCount;
+    float coneCutoff;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneApex;
+    glm::vec3 coneAxis;
+};
+
+/// <summary>
+/// 分割の結果の統計
+/// </summary>
+struct MeshletStatistics
+{
+    uint32_t meshletCount;
+    float averageVertices;
+    float averageTriangles;
+
+    // 法線の円錐で判定できる（coneCutoff < 1 の）メッシュレットの割合
+    float coneRatio;
+};
+
+size_t buildMeshlets(uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount,
+    std::vector<Meshlet>& meshlets);
+
+Meshlet computeMeshletBounds(const uint32_t* indices, size_t triangleCount, const float* positions, size_t positionStride);
+
+MeshletStatistics analyzeMeshlets(const Meshlet* meshlets, size_t meshletCount);
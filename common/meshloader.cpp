@@ -0,0 +1,1443 @@
+#include "meshloader.h"
+#include "meshcache.h"
+#include "meshcodec.h"
+#include "meshoptimizer.h"
+#include "parallel.h"
+#include "json.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+using namespace std;
+
+namespace
+{
+    // ワーカースレッドに渡す作業の大きさ（ステージングバッファはこれより大きい必要がある）
+    const uint32_t VerticesPerJob = 16384;
+    const uint32_t IndicesPerJob = 65536;
+
+    // float 以外のアクセサや OBJ の頂点を変換する際にスタック上で使う一時領域の要素数
+    const uint32_t DecodeChunk = 256;
+
+    const uint32_t InvalidIndex = ~0u;
+
+    // glTF の componentType
+    const uint32_t ComponentByte = 5120;
+    const uint32_t ComponentUnsignedByte = 5121;
+    const uint32_t ComponentShort = 5122;
+    const uint32_t ComponentUnsignedShort = 5123;
+    const uint32_t ComponentUnsignedInt = 5125;
+    const uint32_t ComponentFloat = 5126;
+
+    const uint32_t GlbMagic = 0x46546C67;       // "glTF"
+    const uint32_t GlbChunkJson = 0x4E4F534A;   // "JSON"
+    const uint32_t GlbChunkBin = 0x004E4942;    // "BIN\0"
+
+    const float DefaultNormal[3] = { 0.0f, 0.0f, 1.0f };
+    const float DefaultTexcoord[2] = { 0.0f, 0.0f };
+    const float DefaultColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    bool reportError(const string& fileName, const string& message)
+    {
+        stringstream ss;
+        ss << "[MeshLoader] " << fileName << ": " << message << endl;
+        OutputDebugStringA(ss.str().c_str());
+        return false;
+    }
+
+    uint32_t getComponentSize(uint32_t componentType)
+    {
+        switch (componentType)
+        {
+        case ComponentByte:
+        case ComponentUnsignedByte:
+            return 1;
+        case ComponentShort:
+        case ComponentUnsignedShort:
+            return 2;
+        case ComponentUnsignedInt:
+        case ComponentFloat:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    uint32_t getComponentCount(const string& type)
+    {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        return 0;
+    }
+
+    /// <summary>
+    /// アクセサの 1 成分を float として読む（normalized の場合は glTF の規則で [-1, 1] / [0, 1] に変換する）
+    /// </summary>
+    float readComponent(const uint8_t* p, uint32_t componentType, bool normalized)
+    {
+        switch (componentType)
+        {
+        case ComponentByte:
+        {
+            int8_t v;
+            memcpy(&v, p, sizeof(v));
+            return normalized ? max(float(v) / 127.0f, -1.0f) : float(v);
+        }
+        case ComponentUnsignedByte:
+            return normalized ? float(*p) / 255.0f : float(*p);
+        case ComponentShort:
+        {
+            int16_t v;
+            memcpy(&v, p, sizeof(v));
+            return normalized ? max(float(v) / 32767.0f, -1.0f) : float(v);
+        }
+        case ComponentUnsignedShort:
+        {
+            uint16_t v;
+            memcpy(&v, p, sizeof(v));
+            return normalized ? float(v) / 65535.0f : float(v);
+        }
+        case ComponentUnsignedInt:
+        {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return float(v);
+        }
+        default:
+        {
+            float v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        }
+    }
+
+    uint32_t readIndex(const uint8_t* p, uint32_t componentType)
+    {
+        switch (componentType)
+        {
+        case ComponentUnsignedByte:
+            return *p;
+        case ComponentUnsignedShort:
+        {
+            uint16_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        default:
+        {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        }
+    }
+
+    /// <summary>
+    /// アクセサの要素を 4 成分の float に変換する（足りない成分は 0、4 番目は 1）
+    /// </summary>
+    template<class View>
+    void loadElements(const View& view, uint32_t first, uint32_t count, float* out)
+    {
+        const auto componentSize = getComponentSize(view.componentType);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const uint8_t* p = view.data + size_t(first + i) * view.stride;
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                out[i * 4 + c] = c < view.components ? readComponent(p + c * componentSize, view.componentType, view.normalized) : (c == 3 ? 1.0f : 0.0f);
+            }
+        }
+    }
+
+    /// <summary>
+    /// アクセサの [first, first + count) を encode に渡す
+    /// float のアクセサはメモリマップ上のデータをそのまま渡し、それ以外はスタック上で少しずつ float に変換してから渡す
+    /// encode(src, srcStride, count, dstIndex, srcComponents)
+    /// </summary>
+    template<class View, class Encode>
+    void encodeAccessor(const View& view, uint32_t first, uint32_t count, Encode encode)
+    {
+        if (view.componentType == ComponentFloat)
+        {
+            auto src = reinterpret_cast<const float*>(view.data + size_t(first) * view.stride);
+            encode(src, view.stride, count, 0u, view.components);
+            return;
+        }
+
+        float temp[DecodeChunk * 4];
+        for (uint32_t done = 0; done < count; done += DecodeChunk)
+        {
+            uint32_t n = min(DecodeChunk, count - done);
+            loadElements(view, first + done, n, temp);
+            encode(temp, 4 * sizeof(float), n, done, 4u);
+        }
+    }
+
+    glm::vec3 toVec3(const JsonValue& value)
+    {
+        float v[3];
+        for (size_t i = 0; i < 3; ++i)
+        {
+            v[i] = float(value[i].asNumber());
+        }
+        return glm::vec3(v[0], v[1], v[2]);
+    }
+
+    string getDirectory(const string& fileName)
+    {
+        auto pos = fileName.find_last_of("/\\");
+        return pos == string::npos ? string() : fileName.substr(0, pos + 1);
+    }
+
+    bool hasExtension(const string& fileName, const char* extension)
+    {
+        size_t length = strlen(extension);
+        if (fileName.size() < length)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (tolower(fileName[fileName.size() - length + i]) != tolower(extension[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // glTF の uri はパーセントエンコードされている
+    string decodeUri(const string& uri)
+    {
+        string result;
+        for (size_t i = 0; i < uri.size(); ++i)
+        {
+            if (uri[i] == '%' && i + 2 < uri.size())
+            {
+                result += char(strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16));
+                i += 2;
+            }
+            else
+            {
+                result += uri[i];
+            }
+        }
+        return result;
+    }
+
+    // ---- OBJ のテキスト解析 ----
+
+    bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    void skipBlank(const char*& p, const char* end)
+    {
+        while (p < end && isBlank(*p))
+        {
+            ++p;
+        }
+    }
+
+    uint32_t countTokens(const char* p, const char* end)
+    {
+        uint32_t count = 0;
+        for (;;)
+        {
+            skipBlank(p, end);
+            if (p == end || *p == '#')
+            {
+                return count;
+            }
+            ++count;
+            while (p < end && !isBlank(*p))
+            {
+                ++p;
+            }
+        }
+    }
+
+    double powerOf10(int exponent)
+    {
+        static const double table[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+        return exponent <= 22 ? table[exponent] : pow(10.0, double(exponent));
+    }
+
+    /// <summary>
+    /// 浮動小数点数を読む（strtof はロケールの影響を受け、遅いので使わない）
+    /// </summary>
+    bool parseFloat(const char*& p, const char* end, float& value)
+    {
+        skipBlank(p, end);
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        bool digits = false;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p)
+        {
+            if (mantissa < 100000000000000000ull)
+            {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+            }
+            else
+            {
+                ++exponent;
+            }
+            digits = true;
+        }
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p)
+            {
+                if (mantissa < 100000000000000000ull)
+                {
+                    mantissa = mantissa * 10 + uint64_t(*p - '0');
+                    --exponent;
+                }
+                digits = true;
+            }
+        }
+        if (!digits)
+        {
+            return false;
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                negativeExponent = *p == '-';
+                ++p;
+            }
+            int e = 0;
+            for (; p < end && *p >= '0' && *p <= '9'; ++p)
+            {
+                e = min(e * 10 + (*p - '0'), 10000);
+            }
+            exponent += negativeExponent ? -e : e;
+        }
+
+        double v = double(mantissa);
+        v = exponent < 0 ? v / powerOf10(-exponent) : v * powerOf10(exponent);
+        value = float(negative ? -v : v);
+        return true;
+    }
+
+    bool parseInt(const char*& p, const char* end, int64_t& value)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+        if (p == end || *p < '0' || *p > '9')
+        {
+            return false;
+        }
+
+        int64_t v = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p)
+        {
+            v = min<int64_t>(v * 10 + (*p - '0'), INT64_C(0xffffffff));
+        }
+        value = negative ? -v : v;
+        return true;
+    }
+
+    /// <summary>
+    /// OBJ のインデックス（1 始まり、負の値はそれまでに定義された要素からの相対位置）を 0 始まりに直す
+    /// </summary>
+    uint32_t resolveObjIndex(int64_t index, uint32_t defined, uint32_t total)
+    {
+        int64_t resolved = index > 0 ? index - 1 : int64_t(defined) + index;
+        return (index != 0 && resolved >= 0 && resolved < int64_t(total)) ? uint32_t(resolved) : InvalidIndex;
+    }
+
+    /// <summary>
+    /// OBJ を並列に解析するための、行の境界で区切ったファイルの一部分
+    /// </summary>
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+
+        // 1 回目の走査で数えた要素数
+        uint32_t positions;
+        uint32_t texcoords;
+        uint32_t normals;
+        uint32_t triangles;
+        bool colors;
+
+        // 先行するチャンクの要素数の合計
+        uint32_t positionBase;
+        uint32_t texcoordBase;
+        uint32_t normalBase;
+        uint32_t triangleBase;
+
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        bool failed;
+    };
+
+    template<class Func>
+    void forEachLine(const char* begin, const char* end, Func func)
+    {
+        const char* p = begin;
+        while (p < end)
+        {
+            auto lineEnd = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+            if (lineEnd == nullptr)
+            {
+                lineEnd = end;
+            }
+            skipBlank(p, lineEnd);
+            func(p, lineEnd);
+            p = lineEnd + 1;
+        }
+    }
+}
+
+MeshLoader::MeshLoader()
+    : m_format(Format::None)
+    , m_objPositionCount(0), m_objNormalCount(0), m_objTexcoordCount(0), m_objHasColors(false)
+    , m_cacheBlocks(nullptr), m_cacheBlockCount(0)
+    , m_buildMeshlets(false)
+    , m_vertexCount(0), m_indexCount(0), m_indexType(VK_INDEX_TYPE_UINT32)
+    , m_boundsMin(0.0f), m_boundsMax(0.0f)
+{
+}
+
+MeshLoader::~MeshLoader()
+{
+    close();
+}
+
+bool MeshLoader::open(const char* fileName)
+{
+    close();
+
+    m_fileName = fileName;
+    if (!m_file.open(fileName))
+    {
+        return reportError(m_fileName, "cannot open file");
+    }
+
+    bool result = hasExtension(m_fileName, ".obj") ? openObj() :
+        hasExtension(m_fileName, ".mesh") ? openCache() : openGltf(fileName);
+    if (!result)
+    {
+        close();
+        return false;
+    }
+
+    // クック済みファイルはバッファ上の配置まで決まっている
+    if (m_format != Format::Cache)
+    {
+        finishOpen();
+    }
+    return true;
+}
+
+void MeshLoader::close()
+{
+    m_format = Format::None;
+    m_file.close();
+    m_externalBuffers.clear();
+    m_gltfPrimitives.clear();
+
+    m_objPositions.reset();
+    m_objColors.reset();
+    m_objNormals.reset();
+    m_objTexcoords.reset();
+    m_objCorners.reset();
+    m_objPositionCount = m_objNormalCount = m_objTexcoordCount = 0;
+    m_objHasColors = false;
+
+    m_cacheBlocks = nullptr;
+    m_cacheBlockCount = 0;
+
+    m_primitives.clear();
+    m_meshlets.clear();
+    m_meshletIndices.clear();
+    m_vertexCount = 0;
+    m_indexCount = 0;
+}
+
+VkDeviceSize MeshLoader::getIndexDataSize() const
+{
+    return VkDeviceSize(m_indexCount) * getIndexSize(m_indexType);
+}
+
+/// <summary>
+/// glTF のメタデータを解析する（.glb の場合は BIN チャンクを、.gltf の場合は外部の .bin をメモリマップして参照する）
+/// </summary>
+bool MeshLoader::openGltf(const char* fileName)
+{
+    m_format = Format::Gltf;
+
+    const uint8_t* data = m_file.data();
+    const size_t size = m_file.size();
+
+    const char* jsonText = reinterpret_cast<const char*>(data);
+    size_t jsonLength = size;
+    const uint8_t* binChunk = nullptr;
+    size_t binLength = 0;
+
+    uint32_t magic = 0;
+    if (size >= 4)
+    {
+        memcpy(&magic, data, sizeof(magic));
+    }
+    if (magic == GlbMagic)
+    {
+        // ヘッダ（magic, version, length）に JSON チャンク、BIN チャンクが続く
+        uint32_t header[5];
+        if (size < sizeof(header))
+        {
+            return reportError(m_fileName, "truncated GLB header");
+        }
+        memcpy(header, data, sizeof(header));
+        if (header[1] != 2 || header[4] != GlbChunkJson || size_t(header[3]) + 20 > size)
+        {
+            return reportError(m_fileName, "unsupported GLB container");
+        }
+        jsonText = reinterpret_cast<const char*>(data + 20);
+        jsonLength = header[3];
+
+        size_t binOffset = 20 + ((size_t(header[3]) + 3) & ~size_t(3));
+        if (binOffset + 8 <= size)
+        {
+            uint32_t chunk[2];
+            memcpy(chunk, data + binOffset, sizeof(chunk));
+            if (chunk[1] == GlbChunkBin && binOffset + 8 + chunk[0] <= size)
+            {
+                binChunk = data + binOffset + 8;
+                binLength = chunk[0];
+            }
+        }
+    }
+
+    JsonValue gltf;
+    string error;
+    if (!parseJson(jsonText, jsonLength, gltf, error))
+    {
+        return reportError(m_fileName, "JSON parse error at " + error);
+    }
+
+    // バッファ
+    struct BufferRange
+    {
+        const uint8_t* data;
+        size_t size;
+    };
+    vector<BufferRange> buffers;
+    const auto directory = getDirectory(fileName);
+    const auto& gltfBuffers = gltf["buffers"];
+    for (size_t i = 0; i < gltfBuffers.size(); ++i)
+    {
+        const auto& buffer = gltfBuffers[i];
+        BufferRange range{ nullptr, 0 };
+        if (!buffer.has("uri"))
+        {
+            range = { binChunk, binLength };
+        }
+        else if (buffer["uri"].asString().compare(0, 5, "data:") == 0)
+        {
+            // base64 の埋め込みデータは一旦デコードしないと使えないので対応しない
+            return reportError(m_fileName, "embedded data URIs are not supported; export as .glb or with external .bin files");
+        }
+        else
+        {
+            auto external = unique_ptr<MappedFile>(new MappedFile());
+            auto path = directory + decodeUri(buffer["uri"].asString());
+            if (!external->open(path.c_str()))
+            {
+                return reportError(m_fileName, "cannot open buffer " + path);
+            }
+            range = { external->data(), external->size() };
+            m_externalBuffers.push_back(move(external));
+        }
+
+        if (range.size < buffer["byteLength"].asNumber())
+        {
+            return reportError(m_fileName, "buffer is smaller than its byteLength");
+        }
+        buffers.push_back(range);
+    }
+
+    const auto& bufferViews = gltf["bufferViews"];
+    const auto& accessors = gltf["accessors"];
+
+    // アクセサの参照先をメモリマップ上のポインタに解決し、範囲を検証する
+    auto makeView = [&](const JsonValue& accessorIndex, AccessorView& view) -> bool
+    {
+        view = AccessorView{ nullptr, 0, 0, 0, ComponentFloat, false };
+        if (accessorIndex.isNull())
+        {
+            return true;
+        }
+
+        const auto& accessor = accessors[accessorIndex.asUint()];
+        if (accessor.isNull() || accessor.has("sparse") || !accessor.has("bufferView"))
+        {
+            return reportError(m_fileName, "sparse or buffer-less accessors are not supported");
+        }
+
+        const auto& bufferView = bufferViews[accessor["bufferView"].asUint()];
+        const auto bufferIndex = bufferView["buffer"].asUint();
+        if (bufferView.isNull() || bufferIndex >= buffers.size() || buffers[bufferIndex].data == nullptr)
+        {
+            return reportError(m_fileName, "accessor refers to a missing buffer");
+        }
+
+        view.componentType = accessor["componentType"].asUint();
+        view.components = getComponentCount(accessor["type"].asString());
+        view.normalized = accessor["normalized"].asBool();
+        view.count = accessor["count"].asUint();
+
+        const auto elementSize = size_t(getComponentSize(view.componentType)) * view.components;
+        if (elementSize == 0)
+        {
+            return reportError(m_fileName, "unsupported accessor type");
+        }
+        view.stride = bufferView.has("byteStride") ? bufferView["byteStride"].asUint() : elementSize;
+
+        const auto viewOffset = size_t(bufferView["byteOffset"].asNumber());
+        const auto viewLength = size_t(bufferView["byteLength"].asNumber());
+        const auto accessorOffset = size_t(accessor["byteOffset"].asNumber());
+        if (viewOffset + viewLength > buffers[bufferIndex].size ||
+            (view.count > 0 && accessorOffset + view.stride * (view.count - 1) + elementSize > viewLength))
+        {
+            return reportError(m_fileName, "accessor exceeds its buffer view");
+        }
+
+        view.data = buffers[bufferIndex].data + viewOffset + accessorOffset;
+        return true;
+    };
+
+    const auto& meshes = gltf["meshes"];
+    for (size_t m = 0; m < meshes.size(); ++m)
+    {
+        const auto& primitives = meshes[m]["primitives"];
+        for (size_t p = 0; p < primitives.size(); ++p)
+        {
+            const auto& primitive = primitives[p];
+            const auto& attributes = primitive["attributes"];
+
+            // 三角形リスト以外は扱わない
+            if (primitive["mode"].asUint(4) != 4 || !attributes.has("POSITION"))
+            {
+                reportError(m_fileName, "skipping a primitive that is not an indexed triangle list with positions");
+                continue;
+            }
+
+            GltfPrimitive source;
+            if (!makeView(attributes["POSITION"], source.position) ||
+                !makeView(attributes["NORMAL"], source.normal) ||
+                !makeView(attributes["TEXCOORD_0"], source.texcoord) ||
+                !makeView(attributes["COLOR_0"], source.color) ||
+                !makeView(primitive["indices"], source.indices))
+            {
+                return false;
+            }
+            if (source.position.components != 3 || source.position.count == 0)
+            {
+                reportError(m_fileName, "skipping a primitive with invalid positions");
+                continue;
+            }
+            if (source.indices.data != nullptr && source.indices.componentType != ComponentUnsignedByte &&
+                source.indices.componentType != ComponentUnsignedShort && source.indices.componentType != ComponentUnsignedInt)
+            {
+                return reportError(m_fileName, "invalid index component type");
+            }
+
+            MeshPrimitive dst{};
+            dst.vertexCount = source.position.count;
+            dst.indexCount = source.indices.data != nullptr ? source.indices.count : source.position.count;
+
+            // POSITION の min / max は glTF では必須だが、無い場合や量子化されている場合は実際の値から求める
+            const auto& minValue = accessors[attributes["POSITION"].asUint()]["min"];
+            const auto& maxValue = accessors[attributes["POSITION"].asUint()]["max"];
+            if (source.position.componentType == ComponentFloat && minValue.size() == 3 && maxValue.size() == 3)
+            {
+                dst.boundsMin = toVec3(minValue);
+                dst.boundsMax = toVec3(maxValue);
+            }
+            else
+            {
+                dst.boundsMin = glm::vec3(FLT_MAX);
+                dst.boundsMax = glm::vec3(-FLT_MAX);
+                float temp[DecodeChunk * 4];
+                for (uint32_t done = 0; done < dst.vertexCount; done += DecodeChunk)
+                {
+                    uint32_t n = min(DecodeChunk, dst.vertexCount - done);
+                    loadElements(source.position, done, n, temp);
+                    for (uint32_t i = 0; i < n; ++i)
+                    {
+                        glm::vec3 v(temp[i * 4 + 0], temp[i * 4 + 1], temp[i * 4 + 2]);
+                        dst.boundsMin = glm::min(dst.boundsMin, v);
+                        dst.boundsMax = glm::max(dst.boundsMax, v);
+                    }
+                }
+            }
+
+            m_gltfPrimitives.push_back(source);
+            m_primitives.push_back(dst);
+        }
+    }
+
+    if (m_primitives.empty())
+    {
+        return reportError(m_fileName, "no triangle primitives");
+    }
+    return true;
+}
+
+/// <summary>
+/// OBJ を解析する
+/// 1 回目の走査で各チャンクの要素数を数え、要素の配列を 1 回だけ確保してから 2 回目の走査で値を読む
+/// どちらの走査もチャンクごとに並列に行う
+/// </summary>
+bool MeshLoader::openObj()
+{
+    m_format = Format::Obj;
+
+    const auto text = reinterpret_cast<const char*>(m_file.data());
+    const auto size = m_file.size();
+
+    // 行の境界でファイルを分割する
+    const size_t chunkCount = max<size_t>(1, min<size_t>(getWorkerCount() * 4, size / (256 * 1024)));
+    vector<ObjChunk> chunks(chunkCount);
+    {
+        const char* begin = text;
+        for (size_t i = 0; i < chunkCount; ++i)
+        {
+            const char* end = text + size * (i + 1) / chunkCount;
+            if (i + 1 < chunkCount)
+            {
+                auto newline = static_cast<const char*>(memchr(end, '\n', size_t(text + size - end)));
+                end = newline != nullptr ? newline + 1 : text + size;
+            }
+            end = max(end, begin);
+
+            chunks[i] = ObjChunk{};
+            chunks[i].begin = begin;
+            chunks[i].end = end;
+            begin = end;
+        }
+    }
+
+    // 1 回目: 要素数を数える
+    parallelFor(chunkCount, [&](size_t i)
+    {
+        auto& chunk = chunks[i];
+        forEachLine(chunk.begin, chunk.end, [&](const char* p, const char* lineEnd)
+        {
+            if (lineEnd - p < 2 || (!isBlank(p[1]) && p[1] != 't' && p[1] != 'n'))
+            {
+                return;
+            }
+            if (p[0] == 'v' && isBlank(p[1]))
+            {
+                chunk.positions++;
+                chunk.colors |= countTokens(p + 1, lineEnd) >= 6;
+            }
+            else if (p[0] == 'v' && p[1] == 't')
+            {
+                chunk.texcoords++;
+            }
+            else if (p[0] == 'v' && p[1] == 'n')
+            {
+                chunk.normals++;
+            }
+            else if (p[0] == 'f' && isBlank(p[1]))
+            {
+                auto corners = countTokens(p + 1, lineEnd);
+                chunk.triangles += corners >= 3 ? corners - 2 : 0;
+            }
+        });
+    });
+
+    uint32_t triangleCount = 0;
+    for (auto& chunk : chunks)
+    {
+        chunk.positionBase = m_objPositionCount;
+        chunk.texcoordBase = m_objTexcoordCount;
+        chunk.normalBase = m_objNormalCount;
+        chunk.triangleBase = triangleCount;
+        m_objPositionCount += chunk.positions;
+        m_objTexcoordCount += chunk.texcoords;
+        m_objNormalCount += chunk.normals;
+        triangleCount += chunk.triangles;
+        m_objHasColors |= chunk.colors;
+    }
+    if (triangleCount == 0 || m_objPositionCount == 0)
+    {
+        return reportError(m_fileName, "no faces");
+    }
+
+    m_objPositions.reset(new glm::vec3[m_objPositionCount]);
+    m_objTexcoords.reset(new glm::vec2[max(m_objTexcoordCount, 1u)]);
+    m_objNormals.reset(new glm::vec3[max(m_objNormalCount, 1u)]);
+    m_objCorners.reset(new ObjCorner[size_t(triangleCount) * 3]);
+    if (m_objHasColors)
+    {
+        m_objColors.reset(new glm::vec3[m_objPositionCount]);
+    }
+
+    // 2 回目: 値を読む
+    parallelFor(chunkCount, [&](size_t i)
+    {
+        auto& chunk = chunks[i];
+        uint32_t position = chunk.positionBase;
+        uint32_t texcoord = chunk.texcoordBase;
+        uint32_t normal = chunk.normalBase;
+        auto corner = &m_objCorners[size_t(chunk.triangleBase) * 3];
+
+        chunk.boundsMin = glm::vec3(FLT_MAX);
+        chunk.boundsMax = glm::vec3(-FLT_MAX);
+
+        forEachLine(chunk.begin, chunk.end, [&](const char* p, const char* lineEnd)
+        {
+            if (lineEnd - p < 2 || (!isBlank(p[1]) && p[1] != 't' && p[1] != 'n'))
+            {
+                return;
+            }
+            if (p[0] == 'v' && isBlank(p[1]))
+            {
+                glm::vec3 v(0.0f);
+                p += 1;
+                chunk.failed |= !parseFloat(p, lineEnd, v.x) || !parseFloat(p, lineEnd, v.y) || !parseFloat(p, lineEnd, v.z);
+                m_objPositions[position] = v;
+                chunk.boundsMin = glm::min(chunk.boundsMin, v);
+                chunk.boundsMax = glm::max(chunk.boundsMax, v);
+
+                if (m_objHasColors)
+                {
+                    // 拡張形式 "v x y z r g b"（色の無い行は白）
+                    glm::vec3 c(1.0f);
+                    if (parseFloat(p, lineEnd, c.x))
+                    {
+                        chunk.failed |= !parseFloat(p, lineEnd, c.y) || !parseFloat(p, lineEnd, c.z);
+                    }
+                    m_objColors[position] = c;
+                }
+                position++;
+            }
+            else if (p[0] == 'v' && p[1] == 't')
+            {
+                glm::vec2 t(0.0f);
+                p += 2;
+                chunk.failed |= !parseFloat(p, lineEnd, t.x);
+                parseFloat(p, lineEnd, t.y);
+
+                // OBJ は左下原点なので glTF と同じ左上原点に揃える
+                m_objTexcoords[texcoord++] = glm::vec2(t.x, 1.0f - t.y);
+            }
+            else if (p[0] == 'v' && p[1] == 'n')
+            {
+                glm::vec3 n(0.0f);
+                p += 2;
+                chunk.failed |= !parseFloat(p, lineEnd, n.x) || !parseFloat(p, lineEnd, n.y) || !parseFloat(p, lineEnd, n.z);
+                m_objNormals[normal++] = n;
+            }
+            else if (p[0] == 'f' && isBlank(p[1]))
+            {
+                // 角の書式は v, v/vt, v//vn, v/vt/vn。多角形は最初の角を中心に扇形に分割する
+                ObjCorner firstCorner{}, previousCorner{};
+                uint32_t cornerCount = 0;
+                p += 1;
+                for (;;)
+                {
+                    skipBlank(p, lineEnd);
+                    if (p == lineEnd || *p == '#')
+                    {
+                        break;
+                    }
+
+                    int64_t v = 0, vt = 0, vn = 0;
+                    if (!parseInt(p, lineEnd, v))
+                    {
+                        chunk.failed = true;
+                        return;
+                    }
+                    if (p < lineEnd && *p == '/')
+                    {
+                        ++p;
+                        if (p < lineEnd && *p != '/')
+                        {
+                            chunk.failed |= !parseInt(p, lineEnd, vt);
+                        }
+                        if (p < lineEnd && *p == '/')
+                        {
+                            ++p;
+                            chunk.failed |= !parseInt(p, lineEnd, vn);
+                        }
+                    }
+
+                    ObjCorner c;
+                    c.position = resolveObjIndex(v, position, m_objPositionCount);
+                    c.texcoord = vt != 0 ? resolveObjIndex(vt, texcoord, m_objTexcoordCount) : InvalidIndex;
+                    c.normal = vn != 0 ? resolveObjIndex(vn, normal, m_objNormalCount) : InvalidIndex;
+                    chunk.failed |= c.position == InvalidIndex;
+
+                    if (cornerCount == 0)
+                    {
+                        firstCorner = c;
+                    }
+                    else if (cornerCount >= 2)
+                    {
+                        *corner++ = firstCorner;
+                        *corner++ = previousCorner;
+                        *corner++ = c;
+                    }
+                    previousCorner = c;
+                    cornerCount++;
+
+                    // 1 回目と同じ数え方にするため、残りの文字はトークンの区切りまで読み飛ばす
+                    while (p < lineEnd && !isBlank(*p))
+                    {
+                        ++p;
+                    }
+                }
+            }
+        });
+    });
+
+    MeshPrimitive dst{};
+    dst.vertexCount = triangleCount * 3;
+    dst.indexCount = triangleCount * 3;
+    dst.boundsMin = glm::vec3(FLT_MAX);
+    dst.boundsMax = glm::vec3(-FLT_MAX);
+    for (const auto& chunk : chunks)
+    {
+        if (chunk.failed)
+        {
+            return reportError(m_fileName, "malformed vertex or face");
+        }
+        dst.boundsMin = glm::min(dst.boundsMin, chunk.boundsMin);
+        dst.boundsMax = glm::max(dst.boundsMax, chunk.boundsMax);
+    }
+    m_primitives.push_back(dst);
+    return true;
+}
+
+/// <summary>
+/// クック済みファイルのテーブルを読む（頂点やインデックスのデータには触れない）
+/// </summary>
+bool MeshLoader::openCache()
+{
+    m_format = Format::Cache;
+
+    const uint8_t* data = m_file.data();
+    string error;
+    if (!validateMeshCache(data, m_file.size(), error))
+    {
+        return reportError(m_fileName, error);
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    auto primitives = reinterpret_cast<const MeshCachePrimitive*>(data + header.primitiveTableOffset);
+    auto lods = reinterpret_cast<const MeshCacheLod*>(data + header.lodTableOffset);
+    auto meshlets = reinterpret_cast<const MeshCacheMeshlet*>(data + header.meshletTableOffset);
+    m_cacheBlocks = reinterpret_cast<const MeshCacheBlock*>(data + header.blockTableOffset);
+    m_cacheBlockCount = header.blockCount;
+
+    for (uint32_t i = 0; i < header.primitiveCount; ++i)
+    {
+        const auto& src = primitives[i];
+        MeshPrimitive dst{};
+        dst.vertexOffset = int32_t(src.vertexOffset);
+        dst.vertexCount = src.vertexCount;
+        memcpy(&dst.quantization.offset, src.quantizationOffset, sizeof(src.quantizationOffset));
+        memcpy(&dst.quantization.scale, src.quantizationScale, sizeof(src.quantizationScale));
+        memcpy(&dst.boundsMin, src.boundsMin, sizeof(src.boundsMin));
+        memcpy(&dst.boundsMax, src.boundsMax, sizeof(src.boundsMax));
+
+        dst.lodCount = src.lodCount;
+        for (uint32_t l = 0; l < src.lodCount; ++l)
+        {
+            const auto& lod = lods[src.firstLod + l];
+            dst.lods[l] = { lod.firstIndex, lod.indexCount, lod.error };
+        }
+        dst.firstIndex = dst.lods[0].firstIndex;
+        dst.indexCount = dst.lods[0].indexCount;
+        dst.firstMeshlet = src.firstMeshlet;
+        dst.meshletCount = src.meshletCount;
+        m_primitives.push_back(dst);
+    }
+
+    // メッシュレットのテーブルは小さいのでコピーしておく
+    m_meshlets.resize(header.meshletCount);
+    for (uint32_t i = 0; i < header.meshletCount; ++i)
+    {
+        const auto& src = meshlets[i];
+        auto& dst = m_meshlets[i];
+        dst.firstIndex = src.firstIndex;
+        dst.triangleCount = src.triangleCount;
+        dst.vertexCount = src.vertexCount;
+        dst.coneCutoff = src.coneCutoff;
+        memcpy(&dst.center, src.center, sizeof(src.center));
+        dst.radius = src.radius;
+        memcpy(&dst.coneApex, src.coneApex, sizeof(src.coneApex));
+        memcpy(&dst.coneAxis, src.coneAxis, sizeof(src.coneAxis));
+    }
+
+    m_vertexCount = header.vertexCount;
+    m_indexCount = header.indexCount;
+    m_indexType = VkIndexType(header.indexType);
+    memcpy(&m_boundsMin, header.boundsMin, sizeof(header.boundsMin));
+    memcpy(&m_boundsMax, header.boundsMax, sizeof(header.boundsMax));
+    return true;
+}
+
+/// <summary>
+/// プリミティブをバッファ上に並べ、インデックスの型と量子化の変換を決める
+/// </summary>
+void MeshLoader::finishOpen()
+{
+    uint32_t maxVertexCount = 0;
+    m_boundsMin = glm::vec3(FLT_MAX);
+    m_boundsMax = glm::vec3(-FLT_MAX);
+    for (auto& primitive : m_primitives)
+    {
+        primitive.firstIndex = m_indexCount;
+        primitive.vertexOffset = int32_t(m_vertexCount);
+        primitive.quantization = computePositionQuantization(primitive.boundsMin, primitive.boundsMax);
+        primitive.lodCount = 1;
+        primitive.lods[0] = { primitive.firstIndex, primitive.indexCount, 0.0f };
+        m_indexCount += primitive.indexCount;
+        m_vertexCount += primitive.vertexCount;
+        maxVertexCount = max(maxVertexCount, primitive.vertexCount);
+        m_boundsMin = glm::min(m_boundsMin, primitive.boundsMin);
+        m_boundsMax = glm::max(m_boundsMax, primitive.boundsMax);
+    }
+
+    // インデックスはプリミティブ内の番号なので、最も大きいプリミティブが 16bit に収まるかで決まる
+    m_indexType = selectIndexType(maxVertexCount);
+}
+
+/// <summary>
+/// glTF / OBJ のプリミティブごとにメッシュレットを作り、並べ替えたインデックスを m_meshletIndices に置く
+/// 境界はクック済みファイルと同じく量子化された位置の空間で求める（cluster.comp が同じ空間で判定する）
+/// </summary>
+void MeshLoader::buildPrimitiveMeshlets()
+{
+    vector<vector<Meshlet>> meshlets(m_primitives.size());
+    m_meshletIndices.assign(m_primitives.size(), vector<uint32_t>());
+
+    parallelFor(m_primitives.size(), [&](size_t p)
+    {
+        const auto& primitive = m_primitives[p];
+        if (primitive.vertexCount == 0 || primitive.indexCount < 3)
+        {
+            return;
+        }
+        auto& indices = m_meshletIndices[p];
+        indices.resize(primitive.indexCount);
+        for (uint32_t i = 0; i < primitive.indexCount; ++i)
+        {
+            indices[i] = readSourceIndex(uint32_t(p), i);
+        }
+
+        // 頂点は読み込みと同じ変換で一旦量子化してから、量子化された位置の空間へ戻す
+        vector<MeshVertex> vertices(primitive.vertexCount);
+        decodeVertices({ uint32_t(p), false, 0, primitive.vertexCount, 0, 0, {} }, vertices.data());
+        vector<glm::vec3> positions(primitive.vertexCount);
+        for (uint32_t v = 0; v < primitive.vertexCount; ++v)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                positions[v][c] = max(float(vertices[v].pos.v[c]) / 32767.0f, -1.0f);
+            }
+        }
+
+        buildMeshlets(indices.data(), indices.size(), &positions[0].x, sizeof(glm::vec3), primitive.vertexCount, meshlets[p]);
+    });
+
+    m_meshlets.clear();
+    for (size_t p = 0; p < m_primitives.size(); ++p)
+    {
+        m_primitives[p].firstMeshlet = uint32_t(m_meshlets.size());
+        m_primitives[p].meshletCount = uint32_t(meshlets[p].size());
+        m_meshlets.insert(m_meshlets.end(), meshlets[p].begin(), meshlets[p].end());
+    }
+}
+
+/// <summary>
+/// 読み込みを一定数ごとの作業に分ける
+/// </summary>
+vector<MeshLoader::LoadJob> MeshLoader::createJobs() const
+{
+    const VkDeviceSize indexSize = getIndexSize(m_indexType);
+    const VkDeviceSize vertexSize = sizeof(MeshVertex);
+
+    vector<LoadJob> jobs;
+    if (m_format == Format::Cache)
+    {
+        // クック済みファイルはブロックがそのまま作業の単位になる
+        for (uint32_t b = 0; b < m_cacheBlockCount; ++b)
+        {
+            const auto& block = m_cacheBlocks[b];
+            const bool indices = block.stream == MeshCacheIndexStream;
+            const auto elementSize = indices ? indexSize : vertexSize;
+            jobs.push_back({ b, indices, block.first, block.count, block.first * elementSize, block.count * elementSize, {} });
+        }
+        return jobs;
+    }
+
+    for (uint32_t p = 0; p < uint32_t(m_primitives.size()); ++p)
+    {
+        const auto& primitive = m_primitives[p];
+        for (uint32_t first = 0; first < primitive.vertexCount; first += VerticesPerJob)
+        {
+            const auto count = min(VerticesPerJob, primitive.vertexCount - first);
+            jobs.push_back({ p, false, first, count, (VkDeviceSize(primitive.vertexOffset) + first) * vertexSize, count * vertexSize, {} });
+        }
+        for (uint32_t first = 0; first < primitive.indexCount; first += IndicesPerJob)
+        {
+            const auto count = min(IndicesPerJob, primitive.indexCount - first);
+            jobs.push_back({ p, true, first, count, (VkDeviceSize(primitive.firstIndex) + first) * indexSize, count * indexSize, {} });
+        }
+    }
+    return jobs;
+}
+
+/// <summary>
+/// 頂点とインデックスをステージングバッファへ並列に書き込み、GPU 上のバッファへ転送する
+/// ステージングバッファに収まる分ずつ作業をまとめ、書き込みが終わるたびに転送する
+/// </summary>
+bool MeshLoader::load(UploadScheduler& uploader, VkBuffer vertexBuffer, VkDeviceSize vertexBufferOffset,
+    VkBuffer indexBuffer, VkDeviceSize indexBufferOffset)
+{
+    if (m_format == Format::None)
+    {
+        return false;
+    }
+
+    const auto startTime = chrono::steady_clock::now();
+    if (m_buildMeshlets && m_format != Format::Cache)
+    {
+        buildPrimitiveMeshlets();
+    }
+    auto jobs = createJobs();
+    atomic<bool> failed(false);
+
+    // クック済みファイルの無圧縮のブロックは CPU で触る必要が無いので、
+    // 非同期読み込みが使える場合はファイルから直接ステージングバッファへ読み込む
+    int file = -1;
+    if (m_format == Format::Cache && uploader.getFileReader() != nullptr)
+    {
+        file = uploader.getFileReader()->openFile(m_fileName.c_str());
+    }
+
+    vector<size_t> decodeJobs;
+    size_t next = 0;
+    while (next < jobs.size())
+    {
+        size_t batchEnd = next;
+        for (; batchEnd < jobs.size(); ++batchEnd)
+        {
+            auto& job = jobs[batchEnd];
+            if (!uploader.allocate(job.size, 4, job.staging))
+            {
+                break;
+            }
+        }
+        if (batchEnd == next)
+        {
+            if (file >= 0)
+            {
+                uploader.getFileReader()->closeFile(file);
+            }
+            m_meshletIndices.clear();
+            return reportError(m_fileName, "staging buffer is too small");
+        }
+
+        // 読み込みを先に発行しておき、完了を待つ間に残りのブロックを復号する
+        decodeJobs.clear();
+        for (size_t i = next; i < batchEnd; ++i)
+        {
+            const auto& job = jobs[i];
+            if (file >= 0 && m_cacheBlocks[job.primitive].encoding == MeshCacheRaw)
+            {
+                const auto& block = m_cacheBlocks[job.primitive];
+                uploader.readFromFile(file, block.dataOffset, job.staging,
+                    job.indices ? indexBuffer : vertexBuffer, (job.indices ? indexBufferOffset : vertexBufferOffset) + job.targetOffset);
+            }
+            else
+            {
+                decodeJobs.push_back(i);
+            }
+        }
+
+        parallelFor(decodeJobs.size(), [&](size_t i)
+        {
+            const auto& job = jobs[decodeJobs[i]];
+            if (!decodeJob(job, job.staging.data))
+            {
+                failed = true;
+                return;
+            }
+            if (job.indices)
+            {
+                uploader.copyToBuffer(job.staging, indexBuffer, indexBufferOffset + job.targetOffset);
+            }
+            else
+            {
+                uploader.copyToBuffer(job.staging, vertexBuffer, vertexBufferOffset + job.targetOffset);
+            }
+        });
+
+        if (!uploader.flush())
+        {
+            failed = true;
+        }
+        next = batchEnd;
+    }
+
+    if (file >= 0)
+    {
+        uploader.getFileReader()->closeFile(file);
+    }
+    m_meshletIndices.clear();
+    if (failed)
+    {
+        return reportError(m_fileName, "corrupted data block or read error");
+    }
+    reportLoadTime(startTime);
+    return true;
+}
+
+/// <summary>
+/// load と同じ処理をステージングバッファを介さずに行う
+/// </summary>
+bool MeshLoader::loadToMemory(void* vertexData, void* indexData)
+{
+    if (m_format == Format::None)
+    {
+        return false;
+    }
+
+    const auto startTime = chrono::steady_clock::now();
+    if (m_buildMeshlets && m_format != Format::Cache)
+    {
+        buildPrimitiveMeshlets();
+    }
+    auto jobs = createJobs();
+    atomic<bool> failed(false);
+
+    parallelFor(jobs.size(), [&](size_t i)
+    {
+        const auto& job = jobs[i];
+        auto base = static_cast<uint8_t*>(job.indices ? indexData : vertexData);
+        if (!decodeJob(job, base + job.targetOffset))
+        {
+            failed = true;
+        }
+    });
+    m_meshletIndices.clear();
+
+    if (failed)
+    {
+        return reportError(m_fileName, "corrupted data block");
+    }
+    reportLoadTime(startTime);
+    return true;
+}
+
+void MeshLoader::reportLoadTime(chrono::steady_clock::time_point startTime) const
+{
+    const auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+    stringstream ss;
+    ss << "[MeshLoader] " << m_fileName << ": " << m_primitives.size() << " primitives, "
+       << m_vertexCount << " vertices, " << m_indexCount << " indices ("
+       << (getVertexDataSize() + getIndexDataSize()) / (1024.0 * 1024.0) << " MB) in "
+       << elapsed << " ms on " << getWorkerCount() << " threads" << endl;
+    OutputDebugStringA(ss.str().c_str());
+}
+
+bool MeshLoader::decodeJob(const LoadJob& job, void* dst) const
+{
+    if (m_format == Format::Cache)
+    {
+        return decodeCacheBlock(job, dst);
+    }
+    if (job.indices)
+    {
+        decodeIndices(job, dst);
+    }
+    else
+    {
+        decodeVertices(job, static_cast<MeshVertex*>(dst));
+    }
+    return true;
+}
+
+void MeshLoader::decodeVertices(const LoadJob& job, MeshVertex* dst) const
+{
+    const auto& primitive = m_primitives[job.primitive];
+    const auto stride = sizeof(MeshVertex);
+
+    if (m_format == Format::Gltf)
+    {
+        const auto& source = m_gltfPrimitives[job.primitive];
+
+        encodeAccessor(source.position, job.first, job.count, [&](const float* src, size_t srcStride, size_t count, uint32_t offset, uint32_t)
+        {
+            encodePositionsSnorm16(src, srcStride, count, primitive.quantization, &dst[offset].pos, stride);
+        });
+
+        if (source.normal.data != nullptr)
+        {
+            encodeAccessor(source.normal, job.first, job.count, [&](const float* src, size_t srcStride, size_t count, uint32_t offset, uint32_t)
+            {
+                encodeNormalsOct16(src, srcStride, count, &dst[offset].normal, stride);
+            });
+        }
+        else
+        {
+            encodeNormalsOct16(DefaultNormal, 0, job.count, &dst->normal, stride);
+        }
+
+        if (source.texcoord.data != nullptr)
+        {
+            encodeAccessor(source.texcoord, job.first, job.count, [&](const float* src, size_t srcStride, size_t count, uint32_t offset, uint32_t)
+            {
+                encodeTexcoordsHalf(src, srcStride, count, &dst[offset].texcoord, stride);
+            });
+        }
+        else
+        {
+            encodeTexcoordsHalf(DefaultTexcoord, 0, job.count, &dst->texcoord, stride);
+        }
+
+        if (source.color.data != nullptr)
+        {
+            encodeAccessor(source.color, job.first, job.count, [&](const float* src, size_t srcStride, size_t count, uint32_t offset, uint32_t components)
+            {
+                encodeColorsUnorm8(src, srcStride, components, count, &dst[offset].color, stride);
+            });
+        }
+        else
+        {
+            encodeColorsUnorm8(DefaultColor, 0, 4, job.count, &dst->color, stride);
+        }
+        return;
+    }
+
+    // OBJ は角ごとに位置・法線・UV を集めてから変換する
+    float positions[DecodeChunk * 3];
+    float normals[DecodeChunk * 3];
+    float texcoords[DecodeChunk * 2];
+    float colors[DecodeChunk * 3];
+    for (uint32_t done = 0; done < job.count; done += DecodeChunk)
+    {
+        uint32_t n = min(DecodeChunk, job.count - done);
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            const auto& corner = m_objCorners[job.first + done + i];
+            memcpy(&positions[i * 3], &m_objPositions[corner.position], sizeof(float) * 3);
+            memcpy(&normals[i * 3], corner.normal != InvalidIndex ? &m_objNormals[corner.normal].x : DefaultNormal, sizeof(float) * 3);
+            memcpy(&texcoords[i * 2], corner.texcoord != InvalidIndex ? &m_objTexcoords[corner.texcoord].x : DefaultTexcoord, sizeof(float) * 2);
+            memcpy(&colors[i * 3], m_objHasColors ? &m_objColors[corner.position].x : DefaultColor, sizeof(float) * 3);
+        }
+
+        auto d = dst + done;
+        encodePositionsSnorm16(positions, sizeof(float) * 3, n, primitive.quantization, &d->pos, stride);
+        encodeNormalsOct16(normals, sizeof(float) * 3, n, &d->normal, stride);
+        encodeTexcoordsHalf(texcoords, sizeof(float) * 2, n, &d->texcoord, stride);
+        encodeColorsUnorm8(colors, sizeof(float) * 3, 3, n, &d->color, stride);
+    }
+}
+
+/// <summary>
+/// インデックスを選んだ型で書き込む（範囲外のインデックスは 0 に置き換える）
+/// メッシュレットを作った場合は、メッシュレットごとに並べ替えたインデックスを書き込む
+/// </summary>
+void MeshLoader::decodeIndices(const LoadJob& job, void* dst) const
+{
+    const uint32_t* reordered = m_meshletIndices.empty() || m_meshletIndices[job.primitive].empty() ?
+        nullptr : m_meshletIndices[job.primitive].data() + job.first;
+    auto read = [&](uint32_t i) -> uint32_t
+    {
+        return reordered != nullptr ? reordered[i] : readSourceIndex(job.primitive, job.first + i);
+    };
+
+    if (m_indexType == VK_INDEX_TYPE_UINT16)
+    {
+        auto d = static_cast<uint16_t*>(dst);
+        for (uint32_t i = 0; i < job.count; ++i)
+        {
+            d[i] = uint16_t(read(i));
+        }
+    }
+    else
+    {
+        auto d = static_cast<uint32_t*>(dst);
+        for (uint32_t i = 0; i < job.count; ++i)
+        {
+            d[i] = read(i);
+        }
+    }
+}
+
+/// <summary>
+/// プリミティブの index 番目のインデックスをファイルから読む（範囲外のインデックスは 0 に置き換える）
+/// </summary>
+uint32_t MeshLoader::readSourceIndex(uint32_t primitive, uint32_t index) const
+{
+    if (m_format != Format::Gltf || m_gltfPrimitives[primitive].indices.data == nullptr)
+    {
+        // インデックスが無い場合（OBJ は角ごとに頂点を作るので常にこちら）
+        return index;
+    }
+    const auto& source = m_gltfPrimitives[primitive].indices;
+    auto v = readIndex(source.data + size_t(index) * source.stride, source.componentType);
+    return v < m_primitives[primitive].vertexCount ? v : 0;
+}
+
+/// <summary>
+/// クック済みファイルのブロックをコピーまたは復号する
+/// </summary>
+bool MeshLoader::decodeCacheBlock(const LoadJob& job, void* dst) const
+{
+    const auto& block = m_cacheBlocks[job.primitive];
+    const uint8_t* data = m_file.data() + block.dataOffset;
+
+    if (block.encoding == MeshCacheRaw)
+    {
+        memcpy(dst, data, size_t(job.size));
+        return true;
+    }
+    if (job.indices)
+    {
+        return decodeIndexBlock(data, size_t(block.dataSize), job.count, m_indexType, dst);
+    }
+    return decodeVertexBlock(data, size_t(block.dataSize), job.count, sizeof(MeshVertex), static_cast<uint8_t*>(dst));
+}
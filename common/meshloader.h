@@ -0,0 +1,222 @@
+#pragma once
+#include "vkappbase.h"
+#include "vertexlayout.h"
+#include "vertexpacking.h"
+#include "mappedfile.h"
+#include "staging.h"
+#include "meshlet.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+/// <summary>
+/// メッシュファイル（glTF 2.0 / OBJ）の読み込み
+/// </summary>
+/// <remarks>
+/// 読み込みは 2 段階で行う。
+///   open: ファイルをメモリマップし、メタデータだけを解析して頂点数・インデックス数・バウンディングボックスを求める
+///   load: 頂点とインデックスを一定数ごとの作業に分け、ワーカースレッドでメモリマップから直接読んで
+///         量子化しながらステージングバッファへ書き込み、GPU 上のバッファへの転送を登録する
+/// 頂点データを一旦 std::vector に展開することはしない。
+/// 呼び出し側は open のあとで getVertexDataSize / getIndexDataSize の大きさのバッファを作り、load に渡す。
+/// glTF はメッシュのプリミティブ単位で読み込み、ノードの変換やマテリアルは扱わない。
+/// OBJ の面は三角形に分割して角ごとに頂点を作る（頂点の統合や最適化はオフラインで行う想定）。
+/// クック済みの .mesh（meshcache.h）は最適化・量子化が済んでいるので、ブロックをコピー（または復号）するだけで済む。
+/// 簡略化した LOD（meshlod.h）はクック済みのファイルにだけ含まれる。glTF / OBJ の場合は必要なら
+/// loadToMemory で読んでから buildMeshLods で作る。
+/// メッシュレット（meshlet.h）はクック済みのファイルに含まれるものを使う。glTF / OBJ の場合は setBuildMeshlets(true) にすると、
+/// load / loadToMemory の前にプリミティブごとにメモリマップ上のデータから作り、並べ替えたインデックスを書き込む。
+/// </remarks>
+
+/// <summary>
+/// 読み込んだメッシュの頂点（20 バイト）
+/// </summary>
+struct MeshVertex
+{
+    Snorm16x4 pos;
+    Unorm8x4 color;
+    Snorm16x2 normal;
+    Half2 texcoord;
+};
+
+DECLARE_VERTEX_LAYOUT(MeshVertex, VK_VERTEX_INPUT_RATE_VERTEX,
+    VERTEX_ATTRIBUTE(MeshVertex, pos, 0),
+    VERTEX_ATTRIBUTE(MeshVertex, color, 1),
+    VERTEX_ATTRIBUTE(MeshVertex, normal, 2),
+    VERTEX_ATTRIBUTE(MeshVertex, texcoord, 3));
+
+// 1 つのプリミティブが持てる LOD の数
+const uint32_t MaxMeshLods = 8;
+
+/// <summary>
+/// 詳細度ごとのインデックスの範囲（頂点はすべての LOD で共有する）
+/// error は元のメッシュからの誤差（オブジェクト空間の距離）
+/// </summary>
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+};
+
+/// <summary>
+/// 1 回の vkCmdDrawIndexed で描画する範囲
+/// インデックスはプリミティブ内の頂点番号なので、vertexOffset と合わせて使う
+/// firstIndex / indexCount は最も詳細な LOD（lods[0]）と同じ
+/// メッシュレットは MeshLoader::getMeshlets の firstMeshlet から meshletCount 個（無ければ 0 個）で、
+/// Meshlet::firstIndex は firstIndex からの位置、境界は量子化された位置の空間
+/// </summary>
+struct MeshPrimitive
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+    uint32_t vertexCount;
+
+    PositionQuantization quantization;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    uint32_t lodCount;
+    MeshLod lods[MaxMeshLods];
+
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+};
+
+struct MeshCacheBlock;
+
+class MeshLoader
+{
+public:
+    MeshLoader();
+    ~MeshLoader();
+
+    // fileName は UTF-8。拡張子が .obj なら OBJ、.mesh ならクック済みファイル、それ以外は glTF（.gltf / .glb）として読む
+    bool open(const char* fileName);
+    void close();
+
+    bool load(UploadScheduler& uploader, VkBuffer vertexBuffer, VkDeviceSize vertexBufferOffset,
+        VkBuffer indexBuffer, VkDeviceSize indexBufferOffset);
+
+    // GPU を使わずにメモリ上へ読み込む（オフラインのツール用）
+    // vertexData / indexData はそれぞれ getVertexDataSize / getIndexDataSize 以上の大きさが必要
+    bool loadToMemory(void* vertexData, void* indexData);
+
+    // glTF / OBJ を読み込むときにメッシュレットを作るか（クック済みファイルには影響しない）
+    void setBuildMeshlets(bool enable) { m_buildMeshlets = enable; }
+
+    const std::vector<MeshPrimitive>& getPrimitives() const { return m_primitives; }
+    const std::vector<Meshlet>& getMeshlets() const { return m_meshlets; }
+    uint32_t getVertexCount() const { return m_vertexCount; }
+    uint32_t getIndexCount() const { return m_indexCount; }
+    VkIndexType getIndexType() const { return m_indexType; }
+    VkDeviceSize getVertexDataSize() const { return VkDeviceSize(m_vertexCount) * sizeof(MeshVertex); }
+    VkDeviceSize getIndexDataSize() const;
+    glm::vec3 getBoundsMin() const { return m_boundsMin; }
+    glm::vec3 getBoundsMax() const { return m_boundsMax; }
+
+private:
+    enum class Format
+    {
+        None,
+        Gltf,
+        Obj,
+        Cache,
+    };
+
+    // glTF のアクセサをメモリマップ上で参照するためのビュー
+    struct AccessorView
+    {
+        const uint8_t* data;
+        size_t stride;
+        uint32_t count;
+        uint32_t components;
+        uint32_t componentType;
+        bool normalized;
+    };
+
+    struct GltfPrimitive
+    {
+        AccessorView position;
+        AccessorView normal;
+        AccessorView texcoord;
+        AccessorView color;
+        AccessorView indices;
+    };
+
+    // OBJ の面の角（位置・UV・法線の番号、無い場合は ~0u）
+    struct ObjCorner
+    {
+        uint32_t position;
+        uint32_t texcoord;
+        uint32_t normal;
+    };
+
+    // ワーカースレッドに渡す 1 つ分の作業
+    // primitive はクック済みファイルの場合はブロックの番号
+    // targetOffset / size は頂点またはインデックスのバッファ上の範囲（バイト単位）
+    struct LoadJob
+    {
+        uint32_t primitive;
+        bool indices;
+        uint32_t first;
+        uint32_t count;
+        VkDeviceSize targetOffset;
+        VkDeviceSize size;
+        StagingAllocation staging;
+    };
+
+    bool openGltf(const char* fileName);
+    bool openObj();
+    bool openCache();
+    void finishOpen();
+    void buildPrimitiveMeshlets();
+
+    std::vector<LoadJob> createJobs() const;
+    bool decodeJob(const LoadJob& job, void* dst) const;
+    void decodeVertices(const LoadJob& job, MeshVertex* dst) const;
+    void decodeIndices(const LoadJob& job, void* dst) const;
+    uint32_t readSourceIndex(uint32_t primitive, uint32_t index) const;
+    bool decodeCacheBlock(const LoadJob& job, void* dst) const;
+    void reportLoadTime(std::chrono::steady_clock::time_point startTime) const;
+
+    Format m_format;
+    std::string m_fileName;
+    MappedFile m_file;
+
+    // glTF のバッファ（外部の .bin はそれぞれメモリマップする）
+    std::vector<std::unique_ptr<MappedFile>> m_externalBuffers;
+    std::vector<GltfPrimitive> m_gltfPrimitives;
+
+    // OBJ の要素（ファイル全体で 1 回だけ確保する）
+    std::unique_ptr<glm::vec3[]> m_objPositions;
+    std::unique_ptr<glm::vec3[]> m_objColors;
+    std::unique_ptr<glm::vec3[]> m_objNormals;
+    std::unique_ptr<glm::vec2[]> m_objTexcoords;
+    std::unique_ptr<ObjCorner[]> m_objCorners;
+    uint32_t m_objPositionCount;
+    uint32_t m_objNormalCount;
+    uint32_t m_objTexcoordCount;
+    bool m_objHasColors;
+
+    // クック済みファイルのブロックのテーブル（メモリマップ上を直接指す）
+    const MeshCacheBlock* m_cacheBlocks;
+    uint32_t m_cacheBlockCount;
+
+    std::vector<MeshPrimitive> m_primitives;
+    std::vector<Meshlet> m_meshlets;
+    bool m_buildMeshlets;
+
+    // メッシュレットごとに並べ替えたプリミティブのインデックス（glTF / OBJ でメッシュレットを作る場合の読み込み中だけ使う）
+    std::vector<std::vector<uint32_t>> m_meshletIndices;
+    uint32_t m_vertexCount;
+    uint32_t m_indexCount;
+    VkIndexType m_indexType;
+    glm::vec3 m_boundsMin;
+    glm::vec3 m_boundsMax;
+};
@@ -0,0 +1,577 @@
+#include "meshlod.h"
+#include "meshoptimizer.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cfloat>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+    // LOD ごとに目標とする三角形の数（1 つ前の LOD に対する比）
+    const float LodReduction = 0.5f;
+
+    // 1 つ前の LOD に対してこれより減らせなかったら（境界や継ぎ目ばかりのメッシュ）LOD を作るのをやめる
+    const float MinLodReduction = 0.85f;
+
+    // これより少ない三角形の LOD からはさらに LOD を作らない
+    const size_t MinLodTriangles = 64;
+
+    // 最も粗い LOD の誤差の上限（メッシュの境界の最大の辺に対する比）
+    const float MaxLodErrorRatio = 0.25f;
+
+    // 縮約で向きが変わる三角形の、前後の法線の cos の下限（これより裏返るような縮約はしない）
+    const float MinNormalDot = 0.1f;
+
+    const uint32_t InvalidIndex = ~0u;
+
+    /// <summary>
+    /// 平面への距離の二次誤差 p^T A p + 2 b・p + c（A は対称行列、w は面積の和）
+    /// </summary>
+    struct Quadric
+    {
+        float a00, a11, a22, a01, a02, a12;
+        float b0, b1, b2;
+        float c;
+        float w;
+    };
+
+    /// <summary>
+    /// 属性の 1 成分の勾配の二次誤差
+    /// 三角形の上で属性を s(p) = g・p + d と表し、頂点の属性 s との差の二乗 (g・p + d - s)^2 を面積で重み付けして足す
+    /// 展開すると p^T A p + 2 b・p + c - 2 s (gs・p + ds) + s^2 w（w は位置の二次誤差と同じ面積の和）
+    /// </summary>
+    struct AttributeQuadric
+    {
+        float a00, a11, a22, a01, a02, a12;
+        float b0, b1, b2;
+        float c;
+        float gs0, gs1, gs2;
+        float ds;
+    };
+
+    struct Collapse
+    {
+        uint32_t source;
+        uint32_t target;
+        float error;
+    };
+
+    vec3 loadPosition(const float* positions, size_t stride, uint32_t index)
+    {
+        auto p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + size_t(index) * stride);
+        return vec3(p[0], p[1], p[2]);
+    }
+
+    void addQuadric(Quadric& q, const Quadric& r)
+    {
+        q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+        q.a01 += r.a01; q.a02 += r.a02; q.a12 += r.a12;
+        q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+        q.c += r.c;
+        q.w += r.w;
+    }
+
+    void addQuadric(AttributeQuadric& q, const AttributeQuadric& r)
+    {
+        q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+        q.a01 += r.a01; q.a02 += r.a02; q.a12 += r.a12;
+        q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+        q.c += r.c;
+        q.gs0 += r.gs0; q.gs1 += r.gs1; q.gs2 += r.gs2;
+        q.ds += r.ds;
+    }
+
+    float evaluateQuadric(const Quadric& q, const vec3& p)
+    {
+        const float rx = q.a00 * p.x + q.a01 * p.y + q.a02 * p.z;
+        const float ry = q.a01 * p.x + q.a11 * p.y + q.a12 * p.z;
+        const float rz = q.a02 * p.x + q.a12 * p.y + q.a22 * p.z;
+        return rx * p.x + ry * p.y + rz * p.z + 2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+    }
+
+    float evaluateQuadric(const AttributeQuadric& q, float w, const vec3& p, float s)
+    {
+        const float rx = q.a00 * p.x + q.a01 * p.y + q.a02 * p.z;
+        const float ry = q.a01 * p.x + q.a11 * p.y + q.a12 * p.z;
+        const float rz = q.a02 * p.x + q.a12 * p.y + q.a22 * p.z;
+        const float quadratic = rx * p.x + ry * p.y + rz * p.z + 2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+        return quadratic - 2.0f * s * (q.gs0 * p.x + q.gs1 * p.y + q.gs2 * p.z + q.ds) + s * s * w;
+    }
+
+    // 単位法線 n と d（n・p + d = 0）の平面、重み w
+    Quadric makePlaneQuadric(const vec3& n, float d, float w)
+    {
+        Quadric q;
+        q.a00 = w * n.x * n.x; q.a11 = w * n.y * n.y; q.a22 = w * n.z * n.z;
+        q.a01 = w * n.x * n.y; q.a02 = w * n.x * n.z; q.a12 = w * n.y * n.z;
+        q.b0 = w * n.x * d; q.b1 = w * n.y * d; q.b2 = w * n.z * d;
+        q.c = w * d * d;
+        q.w = w;
+        return q;
+    }
+
+    // 三角形の上の属性の勾配 g と d（g・p + d = s）から作る
+    AttributeQuadric makeAttributeQuadric(const vec3& g, float d, float w)
+    {
+        AttributeQuadric q;
+        q.a00 = w * g.x * g.x; q.a11 = w * g.y * g.y; q.a22 = w * g.z * g.z;
+        q.a01 = w * g.x * g.y; q.a02 = w * g.x * g.z; q.a12 = w * g.y * g.z;
+        q.b0 = w * g.x * d; q.b1 = w * g.y * d; q.b2 = w * g.z * d;
+        q.c = w * d * d;
+        q.gs0 = w * g.x; q.gs1 = w * g.y; q.gs2 = w * g.z;
+        q.ds = w * d;
+        return q;
+    }
+
+    /// <summary>
+    /// 動かさない頂点（境界・継ぎ目）を調べる
+    /// 位置が同じ頂点は同じ頂点として辺をたどり、反対向きの辺が無い（または同じ向きの辺が複数ある）辺の両端を境界とする
+    /// </summary>
+    vector<uint8_t> findLockedVertices(const uint32_t* indices, size_t indexCount, const vector<vec3>& points)
+    {
+        const size_t vertexCount = points.size();
+        vector<uint8_t> referenced(vertexCount, 0);
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            referenced[indices[i]] = 1;
+        }
+
+        // 位置が同じ頂点に同じ番号を振る（使われていない頂点は継ぎ目にしない）
+        size_t tableSize = 1;
+        while (tableSize < vertexCount * 2)
+        {
+            tableSize *= 2;
+        }
+        vector<uint32_t> table(tableSize, InvalidIndex);
+        vector<uint32_t> remap(vertexCount);
+        vector<uint8_t> seam(vertexCount, 0);
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            remap[v] = uint32_t(v);
+            if (!referenced[v])
+            {
+                continue;
+            }
+            size_t slot = size_t(hashValue(points[v])) & (tableSize - 1);
+            for (;;)
+            {
+                auto& entry = table[slot];
+                if (entry == InvalidIndex)
+                {
+                    entry = uint32_t(v);
+                    break;
+                }
+                if (points[entry] == points[v])
+                {
+                    remap[v] = entry;
+                    seam[v] = 1;
+                    seam[entry] = 1;
+                    break;
+                }
+                slot = (slot + 1) & (tableSize - 1);
+            }
+        }
+
+        vector<uint64_t> edges;
+        edges.reserve(indexCount);
+        for (size_t i = 0; i < indexCount; i += 3)
+        {
+            for (size_t e = 0; e < 3; ++e)
+            {
+                const uint64_t a = remap[indices[i + e]];
+                const uint64_t b = remap[indices[i + (e + 1) % 3]];
+                edges.push_back((a << 32) | b);
+            }
+        }
+        sort(edges.begin(), edges.end());
+
+        vector<uint8_t> border(vertexCount, 0);
+        for (size_t i = 0; i < edges.size(); ++i)
+        {
+            const uint32_t a = uint32_t(edges[i] >> 32);
+            const uint32_t b = uint32_t(edges[i] & 0xffffffffu);
+            const uint64_t reverse = (uint64_t(b) << 32) | a;
+            const bool duplicated = (i > 0 && edges[i - 1] == edges[i]) || (i + 1 < edges.size() && edges[i + 1] == edges[i]);
+            if (a == b || duplicated || !binary_search(edges.begin(), edges.end(), reverse))
+            {
+                border[a] = 1;
+                border[b] = 1;
+            }
+        }
+
+        vector<uint8_t> locked(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            locked[v] = seam[v] | border[remap[v]];
+        }
+        return locked;
+    }
+
+    /// <summary>
+    /// source を target へ寄せてよいか
+    /// 周りの三角形が裏返らないことと、縮約した辺の両端の共通の隣接頂点が辺を挟む三角形の頂点だけであること（穴を潰さない）
+    /// </summary>
+    bool canCollapse(uint32_t source, uint32_t target, const vector<uint32_t>& indices,
+        const vector<uint32_t>& offsets, const vector<uint32_t>& triangles, const vector<vec3>& points, vector<uint32_t>& neighbors)
+    {
+        neighbors.clear();
+        uint32_t sharedTriangles = 0;
+        for (uint32_t i = offsets[source]; i < offsets[source + 1]; ++i)
+        {
+            const uint32_t* triangle = &indices[size_t(triangles[i]) * 3];
+            if (triangle[0] == target || triangle[1] == target || triangle[2] == target)
+            {
+                sharedTriangles++;
+                continue;
+            }
+
+            vec3 before[3], after[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                before[k] = points[triangle[k]];
+                after[k] = triangle[k] == source ? points[target] : before[k];
+                if (triangle[k] != source)
+                {
+                    neighbors.push_back(triangle[k]);
+                }
+            }
+            const vec3 n0 = cross(before[1] - before[0], before[2] - before[0]);
+            const vec3 n1 = cross(after[1] - after[0], after[2] - after[0]);
+            if (dot(n0, n1) <= MinNormalDot * length(n0) * length(n1) || n1 == vec3(0.0f))
+            {
+                return false;
+            }
+        }
+
+        sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        uint32_t common = 0;
+        for (uint32_t i = offsets[target]; i < offsets[target + 1]; ++i)
+        {
+            const uint32_t* triangle = &indices[size_t(triangles[i]) * 3];
+            if (triangle[0] == source || triangle[1] == source || triangle[2] == source)
+            {
+                continue;
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t v = triangle[k];
+                if (v != target && binary_search(neighbors.begin(), neighbors.end(), v))
+                {
+                    // 同じ頂点を何度も数えないよう、数えたものは取り除く
+                    neighbors.erase(lower_bound(neighbors.begin(), neighbors.end(), v));
+                    common++;
+                }
+            }
+        }
+
+        // 辺を挟む三角形の向こうの頂点は source の周りの三角形（target を含まないもの）にも現れるので、その数までは許す
+        return common <= sharedTriangles;
+    }
+}
+
+/// <summary>
+/// 辺の縮約を繰り返して三角形を targetIndexCount / 3 個まで減らし、destination に書き込んだインデックスの数を返す
+/// 1 回のパスでは、頂点ごとに最も誤差の小さい縮約先を選んで誤差の順に並べ、周りの三角形が重ならない縮約を
+/// まとめて行う（縮約した頂点の周りは次のパスで判定し直す）。
+/// 誤差が targetError（位置と同じ空間の距離）を超える縮約はしないので、目標まで減らないこともある。
+/// attributes は頂点ごとに attributeCount 個の float で、attributeWeights 倍して位置の誤差と比べる
+/// （位置はメッシュの境界の最大の辺が 1 になるよう正規化して扱うので、重みはメッシュの大きさによらない）。
+/// resultError には行った縮約の最大の誤差（位置と同じ空間の距離）を返す
+/// </summary>
+size_t simplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+    const float* positions, size_t positionStride, size_t vertexCount,
+    const float* attributes, size_t attributeStride, const float* attributeWeights, size_t attributeCount,
+    size_t targetIndexCount, float targetError, float* resultError)
+{
+    attributeCount = attributes != nullptr ? min(attributeCount, MaxSimplifyAttributes) : 0;
+    vector<uint32_t> result(indices, indices + indexCount - indexCount % 3);
+    if (resultError != nullptr)
+    {
+        *resultError = 0.0f;
+    }
+
+    // 位置を正規化し、属性は重みを掛けておく
+    vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        const vec3 p = loadPosition(positions, positionStride, uint32_t(v));
+        boundsMin = min(boundsMin, p);
+        boundsMax = max(boundsMax, p);
+    }
+    const vec3 size = boundsMax - boundsMin;
+    const float extent = std::max(size.x, std::max(size.y, size.z));
+    const float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+    vector<vec3> points(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        points[v] = (loadPosition(positions, positionStride, uint32_t(v)) - boundsMin) * scale;
+    }
+    vector<float> values(vertexCount * attributeCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        auto src = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(attributes) + v * attributeStride);
+        for (size_t k = 0; k < attributeCount; ++k)
+        {
+            values[v * attributeCount + k] = src[k] * attributeWeights[k];
+        }
+    }
+
+    const auto locked = findLockedVertices(result.data(), result.size(), points);
+
+    // 三角形の平面と属性の勾配の二次誤差を、面積で重み付けして頂点に集める
+    vector<Quadric> quadrics(vertexCount, Quadric{});
+    vector<AttributeQuadric> attributeQuadrics(vertexCount * attributeCount, AttributeQuadric{});
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        const uint32_t v[3] = { result[i], result[i + 1], result[i + 2] };
+        const vec3 e1 = points[v[1]] - points[v[0]];
+        const vec3 e2 = points[v[2]] - points[v[0]];
+        const vec3 n = cross(e1, e2);
+        const float length2 = length(n);
+        if (length2 == 0.0f)
+        {
+            continue;
+        }
+        const float area = length2 * 0.5f;
+        const vec3 normal = n / length2;
+        const Quadric plane = makePlaneQuadric(normal, -dot(normal, points[v[0]]), area);
+        for (int k = 0; k < 3; ++k)
+        {
+            addQuadric(quadrics[v[k]], plane);
+        }
+
+        // 勾配は三角形の平面内で、2 辺に沿った属性の変化から求める
+        const float a = dot(e1, e1), b = dot(e1, e2), c = dot(e2, e2);
+        const float det = a * c - b * b;
+        if (det <= 0.0f)
+        {
+            continue;
+        }
+        for (size_t k = 0; k < attributeCount; ++k)
+        {
+            const float s0 = values[v[0] * attributeCount + k];
+            const float ds1 = values[v[1] * attributeCount + k] - s0;
+            const float ds2 = values[v[2] * attributeCount + k] - s0;
+            const vec3 g = (e1 * (c * ds1 - b * ds2) + e2 * (a * ds2 - b * ds1)) / det;
+            const AttributeQuadric attribute = makeAttributeQuadric(g, s0 - dot(g, points[v[0]]), area);
+            for (int j = 0; j < 3; ++j)
+            {
+                addQuadric(attributeQuadrics[v[j] * attributeCount + k], attribute);
+            }
+        }
+    }
+
+    // source を target へ寄せた場合の、両方の二次誤差の和を target の位置と属性で評価して面積で割ったもの
+    auto evaluateCollapse = [&](uint32_t source, uint32_t target)
+    {
+        Quadric q = quadrics[source];
+        addQuadric(q, quadrics[target]);
+        const vec3& p = points[target];
+        float error = evaluateQuadric(q, p);
+        for (size_t k = 0; k < attributeCount; ++k)
+        {
+            AttributeQuadric a = attributeQuadrics[source * attributeCount + k];
+            addQuadric(a, attributeQuadrics[target * attributeCount + k]);
+            error += evaluateQuadric(a, q.w, p, values[target * attributeCount + k]);
+        }
+        return q.w > 0.0f ? fabs(error) / q.w : 0.0f;
+    };
+
+    const float errorLimit = (targetError * scale) * (targetError * scale);
+    float maxError = 0.0f;
+    vector<uint32_t> offsets, triangles, remap, bestTargets, neighbors;
+    vector<float> bestErrors;
+    vector<uint8_t> touched;
+    vector<Collapse> collapses;
+    while (result.size() > targetIndexCount)
+    {
+        // 頂点を使う三角形の一覧（CSR 形式）
+        const size_t triangleCount = result.size() / 3;
+        offsets.assign(vertexCount + 1, 0);
+        for (uint32_t v : result)
+        {
+            offsets[v + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            offsets[v + 1] += offsets[v];
+        }
+        triangles.resize(result.size());
+        {
+            vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < result.size(); ++i)
+            {
+                triangles[cursors[result[i]]++] = uint32_t(i / 3);
+            }
+        }
+
+        // 頂点ごとに最も誤差の小さい縮約先（三角形の中で次の頂点へ向かう辺をたどれば、周りの辺をすべて見られる）
+        bestTargets.assign(vertexCount, InvalidIndex);
+        bestErrors.assign(vertexCount, FLT_MAX);
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            for (size_t e = 0; e < 3; ++e)
+            {
+                const uint32_t source = result[t * 3 + e];
+                const uint32_t target = result[t * 3 + (e + 1) % 3];
+                if (locked[source])
+                {
+                    continue;
+                }
+                const float error = evaluateCollapse(source, target);
+                if (error < bestErrors[source])
+                {
+                    bestErrors[source] = error;
+                    bestTargets[source] = target;
+                }
+            }
+        }
+        collapses.clear();
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            if (bestTargets[v] != InvalidIndex && bestErrors[v] <= errorLimit)
+            {
+                collapses.push_back({ uint32_t(v), bestTargets[v], bestErrors[v] });
+            }
+        }
+        sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        // 周りの三角形が重ならない縮約をまとめて行う
+        const size_t trianglesToRemove = std::max<size_t>((result.size() - targetIndexCount) / 3, 1);
+        size_t removed = 0;
+        size_t applied = 0;
+        remap.resize(vertexCount);
+        iota(remap.begin(), remap.end(), 0u);
+        touched.assign(vertexCount, 0);
+        for (const auto& collapse : collapses)
+        {
+            if (removed >= trianglesToRemove)
+            {
+                break;
+            }
+            if (touched[collapse.source] || touched[collapse.target] ||
+                !canCollapse(collapse.source, collapse.target, result, offsets, triangles, points, neighbors))
+            {
+                continue;
+            }
+
+            for (uint32_t i = offsets[collapse.source]; i < offsets[collapse.source + 1]; ++i)
+            {
+                const uint32_t* triangle = &result[size_t(triangles[i]) * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+                if (triangle[0] == collapse.target || triangle[1] == collapse.target || triangle[2] == collapse.target)
+                {
+                    removed++;
+                }
+            }
+            touched[collapse.target] = 1;
+            remap[collapse.source] = collapse.target;
+            addQuadric(quadrics[collapse.target], quadrics[collapse.source]);
+            for (size_t k = 0; k < attributeCount; ++k)
+            {
+                addQuadric(attributeQuadrics[collapse.target * attributeCount + k], attributeQuadrics[collapse.source * attributeCount + k]);
+            }
+            maxError = std::max(maxError, collapse.error);
+            applied++;
+        }
+        if (applied == 0)
+        {
+            break;
+        }
+
+        // インデックスを付け替えて、潰れた三角形を取り除く
+        size_t written = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            const uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (a != b && b != c && a != c)
+            {
+                result[written++] = a;
+                result[written++] = b;
+                result[written++] = c;
+            }
+        }
+        result.resize(written);
+    }
+
+    copy(result.begin(), result.end(), destination);
+    if (resultError != nullptr)
+    {
+        *resultError = sqrt(maxError) / scale;
+    }
+    return result.size();
+}
+
+/// <summary>
+/// indices（最も詳細な LOD）を 1 つ前の LOD の半分程度ずつ簡略化した LOD を末尾に追加していく
+/// lods には firstIndex を indices の先頭からの位置として、最も詳細な LOD を含めて書き込み、その数を返す
+/// 簡略化した LOD は頂点キャッシュ最適化しておく（頂点は共有するので頂点フェッチの最適化はすべての LOD を合わせて行う）
+/// </summary>
+uint32_t buildMeshLods(vector<uint32_t>& indices, const float* positions, size_t positionStride, size_t vertexCount,
+    const float* attributes, size_t attributeStride, const float* attributeWeights, size_t attributeCount,
+    MeshLod* lods, uint32_t maxLodCount)
+{
+    if (maxLodCount == 0)
+    {
+        return 0;
+    }
+    lods[0] = { 0, uint32_t(indices.size()), 0.0f };
+
+    vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        const vec3 p = loadPosition(positions, positionStride, uint32_t(v));
+        boundsMin = min(boundsMin, p);
+        boundsMax = max(boundsMax, p);
+    }
+    const vec3 size = boundsMax - boundsMin;
+    const float maxError = std::max(size.x, std::max(size.y, size.z)) * MaxLodErrorRatio;
+
+    uint32_t lodCount = 1;
+    float error = 0.0f;
+    vector<uint32_t> source(indices), simplified;
+    while (lodCount < maxLodCount && source.size() / 3 > MinLodTriangles && error < maxError)
+    {
+        const size_t targetIndexCount = size_t(float(source.size() / 3) * LodReduction) * 3;
+        float lodError = 0.0f;
+        simplified.resize(source.size());
+        const size_t count = simplifyMesh(simplified.data(), source.data(), source.size(), positions, positionStride, vertexCount,
+            attributes, attributeStride, attributeWeights, attributeCount, targetIndexCount, maxError - error, &lodError);
+        if (count == 0 || float(count) > float(source.size()) * MinLodReduction)
+        {
+            break;
+        }
+        simplified.resize(count);
+        optimizeVertexCache(simplified.data(), simplified.data(), count, vertexCount);
+
+        error += lodError;
+        lods[lodCount++] = { uint32_t(indices.size()), uint32_t(count), error };
+        indices.insert(indices.end(), simplified.begin(), simplified.end());
+        source.swap(simplified);
+    }
+    return lodCount;
+}
+
+/// <summary>
+/// 画面上の誤差（error * pixelsPerError ピクセル）が errorThreshold に収まる中で最も粗い LOD を選ぶ
+/// previousLod より粗い LOD は (1 - LodHysteresis) 倍の余裕を持って収まる場合だけ選ぶ（cull.comp と同じ規則）
+/// </summary>
+uint32_t selectMeshLod(const MeshLod* lods, uint32_t lodCount, float pixelsPerError, float errorThreshold, uint32_t previousLod)
+{
+    for (uint32_t i = lodCount; i > 1; --i)
+    {
+        const uint32_t lod = i - 1;
+        const float threshold = lod > previousLod ? errorThreshold * (1.0f - LodHysteresis) : errorThreshold;
+        if (lods[lod].error * pixelsPerError <= threshold)
+        {
+            return lod;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "meshloader.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// LOD の生成（二次誤差による簡略化）と、画面上の誤差による LOD の選択
+/// </summary>
+/// <remarks>
+/// simplifyMesh は辺の縮約で三角形を減らす。頂点は新しく作らず既存の頂点へ寄せるだけなので、
+/// すべての LOD が同じ頂点バッファを共有でき、LOD ごとに必要なのはインデックスだけになる。
+/// 縮約の誤差は三角形の平面への距離の二次誤差（Garland と Heckbert）に、頂点の属性（法線・色・UV など）の
+/// 勾配の二次誤差を重み付きで足したもの。どちらも面積で重み付けし、頂点に集まった面積で割って平均にする。
+/// 位置の輪郭を保つため、次の頂点は動かさない（縮約先にはなれる）。
+///   境界: 反対向きの辺が無い辺（穴や開いた縁）の頂点
+///   継ぎ目: 位置が同じで属性が違う頂点（UV や法線の継ぎ目で分かれた頂点）
+/// buildMeshLods は 1 つ前の LOD をさらに半分程度に簡略化していき、誤差は各段の誤差の和（実際より大きめ）にする。
+///
+/// 実行時は、LOD の誤差（メッシュの空間での距離）を画面上のピクセルに換算し、許容範囲に収まる中で最も粗い LOD を選ぶ。
+/// 境目の距離で毎フレーム LOD が行き来しないよう、今より粗い LOD へは誤差が許容範囲の (1 - LodHysteresis) 倍以下になるまで切り替えない。
+/// GPU の選択（cull.comp）も同じ規則で、オブジェクトごとに前のフレームの LOD を覚えている。
+/// </remarks>
+
+// 今より粗い LOD へ切り替える誤差の余裕（許容範囲に対する比）
+const float LodHysteresis = 0.25f;
+
+// simplifyMesh で 1 頂点に持てる属性の成分の最大数
+const size_t MaxSimplifyAttributes = 8;
+
+size_t simplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+    const float* positions, size_t positionStride, size_t vertexCount,
+    const float* attributes, size_t attributeStride, const float* attributeWeights, size_t attributeCount,
+    size_t targetIndexCount, float targetError, float* resultError);
+
+uint32_t buildMeshLods(std::vector<uint32_t>& indices, const float* positions, size_t positionStride, size_t vertexCount,
+    const float* attributes, size_t attributeStride, const float* attributeWeights, size_t attributeCount,
+    MeshLod* lods, uint32_t maxLodCount);
+
+uint32_t selectMeshLod(const MeshLod* lods, uint32_t lodCount, float pixelsPerError, float errorThreshold, uint32_t previousLod);
@@ -0,0 +1,546 @@
+#include "meshoptimizer.h"
+#include "hash.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    // Forsyth のアルゴリズムで使う LRU キャッシュのサイズと重み
+    // 実際の GPU のキャッシュ（FIFO）より大きめにしておくと、どのサイズに対しても安定して良い結果になる
+    const int ScoringCacheSize = 32;
+    const float CacheDecayPower = 1.5f;
+    const float LastTriangleScore = 0.75f;
+    const float ValenceBoostScale = 2.0f;
+    const float ValenceBoostPower = 0.5f;
+
+    const uint32_t InvalidIndex = ~0u;
+
+    float computeVertexScore(int cachePosition, uint32_t remainingValence)
+    {
+        if (remainingValence == 0)
+        {
+            // もう使われない頂点
+            return -1.0f;
+        }
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+            {
+                // 直前の三角形の頂点は、同じ辺を共有する三角形ばかりが続かないよう一定値にする
+                score = LastTriangleScore;
+            }
+            else
+            {
+                float scale = 1.0f / float(ScoringCacheSize - 3);
+                score = powf(1.0f - float(cachePosition - 3) * scale, CacheDecayPower);
+            }
+        }
+
+        // 残りの三角形が少ない頂点を優先して片付ける
+        score += ValenceBoostScale * powf(float(remainingValence), -ValenceBoostPower);
+        return score;
+    }
+
+    /// <summary>
+    /// タイムスタンプで FIFO キャッシュを模擬する
+    /// 最後にキャッシュに入ってから cacheSize 回以上ミスが起きていればキャッシュから追い出されている
+    /// </summary>
+    class FifoCacheSimulator
+    {
+    public:
+        FifoCacheSimulator(size_t vertexCount, uint32_t cacheSize)
+            : m_timestamps(vertexCount, 0), m_cacheSize(cacheSize), m_timestamp(cacheSize + 1)
+        {
+        }
+
+        // 頂点を参照し、キャッシュミス（頂点シェーダの実行）が起きたら 1 を返す
+        uint32_t access(uint32_t vertex)
+        {
+            if (m_timestamp - m_timestamps[vertex] > m_cacheSize)
+            {
+                m_timestamps[vertex] = m_timestamp++;
+                return 1;
+            }
+            return 0;
+        }
+
+        uint32_t accessTriangle(const uint32_t* triangle)
+        {
+            return access(triangle[0]) + access(triangle[1]) + access(triangle[2]);
+        }
+
+        // キャッシュを空にする
+        void reset()
+        {
+            m_timestamp += m_cacheSize + 1;
+        }
+
+    private:
+        vector<uint32_t> m_timestamps;
+        uint32_t m_cacheSize;
+        uint32_t m_timestamp;
+    };
+
+    glm::vec3 loadPosition(const uint8_t* positions, size_t stride, uint32_t index)
+    {
+        glm::vec3 p;
+        memcpy(&p, positions + index * stride, sizeof(p));
+        return p;
+    }
+}
+
+/// <summary>
+/// インデックス列を FIFO キャッシュで描画したときの頂点シェーダ実行数を求める
+/// </summary>
+VertexCacheStatistics analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStatistics stats{};
+    stats.triangleCount = uint32_t(indexCount / 3);
+
+    FifoCacheSimulator cache(vertexCount, cacheSize);
+    vector<bool> referenced(vertexCount, false);
+    for (size_t i = 0; i < stats.triangleCount * 3; i += 3)
+    {
+        stats.vertexTransforms += cache.accessTriangle(&indices[i]);
+        for (size_t k = 0; k < 3; ++k)
+        {
+            if (!referenced[indices[i + k]])
+            {
+                referenced[indices[i + k]] = true;
+                stats.vertexCount++;
+            }
+        }
+    }
+
+    stats.acmr = stats.triangleCount ? float(stats.vertexTransforms) / float(stats.triangleCount) : 0.0f;
+    stats.atvr = stats.vertexCount ? float(stats.vertexTransforms) / float(stats.vertexCount) : 0.0f;
+    return stats;
+}
+
+/// <summary>
+/// 頂点キャッシュの効率が良くなるよう三角形の順序を並べ替える（Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"）
+/// destination と indices は同じ配列でもよい
+/// </summary>
+void optimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    vector<uint32_t> source(indices, indices + triangleCount * 3);
+
+    // 頂点ごとに、その頂点を使う（まだ出力していない）三角形のリストを作る
+    vector<uint32_t> valence(vertexCount, 0);
+    for (auto v : source)
+    {
+        valence[v]++;
+    }
+
+    vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + valence[v];
+    }
+
+    vector<uint32_t> adjacency(source.size());
+    {
+        vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                auto v = source[t * 3 + k];
+                adjacency[fill[v]++] = uint32_t(t);
+            }
+        }
+    }
+
+    vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        vertexScores[v] = computeVertexScore(-1, valence[v]);
+    }
+
+    vector<float> triangleScores(triangleCount);
+    vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        const uint32_t* tri = &source[t * 3];
+        triangleScores[t] = vertexScores[tri[0]] + vertexScores[tri[1]] + vertexScores[tri[2]];
+    }
+
+    // 最初の三角形は全体で最もスコアの高いもの
+    uint32_t bestTriangle = uint32_t(max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+
+    // 新しい頂点を先頭に入れると一時的に 3 つはみ出す
+    uint32_t cache[ScoringCacheSize + 3];
+    uint32_t cacheCount = 0;
+    size_t inputCursor = 0;
+
+    for (size_t outputTriangle = 0; outputTriangle < triangleCount; ++outputTriangle)
+    {
+        if (bestTriangle == InvalidIndex)
+        {
+            // キャッシュ内の頂点から続けられる三角形がないので、まだ出力していない三角形を先頭から探す
+            while (emitted[inputCursor])
+            {
+                ++inputCursor;
+            }
+            bestTriangle = uint32_t(inputCursor);
+        }
+
+        const uint32_t* tri = &source[bestTriangle * 3];
+        destination[outputTriangle * 3 + 0] = tri[0];
+        destination[outputTriangle * 3 + 1] = tri[1];
+        destination[outputTriangle * 3 + 2] = tri[2];
+        emitted[bestTriangle] = true;
+
+        // 出力した三角形を頂点の隣接リストから取り除く
+        for (size_t k = 0; k < 3; ++k)
+        {
+            auto v = tri[k];
+            auto begin = adjacency.begin() + adjacencyOffsets[v];
+            auto end = begin + valence[v];
+            auto it = find(begin, end, bestTriangle);
+            iter_swap(it, end - 1);
+            valence[v]--;
+        }
+
+        // LRU キャッシュの更新（三角形の頂点を先頭に入れ、残りを後ろにずらす）
+        uint32_t newCache[ScoringCacheSize + 3];
+        uint32_t newCount = 0;
+        for (size_t k = 0; k < 3; ++k)
+        {
+            // 縮退した三角形では同じ頂点が重複する
+            if (find(newCache, newCache + newCount, tri[k]) == newCache + newCount)
+            {
+                newCache[newCount++] = tri[k];
+            }
+        }
+        for (uint32_t i = 0; i < cacheCount; ++i)
+        {
+            auto v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+            {
+                newCache[newCount++] = v;
+            }
+        }
+
+        // キャッシュ内（と今回追い出された）頂点のスコアを更新し、それらを使う三角形から次の候補を選ぶ
+        bestTriangle = InvalidIndex;
+        float bestScore = 0.0f;
+        for (uint32_t i = 0; i < newCount; ++i)
+        {
+            auto v = newCache[i];
+            int position = i < ScoringCacheSize ? int(i) : -1;
+
+            float score = computeVertexScore(position, valence[v]);
+            float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+
+            for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v] + valence[v]; ++a)
+            {
+                auto t = adjacency[a];
+                triangleScores[t] += delta;
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        cacheCount = min<uint32_t>(newCount, ScoringCacheSize);
+        memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+    }
+}
+
+/// <summary>
+/// オーバードローが減るよう、キャッシュ最適化済みのインデックス列をクラスタ単位で並べ替える
+/// </summary>
+/// <remarks>
+/// Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" の方針に従う。
+/// キャッシュを空にしてもクラスタの ACMR が元の threshold 倍以内に収まる位置で分割し、
+/// メッシュの中心から外を向いているクラスタほど先に描く。
+/// threshold は 1.05 程度（キャッシュ効率を 5% まで犠牲にする）が目安。
+/// </remarks>
+void optimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+    const float* positions, size_t positionStride, size_t vertexCount, float threshold)
+{
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    vector<uint32_t> source(indices, indices + triangleCount * 3);
+
+    // 全ての頂点がキャッシュミスする三角形をハードな境界とする（そこで分割してもキャッシュ効率は変わらない）
+    vector<uint32_t> hardBoundaries;
+    {
+        FifoCacheSimulator cache(vertexCount, DefaultVertexCacheSize);
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            if (cache.accessTriangle(&source[t * 3]) == 3)
+            {
+                hardBoundaries.push_back(uint32_t(t));
+            }
+        }
+        hardBoundaries.push_back(uint32_t(triangleCount));
+    }
+
+    // ハードな境界の間を、キャッシュを空にしても ACMR が threshold 倍以内に収まる位置でさらに分割する
+    vector<uint32_t> clusters;
+    {
+        FifoCacheSimulator cache(vertexCount, DefaultVertexCacheSize);
+        for (size_t h = 0; h + 1 < hardBoundaries.size(); ++h)
+        {
+            uint32_t begin = hardBoundaries[h];
+            uint32_t end = hardBoundaries[h + 1];
+
+            cache.reset();
+            uint32_t clusterMisses = 0;
+            for (uint32_t t = begin; t < end; ++t)
+            {
+                clusterMisses += cache.accessTriangle(&source[t * 3]);
+            }
+            float clusterThreshold = threshold * float(clusterMisses) / float(end - begin);
+
+            cache.reset();
+            uint32_t start = begin;
+            uint32_t misses = 0;
+            clusters.push_back(start);
+            for (uint32_t t = begin; t < end; ++t)
+            {
+                misses += cache.accessTriangle(&source[t * 3]);
+                if (t + 1 < end && float(misses) / float(t - start + 1) <= clusterThreshold)
+                {
+                    start = t + 1;
+                    misses = 0;
+                    clusters.push_back(start);
+                    cache.reset();
+                }
+            }
+        }
+        clusters.push_back(uint32_t(triangleCount));
+    }
+
+    // クラスタごとの中心（面積で重み付け）と平均法線
+    const size_t clusterCount = clusters.size() - 1;
+    auto positionBytes = reinterpret_cast<const uint8_t*>(positions);
+
+    vector<glm::vec3> centroids(clusterCount);
+    vector<glm::vec3> normals(clusterCount);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (uint32_t t = clusters[c]; t < clusters[c + 1]; ++t)
+        {
+            auto p0 = loadPosition(positionBytes, positionStride, source[t * 3 + 0]);
+            auto p1 = loadPosition(positionBytes, positionStride, source[t * 3 + 1]);
+            auto p2 = loadPosition(positionBytes, positionStride, source[t * 3 + 2]);
+
+            // 外積の長さは面積の 2 倍
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = sqrtf(glm::dot(n, n));
+
+            centroid = centroid + (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal = normal + n;
+            area += triangleArea;
+        }
+
+        meshCentroid = meshCentroid + centroid;
+        meshArea += area;
+
+        centroids[c] = area > 0.0f ? centroid * (1.0f / area) : centroid;
+        float length = sqrtf(glm::dot(normal, normal));
+        normals[c] = length > 0.0f ? normal * (1.0f / length) : normal;
+    }
+    if (meshArea > 0.0f)
+    {
+        meshCentroid = meshCentroid * (1.0f / meshArea);
+    }
+
+    vector<float> sortKeys(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        sortKeys[c] = glm::dot(centroids[c] - meshCentroid, normals[c]);
+    }
+
+    vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        order[c] = uint32_t(c);
+    }
+    stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    size_t output = 0;
+    for (auto c : order)
+    {
+        size_t begin = size_t(clusters[c]) * 3;
+        size_t end = size_t(clusters[c + 1]) * 3;
+        memcpy(destination + output, &source[begin], (end - begin) * sizeof(uint32_t));
+        output += end - begin;
+    }
+}
+
+/// <summary>
+/// インデックスが参照する順に頂点データを並べ直す
+/// indices はその場で書き換えられ、参照されない頂点は取り除かれる。戻り値は出力した頂点数
+/// </summary>
+size_t optimizeVertexFetch(void* destination, uint32_t* indices, size_t indexCount,
+    const void* vertices, size_t vertexCount, size_t vertexSize)
+{
+    vector<uint32_t> remap(vertexCount, InvalidIndex);
+
+    // destination と vertices が同じ場合に備えて元のデータを退避しておく
+    auto src = static_cast<const uint8_t*>(vertices);
+    vector<uint8_t> copy;
+    if (destination == vertices)
+    {
+        copy.assign(src, src + vertexCount * vertexSize);
+        src = copy.data();
+    }
+
+    auto dst = static_cast<uint8_t*>(destination);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        auto& r = remap[indices[i]];
+        if (r == InvalidIndex)
+        {
+            memcpy(dst + size_t(next) * vertexSize, src + size_t(indices[i]) * vertexSize, vertexSize);
+            r = next++;
+        }
+        indices[i] = r;
+    }
+    return next;
+}
+
+/// <summary>
+/// 内容がバイト単位で同じ頂点を 1 つにまとめ、インデックスを付け替える
+/// 残った頂点は元の順番のまま前に詰め、その数を返す（角ごとに頂点を作った OBJ などを最適化する前に使う）
+/// </summary>
+size_t weldVertices(uint32_t* indices, size_t indexCount, void* vertices, size_t vertexCount, size_t vertexSize)
+{
+    // 開番地法のハッシュ表（負荷率 0.5 以下）。値は詰めたあとの頂点番号
+    size_t tableSize = 1;
+    while (tableSize < vertexCount * 2)
+    {
+        tableSize *= 2;
+    }
+    vector<uint32_t> table(tableSize, InvalidIndex);
+    vector<uint32_t> remap(vertexCount);
+
+    auto data = static_cast<uint8_t*>(vertices);
+    uint32_t next = 0;
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        const uint8_t* vertex = data + v * vertexSize;
+        size_t slot = size_t(hashBytes(vertex, vertexSize)) & (tableSize - 1);
+        for (;;)
+        {
+            auto& entry = table[slot];
+            if (entry == InvalidIndex)
+            {
+                // 初めて見る頂点。詰めた位置は常に v 以下なので、まだ読んでいない頂点を上書きすることはない
+                if (next != v)
+                {
+                    memmove(data + size_t(next) * vertexSize, vertex, vertexSize);
+                }
+                entry = next;
+                remap[v] = next++;
+                break;
+            }
+            if (memcmp(data + size_t(entry) * vertexSize, vertex, vertexSize) == 0)
+            {
+                remap[v] = entry;
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        indices[i] = remap[indices[i]];
+    }
+    return next;
+}
+
+/// <summary>
+/// キャッシュ・オーバードロー・フェッチの最適化をまとめて行う（頂点データとインデックスはその場で書き換える）
+/// positionOffset は頂点構造体内の float3 の位置のオフセット
+/// </summary>
+MeshOptimizationReport optimizeMesh(uint32_t* indices, size_t indexCount,
+    void* vertices, size_t vertexCount, size_t vertexSize, size_t positionOffset)
+{
+    MeshOptimizationReport report{};
+    report.before = analyzeVertexCache(indices, indexCount, vertexCount);
+
+    auto positions = reinterpret_cast<const float*>(static_cast<const uint8_t*>(vertices) + positionOffset);
+    optimizeVertexCache(indices, indices, indexCount, vertexCount);
+    optimizeOverdraw(indices, indices, indexCount, positions, vertexSize, vertexCount, 1.05f);
+
+    report.vertexCount = uint32_t(optimizeVertexFetch(vertices, indices, indexCount, vertices, vertexCount, vertexSize));
+    report.after = analyzeVertexCache(indices, indexCount, report.vertexCount);
+    report.indexType = selectIndexType(report.vertexCount);
+    return report;
+}
+
+void printMeshOptimizationReport(const char* name, const MeshOptimizationReport& report)
+{
+    stringstream ss;
+    ss << "[MeshOptimizer] " << name << ": "
+       << report.after.triangleCount << " triangles, "
+       << report.before.vertexCount << " -> " << report.vertexCount << " vertices, "
+       << "ACMR " << report.before.acmr << " -> " << report.after.acmr << ", "
+       << "ATVR " << report.before.atvr << " -> " << report.after.atvr << ", "
+       << "index " << (report.indexType == VK_INDEX_TYPE_UINT16 ? "uint16" : "uint32") << endl;
+    OutputDebugStringA(ss.str().c_str());
+}
+
+/// <summary>
+/// 頂点数から使うインデックスの型を決める
+/// 0xFFFF はプリミティブリスタートの値と衝突するので 16bit で使えるのは 65535 頂点まで
+/// </summary>
+VkIndexType selectIndexType(size_t vertexCount)
+{
+    return vertexCount <= 0xFFFF ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+size_t getIndexSize(VkIndexType type)
+{
+    return type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+void writeIndices(void* destination, const uint32_t* indices, size_t indexCount, VkIndexType type)
+{
+    if (type == VK_INDEX_TYPE_UINT16)
+    {
+        auto dst = static_cast<uint16_t*>(destination);
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            dst[i] = uint16_t(indices[i]);
+        }
+    }
+    else
+    {
+        memcpy(destination, indices, indexCount * sizeof(uint32_t));
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "vkappbase.h"
+
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// 読み込み時（またはオフライン）に行うメッシュの最適化
+/// </summary>
+/// <remarks>
+/// optimizeMesh は次の順で処理する。
+///   1. 頂点キャッシュ最適化（Forsyth のアルゴリズムで三角形を並べ替える）
+///   2. オーバードロー最適化（キャッシュ効率を threshold 倍まで悪化させてよい範囲でクラスタに分け、
+///      外側を向いたクラスタが先に描かれるよう並べ替える）
+///   3. 頂点フェッチ最適化（インデックスが初めて参照する順に頂点を並べ直し、未使用の頂点を取り除く）
+/// インデックスは常に uint32_t で処理し、GPU へ書き込む際に selectIndexType / writeIndices で
+/// 頂点数が収まる場合は 16bit に詰める。
+/// 位置は float3 である必要があるので、量子化（vertexpacking.h）より前に行うこと。
+/// </remarks>
+
+/// <summary>
+/// 頂点キャッシュの効率
+/// ACMR = 1 三角形あたりの頂点シェーダ実行数（0.5 に近いほど良い、最悪 3.0）
+/// ATVR = 頂点数に対する頂点シェーダ実行数の比（1.0 が理想）
+/// </summary>
+struct VertexCacheStatistics
+{
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    uint32_t vertexTransforms;
+    float acmr;
+    float atvr;
+};
+
+/// <summary>
+/// optimizeMesh の結果
+/// </summary>
+struct MeshOptimizationReport
+{
+    VertexCacheStatistics before;
+    VertexCacheStatistics after;
+
+    // 参照されない頂点を除いたあとの頂点数
+    uint32_t vertexCount;
+    VkIndexType indexType;
+};
+
+// 統計に使う FIFO キャッシュのサイズ（一般的な GPU の後段頂点キャッシュ相当）
+const uint32_t DefaultVertexCacheSize = 16;
+
+VertexCacheStatistics analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+    uint32_t cacheSize = DefaultVertexCacheSize);
+
+void optimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+void optimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+    const float* positions, size_t positionStride, size_t vertexCount, float threshold);
+
+size_t weldVertices(uint32_t* indices, size_t indexCount, void* vertices, size_t vertexCount, size_t vertexSize);
+
+size_t optimizeVertexFetch(void* destination, uint32_t* indices, size_t indexCount,
+    const void* vertices, size_t vertexCount, size_t vertexSize);
+
+MeshOptimizationReport optimizeMesh(uint32_t* indices, size_t indexCount,
+    void* vertices, size_t vertexCount, size_t vertexSize, size_t positionOffset);
+
+void printMeshOptimizationReport(const char* name, const MeshOptimizationReport& report);
+
+VkIndexType selectIndexType(size_t vertexCount);
+size_t getIndexSize(VkIndexType type);
+void writeIndices(void* destination, const uint32_t* indices, size_t indexCount, VkIndexType type);
@@ -0,0 +1,24 @@
+#include "parallel.h"
+#include "jobsystem.h"
+
+using namespace std;
+
+unsigned getWorkerCount()
+{
+    return JobSystem::getDefault().getThreadCount();
+}
+
+/// <summary>
+/// 要素ごとの処理時間が大きく異なってもよいように、1 要素ずつまで分けられるようにする
+/// （分けるのは他のスレッドが空いている場合だけなので、軽い要素が多くても 1 つずつのジョブにはならない）
+/// </summary>
+void parallelFor(size_t count, const function<void(size_t)>& func)
+{
+    JobSystem::getDefault().parallelFor(count, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            func(i);
+        }
+    });
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <functional>
+#include <cstddef>
+
+/// <summary>
+/// 処理を CPU のコア数に合わせて並列に実行するための簡単な仕組み
+/// </summary>
+/// <remarks>
+/// 共有のジョブシステム（jobsystem.h の JobSystem::getDefault）のワーカーで実行する。
+/// ジョブの中から呼んでもよい（待つ間はそのスレッドも他のジョブを実行する）。
+/// </remarks>
+
+// 並列処理に使うスレッド数（呼び出したスレッドを含む）
+unsigned getWorkerCount();
+
+// func(i) を i = 0 .. count-1 について並列に呼ぶ。全て終わるまで戻らない
+void parallelFor(size_t count, const std::function<void(size_t)>& func);
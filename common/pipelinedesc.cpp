@@ -0,0 +1,64 @@
+#include "pipelinedesc.h"
+#include "hash.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/// <summary>
+/// 特殊化定数をハッシュ値に畳み込む
+/// 定数 ID・サイズ・値が同じなら設定した順番によらず同じハッシュになるよう、ID 順にたどる
+/// </summary>
+uint64_t SpecializationConstants::hash(uint64_t seed) const
+{
+    uint64_t hash = hashValue(uint32_t(m_entries.size()), seed);
+
+    vector<const VkSpecializationMapEntry*> sorted;
+    sorted.reserve(m_entries.size());
+    for (const auto& e : m_entries)
+    {
+        sorted.push_back(&e);
+    }
+    sort(sorted.begin(), sorted.end(), [](const VkSpecializationMapEntry* a, const VkSpecializationMapEntry* b)
+    {
+        return a->constantID < b->constantID;
+    });
+
+    for (auto e : sorted)
+    {
+        hash = hashValue(e->constantID, hash);
+        hash = hashValue(uint32_t(e->size), hash);
+        hash = hashBytes(&m_data[e->offset], e->size, hash);
+    }
+    return hash;
+}
+
+/// <summary>
+/// パイプライン記述のハッシュ値を計算する
+/// シェーダのバリアントと特殊化定数もここに含まれるので、定数だけが違うパイプラインも区別される
+/// </summary>
+uint64_t GraphicsPipelineDesc::hash() const
+{
+    uint64_t hash = HashSeed;
+
+    hash = hashValue(uint32_t(stages.size()), hash);
+    for (const auto& s : stages)
+    {
+        hash = hashValue(s.stage, hash);
+        hash = hashValue(s.shaderId, hash);
+        hash = hashValue(s.defineMask, hash);
+        hash = s.constants.hash(hash);
+    }
+
+    hash = hashValue(uint32_t(vertexBindings.size()), hash);
+    hash = hashBytes(vertexBindings.data(), vertexBindings.size() * sizeof(VkVertexInputBindingDescription), hash);
+    hash = hashValue(uint32_t(vertexAttributes.size()), hash);
+    hash = hashBytes(vertexAttributes.data(), vertexAttributes.size() * sizeof(VkVertexInputAttributeDescription), hash);
+
+    hash = hashValue(topology, hash);
+    hash = hashValue(cullMode, hash);
+    hash = hashValue(depthTestEnable, hash);
+    hash = hashValue(depthWriteEnable, hash);
+    hash = hashValue(blendEnable, hash);
+    return hash;
+}
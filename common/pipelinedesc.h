@@ -0,0 +1,169 @@
+#pragma once
+#include "vkappbase.h"
+#include "vertexlayout.h"
+
+#include <vector>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+
+/// <summary>
+/// シェーダステージに渡す特殊化定数（specialization constant）の集合
+/// </summary>
+/// <remarks>
+/// GLSL 側の layout(constant_id = N) に対応する値を型付きで保持する。
+/// getInfo() が返す VkSpecializationInfo はこのオブジェクト内部のメモリを指すので、
+/// パイプライン生成が終わるまでこのオブジェクトを生かしておくこと。
+/// </remarks>
+class SpecializationConstants
+{
+public:
+    SpecializationConstants() : m_info{} {}
+    SpecializationConstants(const SpecializationConstants& other) : m_entries(other.m_entries), m_data(other.m_data), m_info{} {}
+    SpecializationConstants& operator=(const SpecializationConstants& other)
+    {
+        m_entries = other.m_entries;
+        m_data = other.m_data;
+        m_info = VkSpecializationInfo{};
+        return *this;
+    }
+
+    // bool はシェーダ側では 32bit の VkBool32 として扱われる
+    void set(uint32_t constantId, bool value)
+    {
+        setRaw(constantId, VkBool32(value ? VK_TRUE : VK_FALSE));
+    }
+
+    template<class T>
+    void set(uint32_t constantId, T value)
+    {
+        static_assert(std::is_arithmetic<T>::value, "specialization constant must be a scalar");
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8, "specialization constant must be 32bit or 64bit");
+        setRaw(constantId, value);
+    }
+
+    bool empty() const { return m_entries.empty(); }
+
+    const VkSpecializationInfo* getInfo()
+    {
+        if (m_entries.empty())
+        {
+            return nullptr;
+        }
+
+        m_info.mapEntryCount = uint32_t(m_entries.size());
+        m_info.pMapEntries = m_entries.data();
+        m_info.dataSize = m_data.size();
+        m_info.pData = m_data.data();
+        return &m_info;
+    }
+
+    uint64_t hash(uint64_t seed) const;
+
+private:
+    template<class T>
+    void setRaw(uint32_t constantId, T value)
+    {
+        // 既に同じ ID があれば上書きする（pMapEntries の constantID は重複してはいけない）
+        for (auto& e : m_entries)
+        {
+            if (e.constantID != constantId)
+            {
+                continue;
+            }
+
+            if (e.size != sizeof(T))
+            {
+                // 型の大きさが変わる場合は古い値を取り除き、データを詰め直して末尾に置く
+                const auto oldOffset = e.offset;
+                const auto oldSize = uint32_t(e.size);
+                m_data.erase(m_data.begin() + oldOffset, m_data.begin() + oldOffset + oldSize);
+                for (auto& other : m_entries)
+                {
+                    if (other.offset > oldOffset)
+                    {
+                        other.offset -= oldSize;
+                    }
+                }
+                e.offset = uint32_t(m_data.size());
+                e.size = sizeof(T);
+                m_data.resize(m_data.size() + sizeof(T));
+            }
+            memcpy(&m_data[e.offset], &value, sizeof(T));
+            return;
+        }
+
+        VkSpecializationMapEntry entry{};
+        entry.constantID = constantId;
+        entry.offset = uint32_t(m_data.size());
+        entry.size = sizeof(T);
+        m_entries.push_back(entry);
+
+        m_data.resize(m_data.size() + sizeof(T));
+        memcpy(&m_data[entry.offset], &value, sizeof(T));
+    }
+
+    std::vector<VkSpecializationMapEntry> m_entries;
+    std::vector<uint8_t> m_data;
+    VkSpecializationInfo m_info;
+};
+
+/// <summary>
+/// パイプラインの 1 シェーダステージの記述
+/// </summary>
+struct ShaderStageDesc
+{
+    VkShaderStageFlagBits stage;
+
+    // ShaderPermutationCache に登録したシェーダ ID とパーミュテーションのマスク
+    uint32_t shaderId;
+    uint32_t defineMask;
+
+    SpecializationConstants constants;
+};
+
+/// <summary>
+/// グラフィックスパイプラインの記述
+/// hash() が同じ値になる記述からは同じパイプラインが作られる
+/// </summary>
+struct GraphicsPipelineDesc
+{
+    GraphicsPipelineDesc()
+        : topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+        , cullMode(VK_CULL_MODE_NONE)
+        , depthTestEnable(VK_TRUE)
+        , depthWriteEnable(VK_TRUE)
+        , blendEnable(VK_TRUE)
+    {
+    }
+
+    std::vector<ShaderStageDesc> stages;
+
+    // 頂点入力（addVertexBinding で頂点構造体から設定する）
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+    VkPrimitiveTopology topology;
+    VkCullModeFlags cullMode;
+    VkBool32 depthTestEnable;
+    VkBool32 depthWriteEnable;
+    VkBool32 blendEnable;
+
+    /// <summary>
+    /// DECLARE_VERTEX_LAYOUT で記述した頂点構造体をバインディングとして追加する
+    /// </summary>
+    template<class V>
+    void addVertexBinding(uint32_t binding)
+    {
+        constexpr auto attributes = makeVertexAttributeDescriptions<V>(0);
+
+        vertexBindings.push_back(makeVertexBindingDescription<V>(binding));
+        for (auto a : attributes)
+        {
+            a.binding = binding;
+            vertexAttributes.push_back(a);
+        }
+    }
+
+    uint64_t hash() const;
+};
@@ -0,0 +1,326 @@
+#include "scenegraph_impl.h"
+#include "cpufeatures.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace scenegraph;
+
+namespace
+{
+    // 1 つのワーカーが一度に更新するノードの数（SIMD の幅の倍数にしておく）
+    const size_t UpdateChunkSize = 8192;
+
+    bool useAvx2()
+    {
+        const auto& features = getCpuFeatures();
+        return features.avx2 && features.fma;
+    }
+
+    void updateChunk(const TransformView& view, size_t first, size_t count, bool root)
+    {
+#if defined(SCENEGRAPH_X86)
+        if (useAvx2())
+        {
+            updateRangeAvx2(view, first, count, root);
+        }
+        else
+        {
+            updateRange<PairOps<Sse2Ops>>(view, first, count, root);
+        }
+#elif defined(SCENEGRAPH_NEON)
+        updateRange<PairOps<NeonOps>>(view, first, count, root);
+#else
+        updateRange<ScalarOps>(view, first, count, root);
+#endif
+    }
+
+    template<class T>
+    void permute(vector<T>& values, const vector<uint32_t>& order, vector<T>& scratch)
+    {
+        scratch.resize(values.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            scratch[i] = values[order[i]];
+        }
+        values.swap(scratch);
+    }
+}
+
+SceneGraph::SceneGraph()
+    : m_layoutDirty(false)
+{
+    m_levelStart.push_back(0);
+}
+
+void SceneGraph::clear()
+{
+    m_translationX.clear();
+    m_translationY.clear();
+    m_translationZ.clear();
+    m_rotationX.clear();
+    m_rotationY.clear();
+    m_rotationZ.clear();
+    m_rotationW.clear();
+    m_scaleX.clear();
+    m_scaleY.clear();
+    m_scaleZ.clear();
+    for (auto& v : m_world)
+    {
+        v.clear();
+    }
+    m_parent.clear();
+    m_depth.clear();
+    m_dirty.clear();
+    m_changed.clear();
+    m_levelStart.assign(1, 0);
+    m_indexOf.clear();
+    m_nodeOf.clear();
+    m_parentIds.clear();
+    m_layoutDirty = false;
+}
+
+void SceneGraph::reserve(size_t count)
+{
+    m_translationX.reserve(count);
+    m_translationY.reserve(count);
+    m_translationZ.reserve(count);
+    m_rotationX.reserve(count);
+    m_rotationY.reserve(count);
+    m_rotationZ.reserve(count);
+    m_rotationW.reserve(count);
+    m_scaleX.reserve(count);
+    m_scaleY.reserve(count);
+    m_scaleZ.reserve(count);
+    for (auto& v : m_world)
+    {
+        v.reserve(count);
+    }
+    m_parent.reserve(count);
+    m_depth.reserve(count);
+    m_dirty.reserve(count);
+    m_changed.reserve(count);
+    m_indexOf.reserve(count);
+    m_nodeOf.reserve(count);
+    m_parentIds.reserve(count);
+}
+
+/// <summary>
+/// ノードを末尾に追加する
+/// 深さが末尾のノード以上なら並びはそのまま保たれ、浅ければ次の update で並べ直す
+/// </summary>
+SceneNodeId SceneGraph::addNode(SceneNodeId parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+    const SceneNodeId node = SceneNodeId(m_nodeOf.size());
+    const uint32_t index = uint32_t(m_parent.size());
+    const uint32_t parentIndex = parent != InvalidSceneNode ? m_indexOf[parent] : 0;
+    const uint32_t depth = parent != InvalidSceneNode ? m_depth[parentIndex] + 1 : 0;
+
+    m_translationX.push_back(translation.x);
+    m_translationY.push_back(translation.y);
+    m_translationZ.push_back(translation.z);
+    m_rotationX.push_back(rotation.x);
+    m_rotationY.push_back(rotation.y);
+    m_rotationZ.push_back(rotation.z);
+    m_rotationW.push_back(rotation.w);
+    m_scaleX.push_back(scale.x);
+    m_scaleY.push_back(scale.y);
+    m_scaleZ.push_back(scale.z);
+    for (int i = 0; i < 12; ++i)
+    {
+        // 最初の update までは単位行列にしておく
+        m_world[i].push_back((i % 5) == 0 ? 1.0f : 0.0f);
+    }
+    m_parent.push_back(parentIndex);
+    m_dirty.push_back(1);
+    m_changed.push_back(0);
+    m_indexOf.push_back(index);
+    m_nodeOf.push_back(node);
+    m_parentIds.push_back(parent);
+
+    if (index > 0 && depth < m_depth.back())
+    {
+        m_layoutDirty = true;
+    }
+    else if (depth + 1 >= m_levelStart.size())
+    {
+        m_levelStart.push_back(index + 1);
+    }
+    else
+    {
+        m_levelStart.back() = index + 1;
+    }
+    m_depth.push_back(depth);
+    return node;
+}
+
+void SceneGraph::setLocalTranslation(SceneNodeId node, const glm::vec3& translation)
+{
+    const uint32_t index = m_indexOf[node];
+    m_translationX[index] = translation.x;
+    m_translationY[index] = translation.y;
+    m_translationZ[index] = translation.z;
+    m_dirty[index] = 1;
+}
+
+void SceneGraph::setLocalRotation(SceneNodeId node, const glm::quat& rotation)
+{
+    const uint32_t index = m_indexOf[node];
+    m_rotationX[index] = rotation.x;
+    m_rotationY[index] = rotation.y;
+    m_rotationZ[index] = rotation.z;
+    m_rotationW[index] = rotation.w;
+    m_dirty[index] = 1;
+}
+
+void SceneGraph::setLocalScale(SceneNodeId node, const glm::vec3& scale)
+{
+    const uint32_t index = m_indexOf[node];
+    m_scaleX[index] = scale.x;
+    m_scaleY[index] = scale.y;
+    m_scaleZ[index] = scale.z;
+    m_dirty[index] = 1;
+}
+
+void SceneGraph::setLocalTransform(SceneNodeId node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+    setLocalTranslation(node, translation);
+    setLocalRotation(node, rotation);
+    setLocalScale(node, scale);
+}
+
+/// <summary>
+/// 段ごとにワールド行列を求める
+/// 親の段を全て書き終えてから次の段に進むので、同じ段の中はどの順に計算してもよい
+/// </summary>
+void SceneGraph::update()
+{
+    if (m_layoutDirty)
+    {
+        rebuildLayout();
+    }
+
+    TransformView view = {
+        m_translationX.data(), m_translationY.data(), m_translationZ.data(),
+        m_rotationX.data(), m_rotationY.data(), m_rotationZ.data(), m_rotationW.data(),
+        m_scaleX.data(), m_scaleY.data(), m_scaleZ.data(),
+        m_parent.data(), m_dirty.data(), m_changed.data(), {},
+    };
+    for (int i = 0; i < 12; ++i)
+    {
+        view.world[i] = m_world[i].data();
+    }
+
+    for (uint32_t level = 0; level < getLevelCount(); ++level)
+    {
+        const size_t first = m_levelStart[level];
+        const size_t count = m_levelStart[level + 1] - first;
+        const bool root = level == 0;
+        const size_t chunkCount = (count + UpdateChunkSize - 1) / UpdateChunkSize;
+        if (chunkCount <= 1)
+        {
+            updateChunk(view, first, count, root);
+            continue;
+        }
+
+        parallelFor(chunkCount, [&](size_t chunk) {
+            const size_t offset = chunk * UpdateChunkSize;
+            updateChunk(view, first + offset, min(UpdateChunkSize, count - offset), root);
+        });
+    }
+
+    if (!m_dirty.empty())
+    {
+        memset(m_dirty.data(), 0, m_dirty.size());
+    }
+}
+
+glm::mat4 SceneGraph::getWorldMatrix(SceneNodeId node) const
+{
+    const uint32_t index = m_indexOf[node];
+    glm::mat4 m(1.0f);
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            m[column][row] = m_world[row * 4 + column][index];
+        }
+    }
+    return m;
+}
+
+void SceneGraph::getWorldRows(SceneNodeId node, glm::vec4& row0, glm::vec4& row1, glm::vec4& row2) const
+{
+    const uint32_t index = m_indexOf[node];
+    row0 = glm::vec4(m_world[0][index], m_world[1][index], m_world[2][index], m_world[3][index]);
+    row1 = glm::vec4(m_world[4][index], m_world[5][index], m_world[6][index], m_world[7][index]);
+    row2 = glm::vec4(m_world[8][index], m_world[9][index], m_world[10][index], m_world[11][index]);
+}
+
+/// <summary>
+/// ノードを深さの順に並べ直す（同じ深さの中は今の順のまま）
+/// </summary>
+void SceneGraph::rebuildLayout()
+{
+    const uint32_t count = uint32_t(m_parent.size());
+    uint32_t levelCount = 0;
+    for (auto depth : m_depth)
+    {
+        levelCount = max(levelCount, depth + 1);
+    }
+
+    // 深さごとの数を数えて段の先頭を決める
+    m_levelStart.assign(levelCount + 1, 0);
+    for (auto depth : m_depth)
+    {
+        m_levelStart[depth + 1]++;
+    }
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        m_levelStart[level + 1] += m_levelStart[level];
+    }
+
+    // order[新しい番号] = 今の番号
+    vector<uint32_t> order(count);
+    vector<uint32_t> cursor(m_levelStart.begin(), m_levelStart.end() - 1);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        order[cursor[m_depth[i]]++] = i;
+    }
+
+    vector<float> scratch;
+    permute(m_translationX, order, scratch);
+    permute(m_translationY, order, scratch);
+    permute(m_translationZ, order, scratch);
+    permute(m_rotationX, order, scratch);
+    permute(m_rotationY, order, scratch);
+    permute(m_rotationZ, order, scratch);
+    permute(m_rotationW, order, scratch);
+    permute(m_scaleX, order, scratch);
+    permute(m_scaleY, order, scratch);
+    permute(m_scaleZ, order, scratch);
+    for (auto& v : m_world)
+    {
+        permute(v, order, scratch);
+    }
+
+    vector<uint32_t> scratchIndices;
+    permute(m_depth, order, scratchIndices);
+    permute(m_nodeOf, order, scratchIndices);
+    vector<uint8_t> scratchFlags;
+    permute(m_dirty, order, scratchFlags);
+    permute(m_changed, order, scratchFlags);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        m_indexOf[m_nodeOf[i]] = i;
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const SceneNodeId parent = m_parentIds[m_nodeOf[i]];
+        m_parent[i] = parent != InvalidSceneNode ? m_indexOf[parent] : 0;
+    }
+    m_layoutDirty = false;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// ノードの階層とその変換を、成分ごとの配列（SoA）で持つシーングラフ
+/// </summary>
+/// <remarks>
+/// ローカルの変換（平行移動・回転・拡大縮小）とワールド行列は成分ごとの配列に入れ、ノードは階層の深さの順に並べる。
+/// 親は必ず前の段にあるので、update は段ごとにワールド行列を求め、同じ段の中はワーカースレッドで分けて SIMD で計算する
+/// （ワールド行列はアフィン変換なので、上 3 行の 12 成分だけを持つ）。
+/// ローカルの変換を変えたノードとその子孫だけを計算し直し、変わらない部分木は SIMD の幅の単位で飛ばす。
+/// ノードは SceneNodeId で指す。深さの順に並べ直しても番号は変わらない（親を先に追加すること）。
+/// </remarks>
+
+typedef uint32_t SceneNodeId;
+const SceneNodeId InvalidSceneNode = ~0u;
+
+class SceneGraph
+{
+public:
+    SceneGraph();
+
+    void clear();
+    void reserve(size_t count);
+
+    // parent が InvalidSceneNode なら根のノードになる
+    SceneNodeId addNode(SceneNodeId parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale);
+
+    void setLocalTranslation(SceneNodeId node, const glm::vec3& translation);
+    void setLocalRotation(SceneNodeId node, const glm::quat& rotation);
+    void setLocalScale(SceneNodeId node, const glm::vec3& scale);
+    void setLocalTransform(SceneNodeId node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale);
+
+    // ローカルの変換を変えたノードとその子孫のワールド行列を求める
+    void update();
+
+    glm::mat4 getWorldMatrix(SceneNodeId node) const;
+
+    // ワールド行列の上 3 行（InstanceData の row0 .. row2 と同じ並び）
+    void getWorldRows(SceneNodeId node, glm::vec4& row0, glm::vec4& row1, glm::vec4& row2) const;
+
+    // 直前の update でワールド行列が変わったか
+    bool isWorldChanged(SceneNodeId node) const { return m_changed[m_indexOf[node]] != 0; }
+
+    SceneNodeId getParent(SceneNodeId node) const { return m_parentIds[node]; }
+    size_t size() const { return m_parent.size(); }
+    uint32_t getLevelCount() const { return uint32_t(m_levelStart.size()) - 1; }
+
+private:
+    void rebuildLayout();
+
+    // ---- 深さの順に並べた成分ごとの配列 ----
+    std::vector<float> m_translationX;
+    std::vector<float> m_translationY;
+    std::vector<float> m_translationZ;
+    std::vector<float> m_rotationX;
+    std::vector<float> m_rotationY;
+    std::vector<float> m_rotationZ;
+    std::vector<float> m_rotationW;
+    std::vector<float> m_scaleX;
+    std::vector<float> m_scaleY;
+    std::vector<float> m_scaleZ;
+
+    // ワールド行列の (行 * 4 + 列) 番目の成分
+    std::vector<float> m_world[12];
+
+    // 親の並びの番号（根は 0 段目にあり、使わない）
+    std::vector<uint32_t> m_parent;
+    std::vector<uint32_t> m_depth;
+    std::vector<uint8_t> m_dirty;
+    std::vector<uint8_t> m_changed;
+
+    // 段ごとの先頭の番号（最後は全体の数）
+    std::vector<uint32_t> m_levelStart;
+
+    // SceneNodeId <-> 並びの番号
+    std::vector<uint32_t> m_indexOf;
+    std::vector<SceneNodeId> m_nodeOf;
+    std::vector<SceneNodeId> m_parentIds;
+
+    // 浅いノードを深いノードの後に追加した場合は、次の update で並べ直す
+    bool m_layoutDirty;
+};
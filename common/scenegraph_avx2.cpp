@@ -0,0 +1,20 @@
+// AVX2 / FMA を使うシーングラフの更新のカーネル
+// このファイルだけ AVX2 を有効にしてコンパイルする（vcxproj のファイル単位の設定）。
+// 呼び出しは scenegraph.cpp で CPU の対応を確認してから行われる。
+#if !defined(_MSC_VER) && (defined(__x86_64__) || defined(__i386__))
+#pragma GCC target("avx2,fma")
+#endif
+#define SCENEGRAPH_AVX2
+#include "scenegraph_impl.h"
+
+#ifdef SCENEGRAPH_X86
+
+namespace scenegraph
+{
+    void updateRangeAvx2(const TransformView& view, size_t first, size_t count, bool root)
+    {
+        updateRange<Avx2Ops>(view, first, count, root);
+    }
+}
+
+#endif
@@ -0,0 +1,259 @@
+#pragma once
+// scenegraph.cpp / scenegraph_avx2.cpp の内部実装（他から include しないこと）
+//
+// カーネルは SIMD 命令セットごとの Ops 構造体をテンプレート引数に取り、1 回のループで Ops::Width 個のノードのワールド行列を求める。
+// ローカルの変換から行列を作るのも親の行列を掛けるのもレーンごとに独立なので、成分ごとの配列のまま計算する。
+// 親の行列はノードごとに違う位置にあるので、成分ごとにギャザーで集める。
+
+#include "scenegraph.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SCENEGRAPH_X86
+#include <immintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define SCENEGRAPH_NEON
+#include <arm_neon.h>
+#endif
+
+namespace scenegraph
+{
+    // 深さの順に並べた変換の配列
+    struct TransformView
+    {
+        const float* translationX;
+        const float* translationY;
+        const float* translationZ;
+        const float* rotationX;
+        const float* rotationY;
+        const float* rotationZ;
+        const float* rotationW;
+        const float* scaleX;
+        const float* scaleY;
+        const float* scaleZ;
+        const uint32_t* parent;
+        const uint8_t* dirty;
+        uint8_t* changed;
+        float* world[12];
+    };
+
+    void updateRangeAvx2(const TransformView& view, size_t first, size_t count, bool root);
+
+// Ops とカーネルはコンパイルオプションの違う 2 つの翻訳単位から使われるので、内部リンケージにしておく
+namespace
+{
+    // ---- スカラー（端数の処理と、SIMD が使えない環境用） ----
+    struct ScalarOps
+    {
+        typedef float F;
+        static const size_t Width = 1;
+
+        static F load(const float* p) { return *p; }
+        static void store(float* p, F v) { *p = v; }
+        static F gather(const float* base, const uint32_t* indices) { return base[indices[0]]; }
+        static F set1(float v) { return v; }
+        static F add(F a, F b) { return a + b; }
+        static F sub(F a, F b) { return a - b; }
+        static F mul(F a, F b) { return a * b; }
+        static F madd(F a, F b, F c) { return a * b + c; }
+    };
+
+    // ---- 4 レーンの命令を 2 本ずつ使って 8 個にする ----
+    template<class O>
+    struct PairOps
+    {
+        struct F
+        {
+            typename O::F lo;
+            typename O::F hi;
+        };
+        static const size_t Width = O::Width * 2;
+
+        static F load(const float* p) { return { O::load(p), O::load(p + O::Width) }; }
+        static void store(float* p, F v) { O::store(p, v.lo); O::store(p + O::Width, v.hi); }
+        static F gather(const float* base, const uint32_t* indices) { return { O::gather(base, indices), O::gather(base, indices + O::Width) }; }
+        static F set1(float v) { return { O::set1(v), O::set1(v) }; }
+        static F add(F a, F b) { return { O::add(a.lo, b.lo), O::add(a.hi, b.hi) }; }
+        static F sub(F a, F b) { return { O::sub(a.lo, b.lo), O::sub(a.hi, b.hi) }; }
+        static F mul(F a, F b) { return { O::mul(a.lo, b.lo), O::mul(a.hi, b.hi) }; }
+        static F madd(F a, F b, F c) { return { O::madd(a.lo, b.lo, c.lo), O::madd(a.hi, b.hi, c.hi) }; }
+    };
+
+#if defined(SCENEGRAPH_X86)
+    // ---- SSE2（x64 では常に使える） ----
+    struct Sse2Ops
+    {
+        typedef __m128 F;
+        static const size_t Width = 4;
+
+        static F load(const float* p) { return _mm_loadu_ps(p); }
+        static void store(float* p, F v) { _mm_storeu_ps(p, v); }
+        static F gather(const float* base, const uint32_t* indices)
+        {
+            return _mm_setr_ps(base[indices[0]], base[indices[1]], base[indices[2]], base[indices[3]]);
+        }
+        static F set1(float v) { return _mm_set1_ps(v); }
+        static F add(F a, F b) { return _mm_add_ps(a, b); }
+        static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+        static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+        static F madd(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    };
+
+#if defined(SCENEGRAPH_AVX2)
+    // ---- AVX2 / FMA（scenegraph_avx2.cpp でのみ使う） ----
+    struct Avx2Ops
+    {
+        typedef __m256 F;
+        static const size_t Width = 8;
+
+        static F load(const float* p) { return _mm256_loadu_ps(p); }
+        static void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+        static F gather(const float* base, const uint32_t* indices)
+        {
+            return _mm256_i32gather_ps(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices)), 4);
+        }
+        static F set1(float v) { return _mm256_set1_ps(v); }
+        static F add(F a, F b) { return _mm256_add_ps(a, b); }
+        static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+        static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+        static F madd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+    };
+#endif
+#elif defined(SCENEGRAPH_NEON)
+    // ---- NEON ----
+    struct NeonOps
+    {
+        typedef float32x4_t F;
+        static const size_t Width = 4;
+
+        static F load(const float* p) { return vld1q_f32(p); }
+        static void store(float* p, F v) { vst1q_f32(p, v); }
+        static F gather(const float* base, const uint32_t* indices)
+        {
+            const float values[4] = { base[indices[0]], base[indices[1]], base[indices[2]], base[indices[3]] };
+            return vld1q_f32(values);
+        }
+        static F set1(float v) { return vdupq_n_f32(v); }
+        static F add(F a, F b) { return vaddq_f32(a, b); }
+        static F sub(F a, F b) { return vsubq_f32(a, b); }
+        static F mul(F a, F b) { return vmulq_f32(a, b); }
+        static F madd(F a, F b, F c) { return vfmaq_f32(c, a, b); }
+    };
+#endif
+
+    /// <summary>
+    /// first から Ops::Width 個のノードのワールド行列を求める
+    /// ローカル行列は T * R * S（R は単位四元数から作る）で、根でなければ左から親のワールド行列を掛ける
+    /// </summary>
+    template<class Ops>
+    void composeBlock(const TransformView& view, size_t first, bool root)
+    {
+        typedef typename Ops::F F;
+
+        const F x = Ops::load(view.rotationX + first);
+        const F y = Ops::load(view.rotationY + first);
+        const F z = Ops::load(view.rotationZ + first);
+        const F w = Ops::load(view.rotationW + first);
+        const F x2 = Ops::add(x, x);
+        const F y2 = Ops::add(y, y);
+        const F z2 = Ops::add(z, z);
+        const F xx = Ops::mul(x, x2);
+        const F yy = Ops::mul(y, y2);
+        const F zz = Ops::mul(z, z2);
+        const F xy = Ops::mul(x, y2);
+        const F xz = Ops::mul(x, z2);
+        const F yz = Ops::mul(y, z2);
+        const F wx = Ops::mul(w, x2);
+        const F wy = Ops::mul(w, y2);
+        const F wz = Ops::mul(w, z2);
+        const F one = Ops::set1(1.0f);
+
+        const F sx = Ops::load(view.scaleX + first);
+        const F sy = Ops::load(view.scaleY + first);
+        const F sz = Ops::load(view.scaleZ + first);
+
+        // ローカル行列（回転の各列に拡大率を掛け、4 列目は平行移動）
+        F local[12];
+        local[0] = Ops::mul(Ops::sub(one, Ops::add(yy, zz)), sx);
+        local[1] = Ops::mul(Ops::sub(xy, wz), sy);
+        local[2] = Ops::mul(Ops::add(xz, wy), sz);
+        local[3] = Ops::load(view.translationX + first);
+        local[4] = Ops::mul(Ops::add(xy, wz), sx);
+        local[5] = Ops::mul(Ops::sub(one, Ops::add(xx, zz)), sy);
+        local[6] = Ops::mul(Ops::sub(yz, wx), sz);
+        local[7] = Ops::load(view.translationY + first);
+        local[8] = Ops::mul(Ops::sub(xz, wy), sx);
+        local[9] = Ops::mul(Ops::add(yz, wx), sy);
+        local[10] = Ops::mul(Ops::sub(one, Ops::add(xx, yy)), sz);
+        local[11] = Ops::load(view.translationZ + first);
+
+        if (root)
+        {
+            for (int i = 0; i < 12; ++i)
+            {
+                Ops::store(view.world[i] + first, local[i]);
+            }
+            return;
+        }
+
+        // 親のワールド行列を 1 行ずつ集めて掛ける（アフィン変換なので 4 行目は (0, 0, 0, 1)）
+        const uint32_t* parent = view.parent + first;
+        for (int row = 0; row < 3; ++row)
+        {
+            const F p0 = Ops::gather(view.world[row * 4 + 0], parent);
+            const F p1 = Ops::gather(view.world[row * 4 + 1], parent);
+            const F p2 = Ops::gather(view.world[row * 4 + 2], parent);
+            const F p3 = Ops::gather(view.world[row * 4 + 3], parent);
+            for (int column = 0; column < 4; ++column)
+            {
+                F v = Ops::mul(p2, local[8 + column]);
+                if (column == 3)
+                {
+                    v = Ops::add(v, p3);
+                }
+                v = Ops::madd(p1, local[4 + column], v);
+                v = Ops::madd(p0, local[column], v);
+                Ops::store(view.world[row * 4 + column] + first, v);
+            }
+        }
+    }
+
+    /// <summary>
+    /// 同じ段の [first, first + count) のノードを更新する
+    /// 自身か親が変わったノードを changed に記録し、Ops::Width 個の中に 1 つも無ければ計算を飛ばす
+    /// </summary>
+    template<class Ops>
+    void updateRange(const TransformView& view, size_t first, size_t count, bool root)
+    {
+        const size_t end = first + count;
+        size_t i = first;
+        for (; i + Ops::Width <= end; i += Ops::Width)
+        {
+            uint8_t any = 0;
+            for (size_t lane = 0; lane < Ops::Width; ++lane)
+            {
+                const size_t node = i + lane;
+                const uint8_t changed = root ? view.dirty[node] : uint8_t(view.dirty[node] | view.changed[view.parent[node]]);
+                view.changed[node] = changed;
+                any |= changed;
+            }
+            if (any != 0)
+            {
+                composeBlock<Ops>(view, i, root);
+            }
+        }
+
+        for (; i < end; ++i)
+        {
+            const uint8_t changed = root ? view.dirty[i] : uint8_t(view.dirty[i] | view.changed[view.parent[i]]);
+            view.changed[i] = changed;
+            if (changed != 0)
+            {
+                composeBlock<ScalarOps>(view, i, root);
+            }
+        }
+    }
+}
+}
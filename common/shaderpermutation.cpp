@@ -0,0 +1,551 @@
+#include "shaderpermutation.h"
+#include "hash.h"
+
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/SPIRV/GlslangToSpv.h>
+#include <spirv-tools/optimizer.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#ifdef _DEBUG
+#pragma comment(lib, "glslangd.lib")
+#pragma comment(lib, "glslang-default-resource-limitsd.lib")
+#pragma comment(lib, "SPIRVd.lib")
+#pragma comment(lib, "SPIRV-Toolsd.lib")
+#pragma comment(lib, "SPIRV-Tools-optd.lib")
+#else
+#pragma comment(lib, "glslang.lib")
+#pragma comment(lib, "glslang-default-resource-limits.lib")
+#pragma comment(lib, "SPIRV.lib")
+#pragma comment(lib, "SPIRV-Tools.lib")
+#pragma comment(lib, "SPIRV-Tools-opt.lib")
+#endif
+
+using namespace std;
+
+namespace
+{
+    // コンパイルオプションやパスの構成を変えたときはこの値を変えて、古いキャッシュを無効化する
+    const uint64_t CacheVersion = 1;
+
+    const char* ManifestFileName = "shadercache.manifest";
+
+    EShLanguage toGlslangStage(VkShaderStageFlagBits stage)
+    {
+        switch (stage)
+        {
+        case VK_SHADER_STAGE_VERTEX_BIT: return EShLangVertex;
+        case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT: return EShLangTessControl;
+        case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT: return EShLangTessEvaluation;
+        case VK_SHADER_STAGE_GEOMETRY_BIT: return EShLangGeometry;
+        case VK_SHADER_STAGE_FRAGMENT_BIT: return EShLangFragment;
+        case VK_SHADER_STAGE_COMPUTE_BIT: return EShLangCompute;
+        default: break;
+        }
+        return EShLangCount;
+    }
+
+    // デバッガが無い状態の DebugBreak はプロセスを終了させてしまうので、デバッガが付いている場合だけ止める
+    void breakIfDebugging()
+    {
+        if (IsDebuggerPresent())
+        {
+            DebugBreak();
+        }
+    }
+
+    // パスからディレクトリ部分（末尾の区切りを含む）を取り出す
+    string directoryOf(const string& path)
+    {
+        auto pos = path.find_last_of("/\\");
+        return pos == string::npos ? string() : path.substr(0, pos + 1);
+    }
+
+    // #include の解決は loadSource で読み込み済みの本文から行う（コンパイル中にファイルを読まない）
+    class SourceIncluder : public glslang::TShader::Includer
+    {
+    public:
+        explicit SourceIncluder(const map<string, string>& includes)
+            : m_includes(includes)
+        {
+        }
+
+        IncludeResult* includeLocal(const char* headerName, const char*, size_t) override
+        {
+            auto it = m_includes.find(headerName);
+            if (it == m_includes.end())
+            {
+                return nullptr;
+            }
+            return new IncludeResult(it->first, it->second.data(), it->second.size(), nullptr);
+        }
+
+        void releaseInclude(IncludeResult* result) override
+        {
+            delete result;
+        }
+
+    private:
+        const map<string, string>& m_includes;
+    };
+}
+
+ShaderPermutationCache::ShaderPermutationCache()
+    : m_mode(Mode::Development)
+    , m_manifestDirty(false)
+{
+}
+
+ShaderPermutationCache::~ShaderPermutationCache()
+{
+}
+
+/// <summary>
+/// キャッシュの初期化
+/// </summary>
+/// <param name="cacheDir">SPIR-V キャッシュを置くディレクトリ</param>
+/// <param name="mode">開発時はキャッシュミスでコンパイル、出荷時はキャッシュのみを利用する</param>
+void ShaderPermutationCache::initialize(const char* cacheDir, Mode mode)
+{
+    m_cacheDir = cacheDir;
+    m_mode = mode;
+
+    if (m_mode == Mode::Development)
+    {
+        CreateDirectoryA(m_cacheDir.c_str(), nullptr);
+
+        // glslang はプロセスごとに一度だけ初期化が必要
+        glslang::InitializeProcess();
+    }
+
+    loadManifest();
+}
+
+void ShaderPermutationCache::terminate()
+{
+    if (m_manifestDirty)
+    {
+        saveManifest();
+    }
+
+    if (m_mode == Mode::Development)
+    {
+        glslang::FinalizeProcess();
+    }
+
+    m_variants.clear();
+    m_shaders.clear();
+    m_manifest.clear();
+}
+
+/// <summary>
+/// シェーダと、そのシェーダが受け付ける define マクロを登録する
+/// </summary>
+/// <returns>getVariant に渡すシェーダ ID</returns>
+uint32_t ShaderPermutationCache::registerShader(const char* fileName, VkShaderStageFlagBits stage, const vector<string>& defines)
+{
+    if (defines.size() > MaxDefines)
+    {
+        OutputDebugStringA("Too many shader defines.\n");
+        DebugBreak();
+    }
+
+    ShaderEntry entry;
+    entry.fileName = fileName;
+    entry.stage = stage;
+    entry.defines = defines;
+    entry.sourceLoaded = false;
+    m_shaders.push_back(entry);
+    return uint32_t(m_shaders.size() - 1);
+}
+
+/// <summary>
+/// define 名のリストをパーミュテーションのビットマスクに変換する
+/// </summary>
+uint32_t ShaderPermutationCache::getDefineMask(uint32_t shaderId, const vector<string>& defines) const
+{
+    const auto& entry = m_shaders[shaderId];
+    uint32_t mask = 0;
+    for (const auto& d : defines)
+    {
+        bool found = false;
+        for (uint32_t i = 0; i < uint32_t(entry.defines.size()); ++i)
+        {
+            if (entry.defines[i] == d)
+            {
+                mask |= 1u << i;
+                found = true;
+                break;
+            }
+        }
+
+        if (!found)
+        {
+            // 宣言されていない define は無視せずに気づけるようにしておく
+            OutputDebugStringA(("Undeclared shader define: " + d + "\n").c_str());
+            DebugBreak();
+        }
+    }
+    return mask;
+}
+
+const vector<uint32_t>& ShaderPermutationCache::getVariant(uint32_t shaderId, const vector<string>& defines)
+{
+    return getVariant(shaderId, getDefineMask(shaderId, defines));
+}
+
+/// <summary>
+/// 指定したパーミュテーションの SPIR-V を取得する
+/// メモリ -> ディスクキャッシュ -> コンパイルの順に探す
+/// </summary>
+const vector<uint32_t>& ShaderPermutationCache::getVariant(uint32_t shaderId, uint32_t defineMask)
+{
+    // 取得に失敗したときに返す空の SPIR-V（呼び出し側はパイプラインを作らない）
+    static const vector<uint32_t> empty;
+
+    auto& entry = m_shaders[shaderId];
+    auto manifestKey = makeManifestKey(entry, defineMask);
+
+    uint64_t hash = 0;
+    if (m_mode == Mode::Shipping)
+    {
+        // 出荷時はソースを読まず、マニフェストからハッシュを引く
+        auto it = m_manifest.find(manifestKey);
+        if (it == m_manifest.end())
+        {
+            OutputDebugStringA(("Shader variant not precompiled: " + manifestKey + "\n").c_str());
+            breakIfDebugging();
+            return empty;
+        }
+        hash = it->second;
+    }
+    else
+    {
+        if (!loadSource(entry))
+        {
+            OutputDebugStringA("File not found.\n");
+            breakIfDebugging();
+            return empty;
+        }
+        hash = computeHash(entry, defineMask);
+    }
+
+    // 開発時は、メモリやディスクキャッシュから引けた場合も今のソースに対応するハッシュを出荷用に記録する
+    // （コンパイルしたときだけ記録すると、ソースを編集して戻したときに編集後のハッシュが残る）
+    auto recordManifest = [&]()
+    {
+        if (m_mode == Mode::Development)
+        {
+            auto it = m_manifest.find(manifestKey);
+            if (it == m_manifest.end() || it->second != hash)
+            {
+                m_manifest[manifestKey] = hash;
+                m_manifestDirty = true;
+            }
+        }
+    };
+
+    auto found = m_variants.find(hash);
+    if (found != m_variants.end())
+    {
+        recordManifest();
+        return found->second;
+    }
+
+    vector<uint32_t> spirv;
+    if (!readCacheFile(hash, spirv))
+    {
+        if (m_mode == Mode::Shipping)
+        {
+            OutputDebugStringA(("Shader cache file not found: " + makeCachePath(hash) + "\n").c_str());
+            breakIfDebugging();
+            return empty;
+        }
+
+        // キャッシュに無いので、ここで初めてコンパイルする
+        // 失敗したものはメモリにも残さず、ソースを直した後の取得でソースを読み直してもう一度コンパイルする
+        if (!compile(entry, defineMask, spirv) || !optimize(spirv))
+        {
+            entry.sourceLoaded = false;
+            breakIfDebugging();
+            return empty;
+        }
+        writeCacheFile(hash, spirv);
+    }
+    recordManifest();
+
+    auto& variant = m_variants[hash];
+    variant.swap(spirv);
+    return variant;
+}
+
+/// <summary>
+/// 登録済みの全シェーダについて、全パーミュテーションを事前にコンパイルしてキャッシュに書き出す
+/// 出荷用のキャッシュを作るときに利用する
+/// </summary>
+bool ShaderPermutationCache::precompileAll()
+{
+    if (m_mode == Mode::Shipping)
+    {
+        return false;
+    }
+
+    bool succeeded = true;
+    for (uint32_t id = 0; id < uint32_t(m_shaders.size()); ++id)
+    {
+        auto count = uint64_t(1) << m_shaders[id].defines.size();
+        for (uint64_t mask = 0; mask < count; ++mask)
+        {
+            succeeded &= !getVariant(id, uint32_t(mask)).empty();
+        }
+    }
+
+    saveManifest();
+    m_manifestDirty = false;
+    return succeeded;
+}
+
+bool ShaderPermutationCache::loadSource(ShaderEntry& entry)
+{
+    if (entry.sourceLoaded)
+    {
+        return true;
+    }
+
+    ifstream infile(entry.fileName, std::ios::binary);
+    if (!infile)
+    {
+        return false;
+    }
+
+    stringstream ss;
+    ss << infile.rdbuf();
+    entry.source = ss.str();
+    entry.includes.clear();
+    if (!loadIncludes(entry, entry.source))
+    {
+        return false;
+    }
+    entry.sourceLoaded = true;
+    return true;
+}
+
+/// <summary>
+/// source の #include "..." が指すファイルを、シェーダと同じディレクトリから読み込む（入れ子のものも辿る）
+/// </summary>
+bool ShaderPermutationCache::loadIncludes(ShaderEntry& entry, const string& source)
+{
+    istringstream lines(source);
+    string line;
+    while (getline(lines, line))
+    {
+        auto pos = line.find_first_not_of(" \t");
+        if (pos == string::npos || line.compare(pos, 8, "#include") != 0)
+        {
+            continue;
+        }
+        auto first = line.find('"', pos + 8);
+        auto last = first == string::npos ? string::npos : line.find('"', first + 1);
+        if (last == string::npos)
+        {
+            continue;
+        }
+
+        auto name = line.substr(first + 1, last - first - 1);
+        if (entry.includes.count(name) != 0)
+        {
+            continue;
+        }
+
+        ifstream infile(directoryOf(entry.fileName) + name, std::ios::binary);
+        if (!infile)
+        {
+            OutputDebugStringA(("Shader include not found: " + name + "\n").c_str());
+            return false;
+        }
+        stringstream ss;
+        ss << infile.rdbuf();
+        auto& included = entry.includes[name];
+        included = ss.str();
+        if (!loadIncludes(entry, included))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// <summary>
+/// キャッシュキーとなるハッシュ値を計算する
+/// ソース本文・インクルードするファイルの本文・ステージ・有効な define を含めるので、どれかが変われば別のバリアントになる
+/// </summary>
+uint64_t ShaderPermutationCache::computeHash(const ShaderEntry& entry, uint32_t defineMask) const
+{
+    uint64_t hash = hashValue(CacheVersion);
+    hash = hashValue(entry.stage, hash);
+    hash = hashBytes(entry.source.data(), entry.source.size(), hash);
+    for (const auto& include : entry.includes)
+    {
+        hash = hashBytes(include.first.data(), include.first.size() + 1, hash);
+        hash = hashBytes(include.second.data(), include.second.size(), hash);
+    }
+    for (uint32_t i = 0; i < uint32_t(entry.defines.size()); ++i)
+    {
+        if (defineMask & (1u << i))
+        {
+            const auto& d = entry.defines[i];
+            hash = hashBytes(d.data(), d.size() + 1, hash);
+        }
+    }
+    return hash;
+}
+
+/// <summary>
+/// glslang で GLSL を SPIR-V にコンパイルする
+/// </summary>
+bool ShaderPermutationCache::compile(const ShaderEntry& entry, uint32_t defineMask, vector<uint32_t>& spirv) const
+{
+    auto lang = toGlslangStage(entry.stage);
+    if (lang == EShLangCount)
+    {
+        OutputDebugStringA("Unsupported shader stage.\n");
+        return false;
+    }
+
+    // 有効な define はプリアンブルとしてソースの先頭に差し込む
+    string preamble;
+    for (uint32_t i = 0; i < uint32_t(entry.defines.size()); ++i)
+    {
+        if (defineMask & (1u << i))
+        {
+            preamble += "#define " + entry.defines[i] + " 1\n";
+        }
+    }
+
+    const char* sources[] = { entry.source.c_str() };
+    const char* names[] = { entry.fileName.c_str() };
+
+    glslang::TShader shader(lang);
+    shader.setStringsWithLengthsAndNames(sources, nullptr, names, 1);
+    shader.setPreamble(preamble.c_str());
+    shader.setEnvInput(glslang::EShSourceGlsl, lang, glslang::EShClientVulkan, 100);
+    shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_1);
+    shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_3);
+
+    auto messages = EShMessages(EShMsgSpvRules | EShMsgVulkanRules);
+    SourceIncluder includer(entry.includes);
+    if (!shader.parse(GetDefaultResources(), 450, false, messages, includer))
+    {
+        OutputDebugStringA(entry.fileName.c_str());
+        OutputDebugStringA(":\n");
+        OutputDebugStringA(shader.getInfoLog());
+        return false;
+    }
+
+    glslang::TProgram program;
+    program.addShader(&shader);
+    if (!program.link(messages))
+    {
+        OutputDebugStringA(program.getInfoLog());
+        return false;
+    }
+
+    glslang::SpvOptions options;
+    options.generateDebugInfo = false;
+    options.disableOptimizer = true;
+    glslang::GlslangToSpv(*program.getIntermediate(lang), spirv, &options);
+    return !spirv.empty();
+}
+
+/// <summary>
+/// spirv-opt 相当の最適化を行う
+/// デバッグ情報の除去と、デッドコード（無効化された #ifdef ブロックの残骸など）の除去が目的
+/// </summary>
+bool ShaderPermutationCache::optimize(vector<uint32_t>& spirv) const
+{
+    spvtools::Optimizer optimizer(SPV_ENV_VULKAN_1_1);
+    optimizer.SetMessageConsumer([](spv_message_level_t, const char*, const spv_position_t&, const char* message)
+    {
+        OutputDebugStringA(message);
+        OutputDebugStringA("\n");
+    });
+    optimizer.RegisterPass(spvtools::CreateStripDebugInfoPass());
+    optimizer.RegisterPass(spvtools::CreateDeadBranchElimPass());
+    optimizer.RegisterPass(spvtools::CreateEliminateDeadFunctionsPass());
+    optimizer.RegisterPass(spvtools::CreateAggressiveDCEPass());
+    optimizer.RegisterPass(spvtools::CreateDeadVariableEliminationPass());
+
+    vector<uint32_t> optimized;
+    if (!optimizer.Run(spirv.data(), spirv.size(), &optimized))
+    {
+        return false;
+    }
+    spirv.swap(optimized);
+    return true;
+}
+
+string ShaderPermutationCache::makeCachePath(uint64_t hash) const
+{
+    stringstream ss;
+    ss << m_cacheDir << "/" << hex << setw(16) << setfill('0') << hash << ".spv";
+    return ss.str();
+}
+
+bool ShaderPermutationCache::readCacheFile(uint64_t hash, vector<uint32_t>& spirv) const
+{
+    ifstream infile(makeCachePath(hash), std::ios::binary);
+    if (!infile)
+    {
+        return false;
+    }
+
+    auto size = size_t(infile.seekg(0, ifstream::end).tellg());
+    if (size == 0 || (size % sizeof(uint32_t)) != 0)
+    {
+        return false;
+    }
+
+    spirv.resize(size / sizeof(uint32_t));
+    infile.seekg(0, ifstream::beg).read(reinterpret_cast<char*>(spirv.data()), size);
+    return bool(infile);
+}
+
+void ShaderPermutationCache::writeCacheFile(uint64_t hash, const vector<uint32_t>& spirv) const
+{
+    ofstream outfile(makeCachePath(hash), std::ios::binary);
+    outfile.write(reinterpret_cast<const char*>(spirv.data()), spirv.size() * sizeof(uint32_t));
+}
+
+/// <summary>
+/// マニフェストを読み込む
+/// 1 行に「ファイル名:マスク ハッシュ値」を記録している
+/// </summary>
+void ShaderPermutationCache::loadManifest()
+{
+    ifstream infile(m_cacheDir + "/" + ManifestFileName);
+    string key;
+    uint64_t hash;
+    while (infile >> key >> hex >> hash)
+    {
+        m_manifest[key] = hash;
+    }
+}
+
+void ShaderPermutationCache::saveManifest() const
+{
+    ofstream outfile(m_cacheDir + "/" + ManifestFileName);
+    for (const auto& v : m_manifest)
+    {
+        outfile << v.first << " " << hex << setw(16) << setfill('0') << v.second << "\n";
+    }
+}
+
+string ShaderPermutationCache::makeManifestKey(const ShaderEntry& entry, uint32_t defineMask) const
+{
+    stringstream ss;
+    ss << entry.fileName << ":" << hex << defineMask;
+    return ss.str();
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "vkappbase.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <cstdint>
+
+/// <summary>
+/// シェーダのパーミュテーション（define マクロの組み合わせ）ごとに SPIR-V を生成・キャッシュする
+/// </summary>
+/// <remarks>
+/// GLSL ソースは glslang でコンパイルし、spirv-opt 相当のパス（デバッグ情報除去・DCE）を通してからキャッシュする。
+/// キャッシュのキーは「ソース本文 + 有効な define + ステージ」のハッシュで、ソースが変わらない限り再コンパイルされない。
+/// #include "..."（GL_GOOGLE_include_directive）で読み込むファイルはシェーダと同じディレクトリから探し、その本文もハッシュに含める。
+/// </remarks>
+class ShaderPermutationCache
+{
+public:
+    enum class Mode
+    {
+        // キャッシュに無いバリアントはその場でコンパイルする（開発時）
+        Development,
+        // 事前にコンパイル済みのキャッシュのみを利用する（出荷時）
+        Shipping,
+    };
+
+    // 1 シェーダで宣言できる define の最大数（パーミュテーションはビットマスクで表す）
+    static const uint32_t MaxDefines = 32;
+
+    ShaderPermutationCache();
+    ~ShaderPermutationCache();
+
+    void initialize(const char* cacheDir, Mode mode);
+    void terminate();
+
+    uint32_t registerShader(const char* fileName, VkShaderStageFlagBits stage, const std::vector<std::string>& defines);
+
+    uint32_t getDefineMask(uint32_t shaderId, const std::vector<std::string>& defines) const;
+    const std::vector<uint32_t>& getVariant(uint32_t shaderId, uint32_t defineMask);
+    const std::vector<uint32_t>& getVariant(uint32_t shaderId, const std::vector<std::string>& defines);
+
+    // 登録済みのシェーダのすべてのバリアントをコンパイルしてキャッシュとマニフェストを書き出す（出荷用のキャッシュを作る）
+    // コンパイルできないバリアントがあれば false
+    bool precompileAll();
+
+    Mode getMode() const { return m_mode; }
+
+private:
+    struct ShaderEntry
+    {
+        std::string fileName;
+        VkShaderStageFlagBits stage;
+        std::vector<std::string> defines;
+        std::string source;
+        // #include で読み込むファイル名 -> 本文（入れ子のものも含む）
+        std::map<std::string, std::string> includes;
+        bool sourceLoaded;
+    };
+
+    bool loadSource(ShaderEntry& entry);
+    bool loadIncludes(ShaderEntry& entry, const std::string& source);
+    uint64_t computeHash(const ShaderEntry& entry, uint32_t defineMask) const;
+    bool compile(const ShaderEntry& entry, uint32_t defineMask, std::vector<uint32_t>& spirv) const;
+    bool optimize(std::vector<uint32_t>& spirv) const;
+
+    std::string makeCachePath(uint64_t hash) const;
+    bool readCacheFile(uint64_t hash, std::vector<uint32_t>& spirv) const;
+    void writeCacheFile(uint64_t hash, const std::vector<uint32_t>& spirv) const;
+
+    void loadManifest();
+    void saveManifest() const;
+    std::string makeManifestKey(const ShaderEntry& entry, uint32_t defineMask) const;
+
+    Mode m_mode;
+    std::string m_cacheDir;
+    bool m_manifestDirty;
+
+    std::vector<ShaderEntry> m_shaders;
+
+    // ハッシュ値 -> SPIR-V（メモリ上のキャッシュ）
+    std::unordered_map<uint64_t, std::vector<uint32_t>> m_variants;
+
+    // "ファイル名:マスク" -> ハッシュ値（出荷時にソース無しでバリアントを引くためのマニフェスト）
+    std::unordered_map<std::string, uint64_t> m_manifest;
+};
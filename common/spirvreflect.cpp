@@ -0,0 +1,214 @@
+#include "spirvreflect.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+    // 必要な分だけの SPIR-V の定義
+    const uint32_t SpirvMagic = 0x07230203;
+    const uint32_t SpirvHeaderWords = 5;
+
+    const uint32_t OpDecorate = 71;
+    const uint32_t OpTypeInt = 21;
+    const uint32_t OpTypeFloat = 22;
+    const uint32_t OpTypeVector = 23;
+    const uint32_t OpTypeMatrix = 24;
+    const uint32_t OpTypePointer = 32;
+    const uint32_t OpVariable = 59;
+
+    const uint32_t DecorationBuiltIn = 11;
+    const uint32_t DecorationLocation = 30;
+
+    const uint32_t StorageClassInput = 1;
+
+    struct TypeInfo
+    {
+        uint32_t opcode;
+        uint32_t componentType;   // Vector / Matrix の要素型
+        uint32_t count;           // Vector の要素数 / Matrix の列数
+        bool isSigned;            // Int のみ
+    };
+}
+
+/// <summary>
+/// 頂点シェーダの SPIR-V から入力変数（ロケーション・要素数・数値型）を読み取る
+/// 組み込み変数（gl_VertexIndex など）は含まない
+/// </summary>
+vector<ShaderVertexInput> reflectVertexInputs(const vector<uint32_t>& spirv)
+{
+    vector<ShaderVertexInput> inputs;
+    if (spirv.size() < SpirvHeaderWords || spirv[0] != SpirvMagic)
+    {
+        return inputs;
+    }
+
+    unordered_map<uint32_t, TypeInfo> types;
+    unordered_map<uint32_t, uint32_t> pointers;     // ポインタ型 ID -> 指す先の型 ID
+    unordered_map<uint32_t, uint32_t> locations;    // 変数 ID -> ロケーション
+    unordered_set<uint32_t> builtins;
+    vector<pair<uint32_t, uint32_t>> variables;     // (ポインタ型 ID, 変数 ID)
+
+    size_t pos = SpirvHeaderWords;
+    while (pos < spirv.size())
+    {
+        auto wordCount = spirv[pos] >> 16;
+        auto opcode = spirv[pos] & 0xffff;
+        if (wordCount == 0 || pos + wordCount > spirv.size())
+        {
+            break;
+        }
+        const auto* op = &spirv[pos];
+
+        switch (opcode)
+        {
+        case OpDecorate:
+            if (op[2] == DecorationLocation)
+            {
+                locations[op[1]] = op[3];
+            }
+            else if (op[2] == DecorationBuiltIn)
+            {
+                builtins.insert(op[1]);
+            }
+            break;
+        case OpTypeInt:
+            types[op[1]] = { opcode, 0, 1, op[3] != 0 };
+            break;
+        case OpTypeFloat:
+            types[op[1]] = { opcode, 0, 1, true };
+            break;
+        case OpTypeVector:
+        case OpTypeMatrix:
+            types[op[1]] = { opcode, op[2], op[3], false };
+            break;
+        case OpTypePointer:
+            if (op[2] == StorageClassInput)
+            {
+                pointers[op[1]] = op[3];
+            }
+            break;
+        case OpVariable:
+            if (op[3] == StorageClassInput)
+            {
+                variables.push_back(make_pair(op[1], op[2]));
+            }
+            break;
+        default:
+            break;
+        }
+        pos += wordCount;
+    }
+
+    // スカラー型から数値型を判定する
+    auto numericTypeOf = [&](uint32_t scalarType)
+    {
+        const auto& t = types[scalarType];
+        if (t.opcode == OpTypeFloat)
+        {
+            return VertexNumericType::Float;
+        }
+        return t.isSigned ? VertexNumericType::SInt : VertexNumericType::UInt;
+    };
+
+    for (const auto& v : variables)
+    {
+        auto variableId = v.second;
+        if (builtins.count(variableId) || !locations.count(variableId) || !pointers.count(v.first))
+        {
+            continue;
+        }
+
+        auto location = locations[variableId];
+        const auto& type = types[pointers[v.first]];
+        if (type.opcode == OpTypeMatrix)
+        {
+            // 行列は列ごとに 1 ロケーションを消費する
+            const auto& column = types[type.componentType];
+            for (uint32_t i = 0; i < type.count; ++i)
+            {
+                inputs.push_back({ location + i, column.count, numericTypeOf(column.componentType) });
+            }
+        }
+        else if (type.opcode == OpTypeVector)
+        {
+            inputs.push_back({ location, type.count, numericTypeOf(type.componentType) });
+        }
+        else
+        {
+            inputs.push_back({ location, 1, numericTypeOf(pointers[v.first]) });
+        }
+    }
+
+    return inputs;
+}
+
+/// <summary>
+/// 頂点入力の記述が頂点シェーダの入力と一致しているかを検証する
+/// </summary>
+/// <remarks>
+/// シェーダが読むロケーションに属性が無い、数値型（float/int/uint）が違う、
+/// フォーマットの要素数がシェーダの要素数より少ない、の場合は不一致とする。
+/// シェーダが読まない属性は問題にしない（警告のみ出力する）。
+/// </remarks>
+bool validateVertexInputs(const vector<uint32_t>& spirv, const vector<VkVertexInputAttributeDescription>& attributes)
+{
+    bool valid = true;
+    auto inputs = reflectVertexInputs(spirv);
+
+    for (const auto& input : inputs)
+    {
+        const VkVertexInputAttributeDescription* found = nullptr;
+        for (const auto& a : attributes)
+        {
+            if (a.location == input.location)
+            {
+                found = &a;
+                break;
+            }
+        }
+
+        stringstream ss;
+        if (found == nullptr)
+        {
+            ss << "Vertex input location " << input.location << " is not provided by the vertex layout.\n";
+            valid = false;
+        }
+        else
+        {
+            auto info = getVertexFormatInfo(found->format);
+            if (info.numericType != input.numericType)
+            {
+                ss << "Vertex input location " << input.location << " numeric type mismatch.\n";
+                valid = false;
+            }
+            else if (info.components < input.components)
+            {
+                ss << "Vertex input location " << input.location << " expects " << input.components
+                    << " components but the format has " << info.components << ".\n";
+                valid = false;
+            }
+        }
+        OutputDebugStringA(ss.str().c_str());
+    }
+
+    for (const auto& a : attributes)
+    {
+        bool used = false;
+        for (const auto& input : inputs)
+        {
+            used |= (input.location == a.location);
+        }
+        if (!used)
+        {
+            stringstream ss;
+            ss << "Vertex attribute location " << a.location << " is not used by the vertex shader.\n";
+            OutputDebugStringA(ss.str().c_str());
+        }
+    }
+
+    return valid;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "vkappbase.h"
+#include "vertexlayout.h"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// SPIR-V から読み取った頂点シェーダの入力変数
+/// </summary>
+struct ShaderVertexInput
+{
+    uint32_t location;
+    uint32_t components;
+    VertexNumericType numericType;
+};
+
+std::vector<ShaderVertexInput> reflectVertexInputs(const std::vector<uint32_t>& spirv);
+
+bool validateVertexInputs(const std::vector<uint32_t>& spirv,
+    const std::vector<VkVertexInputAttributeDescription>& attributes);
@@ -0,0 +1,287 @@
+#include "staging.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+UploadScheduler::UploadScheduler()
+    : m_device(VK_NULL_HANDLE), m_queue(VK_NULL_HANDLE), m_commandPool(VK_NULL_HANDLE), m_command(VK_NULL_HANDLE), m_fence(VK_NULL_HANDLE)
+    , m_buffer(VK_NULL_HANDLE), m_memory(VK_NULL_HANDLE), m_mapped(nullptr), m_capacity(0), m_head(0), m_totalUploaded(0)
+    , m_reader(nullptr), m_failedReads(0)
+{
+}
+
+void UploadScheduler::initialize(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProps,
+    VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize capacity)
+{
+    m_device = device;
+    m_queue = queue;
+    m_capacity = capacity;
+    m_head = 0;
+    m_totalUploaded = 0;
+
+    // ステージングバッファ（ホストから書き込めるメモリに置き、マップしたままにする）
+    VkBufferCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    ci.size = capacity;
+    ci.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    vkCreateBuffer(m_device, &ci, nullptr, &m_buffer);
+
+    VkMemoryRequirements reqs;
+    vkGetBufferMemoryRequirements(m_device, m_buffer, &reqs);
+    VkMemoryAllocateInfo ai{};
+    ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    ai.allocationSize = reqs.size;
+    ai.memoryTypeIndex = findMemoryType(memProps, reqs.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (ai.memoryTypeIndex == ~0u)
+    {
+        // 容量を 0 にしておき、allocate が常に失敗するようにする
+        OutputDebugStringA("UploadScheduler: no host-visible memory type for the staging buffer.\n");
+        vkDestroyBuffer(m_device, m_buffer, nullptr);
+        m_buffer = VK_NULL_HANDLE;
+        m_device = VK_NULL_HANDLE;
+        m_capacity = 0;
+        return;
+    }
+    vkAllocateMemory(m_device, &ai, nullptr, &m_memory);
+    vkBindBufferMemory(m_device, m_buffer, m_memory, 0);
+
+    void* p;
+    vkMapMemory(m_device, m_memory, 0, VK_WHOLE_SIZE, 0, &p);
+    m_mapped = static_cast<uint8_t*>(p);
+
+    // 転送用のコマンドバッファ
+    VkCommandPoolCreateInfo poolCI{};
+    poolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolCI.queueFamilyIndex = queueFamilyIndex;
+    poolCI.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    vkCreateCommandPool(m_device, &poolCI, nullptr, &m_commandPool);
+
+    VkCommandBufferAllocateInfo commandAI{};
+    commandAI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandAI.commandPool = m_commandPool;
+    commandAI.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandAI.commandBufferCount = 1;
+    vkAllocateCommandBuffers(m_device, &commandAI, &m_command);
+
+    VkFenceCreateInfo fenceCI{};
+    fenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    vkCreateFence(m_device, &fenceCI, nullptr, &m_fence);
+}
+
+void UploadScheduler::terminate()
+{
+    if (m_device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    flush();
+    attachFileReader(nullptr);
+
+    vkDestroyFence(m_device, m_fence, nullptr);
+    vkFreeCommandBuffers(m_device, m_commandPool, 1, &m_command);
+    vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+
+    vkUnmapMemory(m_device, m_memory);
+    vkFreeMemory(m_device, m_memory, nullptr);
+    vkDestroyBuffer(m_device, m_buffer, nullptr);
+
+    m_device = VK_NULL_HANDLE;
+    m_mapped = nullptr;
+}
+
+/// <summary>
+/// ステージングバッファから領域を切り出す（ロックを取らずに先頭位置を進めるだけ）
+/// </summary>
+bool UploadScheduler::allocate(VkDeviceSize size, VkDeviceSize alignment, StagingAllocation& allocation)
+{
+    auto head = m_head.load(memory_order_relaxed);
+    VkDeviceSize offset;
+    do
+    {
+        offset = (head + alignment - 1) / alignment * alignment;
+        if (offset + size > m_capacity)
+        {
+            return false;
+        }
+    } while (!m_head.compare_exchange_weak(head, offset + size, memory_order_relaxed));
+
+    allocation.data = m_mapped + offset;
+    allocation.offset = offset;
+    allocation.size = size;
+    return true;
+}
+
+void UploadScheduler::copyToBuffer(const StagingAllocation& source, VkBuffer destination, VkDeviceSize destinationOffset)
+{
+    PendingCopy copy;
+    copy.source = m_buffer;
+    copy.destination = destination;
+    copy.region.srcOffset = source.offset;
+    copy.region.dstOffset = destinationOffset;
+    copy.region.size = source.size;
+
+    lock_guard<mutex> lock(m_pendingMutex);
+    m_pending.push_back(copy);
+}
+
+void UploadScheduler::copyBuffer(VkBuffer source, VkBuffer destination, const VkBufferCopy& region)
+{
+    PendingCopy copy;
+    copy.source = source;
+    copy.destination = destination;
+    copy.region = region;
+
+    lock_guard<mutex> lock(m_pendingMutex);
+    m_pending.push_back(copy);
+}
+
+bool UploadScheduler::upload(const void* data, VkDeviceSize size, VkBuffer destination, VkDeviceSize destinationOffset)
+{
+    if (m_capacity == 0)
+    {
+        return false;
+    }
+
+    // 1 回に確保するのは容量の 1/4 まで（ワーカースレッドが同時に確保する余地を残す）
+    const VkDeviceSize chunkSize = max<VkDeviceSize>(m_capacity / 4, 1);
+    auto src = static_cast<const uint8_t*>(data);
+    bool succeeded = true;
+    while (size > 0)
+    {
+        StagingAllocation allocation;
+        const VkDeviceSize chunk = min(size, chunkSize);
+        if (!allocate(chunk, 16, allocation))
+        {
+            succeeded &= flush();
+            continue;
+        }
+        memcpy(allocation.data, src, size_t(chunk));
+        copyToBuffer(allocation, destination, destinationOffset);
+
+        src += chunk;
+        destinationOffset += chunk;
+        size -= chunk;
+    }
+    return succeeded;
+}
+
+/// <summary>
+/// 非同期読み込みを設定する（nullptr で解除）
+/// io_uring の場合はステージングバッファが固定バッファとして登録される
+/// </summary>
+void UploadScheduler::attachFileReader(AsyncFileReader* reader)
+{
+    if (m_reader != nullptr)
+    {
+        m_reader->wait();
+        m_reader->unregisterBuffer();
+    }
+    m_reader = reader;
+    if (m_reader != nullptr)
+    {
+        m_reader->registerBuffer(m_mapped, size_t(m_capacity));
+    }
+}
+
+/// <summary>
+/// ファイルの一部をステージングバッファへ読み込み、読み終わったら buffer への転送を登録する
+/// </summary>
+void UploadScheduler::readFromFile(int file, uint64_t fileOffset, const StagingAllocation& destination,
+    VkBuffer buffer, VkDeviceSize bufferOffset)
+{
+    if (m_reader == nullptr)
+    {
+        m_failedReads++;
+        return;
+    }
+
+    m_reader->read(file, fileOffset, size_t(destination.size), destination.data,
+        [this, destination, buffer, bufferOffset](size_t, bool succeeded)
+    {
+        if (succeeded)
+        {
+            copyToBuffer(destination, buffer, bufferOffset);
+        }
+        else
+        {
+            m_failedReads++;
+        }
+    });
+}
+
+bool UploadScheduler::flush()
+{
+    // 読み込み中の領域は転送できないので、先にすべての読み込みを完了させる
+    if (m_reader != nullptr)
+    {
+        m_reader->wait();
+    }
+    const bool succeeded = m_failedReads == 0;
+    m_failedReads = 0;
+
+    lock_guard<mutex> lock(m_pendingMutex);
+    if (m_pending.empty())
+    {
+        m_head = 0;
+        return succeeded;
+    }
+
+    // 転送先と転送元の組ごとにまとめて 1 回の vkCmdCopyBuffer で記録する
+    stable_sort(m_pending.begin(), m_pending.end(), [](const PendingCopy& a, const PendingCopy& b) {
+        return a.destination != b.destination ? a.destination < b.destination : a.source < b.source;
+    });
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(m_command, &beginInfo);
+
+    vector<VkBufferCopy> regions;
+    for (size_t i = 0; i < m_pending.size();)
+    {
+        auto destination = m_pending[i].destination;
+        auto source = m_pending[i].source;
+        regions.clear();
+        for (; i < m_pending.size() && m_pending[i].destination == destination && m_pending[i].source == source; ++i)
+        {
+            regions.push_back(m_pending[i].region);
+        }
+        if (source == m_buffer)
+        {
+            for (const auto& region : regions)
+            {
+                m_totalUploaded += region.size;
+            }
+        }
+        vkCmdCopyBuffer(m_command, source, destination, uint32_t(regions.size()), regions.data());
+    }
+
+    // 転送した内容を頂点入力・インデックス・シェーダから読めるようにする
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(m_command, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkEndCommandBuffer(m_command);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_command;
+    vkQueueSubmit(m_queue, 1, &submitInfo, m_fence);
+
+    vkWaitForFences(m_device, 1, &m_fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(m_device, 1, &m_fence);
+    vkResetCommandBuffer(m_command, 0);
+
+    m_pending.clear();
+    m_head = 0;
+    return succeeded;
+}
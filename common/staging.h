@@ -0,0 +1,90 @@
+#pragma once
+#include "vkappbase.h"
+#include "asyncio.h"
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+/// <summary>
+/// ステージングバッファ上に確保した領域
+/// data は永続的にマップされたメモリを指すので、そのまま書き込んでよい
+/// </summary>
+struct StagingAllocation
+{
+    void* data;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+/// <summary>
+/// ステージングバッファを経由して GPU 上のバッファへデータを転送する
+/// </summary>
+/// <remarks>
+/// allocate と copyToBuffer は複数のスレッドから同時に呼んでよい。
+/// ワーカースレッドは確保した領域へ直接データを書き込み、転送を登録するだけにして、
+/// コマンドの記録と送信は flush を呼んだスレッドがまとめて行う。
+/// ステージングバッファが一杯になったら flush で転送を完了させてから再び確保する。
+/// attachFileReader で非同期読み込みを設定すると、readFromFile でファイルの内容を CPU で触らずに
+/// ステージングバッファへ直接読み込める（読み込みが完了した時点で転送が登録される）。
+/// </remarks>
+class UploadScheduler
+{
+public:
+    UploadScheduler();
+
+    void initialize(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProps,
+        VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize capacity);
+    void terminate();
+
+    // 空きがなければ false を返す
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, StagingAllocation& allocation);
+    void copyToBuffer(const StagingAllocation& source, VkBuffer destination, VkDeviceSize destinationOffset);
+
+    // GPU 上のバッファ同士のコピーを登録する（flush で転送と一緒に記録する。source と destination は別のバッファであること）
+    void copyBuffer(VkBuffer source, VkBuffer destination, const VkBufferCopy& region);
+
+    // メモリ上のデータを転送する。ステージングバッファより大きければ分割し、一杯になったら flush する
+    // （flush と同じスレッドから呼ぶこと。転送を完了させるには最後に flush を呼ぶ）
+    bool upload(const void* data, VkDeviceSize size, VkBuffer destination, VkDeviceSize destinationOffset);
+
+    // ステージングバッファを読み込み先として登録する（readFromFile は flush と同じスレッドから呼ぶこと）
+    void attachFileReader(AsyncFileReader* reader);
+    AsyncFileReader* getFileReader() const { return m_reader; }
+    void readFromFile(int file, uint64_t fileOffset, const StagingAllocation& destination,
+        VkBuffer buffer, VkDeviceSize bufferOffset);
+
+    // ファイルからの読み込みと登録された転送を完了させ、ステージングバッファを空にする
+    // 前回の flush 以降に失敗した読み込みがあれば false を返す
+    bool flush();
+
+    VkDeviceSize getCapacity() const { return m_capacity; }
+    VkDeviceSize getTotalUploaded() const { return m_totalUploaded; }
+
+private:
+    struct PendingCopy
+    {
+        VkBuffer source;
+        VkBuffer destination;
+        VkBufferCopy region;
+    };
+
+    VkDevice m_device;
+    VkQueue m_queue;
+    VkCommandPool m_commandPool;
+    VkCommandBuffer m_command;
+    VkFence m_fence;
+
+    VkBuffer m_buffer;
+    VkDeviceMemory m_memory;
+    uint8_t* m_mapped;
+    VkDeviceSize m_capacity;
+    std::atomic<VkDeviceSize> m_head;
+
+    std::mutex m_pendingMutex;
+    std::vector<PendingCopy> m_pending;
+    VkDeviceSize m_totalUploaded;
+
+    AsyncFileReader* m_reader;
+    uint32_t m_failedReads;
+};
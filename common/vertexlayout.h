@@ -0,0 +1,206 @@
+#pragma once
+#include "vkappbase.h"
+#include "glm/glm.hpp"
+
+#include <array>
+#include <tuple>
+#include <cstddef>
+#include <cstdint>
+
+/// <summary>
+/// C++ の頂点構造体から VkVertexInput*Description をコンパイル時に導出するための仕組み
+/// </summary>
+/// <remarks>
+/// 使い方:
+///   DECLARE_VERTEX_LAYOUT(Vertex, VK_VERTEX_INPUT_RATE_VERTEX,
+///       VERTEX_ATTRIBUTE(Vertex, pos, 0),
+///       VERTEX_ATTRIBUTE(Vertex, color, 1));
+/// フォーマットはメンバの型から決まり、オフセットは offsetof で求める。
+/// ロケーションの重複・メンバの重なり・記述漏れ（構造体サイズと属性サイズの不一致）は static_assert で検出される。
+/// </remarks>
+
+// ---- フォーマット情報 ----
+
+enum class VertexNumericType
+{
+    Float,  // SFLOAT / UNORM / SNORM など、シェーダからは float として見えるもの
+    SInt,
+    UInt,
+};
+
+struct VertexFormatInfo
+{
+    uint32_t size;
+    uint32_t components;
+    VertexNumericType numericType;
+};
+
+constexpr VertexFormatInfo getVertexFormatInfo(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R32_SFLOAT: return { 4, 1, VertexNumericType::Float };
+    case VK_FORMAT_R32G32_SFLOAT: return { 8, 2, VertexNumericType::Float };
+    case VK_FORMAT_R32G32B32_SFLOAT: return { 12, 3, VertexNumericType::Float };
+    case VK_FORMAT_R32G32B32A32_SFLOAT: return { 16, 4, VertexNumericType::Float };
+    case VK_FORMAT_R32_SINT: return { 4, 1, VertexNumericType::SInt };
+    case VK_FORMAT_R32G32_SINT: return { 8, 2, VertexNumericType::SInt };
+    case VK_FORMAT_R32G32B32_SINT: return { 12, 3, VertexNumericType::SInt };
+    case VK_FORMAT_R32G32B32A32_SINT: return { 16, 4, VertexNumericType::SInt };
+    case VK_FORMAT_R32_UINT: return { 4, 1, VertexNumericType::UInt };
+    case VK_FORMAT_R32G32_UINT: return { 8, 2, VertexNumericType::UInt };
+    case VK_FORMAT_R32G32B32_UINT: return { 12, 3, VertexNumericType::UInt };
+    case VK_FORMAT_R32G32B32A32_UINT: return { 16, 4, VertexNumericType::UInt };
+    case VK_FORMAT_R8G8B8A8_UNORM: return { 4, 4, VertexNumericType::Float };
+    case VK_FORMAT_R8G8B8A8_SNORM: return { 4, 4, VertexNumericType::Float };
+    case VK_FORMAT_R8G8B8A8_UINT: return { 4, 4, VertexNumericType::UInt };
+    case VK_FORMAT_R16G16_SFLOAT: return { 4, 2, VertexNumericType::Float };
+    case VK_FORMAT_R16G16_SNORM: return { 4, 2, VertexNumericType::Float };
+    case VK_FORMAT_R16G16_UNORM: return { 4, 2, VertexNumericType::Float };
+    case VK_FORMAT_R16G16B16A16_SFLOAT: return { 8, 4, VertexNumericType::Float };
+    case VK_FORMAT_R16G16B16A16_SNORM: return { 8, 4, VertexNumericType::Float };
+    case VK_FORMAT_R16G16B16A16_UNORM: return { 8, 4, VertexNumericType::Float };
+    default: break;
+    }
+    return { 0, 0, VertexNumericType::Float };
+}
+
+// ---- メンバの型 -> VkFormat ----
+
+template<class T>
+struct VertexFormatOf
+{
+    // 対応していない型を使った場合はここでコンパイルエラーになる
+    static_assert(sizeof(T) == 0, "no VkFormat is associated with this vertex member type");
+};
+
+#define VERTEX_FORMAT_OF(Type, Format) \
+    template<> struct VertexFormatOf<Type> { static constexpr VkFormat value = Format; }
+
+VERTEX_FORMAT_OF(float, VK_FORMAT_R32_SFLOAT);
+VERTEX_FORMAT_OF(glm::vec2, VK_FORMAT_R32G32_SFLOAT);
+VERTEX_FORMAT_OF(glm::vec3, VK_FORMAT_R32G32B32_SFLOAT);
+VERTEX_FORMAT_OF(glm::vec4, VK_FORMAT_R32G32B32A32_SFLOAT);
+VERTEX_FORMAT_OF(int32_t, VK_FORMAT_R32_SINT);
+VERTEX_FORMAT_OF(glm::ivec2, VK_FORMAT_R32G32_SINT);
+VERTEX_FORMAT_OF(glm::ivec3, VK_FORMAT_R32G32B32_SINT);
+VERTEX_FORMAT_OF(glm::ivec4, VK_FORMAT_R32G32B32A32_SINT);
+VERTEX_FORMAT_OF(uint32_t, VK_FORMAT_R32_UINT);
+VERTEX_FORMAT_OF(glm::uvec2, VK_FORMAT_R32G32_UINT);
+VERTEX_FORMAT_OF(glm::uvec3, VK_FORMAT_R32G32B32_UINT);
+VERTEX_FORMAT_OF(glm::uvec4, VK_FORMAT_R32G32B32A32_UINT);
+
+// ---- 属性の記述 ----
+
+struct VertexAttribute
+{
+    uint32_t location;
+    VkFormat format;
+    uint32_t offset;
+    uint32_t size;
+};
+
+template<class Member>
+constexpr VertexAttribute makeVertexAttribute(uint32_t location, size_t offset)
+{
+    static_assert(getVertexFormatInfo(VertexFormatOf<Member>::value).size == sizeof(Member),
+        "vertex member size does not match its VkFormat");
+    return { location, VertexFormatOf<Member>::value, uint32_t(offset), uint32_t(sizeof(Member)) };
+}
+
+#define VERTEX_ATTRIBUTE(Type, Member, Location) \
+    makeVertexAttribute<decltype(Type::Member)>(Location, offsetof(Type, Member))
+
+/// <summary>
+/// 頂点構造体ごとに特殊化するトレイト
+/// DECLARE_VERTEX_LAYOUT マクロで定義する
+/// </summary>
+template<class V>
+struct VertexLayout;
+
+// ---- コンパイル時の検証 ----
+
+template<class V>
+constexpr bool vertexLayoutHasUniqueLocations()
+{
+    constexpr auto attributes = VertexLayout<V>::attributes();
+    for (size_t i = 0; i < attributes.size(); ++i)
+    {
+        for (size_t j = i + 1; j < attributes.size(); ++j)
+        {
+            if (attributes[i].location == attributes[j].location)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<class V>
+constexpr bool vertexLayoutHasNoOverlap()
+{
+    constexpr auto attributes = VertexLayout<V>::attributes();
+    for (size_t i = 0; i < attributes.size(); ++i)
+    {
+        if (attributes[i].offset + attributes[i].size > sizeof(V))
+        {
+            return false;
+        }
+        for (size_t j = i + 1; j < attributes.size(); ++j)
+        {
+            const auto& a = attributes[i];
+            const auto& b = attributes[j];
+            if (a.offset < b.offset + b.size && b.offset < a.offset + a.size)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<class V>
+constexpr bool vertexLayoutCoversStruct()
+{
+    constexpr auto attributes = VertexLayout<V>::attributes();
+    size_t total = 0;
+    for (size_t i = 0; i < attributes.size(); ++i)
+    {
+        total += attributes[i].size;
+    }
+    return total == sizeof(V);
+}
+
+#define DECLARE_VERTEX_LAYOUT(Type, InputRate, ...) \
+    template<> struct VertexLayout<Type> \
+    { \
+        static constexpr VkVertexInputRate inputRate = InputRate; \
+        static constexpr auto attributes() \
+        { \
+            return std::array<VertexAttribute, std::tuple_size<decltype(std::make_tuple(__VA_ARGS__))>::value>{ { __VA_ARGS__ } }; \
+        } \
+    }; \
+    static_assert(vertexLayoutHasUniqueLocations<Type>(), #Type ": duplicated vertex attribute location"); \
+    static_assert(vertexLayoutHasNoOverlap<Type>(), #Type ": vertex attributes overlap or exceed the struct"); \
+    static_assert(vertexLayoutCoversStruct<Type>(), #Type ": vertex struct has members not described in its layout")
+
+// ---- Vulkan の記述子への変換 ----
+
+template<class V>
+constexpr VkVertexInputBindingDescription makeVertexBindingDescription(uint32_t binding)
+{
+    return { binding, uint32_t(sizeof(V)), VertexLayout<V>::inputRate };
+}
+
+template<class V>
+constexpr auto makeVertexAttributeDescriptions(uint32_t binding)
+{
+    constexpr auto attributes = VertexLayout<V>::attributes();
+    std::array<VkVertexInputAttributeDescription, attributes.size()> result{};
+    for (size_t i = 0; i < attributes.size(); ++i)
+    {
+        result[i] = { attributes[i].location, binding, attributes[i].format, attributes[i].offset };
+    }
+    return result;
+}
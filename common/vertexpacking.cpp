@@ -0,0 +1,171 @@
+#include "vertexpacking_impl.h"
+#include "cpufeatures.h"
+
+#include <cfloat>
+
+using namespace std;
+using namespace vertexpacking;
+
+namespace
+{
+    /// <summary>
+    /// AVX2 のカーネルが使えるか（CPU と OS の両方が対応しているか）を判定する
+    /// </summary>
+    bool useAvx2()
+    {
+        const auto& features = getCpuFeatures();
+        return features.avx2 && features.f16c && features.fma;
+    }
+}
+
+/// <summary>
+/// 位置の量子化に使う変換をバウンディングボックスから求める
+/// 各軸を [-1, 1] に収めるので、snorm16 ならメッシュの大きさの 1/65534 の精度になる
+/// </summary>
+PositionQuantization computePositionQuantization(const float* positions, size_t stride, size_t count)
+{
+    glm::vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+    auto p = reinterpret_cast<const uint8_t*>(positions);
+    for (size_t i = 0; i < count; ++i, p += stride)
+    {
+        glm::vec3 v;
+        memcpy(&v, p, sizeof(v));
+        minPos = glm::min(minPos, v);
+        maxPos = glm::max(maxPos, v);
+    }
+
+    if (count == 0)
+    {
+        PositionQuantization q;
+        q.offset = glm::vec4(0.0f);
+        q.scale = glm::vec4(1.0f);
+        return q;
+    }
+    return computePositionQuantization(minPos, maxPos);
+}
+
+/// <summary>
+/// バウンディングボックスが既に分かっている場合（glTF のアクセサの min / max など）
+/// </summary>
+PositionQuantization computePositionQuantization(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    PositionQuantization q;
+    q.offset = glm::vec4((boundsMin + boundsMax) * 0.5f, 0.0f);
+    q.scale = glm::vec4((boundsMax - boundsMin) * 0.5f, 1.0f);
+    return q;
+}
+
+void encodePositionsSnorm16(const float* src, size_t srcStride, size_t count,
+    const PositionQuantization& quantization, void* dst, size_t dstStride)
+{
+    auto s = reinterpret_cast<const uint8_t*>(src);
+    auto d = static_cast<uint8_t*>(dst);
+
+    size_t done = 0;
+#if defined(VERTEXPACKING_X86)
+    done = useAvx2()
+        ? encodePositionsSnorm16Avx2(s, srcStride, count, quantization, d, dstStride)
+        : encodePositionsSnorm16<Sse2Ops>(s, srcStride, count, quantization, d, dstStride);
+#elif defined(VERTEXPACKING_NEON)
+    done = encodePositionsSnorm16<NeonOps>(s, srcStride, count, quantization, d, dstStride);
+#endif
+    encodePositionsSnorm16<ScalarOps>(s + done * srcStride, srcStride, count - done, quantization, d + done * dstStride, dstStride);
+}
+
+void encodePositionsHalf(const float* src, size_t srcStride, size_t count,
+    const PositionQuantization& quantization, void* dst, size_t dstStride)
+{
+    auto s = reinterpret_cast<const uint8_t*>(src);
+    auto d = static_cast<uint8_t*>(dst);
+
+    size_t done = 0;
+#if defined(VERTEXPACKING_X86)
+    done = useAvx2()
+        ? encodePositionsHalfAvx2(s, srcStride, count, quantization, d, dstStride)
+        : encodePositionsHalf<Sse2Ops>(s, srcStride, count, quantization, d, dstStride);
+#elif defined(VERTEXPACKING_NEON)
+    done = encodePositionsHalf<NeonOps>(s, srcStride, count, quantization, d, dstStride);
+#endif
+    encodePositionsHalf<ScalarOps>(s + done * srcStride, srcStride, count - done, quantization, d + done * dstStride, dstStride);
+}
+
+void encodeNormalsOct16(const float* src, size_t srcStride, size_t count, void* dst, size_t dstStride)
+{
+    auto s = reinterpret_cast<const uint8_t*>(src);
+    auto d = static_cast<uint8_t*>(dst);
+
+    size_t done = 0;
+#if defined(VERTEXPACKING_X86)
+    done = useAvx2()
+        ? encodeNormalsOct16Avx2(s, srcStride, count, d, dstStride)
+        : encodeNormalsOct16<Sse2Ops>(s, srcStride, count, d, dstStride);
+#elif defined(VERTEXPACKING_NEON)
+    done = encodeNormalsOct16<NeonOps>(s, srcStride, count, d, dstStride);
+#endif
+    encodeNormalsOct16<ScalarOps>(s + done * srcStride, srcStride, count - done, d + done * dstStride, dstStride);
+}
+
+void encodeColorsUnorm8(const float* src, size_t srcStride, uint32_t srcComponents, size_t count, void* dst, size_t dstStride)
+{
+    auto s = reinterpret_cast<const uint8_t*>(src);
+    auto d = static_cast<uint8_t*>(dst);
+
+    size_t done = 0;
+#if defined(VERTEXPACKING_X86)
+    done = useAvx2()
+        ? encodeColorsUnorm8Avx2(s, srcStride, srcComponents, count, d, dstStride)
+        : encodeColorsUnorm8<Sse2Ops>(s, srcStride, srcComponents, count, d, dstStride);
+#elif defined(VERTEXPACKING_NEON)
+    done = encodeColorsUnorm8<NeonOps>(s, srcStride, srcComponents, count, d, dstStride);
+#endif
+    encodeColorsUnorm8<ScalarOps>(s + done * srcStride, srcStride, srcComponents, count - done, d + done * dstStride, dstStride);
+}
+
+void encodeTexcoordsHalf(const float* src, size_t srcStride, size_t count, void* dst, size_t dstStride)
+{
+    auto s = reinterpret_cast<const uint8_t*>(src);
+    auto d = static_cast<uint8_t*>(dst);
+
+    size_t done = 0;
+#if defined(VERTEXPACKING_X86)
+    done = useAvx2()
+        ? encodeTexcoordsHalfAvx2(s, srcStride, count, d, dstStride)
+        : encodeTexcoordsHalf<Sse2Ops>(s, srcStride, count, d, dstStride);
+#elif defined(VERTEXPACKING_NEON)
+    done = encodeTexcoordsHalf<NeonOps>(s, srcStride, count, d, dstStride);
+#endif
+    encodeTexcoordsHalf<ScalarOps>(s + done * srcStride, srcStride, count - done, d + done * dstStride, dstStride);
+}
+
+uint16_t floatToHalf(float value)
+{
+    return floatToHalfScalar(value);
+}
+
+float halfToFloat(uint16_t value)
+{
+    uint32_t sign = uint32_t(value & 0x8000u) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ffu;
+
+    if (exponent == 0)
+    {
+        // 0 と非正規化数
+        float f = float(mantissa) * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+    }
+
+    uint32_t bits;
+    if (exponent == 31)
+    {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "vertexlayout.h"
+
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// 量子化（圧縮）した頂点フォーマットと、float データからの変換処理
+/// </summary>
+/// <remarks>
+/// 位置はメッシュごとの変換（offset + v * scale）で [-1, 1] に正規化してから snorm16 / half で保持し、
+/// 頂点シェーダで元の座標に戻す。法線は八面体（octahedral）エンコードで 2 成分にし、
+/// 色は unorm8、UV は half で保持する。
+/// 変換は AVX2 / SSE2 / NEON のカーネルで行い、AVX2 は実行時に CPU が対応している場合のみ使う。
+/// </remarks>
+
+struct Snorm16x4
+{
+    int16_t v[4];
+};
+
+struct Snorm16x2
+{
+    int16_t v[2];
+};
+
+struct Half4
+{
+    uint16_t v[4];
+};
+
+struct Half2
+{
+    uint16_t v[2];
+};
+
+struct Unorm8x4
+{
+    uint8_t v[4];
+};
+
+VERTEX_FORMAT_OF(Snorm16x4, VK_FORMAT_R16G16B16A16_SNORM);
+VERTEX_FORMAT_OF(Snorm16x2, VK_FORMAT_R16G16_SNORM);
+VERTEX_FORMAT_OF(Half4, VK_FORMAT_R16G16B16A16_SFLOAT);
+VERTEX_FORMAT_OF(Half2, VK_FORMAT_R16G16_SFLOAT);
+VERTEX_FORMAT_OF(Unorm8x4, VK_FORMAT_R8G8B8A8_UNORM);
+
+/// <summary>
+/// 位置の逆量子化に使う変換（position = offset + packed * scale）
+/// プッシュ定数としてそのまま渡せるよう vec4 で持つ
+/// </summary>
+struct PositionQuantization
+{
+    glm::vec4 offset;
+    glm::vec4 scale;
+};
+
+PositionQuantization computePositionQuantization(const float* positions, size_t stride, size_t count);
+PositionQuantization computePositionQuantization(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+// 入力は float の配列（stride はバイト単位）、出力は頂点バッファ上の該当メンバ（dstStride は頂点構造体のサイズ）
+
+void encodePositionsSnorm16(const float* src, size_t srcStride, size_t count,
+    const PositionQuantization& quantization, void* dst, size_t dstStride);
+
+void encodePositionsHalf(const float* src, size_t srcStride, size_t count,
+    const PositionQuantization& quantization, void* dst, size_t dstStride);
+
+void encodeNormalsOct16(const float* src, size_t srcStride, size_t count, void* dst, size_t dstStride);
+
+void encodeColorsUnorm8(const float* src, size_t srcStride, uint32_t srcComponents, size_t count, void* dst, size_t dstStride);
+
+void encodeTexcoordsHalf(const float* src, size_t srcStride, size_t count, void* dst, size_t dstStride);
+
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
@@ -0,0 +1,40 @@
+// AVX2 / F16C / FMA を使う変換カーネル
+// このファイルだけ AVX2 を有効にしてコンパイルする（vcxproj のファイル単位の設定）。
+// 呼び出しは vertexpacking.cpp で CPU の対応を確認してから行われる。
+#if !defined(_MSC_VER) && (defined(__x86_64__) || defined(__i386__))
+#pragma GCC target("avx2,f16c,fma")
+#endif
+#define VERTEXPACKING_AVX2
+#include "vertexpacking_impl.h"
+
+#ifdef VERTEXPACKING_X86
+
+namespace vertexpacking
+{
+    size_t encodePositionsSnorm16Avx2(const uint8_t* src, size_t srcStride, size_t count, const PositionQuantization& q, uint8_t* dst, size_t dstStride)
+    {
+        return encodePositionsSnorm16<Avx2Ops>(src, srcStride, count, q, dst, dstStride);
+    }
+
+    size_t encodePositionsHalfAvx2(const uint8_t* src, size_t srcStride, size_t count, const PositionQuantization& q, uint8_t* dst, size_t dstStride)
+    {
+        return encodePositionsHalf<Avx2Ops>(src, srcStride, count, q, dst, dstStride);
+    }
+
+    size_t encodeNormalsOct16Avx2(const uint8_t* src, size_t srcStride, size_t count, uint8_t* dst, size_t dstStride)
+    {
+        return encodeNormalsOct16<Avx2Ops>(src, srcStride, count, dst, dstStride);
+    }
+
+    size_t encodeColorsUnorm8Avx2(const uint8_t* src, size_t srcStride, uint32_t srcComponents, size_t count, uint8_t* dst, size_t dstStride)
+    {
+        return encodeColorsUnorm8<Avx2Ops>(src, srcStride, srcComponents, count, dst, dstStride);
+    }
+
+    size_t encodeTexcoordsHalfAvx2(const uint8_t* src, size_t srcStride, size_t count, uint8_t* dst, size_t dstStride)
+    {
+        return encodeTexcoordsHalf<Avx2Ops>(src, srcStride, count, dst, dstStride);
+    }
+}
+
+#endif
@@ -0,0 +1,382 @@
+#pragma once
+// vertexpacking.cpp / vertexpacking_avx2.cpp の内部実装（他から include しないこと）
+//
+// 変換カーネルは SIMD 命令セットごとの Ops 構造体をテンプレート引数に取り、1 回のループで Ops::Width 頂点を処理する。
+// 演算は SIMD で行い、ストライド付きの入出力はレーン単位で読み書きする。
+
+#include "vertexpacking.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VERTEXPACKING_X86
+#include <immintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define VERTEXPACKING_NEON
+#include <arm_neon.h>
+#endif
+
+namespace vertexpacking
+{
+// Ops とカーネルはコンパイルオプションの違う 2 つの翻訳単位から使われるので、
+// リンク時に AVX2 でコンパイルされた実体が共有されないよう内部リンケージにしておく
+namespace
+{
+    inline float loadFloat(const uint8_t* p)
+    {
+        float v;
+        memcpy(&v, p, sizeof(float));
+        return v;
+    }
+
+    inline uint16_t floatToHalfScalar(float value)
+    {
+        // 最近接偶数丸め（F16C の _mm_cvtps_ph と同じ結果になる）
+        uint32_t x;
+        memcpy(&x, &value, sizeof(x));
+        uint32_t sign = x & 0x80000000u;
+        x ^= sign;
+
+        uint32_t o;
+        if (x >= 0x47800000u)
+        {
+            // 65536.0 以上は Inf、NaN は quiet NaN
+            o = (x > 0x7f800000u) ? 0x7e00u : 0x7c00u;
+        }
+        else if (x < 0x38800000u)
+        {
+            // half の非正規化数の範囲は、浮動小数の加算で仮数を丸めて取り出す
+            float f;
+            memcpy(&f, &x, sizeof(f));
+            f += 0.5f;
+            memcpy(&o, &f, sizeof(o));
+            o -= 0x3f000000u;
+        }
+        else
+        {
+            uint32_t mantissaOdd = (x >> 13) & 1;
+            x += 0xc8000fffu;   // 指数のバイアスを 127 -> 15 に付け替え、丸め用の 0xfff を足す
+            x += mantissaOdd;
+            o = x >> 13;
+        }
+        return uint16_t(o | (sign >> 16));
+    }
+
+    // ---- スカラー（端数の処理と、SIMD が使えない環境用） ----
+    struct ScalarOps
+    {
+        typedef float F;
+        typedef bool Mask;
+        static const size_t Width = 1;
+
+        static F set1(float v) { return v; }
+        static F gather(const uint8_t* p, size_t) { return loadFloat(p); }
+        static F add(F a, F b) { return a + b; }
+        static F sub(F a, F b) { return a - b; }
+        static F mul(F a, F b) { return a * b; }
+        static F div(F a, F b) { return a / b; }
+        static F min(F a, F b) { return a < b ? a : b; }
+        static F max(F a, F b) { return a > b ? a : b; }
+        static F abs(F a) { return std::fabs(a); }
+        static F signNotZero(F a) { return std::signbit(a) ? -1.0f : 1.0f; }
+        static Mask lessThan(F a, F b) { return a < b; }
+        static F select(Mask m, F a, F b) { return m ? a : b; }
+        static void storeInt(int32_t* out, F a) { out[0] = int32_t(std::lrint(a)); }
+        static void storeHalf(uint16_t* out, F a) { out[0] = floatToHalfScalar(a); }
+    };
+
+#ifdef VERTEXPACKING_X86
+    // ---- SSE2（x64 では常に使える） ----
+    struct Sse2Ops
+    {
+        typedef __m128 F;
+        typedef __m128 Mask;
+        static const size_t Width = 4;
+
+        static F set1(float v) { return _mm_set1_ps(v); }
+        static F gather(const uint8_t* p, size_t stride)
+        {
+            return _mm_setr_ps(loadFloat(p), loadFloat(p + stride), loadFloat(p + stride * 2), loadFloat(p + stride * 3));
+        }
+        static F add(F a, F b) { return _mm_add_ps(a, b); }
+        static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+        static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+        static F div(F a, F b) { return _mm_div_ps(a, b); }
+        static F min(F a, F b) { return _mm_min_ps(a, b); }
+        static F max(F a, F b) { return _mm_max_ps(a, b); }
+        static F abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+        static F signNotZero(F a) { return _mm_or_ps(_mm_set1_ps(1.0f), _mm_and_ps(_mm_set1_ps(-0.0f), a)); }
+        static Mask lessThan(F a, F b) { return _mm_cmplt_ps(a, b); }
+        static F select(Mask m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+        static void storeInt(int32_t* out, F a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_cvtps_epi32(a)); }
+        static void storeHalf(uint16_t* out, F a)
+        {
+            // floatToHalfScalar と同じ処理を 4 レーン同時に行う
+            auto x = _mm_castps_si128(a);
+            auto sign = _mm_and_si128(x, _mm_set1_epi32(int32_t(0x80000000u)));
+            x = _mm_xor_si128(x, sign);
+
+            auto isInfNan = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x47800000 - 1));
+            auto isNan = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x7f800000));
+            auto isDenorm = _mm_cmplt_epi32(x, _mm_set1_epi32(0x38800000));
+
+            auto infNan = _mm_or_si128(_mm_and_si128(isNan, _mm_set1_epi32(0x7e00)), _mm_andnot_si128(isNan, _mm_set1_epi32(0x7c00)));
+            auto denorm = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(x), _mm_set1_ps(0.5f))), _mm_set1_epi32(0x3f000000));
+            auto mantissaOdd = _mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(1));
+            auto normal = _mm_add_epi32(x, _mm_set1_epi32(int32_t(0xc8000fffu)));
+            normal = _mm_srli_epi32(_mm_add_epi32(normal, mantissaOdd), 13);
+
+            auto o = _mm_or_si128(_mm_and_si128(isDenorm, denorm), _mm_andnot_si128(isDenorm, normal));
+            o = _mm_or_si128(_mm_and_si128(isInfNan, infNan), _mm_andnot_si128(isInfNan, o));
+            o = _mm_or_si128(o, _mm_srli_epi32(sign, 16));
+
+            // SSE2 には符号なしのパックが無いので、符号拡張してから符号付きでパックする
+            o = _mm_srai_epi32(_mm_slli_epi32(o, 16), 16);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packs_epi32(o, o));
+        }
+    };
+
+#ifdef VERTEXPACKING_AVX2
+    // ---- AVX2 + F16C（vertexpacking_avx2.cpp の中でのみ定義される） ----
+    struct Avx2Ops
+    {
+        typedef __m256 F;
+        typedef __m256 Mask;
+        static const size_t Width = 8;
+
+        static F set1(float v) { return _mm256_set1_ps(v); }
+        static F gather(const uint8_t* p, size_t stride)
+        {
+            auto offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(int32_t(stride)));
+            return _mm256_i32gather_ps(reinterpret_cast<const float*>(p), offsets, 1);
+        }
+        static F add(F a, F b) { return _mm256_add_ps(a, b); }
+        static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+        static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+        static F div(F a, F b) { return _mm256_div_ps(a, b); }
+        static F min(F a, F b) { return _mm256_min_ps(a, b); }
+        static F max(F a, F b) { return _mm256_max_ps(a, b); }
+        static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+        static F signNotZero(F a) { return _mm256_or_ps(_mm256_set1_ps(1.0f), _mm256_and_ps(_mm256_set1_ps(-0.0f), a)); }
+        static Mask lessThan(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static F select(Mask m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+        static void storeInt(int32_t* out, F a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtps_epi32(a)); }
+        static void storeHalf(uint16_t* out, F a)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_cvtps_ph(a, _MM_FROUND_TO_NEAREST_INT));
+        }
+    };
+#endif
+#endif
+
+#ifdef VERTEXPACKING_NEON
+    // ---- NEON（ARM64） ----
+    struct NeonOps
+    {
+        typedef float32x4_t F;
+        typedef uint32x4_t Mask;
+        static const size_t Width = 4;
+
+        static F set1(float v) { return vdupq_n_f32(v); }
+        static F gather(const uint8_t* p, size_t stride)
+        {
+            float lanes[4] = { loadFloat(p), loadFloat(p + stride), loadFloat(p + stride * 2), loadFloat(p + stride * 3) };
+            return vld1q_f32(lanes);
+        }
+        static F add(F a, F b) { return vaddq_f32(a, b); }
+        static F sub(F a, F b) { return vsubq_f32(a, b); }
+        static F mul(F a, F b) { return vmulq_f32(a, b); }
+        static F div(F a, F b) { return vdivq_f32(a, b); }
+        static F min(F a, F b) { return vminq_f32(a, b); }
+        static F max(F a, F b) { return vmaxq_f32(a, b); }
+        static F abs(F a) { return vabsq_f32(a); }
+        static F signNotZero(F a)
+        {
+            auto signBit = vandq_u32(vreinterpretq_u32_f32(a), vdupq_n_u32(0x80000000u));
+            return vreinterpretq_f32_u32(vorrq_u32(signBit, vreinterpretq_u32_f32(vdupq_n_f32(1.0f))));
+        }
+        static Mask lessThan(F a, F b) { return vcltq_f32(a, b); }
+        static F select(Mask m, F a, F b) { return vbslq_f32(m, a, b); }
+        static void storeInt(int32_t* out, F a) { vst1q_s32(out, vcvtnq_s32_f32(a)); }
+        static void storeHalf(uint16_t* out, F a) { vst1_u16(out, vreinterpret_u16_f16(vcvt_f16_f32(a))); }
+    };
+#endif
+
+    // ---- 変換カーネル ----
+    // いずれも Width の倍数分だけ処理して、処理した頂点数を返す（端数は呼び出し側が ScalarOps で処理する）
+
+    template<class Ops>
+    inline typename Ops::F clampSigned(typename Ops::F v)
+    {
+        return Ops::min(Ops::max(v, Ops::set1(-1.0f)), Ops::set1(1.0f));
+    }
+
+    template<class Ops>
+    inline typename Ops::F clampUnsigned(typename Ops::F v)
+    {
+        return Ops::min(Ops::max(v, Ops::set1(0.0f)), Ops::set1(1.0f));
+    }
+
+    inline float inverseScale(float s)
+    {
+        return s != 0.0f ? 1.0f / s : 0.0f;
+    }
+
+    template<class Ops>
+    size_t encodePositionsSnorm16(const uint8_t* src, size_t srcStride, size_t count,
+        const PositionQuantization& q, uint8_t* dst, size_t dstStride)
+    {
+        const size_t W = Ops::Width;
+        const auto offsetX = Ops::set1(q.offset.x), offsetY = Ops::set1(q.offset.y), offsetZ = Ops::set1(q.offset.z);
+        const auto invX = Ops::set1(inverseScale(q.scale.x)), invY = Ops::set1(inverseScale(q.scale.y)), invZ = Ops::set1(inverseScale(q.scale.z));
+        const auto snormMax = Ops::set1(32767.0f);
+
+        size_t i = 0;
+        for (; i + W <= count; i += W)
+        {
+            const auto* p = src + i * srcStride;
+            auto x = Ops::mul(clampSigned<Ops>(Ops::mul(Ops::sub(Ops::gather(p + 0, srcStride), offsetX), invX)), snormMax);
+            auto y = Ops::mul(clampSigned<Ops>(Ops::mul(Ops::sub(Ops::gather(p + 4, srcStride), offsetY), invY)), snormMax);
+            auto z = Ops::mul(clampSigned<Ops>(Ops::mul(Ops::sub(Ops::gather(p + 8, srcStride), offsetZ), invZ)), snormMax);
+
+            int32_t xs[W], ys[W], zs[W];
+            Ops::storeInt(xs, x);
+            Ops::storeInt(ys, y);
+            Ops::storeInt(zs, z);
+            for (size_t l = 0; l < W; ++l)
+            {
+                Snorm16x4 v = { { int16_t(xs[l]), int16_t(ys[l]), int16_t(zs[l]), 0 } };
+                memcpy(dst + (i + l) * dstStride, &v, sizeof(v));
+            }
+        }
+        return i;
+    }
+
+    template<class Ops>
+    size_t encodePositionsHalf(const uint8_t* src, size_t srcStride, size_t count,
+        const PositionQuantization& q, uint8_t* dst, size_t dstStride)
+    {
+        const size_t W = Ops::Width;
+        const auto offsetX = Ops::set1(q.offset.x), offsetY = Ops::set1(q.offset.y), offsetZ = Ops::set1(q.offset.z);
+        const auto invX = Ops::set1(inverseScale(q.scale.x)), invY = Ops::set1(inverseScale(q.scale.y)), invZ = Ops::set1(inverseScale(q.scale.z));
+
+        size_t i = 0;
+        for (; i + W <= count; i += W)
+        {
+            const auto* p = src + i * srcStride;
+            auto x = Ops::mul(Ops::sub(Ops::gather(p + 0, srcStride), offsetX), invX);
+            auto y = Ops::mul(Ops::sub(Ops::gather(p + 4, srcStride), offsetY), invY);
+            auto z = Ops::mul(Ops::sub(Ops::gather(p + 8, srcStride), offsetZ), invZ);
+
+            uint16_t xs[W], ys[W], zs[W];
+            Ops::storeHalf(xs, x);
+            Ops::storeHalf(ys, y);
+            Ops::storeHalf(zs, z);
+            for (size_t l = 0; l < W; ++l)
+            {
+                Half4 v = { { xs[l], ys[l], zs[l], 0 } };
+                memcpy(dst + (i + l) * dstStride, &v, sizeof(v));
+            }
+        }
+        return i;
+    }
+
+    template<class Ops>
+    size_t encodeNormalsOct16(const uint8_t* src, size_t srcStride, size_t count, uint8_t* dst, size_t dstStride)
+    {
+        const size_t W = Ops::Width;
+        const auto one = Ops::set1(1.0f);
+        const auto zero = Ops::set1(0.0f);
+        const auto epsilon = Ops::set1(1e-20f);
+        const auto snormMax = Ops::set1(32767.0f);
+
+        size_t i = 0;
+        for (; i + W <= count; i += W)
+        {
+            const auto* p = src + i * srcStride;
+            auto x = Ops::gather(p + 0, srcStride);
+            auto y = Ops::gather(p + 4, srcStride);
+            auto z = Ops::gather(p + 8, srcStride);
+
+            // 八面体へ射影（L1 ノルムで正規化）
+            auto l1 = Ops::max(Ops::add(Ops::add(Ops::abs(x), Ops::abs(y)), Ops::abs(z)), epsilon);
+            x = Ops::div(x, l1);
+            y = Ops::div(y, l1);
+
+            // 下半球は対角線で折り返す
+            auto lower = Ops::lessThan(z, zero);
+            auto foldedX = Ops::mul(Ops::sub(one, Ops::abs(y)), Ops::signNotZero(x));
+            auto foldedY = Ops::mul(Ops::sub(one, Ops::abs(x)), Ops::signNotZero(y));
+            x = Ops::select(lower, foldedX, x);
+            y = Ops::select(lower, foldedY, y);
+
+            int32_t xs[W], ys[W];
+            Ops::storeInt(xs, Ops::mul(clampSigned<Ops>(x), snormMax));
+            Ops::storeInt(ys, Ops::mul(clampSigned<Ops>(y), snormMax));
+            for (size_t l = 0; l < W; ++l)
+            {
+                Snorm16x2 v = { { int16_t(xs[l]), int16_t(ys[l]) } };
+                memcpy(dst + (i + l) * dstStride, &v, sizeof(v));
+            }
+        }
+        return i;
+    }
+
+    template<class Ops>
+    size_t encodeColorsUnorm8(const uint8_t* src, size_t srcStride, uint32_t srcComponents, size_t count, uint8_t* dst, size_t dstStride)
+    {
+        const size_t W = Ops::Width;
+        const auto unormMax = Ops::set1(255.0f);
+
+        size_t i = 0;
+        for (; i + W <= count; i += W)
+        {
+            const auto* p = src + i * srcStride;
+            int32_t cs[4][W];
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                // アルファが無い場合は 1.0 とする
+                auto v = c < srcComponents ? Ops::gather(p + c * 4, srcStride) : Ops::set1(1.0f);
+                Ops::storeInt(cs[c], Ops::mul(clampUnsigned<Ops>(v), unormMax));
+            }
+            for (size_t l = 0; l < W; ++l)
+            {
+                Unorm8x4 v = { { uint8_t(cs[0][l]), uint8_t(cs[1][l]), uint8_t(cs[2][l]), uint8_t(cs[3][l]) } };
+                memcpy(dst + (i + l) * dstStride, &v, sizeof(v));
+            }
+        }
+        return i;
+    }
+
+    template<class Ops>
+    size_t encodeTexcoordsHalf(const uint8_t* src, size_t srcStride, size_t count, uint8_t* dst, size_t dstStride)
+    {
+        const size_t W = Ops::Width;
+
+        size_t i = 0;
+        for (; i + W <= count; i += W)
+        {
+            const auto* p = src + i * srcStride;
+            uint16_t us[W], vs[W];
+            Ops::storeHalf(us, Ops::gather(p + 0, srcStride));
+            Ops::storeHalf(vs, Ops::gather(p + 4, srcStride));
+            for (size_t l = 0; l < W; ++l)
+            {
+                Half2 v = { { us[l], vs[l] } };
+                memcpy(dst + (i + l) * dstStride, &v, sizeof(v));
+            }
+        }
+        return i;
+    }
+
+}
+
+    // AVX2 版のエントリポイント（vertexpacking_avx2.cpp）
+    size_t encodePositionsSnorm16Avx2(const uint8_t* src, size_t srcStride, size_t count, const PositionQuantization& q, uint8_t* dst, size_t dstStride);
+    size_t encodePositionsHalfAvx2(const uint8_t* src, size_t srcStride, size_t count, const PositionQuantization& q, uint8_t* dst, size_t dstStride);
+    size_t encodeNormalsOct16Avx2(const uint8_t* src, size_t srcStride, size_t count, uint8_t* dst, size_t dstStride);
+    size_t encodeColorsUnorm8Avx2(const uint8_t* src, size_t srcStride, uint32_t srcComponents, size_t count, uint8_t* dst, size_t dstStride);
+    size_t encodeTexcoordsHalfAvx2(const uint8_t* src, size_t srcStride, size_t count, uint8_t* dst, size_t dstStride);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "vkappbase.h"
+#include "vertexpacking.h"
+
+#include <cstdint>
+
+/// <summary>
+/// 頂点シェーダが頂点バッファをデバイスアドレスで直接読む（バーテックスプリング）ためのプッシュ定数
+/// </summary>
+/// <remarks>
+/// 固定機能の頂点入力を使わないので、パイプラインはメッシュの頂点レイアウトに依存しない。
+/// 頂点の読み方（フォーマットとストライド）はプッシュ定数で渡し、シェーダ（shader.vert の USE_VERTEX_PULLING）が自分で展開する。
+/// インデックスはインデックスバッファから読ませたままにする（頂点キャッシュが効き、インデックスの型はパイプラインに含まれない）。
+/// シェーダは gl_VertexIndex（vertexOffset が足された値）で頂点を選ぶので、vertices にはバッファの先頭のアドレスを渡す。
+/// </remarks>
+
+/// <summary>
+/// 頂点のフォーマット（shader.vert の VertexPull* と合わせる）
+/// </summary>
+enum class VertexPullFormat : uint32_t
+{
+    // MeshVertex（snorm16 の位置と unorm8 の色）
+    PackedMeshVertex = 0,
+
+    // float の位置（xyz）と色（rgb）
+    FloatPositionColor = 1,
+};
+
+/// <summary>
+/// シェーダの push_constant ブロック VertexPull と同じ並び（48 バイト）
+/// </summary>
+struct VertexPullConstants
+{
+    PositionQuantization quantization;
+    VkDeviceAddress vertices;
+    uint32_t vertexStride;
+    uint32_t format;
+};
+
+static_assert(sizeof(VertexPullConstants) == 48, "VertexPullConstants must match the push constant block in shader.vert");
+
+inline VertexPullConstants makeVertexPullConstants(const PositionQuantization& quantization, VkDeviceAddress vertices,
+    uint32_t vertexStride, VertexPullFormat format)
+{
+    VertexPullConstants constants;
+    constants.quantization = quantization;
+    constants.vertices = vertices;
+    constants.vertexStride = vertexStride;
+    constants.format = uint32_t(format);
+    return constants;
+}
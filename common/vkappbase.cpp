@@ -2,12 +2,16 @@
 #include <sstream>
 #include <algorithm>
 #include <array>
+#include <cstring>
 
 #define GetInstanceProcAddr(FuncName) \
     m_##FuncName = reinterpret_cast<PFN_##FuncName>(vkGetInstanceProcAddr(m_instance, #FuncName))
 
 using namespace std;
 
+// 描画スレッドを待つ間にウィンドウのイベントを処理する間隔
+static const chrono::milliseconds FramePacketPollInterval(2);
+
 static VkBool32 VKAPI_CALL DebugReportCallback(
     VkDebugReportFlagsEXT flags,
     VkDebugReportObjectTypeEXT objectTypes,
@@ -50,7 +54,14 @@ void VulkanAppBase::checkResult(VkResult result)
 
 VulkanAppBase::VulkanAppBase()
     : m_presentMode(VK_PRESENT_MODE_FIFO_KHR)
+    , m_deviceFeatures{}
+    , m_vkCmdDrawIndexedIndirectCount(nullptr)
+    , m_vkCmdDrawMultiIndexed(nullptr)
+    , m_maxMultiDrawCount(0)
+    , m_vkGetBufferDeviceAddress(nullptr)
     , m_imageIndex(0)
+    , m_framePacketCount(0)
+    , m_framePacket(0)
 {
 }
 
@@ -107,10 +118,25 @@ void VulkanAppBase::initialize(GLFWwindow* window, const char* appName)
     prepareSemaphores();
 
     prepare();
+    m_scheduler.initialize(window);
+    m_lastFrameTime = chrono::steady_clock::now();
+
+    // キューへの送信と present は以降は描画スレッドだけが行う（prepare での転送は済んでいる）
+    if (m_framePacketCount > 0)
+    {
+        m_framePacketQueue.initialize(m_framePacketCount);
+        m_renderThread = thread(&VulkanAppBase::renderThreadMain, this);
+    }
 }
 
 void VulkanAppBase::terminate()
 {
+    if (m_renderThread.joinable())
+    {
+        m_framePacketQueue.close();
+        m_renderThread.join();
+    }
+    m_scheduler.terminate();
     vkDeviceWaitIdle(m_device);
 
     cleanup();
@@ -119,6 +145,7 @@ void VulkanAppBase::terminate()
     m_commands.clear();
 
     vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+    vkDestroyRenderPass(m_device, m_renderPassLoad, nullptr);
     for (auto& v : m_framebuffers)
     {
         vkDestroyFramebuffer(m_device, v, nullptr);
@@ -243,20 +270,107 @@ void VulkanAppBase::createDevice()
     }
 
     vector<const char*> extensions;
+    bool hasDrawIndirectCount = false;
+    bool hasMultiDraw = false;
+    bool hasBufferDeviceAddress = false;
     for (const auto& v : devExtProps)
     {
         extensions.push_back(v.extensionName);
+        hasDrawIndirectCount |= strcmp(v.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0;
+        hasMultiDraw |= strcmp(v.extensionName, VK_EXT_MULTI_DRAW_EXTENSION_NAME) == 0;
+        hasBufferDeviceAddress |= strcmp(v.extensionName, VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME) == 0;
     }
+
+    // GPU 駆動の描画（間接描画のコマンドを複数まとめて発行し、firstInstance でオブジェクトを選ぶ）に使う機能は、対応していれば有効にする
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(m_physDev, &supportedFeatures);
+    m_deviceFeatures = VkPhysicalDeviceFeatures{};
+    m_deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    m_deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
+    // 拡張の機能は有効にする必要もある。対応している拡張の分だけ問い合わせ、使えるものを pNext に繋ぐ
+    //   VK_EXT_multi_draw: 同じ状態の描画を 1 回の vkCmdDrawMultiIndexedEXT にまとめる
+    //   VK_KHR_buffer_device_address: 頂点シェーダが頂点バッファをアドレスで直接読む（バーテックスプリング）
+    VkPhysicalDeviceMultiDrawFeaturesEXT multiDrawFeatures{};
+    multiDrawFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTI_DRAW_FEATURES_EXT;
+    VkPhysicalDeviceBufferDeviceAddressFeaturesKHR bufferDeviceAddressFeatures{};
+    bufferDeviceAddressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR;
+    {
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        if (hasMultiDraw)
+        {
+            multiDrawFeatures.pNext = features2.pNext;
+            features2.pNext = &multiDrawFeatures;
+        }
+        if (hasBufferDeviceAddress)
+        {
+            bufferDeviceAddressFeatures.pNext = features2.pNext;
+            features2.pNext = &bufferDeviceAddressFeatures;
+        }
+        if (features2.pNext != nullptr)
+        {
+            vkGetPhysicalDeviceFeatures2(m_physDev, &features2);
+        }
+    }
+    hasMultiDraw = hasMultiDraw && multiDrawFeatures.multiDraw == VK_TRUE;
+    hasBufferDeviceAddress = hasBufferDeviceAddress && bufferDeviceAddressFeatures.bufferDeviceAddress == VK_TRUE;
+
+    void* enabledFeatures = nullptr;
+    if (hasMultiDraw)
+    {
+        multiDrawFeatures.pNext = enabledFeatures;
+        enabledFeatures = &multiDrawFeatures;
+    }
+    if (hasBufferDeviceAddress)
+    {
+        // キャプチャ / リプレイとマルチデバイスは使わない
+        bufferDeviceAddressFeatures.pNext = enabledFeatures;
+        bufferDeviceAddressFeatures.bufferDeviceAddressCaptureReplay = VK_FALSE;
+        bufferDeviceAddressFeatures.bufferDeviceAddressMultiDevice = VK_FALSE;
+        enabledFeatures = &bufferDeviceAddressFeatures;
+
+        // 古い VK_EXT_buffer_device_address とは同時に有効にできない
+        extensions.erase(remove_if(extensions.begin(), extensions.end(),
+            [](const char* name) { return strcmp(name, VK_EXT_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME) == 0; }), extensions.end());
+    }
+
     VkDeviceCreateInfo ci{};
     ci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    ci.pNext = enabledFeatures;
     ci.pQueueCreateInfos = &devQueueCI;
     ci.queueCreateInfoCount = 1;
     ci.ppEnabledExtensionNames = extensions.data();
     ci.enabledExtensionCount = uint32_t(extensions.size());
+    ci.pEnabledFeatures = &m_deviceFeatures;
 
     auto result = vkCreateDevice(m_physDev, &ci, nullptr, &m_device);
     checkResult(result);
 
+    if (hasDrawIndirectCount)
+    {
+        m_vkCmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+            vkGetDeviceProcAddr(m_device, "vkCmdDrawIndexedIndirectCountKHR"));
+    }
+    if (hasMultiDraw)
+    {
+        VkPhysicalDeviceMultiDrawPropertiesEXT multiDrawProps{};
+        multiDrawProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTI_DRAW_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 props2{};
+        props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        props2.pNext = &multiDrawProps;
+        vkGetPhysicalDeviceProperties2(m_physDev, &props2);
+
+        m_vkCmdDrawMultiIndexed = reinterpret_cast<PFN_vkCmdDrawMultiIndexedEXT>(
+            vkGetDeviceProcAddr(m_device, "vkCmdDrawMultiIndexedEXT"));
+        m_maxMultiDrawCount = multiDrawProps.maxMultiDrawCount;
+    }
+    if (hasBufferDeviceAddress)
+    {
+        m_vkGetBufferDeviceAddress = reinterpret_cast<PFN_vkGetBufferDeviceAddressKHR>(
+            vkGetDeviceProcAddr(m_device, "vkGetBufferDeviceAddressKHR"));
+    }
+
     // デバイスキューの取得
     vkGetDeviceQueue(m_device, m_graphicsQueueIndex, 0, &m_deviceQueue);
 }
@@ -357,7 +471,8 @@ void VulkanAppBase::createDepthBuffer()
     ci.extent.depth = 1;
 
     // NOTE: DepthBuffer は Stencil 的なアタッチメントということ？
-    ci.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    // 描画したデプスをコンピュートシェーダで読む（Hi-Z の生成など）ので、サンプリングもできるようにしておく
+    ci.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
     ci.samples = VK_SAMPLE_COUNT_1_BIT;
     ci.arrayLayers = 1;
 
@@ -490,13 +605,34 @@ void VulkanAppBase::createRenderPass()
     subpassDesc.pColorAttachments = &colorReference;
     subpassDesc.pDepthStencilAttachment = &depthReference;
 
+    // 前のフレームやレンダーパスの外（コンピュートシェーダ）での読み書きが終わってから、アタッチメントに書き込む
+    VkSubpassDependency dependency{};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
     ci.attachmentCount = uint32_t(attachments.size());
     ci.pAttachments = attachments.data();
     ci.subpassCount = 1;
     ci.pSubpasses = &subpassDesc;
+    ci.dependencyCount = 1;
+    ci.pDependencies = &dependency;
 
     auto result = vkCreateRenderPass(m_device, &ci, nullptr, &m_renderPass);
     checkResult(result);
+
+    // 続けて描画する方は、m_renderPass の終了時のレイアウトから内容を読み込んで始める
+    colorTarget.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    colorTarget.initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    depthTarget.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthTarget.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    result = vkCreateRenderPass(m_device, &ci, nullptr, &m_renderPassLoad);
+    checkResult(result);
 }
 
 /// <summary>
@@ -569,14 +705,14 @@ void VulkanAppBase::prepareSemaphores()
     vkCreateSemaphore(m_device, &ci, nullptr, &m_presentCompletedSem);
 }
 
-uint32_t VulkanAppBase::getMemoryTypeIndex(uint32_t requestBits, VkMemoryPropertyFlags requestProps) const
+uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties& memProps, uint32_t requestBits, VkMemoryPropertyFlags requestProps)
 {
     uint32_t result = ~0u;
-    for (uint32_t i = 0; i < m_physMemProps.memoryTypeCount; ++i)
+    for (uint32_t i = 0; i < memProps.memoryTypeCount; ++i)
     {
         if (requestBits & 1)
         {
-            const auto& types = m_physMemProps.memoryTypes[i];
+            const auto& types = memProps.memoryTypes[i];
             if ((types.propertyFlags & requestProps) == requestProps)
             {
                 result = i;
@@ -589,6 +725,11 @@ uint32_t VulkanAppBase::getMemoryTypeIndex(uint32_t requestBits, VkMemoryPropert
     return result;
 }
 
+uint32_t VulkanAppBase::getMemoryTypeIndex(uint32_t requestBits, VkMemoryPropertyFlags requestProps) const
+{
+    return findMemoryType(m_physMemProps, requestBits, requestProps);
+}
+
 /// <summary>
 /// デバッグレポートを有効化
 /// </summary>
@@ -626,6 +767,74 @@ void VulkanAppBase::disableDebugReport()
     }
 }
 
+/// <summary>
+/// 描画スレッドを使う場合、メインスレッドの処理（入力・シミュレーション・フレームパケットの作成）は
+/// フェンスや present の待ちでは止まらず、前のフレームの描画と並行して進む。
+/// ただし読まれていないパケットは 1 つまでとし、描画より先に進みすぎて書いたパケットを捨て続けないよう、
+/// 空きと前のパケットが読まれるのを待つ。待つ間もウィンドウのイベントは処理する
+/// </summary>
+void VulkanAppBase::frame()
+{
+    const auto now = chrono::steady_clock::now();
+    const uint32_t steps = m_timestep.advance(chrono::duration<double>(now - m_lastFrameTime).count());
+    m_lastFrameTime = now;
+    for (uint32_t i = 0; i < steps; ++i)
+    {
+        update(m_timestep.getStep());
+    }
+
+    if (!m_renderThread.joinable())
+    {
+        writeFramePacket(0);
+        m_framePacket = 0;
+        render();
+        return;
+    }
+
+    while (!m_framePacketQueue.waitForWritable(FramePacketPollInterval))
+    {
+        glfwPollEvents();
+    }
+    const uint32_t packet = m_framePacketQueue.beginWrite();
+    if (packet == FramePacketQueue::InvalidFramePacket)
+    {
+        return;
+    }
+    writeFramePacket(packet);
+    while (!m_framePacketQueue.waitForConsumed(FramePacketPollInterval))
+    {
+        glfwPollEvents();
+    }
+    m_framePacketQueue.endWrite(packet);
+}
+
+/// <summary>
+/// 最も新しいフレームパケットを受け取って render することを、terminate でキューが閉じられるまで繰り返す
+/// </summary>
+void VulkanAppBase::renderThreadMain()
+{
+    for (;;)
+    {
+        const uint32_t packet = m_framePacketQueue.beginRead();
+        if (packet == FramePacketQueue::InvalidFramePacket)
+        {
+            break;
+        }
+        m_framePacket = packet;
+        render();
+        m_framePacketQueue.endRead(packet);
+    }
+}
+
+void VulkanAppBase::waitForRenderIdle()
+{
+    if (m_renderThread.joinable())
+    {
+        m_framePacketQueue.waitForIdle();
+    }
+    vkDeviceWaitIdle(m_device);
+}
+
 void VulkanAppBase::render()
 {
     uint32_t nextImageIndex = 0;
@@ -655,13 +864,16 @@ void VulkanAppBase::render()
     commandBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     auto& command = m_commands[nextImageIndex];
     vkBeginCommandBuffer(command, &commandBI);
-    vkCmdBeginRenderPass(command, &renderPassBI, VK_SUBPASS_CONTENTS_INLINE);
 
     m_imageIndex = nextImageIndex;
+    makePreRenderPassCommand(command);
+
+    vkCmdBeginRenderPass(command, &renderPassBI, VK_SUBPASS_CONTENTS_INLINE);
     makeCommand(command);
 
     // コマンド・レンダーパス修了
     vkCmdEndRenderPass(command);
+    makePostRenderPassCommand(command);
     vkEndCommandBuffer(command);
 
     // コマンドを実行（送信）
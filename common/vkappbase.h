@@ -1,5 +1,6 @@
 #pragma once
 #define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
 #include <windows.h>
 
 #define VK_USE_PLATFORM_WIN32_KHR
@@ -11,7 +12,16 @@
 #include <vulkan/vk_layer.h>
 #include <vulkan/vulkan_win32.h>
 
+#include "framepacket.h"
+#include "fixedtimestep.h"
+#include "framescheduler.h"
+
 #include <vector>
+#include <thread>
+#include <chrono>
+
+// memProps の中から requestBits に含まれ requestProps をすべて持つメモリタイプを探す（無ければ ~0u）
+uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties& memProps, uint32_t requestBits, VkMemoryPropertyFlags requestProps);
 
 class VulkanAppBase
 {
@@ -23,10 +33,37 @@ public:
 
     virtual void render();
 
+    // メインスレッドから毎フレーム呼ぶ。経過時間の分だけ update でシミュレーションを進めてからフレームパケットを書き、
+    // 描画スレッドを使う場合は、前のパケットが描画スレッドに読まれてからそれを渡して戻る。使わない場合は続けて render する
+    void frame();
+
+    // メインループは getScheduler().waitForFrame() が true を返した時だけ frame を呼ぶ
+    FrameScheduler& getScheduler() { return m_scheduler; }
+
+    // シミュレーションの刻み幅（秒）と 1 フレームで進める最大のステップ数（既定は 60 Hz、5 ステップ）
+    void setFixedTimestep(double step, uint32_t maxSteps) { m_timestep.initialize(step, maxSteps); }
+
+    // 描画スレッドで render する（packetCount が 2 ならダブルバッファ、3 ならトリプルバッファ）。initialize の前に呼ぶ
+    void setRenderThread(uint32_t packetCount) { m_framePacketCount = packetCount; }
+
+    // メインスレッドでフレームパケット packet を書く（描画スレッドを使う場合は、前のパケットの render と並行して呼ばれる）
+    // render の中では m_framePacket が描くパケットの番号になる
+    // 描画する状態は、直前の 2 回の update の状態を m_timestep.getAlpha() で補間して求める
+    virtual void writeFramePacket(uint32_t packet) {}
+
+    // メインスレッドでシミュレーションを固定の刻み幅 step（秒）だけ進める（frame ごとに 0 回以上呼ばれる）
+    virtual void update(double step) {}
+
     virtual void prepare() {}
     virtual void cleanup() {}
     virtual void makeCommand(VkCommandBuffer command) {}
 
+    // レンダーパスの開始前に記録するコマンド（コンピュートシェーダによるカリングなど）
+    virtual void makePreRenderPassCommand(VkCommandBuffer command) {}
+
+    // レンダーパスの終了後に記録するコマンド（デプスバッファを読むコンピュートシェーダや、m_renderPassLoad で続けて描画する場合など）
+    virtual void makePostRenderPassCommand(VkCommandBuffer command) {}
+
 protected:
     static void checkResult(VkResult);
 
@@ -51,6 +88,12 @@ protected:
     void enableDebugReport();
     void disableDebugReport();
 
+    void renderThreadMain();
+
+    // 描画スレッドが受け取ったパケットを描き終わり、GPU の処理もすべて終わるまで待つ（メインスレッドから呼ぶ）
+    // 描画に使っているバッファを作り直す前に呼ぶ。戻ってから次のパケットを渡すまで描画スレッドは何もしない
+    void waitForRenderIdle();
+
     VkInstance m_instance;
     VkDevice m_device;
     VkPhysicalDevice m_physDev;
@@ -64,6 +107,19 @@ protected:
     uint32_t m_graphicsQueueIndex;
     VkQueue m_deviceQueue;
 
+    // 論理デバイスで有効にした機能
+    VkPhysicalDeviceFeatures m_deviceFeatures;
+
+    // VK_KHR_draw_indirect_count が使えない場合は nullptr
+    PFN_vkCmdDrawIndexedIndirectCountKHR m_vkCmdDrawIndexedIndirectCount;
+
+    // VK_EXT_multi_draw が使えない場合は nullptr と 0
+    PFN_vkCmdDrawMultiIndexedEXT m_vkCmdDrawMultiIndexed;
+    uint32_t m_maxMultiDrawCount;
+
+    // VK_KHR_buffer_device_address が使えない場合は nullptr
+    PFN_vkGetBufferDeviceAddressKHR m_vkGetBufferDeviceAddress;
+
 
     VkCommandPool m_commandPool;
     VkPresentModeKHR m_presentMode;
@@ -77,6 +133,9 @@ protected:
     VkImageView m_depthBufferView;
 
     VkRenderPass m_renderPass;
+
+    // クリアせずに m_renderPass の結果へ続けて描画するレンダーパス（m_framebuffers をそのまま使える）
+    VkRenderPass m_renderPassLoad;
     std::vector<VkFramebuffer> m_framebuffers;
 
     std::vector<VkFence> m_fences;
@@ -91,4 +150,15 @@ protected:
     std::vector<VkCommandBuffer> m_commands;
 
     uint32_t m_imageIndex;
+
+    // 描画スレッド（m_framePacketCount が 0 なら使わず、メインスレッドで render する）
+    uint32_t m_framePacketCount;
+    FramePacketQueue m_framePacketQueue;
+    std::thread m_renderThread;
+    uint32_t m_framePacket;
+
+    // 描画し直す必要があれば m_scheduler.requestFrame() を呼ぶ（OnDemand の場合）
+    FrameScheduler m_scheduler;
+    FixedTimestep m_timestep;
+    std::chrono::steady_clock::time_point m_lastFrameTime;
 };